@@ -0,0 +1,106 @@
+#pragma once
+
+#include "airmap/panorama.h"
+#include "airmap/stitcher_configuration.h"
+
+#include <cstddef>
+
+namespace airmap {
+namespace stitcher {
+
+/**
+ * @brief AdmissionController
+ * Decides which stitches can run at once on a host, so that the sum of
+ * their predicted peak memory stays within a global RAM budget, and gives
+ * each admitted stitch an explicit memory budget.
+ *
+ * Stitches running in the same process share OpenCV's thread pool, whose
+ * size is process-wide, so there is no thread count to give each.
+ */
+class AdmissionController
+{
+public:
+    /**
+     * @brief Admission
+     * The budgets given to an admitted stitch, to be released when it
+     * ends.
+     */
+    struct Admission
+    {
+        //! Predicted peak memory of the stitch.
+        size_t peakMB = 0;
+        //! Panorama::Parameters::memoryBudgetMB for the stitch.
+        size_t memoryBudgetMB = 0;
+    };
+
+    /**
+     * @brief AdmissionController
+     * @param memoryBudgetMB RAM budget of all the stitches at once.
+     * @param maxJobs Maximum number of stitches at once.
+     */
+    AdmissionController(size_t memoryBudgetMB, size_t maxJobs);
+
+    /**
+     * @brief predictPeakMB
+     * Predict the peak memory of stitching a panorama, with the model the
+     * stitcher plans its scales by (see MemoryPlanner): the peak of the
+     * stages after the decoded images are scaled down to
+     * Parameters::maxInputImageSize, composed at the configured scale.
+     * Given this budget, the stitcher scales its input no further.
+     * @param imageCount
+     * @param imagePixels Pixels of each image, 0 if unknown, which assumes
+     * Parameters::maxInputImageSize.
+     * @param parameters
+     * @param config
+     * @param focalPixels Focal length of the camera in pixels of the
+     * images, 0 if unknown.
+     */
+    static size_t predictPeakMB(size_t imageCount, size_t imagePixels,
+                                const Panorama::Parameters &parameters,
+                                const Configuration &config = Configuration(StitchType::ThreeSixty),
+                                double focalPixels = 0.);
+
+    /**
+     * @brief predictPeakMB
+     * Predict the peak memory of stitching a panorama, from the size of its
+     * images reported in EXIF, and the focal length of its camera if it
+     * is a known model.
+     * @param panorama
+     * @param parameters
+     * @param config
+     */
+    static size_t predictPeakMB(const Panorama &panorama,
+                                const Panorama::Parameters &parameters,
+                                const Configuration &config = Configuration(StitchType::ThreeSixty));
+
+    /**
+     * @brief admit
+     * Admit a stitch if its predicted peak fits in the memory left, and a
+     * job is left.  A stitch is always admitted when nothing else runs,
+     * with at most the whole memory budget, in which case the stitcher
+     * scales its input down to fit.
+     * @param peakMB Predicted peak memory of the stitch.
+     * @param admission Receives the budgets of the stitch, if admitted.
+     * @return Whether the stitch was admitted.
+     */
+    bool admit(size_t peakMB, Admission &admission);
+
+    /**
+     * @brief release
+     * Release the budgets of a stitch that ended.
+     * @param admission
+     */
+    void release(const Admission &admission);
+
+    size_t availableMemoryMB() const { return _memoryBudgetMB - _usedMemoryMB; }
+    size_t running() const { return _running; }
+
+private:
+    const size_t _memoryBudgetMB;
+    const size_t _maxJobs;
+    size_t _usedMemoryMB;
+    size_t _running;
+};
+
+} // namespace stitcher
+} // namespace airmap
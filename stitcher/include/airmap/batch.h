@@ -0,0 +1,132 @@
+#pragma once
+
+#include "airmap/admission.h"
+#include "airmap/logging.h"
+#include "airmap/monitor/timer.h"
+#include "airmap/panorama.h"
+#include "airmap/stitcher.h"
+#include "airmap/stitcher_configuration.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace airmap {
+namespace stitcher {
+
+/**
+ * @brief BatchStitcher
+ * Finds the panoramas among the images of a directory, e.g. of a whole
+ * flight, and stitches several of them at once, sharing a RAM budget and
+ * OpenCV's thread pool between them.
+ */
+class BatchStitcher
+{
+public:
+    /**
+     * @brief Job
+     * A panorama to stitch and where to write it.
+     */
+    struct Job
+    {
+        Panorama panorama;
+        std::string outputPath;
+    };
+
+    /**
+     * @brief Summary
+     * The outcome of a job.
+     */
+    struct Summary
+    {
+        std::string outputPath;
+        size_t imageCount = 0;
+        bool successful = false;
+        //! Why the stitch failed, if it did.
+        std::string error;
+        //! Time from the start of the job to its end.
+        monitor::ElapsedTime elapsed;
+        //! The budgets the stitch was admitted with.
+        AdmissionController::Admission admission;
+        Stitcher::Report report;
+    };
+
+    /**
+     * @brief BatchStitcher
+     * @param config Configuration of each stitch.
+     * @param parameters Parameters of each stitch.  The memory budget is
+     * the budget of all the panoramas stitched at once.
+     * @param concurrentJobs The maximum number of panoramas to stitch at
+     * once.
+     * @param threads The size of OpenCV's thread pool, shared by all the
+     * panoramas stitched at once, and the most of them stitched at once.
+     * @param logger
+     */
+    BatchStitcher(const Configuration &config,
+                  const Panorama::Parameters &parameters, size_t concurrentJobs,
+                  size_t threads, std::shared_ptr<logging::Logger> logger);
+
+    /**
+     * @brief cancel
+     * Don't start any more jobs.  Jobs already started are finished.
+     */
+    void cancel();
+
+    /**
+     * @brief group
+     * Group images into panoramas the way Panorama::add accepts them,
+     * taken in time order.
+     * @param images
+     * @param minImageCount Groups of fewer images are left out.
+     */
+    static std::vector<Panorama>
+    group(std::vector<GeoImage> images,
+          size_t minImageCount = Panorama::MinImageCount);
+
+    /**
+     * @brief jobs
+     * A job for each panorama, written as <first image>.panorama.jpg.
+     * @param panoramas
+     * @param outputDirectory Where to write the panoramas, next to their
+     * images if empty.
+     */
+    static std::vector<Job> jobs(const std::vector<Panorama> &panoramas,
+                                 const std::string &outputDirectory = "");
+
+    /**
+     * @brief scan
+     * Read the EXIF of the JPEG images in a directory, skipping stitched
+     * panoramas, their cubemaps and images without EXIF.
+     * @param directory
+     */
+    std::vector<GeoImage> scan(const std::string &directory) const;
+
+    /**
+     * @brief stitch
+     * Stitch the jobs, the largest first, as many at a time as an
+     * AdmissionController admits within the RAM budget.
+     * @param jobs
+     * @return A summary of each job, in the order of jobs.
+     */
+    std::vector<Summary> stitch(const std::vector<Job> &jobs);
+
+private:
+    const Configuration _config;
+    const Panorama::Parameters _parameters;
+    const size_t _concurrentJobs;
+    const size_t _threads;
+    std::shared_ptr<logging::Logger> _logger;
+    std::atomic<bool> _cancelled;
+
+    /**
+     * @brief stitch
+     * Stitch a single job.
+     * @param job
+     * @param parameters Parameters with the job's share of the budgets.
+     */
+    Summary stitch(const Job &job, const Panorama::Parameters &parameters);
+};
+
+} // namespace stitcher
+} // namespace airmap
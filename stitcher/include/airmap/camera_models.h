@@ -23,7 +23,7 @@ struct CameraModels
      * Detect the camera model and return a Camera instance.
      * @param image
      */
-    std::shared_ptr<Camera> detect(const GeoImage &image)
+    std::shared_ptr<Camera> detect(const GeoImage &image) const
     {
         for (const auto &model : models) {
             if (image.cameraModel == model.first) {
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "airmap/logging.h"
+#include "airmap/monitor/timer.h"
+#include "airmap/panorama.h"
+#include "airmap/stitcher.h"
+#include "airmap/stitcher_configuration.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace airmap {
+namespace stitcher {
+
+/**
+ * @brief StitchDaemon
+ * Stitches panoramas requested over a local Unix socket, one at a time, in
+ * a process that stays up between them, so that each stitch doesn't pay for
+ * starting a process, initializing OpenCV, its thread pool and OpenCL, and
+ * building the camera models.
+ *
+ * The socket is created readable and writable by its owner only (0600),
+ * as requests read and write any path the daemon's user may: only that user
+ * may submit stitches.
+ *
+ * A client sends a request line, reads the progress of the stitch as it
+ * goes, and may cancel it by sending "cancel" or by disconnecting.  Clients
+ * connecting while a panorama is stitched wait their turn in the socket's
+ * backlog.  Lines are tab separated fields:
+ *
+ *   request:  stitch input=<path>... output=<path> [ram_budget=<MB>]
+ *             [retries=<n>] [deadline=<seconds>] [cubemap=<0|1>]
+ *             [preview=<0|1>]
+ *   cancel:   cancel
+ *   response: estimate <time remaining>
+ *             progress <0..1>
+ *             output <elapsed time> <path>
+ *             done <setup time> <stitch time>
+ *             cancelled
+ *             error <message>
+ *
+ * Each stitch ends with one of done, cancelled or error.
+ */
+class StitchDaemon
+{
+public:
+    /**
+     * @brief Request
+     * A panorama to stitch.
+     */
+    struct Request
+    {
+        std::vector<std::string> inputPaths;
+        std::string outputPath;
+        Panorama::Parameters parameters;
+        bool preview = false;
+
+        /**
+         * @brief parse
+         * Parse a request line.
+         * @param line
+         * @param defaults Parameters of the fields the line leaves out.
+         * @throws std::invalid_argument If the line is not a request.
+         */
+        static Request parse(const std::string &line,
+                             const Panorama::Parameters &defaults);
+
+        /**
+         * @brief str
+         * The request line, without its newline.
+         */
+        std::string str() const;
+    };
+
+    /**
+     * @brief Response
+     * A response line, split into its fields.
+     */
+    using Response = std::vector<std::string>;
+    using ResponseCb = std::function<void(const Response &)>;
+
+    /**
+     * @brief Client
+     * A connection to a daemon.
+     */
+    class Client
+    {
+    public:
+        /**
+         * @brief Client
+         * @param socketPath
+         * @throws std::runtime_error If the daemon can't be connected to.
+         */
+        explicit Client(const std::string &socketPath);
+        ~Client();
+
+        Client(const Client &) = delete;
+        Client &operator=(const Client &) = delete;
+
+        /**
+         * @brief cancel
+         * Cancel the stitch being submitted, from another thread.
+         */
+        void cancel();
+
+        /**
+         * @brief submit
+         * Send a request and wait for its stitch to end.
+         * @param request
+         * @param responseCb Called with each response line.
+         * @return The last response: done, cancelled or error.
+         * @throws std::runtime_error If the connection to the daemon is lost.
+         */
+        Response submit(const Request &request,
+                        ResponseCb responseCb = [](const Response &) {});
+
+    private:
+        int _socket;
+    };
+
+    /**
+     * @brief StitchDaemon
+     * @param socketPath Path of the Unix socket to listen on.  A stale
+     * socket left at this path, which no daemon listens on, is replaced.
+     * The socket is removed with the daemon.
+     * @param config Configuration of each stitch.
+     * @param defaults Parameters of each stitch, unless the request sets
+     * them.
+     * @param threads The number of threads of each stitch.
+     * @param logger
+     */
+    StitchDaemon(const std::string &socketPath, const Configuration &config,
+                 const Panorama::Parameters &defaults, size_t threads,
+                 std::shared_ptr<logging::Logger> logger);
+    ~StitchDaemon();
+
+    StitchDaemon(const StitchDaemon &) = delete;
+    StitchDaemon &operator=(const StitchDaemon &) = delete;
+
+    /**
+     * @brief run
+     * Warm up, then serve requests until stopped.
+     * @throws std::runtime_error If a daemon already listens on the socket
+     * path, or something other than a socket is there.
+     */
+    void run();
+
+    /**
+     * @brief stop
+     * Stop serving requests, cancelling the current stitch.  Safe to call
+     * from another thread.
+     */
+    void stop();
+
+    /**
+     * @brief warmUp
+     * Start OpenCV's thread pool, and create the OpenCL context, which each
+     * stitch of a fresh process would otherwise do first.
+     * @param threads The number of threads of OpenCV's pool.
+     * @param enableOpenCL
+     * @return How long it took, which the daemon saves from each stitch.
+     */
+    static monitor::ElapsedTime warmUp(size_t threads, bool enableOpenCL);
+
+private:
+    const std::string _socketPath;
+    const Configuration _config;
+    const Panorama::Parameters _defaults;
+    const size_t _threads;
+    std::shared_ptr<logging::Logger> _logger;
+    std::atomic<bool> _stopped;
+    int _socket;
+    //! Whether the socket at the socket path is this daemon's, to remove.
+    bool _boundSocket;
+
+    /**
+     * @brief _current
+     * The stitch being served, to be cancelled when stopped.
+     */
+    Stitcher::SharedPtr _current;
+    std::mutex _currentMutex;
+
+    /**
+     * @brief serve
+     * Serve the request of a client.
+     * @param client The client's socket.
+     */
+    void serve(int client);
+};
+
+} // namespace stitcher
+} // namespace airmap
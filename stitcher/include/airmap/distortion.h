@@ -57,6 +57,26 @@ public:
      */
     virtual void undistort(cv::Mat &image, cv::InputArray K = noArray()) = 0;
 
+    /**
+     * @brief distort
+     * Distort an undistorted image, the inverse of undistort, e.g. to
+     * render the image the camera would capture.
+     * @param image Image to distort.
+     * @param K Camera intrinsics matrix.
+     */
+    virtual void distort(cv::Mat &image, cv::InputArray K = noArray()) = 0;
+
+    /**
+     * @brief undistortedK
+     * Intrinsics matrix of an image of the given size as undistorted,
+     * K unless undistortion changes the projection.
+     * @param width Image width.
+     * @param height Image height.
+     * @param K Camera intrinsics matrix.
+     */
+    virtual cv::Mat undistortedK(int width, int height,
+                                 cv::InputArray K = noArray()) const;
+
 protected:
     bool _enabled;
     CropROICb _crop_roi_cb;
@@ -195,6 +215,14 @@ public:
      */
     void undistort(cv::Mat &image, cv::InputArray K = noArray());
 
+    /**
+     * @brief distort
+     * Distort a single image.
+     * @param image Image to distort.
+     * @param K Camera intrinsics matrix.
+     */
+    void distort(cv::Mat &image, cv::InputArray K = noArray());
+
 protected:
     /**
      * @brief _parameters
@@ -348,6 +376,32 @@ public:
      */
     void createPerspectiveUndistortionMaps(cv::Mat &map_x, cv::Mat &map_y);
 
+    /**
+     * @brief createPerspectiveDistortionMaps
+     * Create x and y distortion maps, the inverse of the undistortion maps.
+     * Pixels outside of the perspective image map to -1.
+     * @param map_x x map
+     * @param map_y y map
+     */
+    void createPerspectiveDistortionMaps(cv::Mat &map_x, cv::Mat &map_y);
+
+    /**
+     * @brief cameraToWorld
+     * Back-projects image coordinates to a 3D world point along its ray,
+     * the inverse of worldToCamera.
+     * @param camera_point 2D image coordinates.
+     * @param world_point 3D world coordinates of a point on the ray.
+     */
+    void cameraToWorld(cv::Point2d &camera_point, cv::Point3d &world_point);
+
+    /**
+     * @brief distort
+     * Distort a single image.
+     * @param image Image to distort.
+     * @param K Camera intrinsics matrix, unused.
+     */
+    void distort(cv::Mat &image, cv::InputArray K = noArray());
+
     /**
      * @brief undistort
      * Undistort a single image.
@@ -373,6 +427,17 @@ public:
      */
     void worldToCamera(cv::Point3d &world_point, cv::Point2d &camera_point);
 
+    /**
+     * @brief undistortedK
+     * Intrinsics matrix of the perspective images undistort produces, of
+     * the given size.
+     * @param width Image width.
+     * @param height Image height.
+     * @param K Camera intrinsics matrix, unused.
+     */
+    cv::Mat undistortedK(int width, int height,
+                         cv::InputArray K = noArray()) const;
+
 protected:
     /**
      * @brief _parameters
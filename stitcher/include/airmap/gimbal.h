@@ -27,6 +27,16 @@ struct GimbalOrientation
 
     GimbalOrientation(const GimbalOrientation &other);
 
+    /**
+     * @brief cameraRotation
+     * Calculate the rotation from the camera frame (x right, y down, z along
+     * the optical axis) to a frame where the camera at zero pitch, roll and
+     * yaw is the identity, as cv::detail::CameraParams::R.  Positive pitch
+     * tilts the camera up, positive yaw turns it right and positive roll
+     * turns it clockwise.
+     */
+    cv::Mat cameraRotation();
+
     /**
      * @brief convertTo
      * Convert unit of angles.
@@ -41,6 +51,13 @@ struct GimbalOrientation
      */
     cv::Mat homography(cv::Mat K);
 
+    /**
+     * @brief hasOrientation
+     * Whether pitch, roll and yaw are all known.  TinyEXIF leaves
+     * the angles missing from the metadata at DBL_MAX.
+     */
+    bool hasOrientation() const;
+
     /**
      * @brief rotationMatrix
      * Calculate the rotation matrix for the given pose.
@@ -2,6 +2,7 @@
 
 #include "airmap/gimbal.h"
 #include "airmap/logging.h"
+#include "airmap/memory_planner.h"
 #include "airmap/opencv/forward.h"
 #include "airmap/panorama.h"
 
@@ -112,19 +113,18 @@ struct SourceImages
 
     /**
      * @brief scaleToAvailableMemory
-     * Scale images based on available system memory.
-     * @param memoryBudgetMB How much RAM headroom can the stitcher assume it
-     * has to its exclusive disposal.
-     * @param maxInputImageSize No of pixels, to which to scale each
-     * input image down.
+     * Plan the scales of the stitch for the memory budget, and scale the
+     * images to the planned input scale.
+     * @param planner Planner of the stitch's configuration and budget.
      * @param inputSizeMB Total size, in MB, of the images.
      * @param inputScaled Calculated scale.
      * @param interpolation OpenCV resize interpolation method.
+     * @return The memory plan, with the scale the images were scaled by.
      * @throws std::invalid_argument When RAM budget is too small.
      */
-    void
-    scaleToAvailableMemory(size_t memoryBudgetMB, size_t &maxInputImageSize,
-                           size_t &inputSizeMB, double &inputScaled,
+    MemoryPlan
+    scaleToAvailableMemory(const MemoryPlanner &planner, size_t &inputSizeMB,
+                           double &inputScaled,
                            int interpolation = defaultInterpolationFlags());
 };
 
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "airmap/monitor/operation.h"
+#include "airmap/panorama.h"
+#include "airmap/stitcher_configuration.h"
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace airmap {
+namespace stitcher {
+
+/**
+ * @brief MemoryPlan
+ * The scales a stitch runs at, and the peak memory each of its stages is
+ * predicted to reach at those scales.
+ */
+struct MemoryPlan
+{
+    //! Scale of the decoded images, which the remaining stages start from.
+    double inputScale = 1.;
+    //! Scale of the images for composition, relative to the input scale,
+    //! as LowLevelOpenCVStitcher::getComposeScale.
+    double composeScale = 1.;
+    //! Scales of the images for finding features and seams, relative to
+    //! the input scale, for the log.
+    double workScale = 1.;
+    double seamScale = 1.;
+    //! Predicted pixels of the composed panorama.
+    size_t panoramaPixels = 0;
+    //! Predicted peak memory of each stage the model covers, in MB.
+    std::map<monitor::Operation::Enum, size_t> peaksMB;
+
+    /**
+     * @brief peakMB
+     * The predicted peak of the stages after the input is scaled, which
+     * the scales of the plan bound.
+     */
+    size_t peakMB() const;
+
+    /**
+     * @brief loadPeakMB
+     * The predicted peak of loading, undistorting and scaling the images,
+     * which hold them at their full size.
+     */
+    size_t loadPeakMB() const;
+
+    /**
+     * @brief str
+     * The scales and the predicted peak of each stage, for the log.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief MemoryPlanner
+ * Predicts the peak memory of each stage of a stitch from the size of its
+ * images and the effective configuration, and chooses the largest input
+ * and compose scales that keep every stage within the memory budget.
+ *
+ * The model counts the buffers each stage holds at once, e.g. the input
+ * images, the warped images at seam scale and the graph of the seam
+ * finder, or the images at compose scale and the pyramids of the blender.
+ * The panorama is bounded by a full sphere when the focal length is
+ * known, else by the sum of the warped images.
+ */
+class MemoryPlanner
+{
+public:
+    /**
+     * @brief baselineMB
+     * Memory of the process before it loads any image: code, OpenCV's
+     * allocations and thread stacks.
+     */
+    static constexpr double baselineMB = 200;
+
+    /**
+     * @brief minimumScale
+     * The least an input scale, or a compose scale relative to the
+     * configured one, may be scaled down to fit the budget, below which
+     * the panorama isn't worth stitching.
+     */
+    static constexpr double minimumScale = 0.2;
+
+    /**
+     * @brief MemoryPlanner
+     * @param config The effective configuration of the stitch.
+     * @param parameters memoryBudgetMB, maxInputImageSize and
+     * alsoCreateCubeMap apply.
+     * @param focalPixels Focal length of the camera in pixels of the
+     * decoded images, 0 if unknown.
+     * @param undistort Whether the images are undistorted once loaded.
+     */
+    MemoryPlanner(const Configuration &config, const Panorama::Parameters &parameters,
+                  double focalPixels = 0., bool undistort = false);
+
+    /**
+     * @brief maxInputScale
+     * The scale that brings images down to Parameters::maxInputImageSize,
+     * 1 for smaller images.
+     * @param imagePixels Pixels of each decoded image.
+     */
+    double maxInputScale(size_t imagePixels) const;
+
+    /**
+     * @brief configuredComposeScale
+     * The compose scale of the configuration for images at an input scale,
+     * as LowLevelOpenCVStitcher::getComposeScale.
+     */
+    double configuredComposeScale(size_t imagePixels, double inputScale) const;
+
+    /**
+     * @brief predict
+     * Predict the peak memory of each stage at given scales.
+     * @param imageCount
+     * @param imagePixels Pixels of each decoded image.
+     * @param inputScale
+     * @param composeScale Relative to the input scale.
+     */
+    MemoryPlan predict(size_t imageCount, size_t imagePixels, double inputScale,
+                       double composeScale) const;
+
+    /**
+     * @brief plan
+     * Choose the largest input scale, up to maxInputScale, at which every
+     * stage fits the budget with the images composed at the configured
+     * scale.  Work and seam scales are set in megapixels, so this is the
+     * largest panorama the budget allows.  Below minimumScale, the input is
+     * kept at minimumScale if the stages before composition fit, and the
+     * largest compose scale at which composition and postprocessing fit is
+     * chosen instead.
+     * @param imageCount
+     * @param imagePixels Pixels of each decoded image.
+     * @throws std::invalid_argument When either scale would be below
+     * minimumScale.
+     */
+    MemoryPlan plan(size_t imageCount, size_t imagePixels) const;
+
+private:
+    const Configuration _config;
+    const Panorama::Parameters _parameters;
+    const double _focalPixels;
+    const bool _undistort;
+};
+
+} // namespace stitcher
+} // namespace airmap
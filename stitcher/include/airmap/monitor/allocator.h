@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "airmap/monitor/operation.h"
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+/**
+ * @brief AllocationStats
+ * The OpenCV matrices allocated while an operation was current.
+ */
+struct AllocationStats
+{
+    //! The number of matrices allocated.
+    uint64_t allocations = 0;
+    //! Bytes allocated, in all.
+    size_t allocatedBytes = 0;
+    //! Bytes of the operation's matrices still allocated.
+    size_t liveBytes = 0;
+    //! The most bytes of all matrices allocated at once while the
+    //! operation was current, whichever operation allocated them.
+    size_t peakBytes = 0;
+};
+
+/**
+ * @brief AllocationTracker
+ * Tracks the OpenCV matrices a stitch allocates, by the operation current
+ * when each was allocated, and enforces a budget on them.
+ *
+ * Matrices are allocated by an allocator installed as OpenCV's default
+ * once per process, which charges each to the tracker bound to the
+ * allocating thread, see bind.  Threads bound to no tracker, e.g. OpenCV's
+ * workers, charge the tracker bound while it is the only one, else their
+ * matrices go untracked, e.g. while a batch stitches several panoramas at
+ * once.  Matrices are credited back to the tracker that was charged, even
+ * once it is destroyed.
+ */
+class AllocationTracker
+{
+public:
+    using SharedPtr = std::shared_ptr<AllocationTracker>;
+
+    //! The counters of a tracker, shared with the tracking allocator.
+    struct Account;
+
+    /**
+     * @brief Binding
+     * Binds a tracker to the thread that created the binding, until it is
+     * destroyed.
+     */
+    class Binding
+    {
+    public:
+        Binding(Binding &&other);
+        Binding(const Binding &) = delete;
+        Binding &operator=(const Binding &) = delete;
+        Binding &operator=(Binding &&) = delete;
+        ~Binding();
+
+    private:
+        friend class AllocationTracker;
+
+        explicit Binding(Account *account);
+
+        Account *_account;
+        Account *_previous;
+    };
+
+    AllocationTracker();
+    ~AllocationTracker();
+
+    AllocationTracker(const AllocationTracker &) = delete;
+    AllocationTracker &operator=(const AllocationTracker &) = delete;
+
+    static SharedPtr create();
+
+    /**
+     * @brief bind
+     * Charge the matrices the calling thread allocates to this tracker,
+     * until the returned binding is destroyed.  Installs the tracking
+     * allocator as OpenCV's default, the first time.
+     */
+    Binding bind();
+
+    /**
+     * @brief budgetMB
+     * The most MB of matrices the tracker may be charged at once, 0 for no
+     * budget.
+     */
+    size_t budgetMB() const;
+
+    /**
+     * @brief changeOperation
+     * Charge the matrices allocated from now on to the given operation.
+     */
+    void changeOperation(Operation::Enum operation);
+
+    /**
+     * @brief checkBudget
+     * Throws if an allocation was refused since the budget was set, e.g.
+     * when OpenCV caught the first exception and threw another.
+     * @throws Stitcher::MemoryBudgetExceededError Of the first allocation
+     * refused.
+     */
+    void checkBudget() const;
+
+    /**
+     * @brief liveBytes
+     * Bytes of the matrices charged to the tracker still allocated.
+     */
+    size_t liveBytes() const;
+
+    /**
+     * @brief reset
+     * Clear the stats of every operation, and whether an allocation was
+     * refused, for another stitch.  Matrices still allocated stay charged.
+     */
+    void reset();
+
+    /**
+     * @brief setBudgetMB
+     * Refuse allocations that would take the matrices charged to the
+     * tracker over the given MB, by throwing
+     * Stitcher::MemoryBudgetExceededError instead of allocating them.
+     * @param budgetMB 0 for no budget.
+     */
+    void setBudgetMB(size_t budgetMB);
+
+    /**
+     * @brief stats
+     * The matrices allocated while the given operation was current.
+     */
+    AllocationStats stats(Operation::Enum operation) const;
+
+private:
+    Account *_account;
+};
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
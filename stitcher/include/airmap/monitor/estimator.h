@@ -2,9 +2,12 @@
 
 #include "airmap/camera.h"
 #include "airmap/logging.h"
+#include "airmap/monitor/history.h"
 #include "airmap/monitor/operation.h"
 #include "airmap/monitor/timer.h"
 
+#include <stdexcept>
+
 namespace airmap {
 namespace stitcher {
 namespace monitor {
@@ -23,6 +26,7 @@ public:
             const std::shared_ptr<airmap::logging::Logger> logger,
             UpdatedCb updatedCb = []() {}, bool enabled = false, bool logEnabled = false)
         : _currentEstimate(0)
+        , _currentOutputElapsed(0)
         , _currentProgress(-1.)
         , _enabled(enabled)
         , _logEnabled(logEnabled)
@@ -44,7 +48,8 @@ public:
      * @brief estimateLogPrefix
      * Prefix for estimate log statements.
      * This can be used by a parent process to scrape the logs
-     * for estimate updates.
+     * for estimate updates.  A progress channel, see ProgressWriter,
+     * conveys the same without parsing logs.
      */
     const std::string estimateLogPrefix = "Estimated time remaining: ";
 
@@ -56,6 +61,15 @@ public:
      */
     const std::string progressLogPrefix = "Progress: ";
 
+    /**
+     * @brief outputLogPrefix
+     * Prefix for log statements of written outputs, followed by the
+     * elapsed time of the stitch and the path of the output.
+     * This can be used by a parent process to scrape the logs
+     * for outputs, e.g. a preview written before the final panorama.
+     */
+    const std::string outputLogPrefix = "Output written: ";
+
     /**
      * @brief currentEstimate
      * Calculates and returns the current estimate of time
@@ -98,6 +112,19 @@ public:
         return 0.;
     }
 
+    /**
+     * @brief currentOutput
+     * Returns the path of the latest output written, if any.
+     */
+    const std::string &currentOutput() const { return _currentOutput; }
+
+    /**
+     * @brief currentOutputElapsed
+     * Returns the elapsed time of the stitch when the latest output was
+     * written.
+     */
+    const ElapsedTime currentOutputElapsed() const { return _currentOutputElapsed; }
+
     /**
      * @brief disable
      * Disable the estimator.
@@ -130,6 +157,49 @@ public:
         _logEnabled = true;
     }
 
+    /**
+     * @brief outputWritten
+     * Records and logs an output written by the stitch.
+     * @param output Path of the output.
+     * @param elapsed Elapsed time of the stitch when it was written.
+     */
+    void outputWritten(const std::string &output, const ElapsedTime &elapsed)
+    {
+        if (!_enabled) {
+            return;
+        }
+
+        _currentOutput = output;
+        _currentOutputElapsed = elapsed;
+
+        if (_logEnabled) {
+            _logger->log(airmap::logging::Logger::Severity::info,
+                         (outputLogPrefix + elapsed.str() + " " + output).c_str(),
+                         "stitcher");
+        }
+
+        updated();
+    }
+
+    /**
+     * @brief setCurrent
+     * Sets the current estimate and progress values at once, e.g. from a
+     * record of the progress channel of a child process, see
+     * ProgressParser, without parsing them from its logs.
+     * @param estimatedTimeRemaining
+     * @param progress A number between 0 and 100.
+     */
+    void setCurrent(const ElapsedTime &estimatedTimeRemaining, double progress)
+    {
+        if (!_enabled) {
+            return;
+        }
+
+        _currentEstimate = estimatedTimeRemaining;
+        _currentProgress = progress;
+        updated();
+    }
+
     /**
      * @brief setCurrentEstimate
      * Sets the current estimate value.
@@ -166,6 +236,44 @@ public:
         updated();
     }
 
+    /**
+     * @brief setCurrentOutput
+     * Sets the latest output written and the elapsed time of the stitch
+     * when it was written.
+     */
+    void setCurrentOutput(const std::string &output, const ElapsedTime &elapsed)
+    {
+        if (!_enabled) {
+            return;
+        }
+
+        _currentOutputElapsed = elapsed;
+        _currentOutput = output;
+        updated();
+    }
+
+    /**
+     * @brief setCurrentOutput
+     * Sets the latest output written, from what follows outputLogPrefix
+     * in the log of a child process: the elapsed time and the path of the
+     * output, separated by a space.
+     */
+    void setCurrentOutput(const std::string &output)
+    {
+        if (!_enabled) {
+            return;
+        }
+
+        const size_t separator = output.find(' ');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("Invalid output string.  Format is 00:00:00.000 path");
+        }
+
+        _currentOutputElapsed = { output.substr(0, separator) };
+        _currentOutput = output.substr(separator + 1);
+        updated();
+    }
+
 protected:
     /**
      * @brief _currentEstimate
@@ -173,6 +281,18 @@ protected:
      */
     ElapsedTime _currentEstimate;
 
+    /**
+     * @brief _currentOutput
+     * The path of the latest output written.
+     */
+    std::string _currentOutput;
+
+    /**
+     * @brief _currentOutputElapsed
+     * The elapsed time of the stitch when the latest output was written.
+     */
+    ElapsedTime _currentOutputElapsed;
+
     /**
      * @brief _currentProgress
      * The current progress of the overall stitch.
@@ -312,7 +432,8 @@ public:
      * @brief estimateOperations
      * Returns the initial estimates for each operation
      * based on known information about the stitch (e.g. camera
-     * model and distortion model).
+     * model and distortion model), or, if there is a history and the
+     * features of the stitch are known, as predicted from past stitches.
      */
     const OperationElapsedTimesMap estimateOperations() const;
 
@@ -322,6 +443,20 @@ public:
      */
     const OperationElapsedTimesMap operationEstimateTimes() const;
 
+    /**
+     * @brief setHistory
+     * Predict the operations from a history of past stitches, and add
+     * the stitch to it once complete, see setJobFeatures.
+     */
+    void setHistory(const History::SharedPtr history);
+
+    /**
+     * @brief setJobFeatures
+     * Sets the features of the stitch, once known, and estimates again the
+     * operations not yet finished.
+     */
+    void setJobFeatures(const JobFeatures &features);
+
     /**
      * @brief setOperationTimesCb
      * @param operationTimesCb A function, which is expected to return
@@ -343,6 +478,18 @@ protected:
      */
     const std::shared_ptr<Camera> _camera;
 
+    /**
+     * @brief _history
+     * The history of past stitches, if any.
+     */
+    History::SharedPtr _history;
+
+    /**
+     * @brief _jobFeatures
+     * The features of the stitch, empty until known.
+     */
+    JobFeatures _jobFeatures;
+
     /**
      * @brief _currentOperation
      * The current operation being executed.
@@ -367,6 +514,20 @@ protected:
      * operations.
      */
     OperationTimesCb _operationTimesCb;
+
+    /**
+     * @brief cameraOperationEstimates
+     * Returns the estimates for each operation of the camera and
+     * distortion model.
+     */
+    const OperationElapsedTimesMap cameraOperationEstimates() const;
+
+    /**
+     * @brief recordJob
+     * Adds the complete stitch to the history, if any, and logs how far
+     * its estimate was from its elapsed time.
+     */
+    void recordJob();
 };
 
 } // namespace monitor
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "airmap/logging.h"
+#include "airmap/monitor/operation.h"
+#include "airmap/monitor/timer.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+/**
+ * @brief JobFeatures
+ * What the elapsed times of the operations of a stitch depend on.
+ */
+struct JobFeatures
+{
+    size_t imageCount = 0;
+    //! Megapixels of all the images, as loaded and at each scale.
+    double inputMegapix = 0.;
+    double workMegapix = 0.;
+    double seamMegapix = 0.;
+    double composeMegapix = 0.;
+    //! Camera model of the images, empty if unknown.
+    std::string camera;
+    //! The settings of the stitch that change its cost, as a key.
+    std::string configuration;
+    size_t threads = 0;
+
+    /**
+     * @brief empty
+     * Whether the features are unknown.
+     */
+    bool empty() const { return imageCount == 0; }
+
+    /**
+     * @brief size
+     * The size of the job the elapsed time of an operation grows with,
+     * e.g. the megapixels warped or the number of cameras adjusted.
+     */
+    double size(const Operation &operation) const;
+};
+
+/**
+ * @brief JobRecord
+ * The features and operation elapsed times of a finished stitch.
+ * Serialized as a line of tab separated <key>=<value> fields, with
+ * times in milliseconds, e.g. with the tabs shown as \t:
+ *
+ *   job\timages=36\tinput_mp=432\twork_mp=21.6\tseam_mp=3.6\tcompose_mp=432
+ *   \tcamera=ANAFI-Thermal\tconfiguration=0-0-0-0-1-0\tthreads=8
+ *   \tStart=1\tLoadImages=1480\t...
+ */
+struct JobRecord
+{
+    JobFeatures features;
+    OperationElapsedTimesMap times;
+
+    /**
+     * @brief parse
+     * Parse a record from its line.
+     * @throws std::invalid_argument If the line is not a record.
+     */
+    static JobRecord parse(const std::string &line);
+
+    /**
+     * @brief str
+     * The line of the record, without its newline.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief PredictionErrors
+ * How far the predictions of a history are from the times of its jobs,
+ * each predicted from the others.
+ */
+struct PredictionErrors
+{
+    //! Mean absolute error of the time of each operation, as a fraction of
+    //! the time.
+    std::map<Operation::Enum, double> operations;
+    //! Mean absolute error of the total time of a stitch, as a fraction of
+    //! the time.
+    double total = 0.;
+    //! Number of jobs predicted.
+    size_t jobs = 0;
+
+    /**
+     * @brief str
+     * The errors, as logged.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief History
+ * The records of past stitches, from which the elapsed time of each
+ * operation of a stitch is predicted: a line fit of the time to the size
+ * of the operation, over the records most similar to the stitch, i.e.
+ * with the same camera, configuration and threads if there are enough of
+ * them.  Safe to use from several threads.
+ */
+class History
+{
+public:
+    using SharedPtr = std::shared_ptr<History>;
+
+    //! Fewest records of a camera, configuration and thread count to fit
+    //! to, before falling back to less similar records.
+    static constexpr size_t MinSimilarRecords = 3;
+    //! Most records kept, the latest.
+    static constexpr size_t MaxRecords = 500;
+
+    /**
+     * @brief History
+     * A history in memory only.
+     */
+    explicit History(std::vector<JobRecord> records = {});
+
+    /**
+     * @brief load
+     * Load the history of a file, empty if the file doesn't exist yet.
+     * Records are appended to the file.  Lines that are not records, e.g.
+     * the last of a stitch killed while appending it, are logged and
+     * skipped.
+     * @param path
+     * @param logger
+     */
+    static SharedPtr load(const std::string &path,
+                          std::shared_ptr<logging::Logger> logger);
+
+    /**
+     * @brief add
+     * Add the record of a finished stitch, and append it to the file of
+     * the history, if any.
+     */
+    void add(const JobRecord &record);
+
+    /**
+     * @brief evaluate
+     * Predict each job of the history from the others.
+     */
+    PredictionErrors evaluate() const;
+
+    /**
+     * @brief predict
+     * Predict the elapsed times of the operations of a stitch, of those
+     * operations the history has records of.
+     */
+    OperationElapsedTimesMap predict(const JobFeatures &features) const;
+
+    /**
+     * @brief records
+     * The records, oldest first.
+     */
+    std::vector<JobRecord> records() const;
+
+private:
+    std::string _path;
+    std::vector<JobRecord> _records;
+    mutable std::mutex _mutex;
+
+    static OperationElapsedTimesMap predict(const std::vector<JobRecord> &records,
+                                            const JobFeatures &features);
+};
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
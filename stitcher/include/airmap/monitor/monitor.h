@@ -1,21 +1,122 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
 
 #include "airmap/logging.h"
+#include "airmap/monitor/allocator.h"
 #include "airmap/monitor/estimator.h"
 #include "airmap/monitor/operation.h"
+#include "airmap/monitor/progress.h"
+#include "airmap/monitor/resources.h"
 #include "airmap/monitor/timer.h"
+#include "airmap/monitor/trace.h"
 
 namespace airmap {
 namespace stitcher {
 namespace monitor {
 
+/**
+ * @brief Cancelled
+ * Thrown by a monitor from within a stitch that was cancelled.
+ */
+class Cancelled : public std::runtime_error {
+public:
+    Cancelled()
+        : std::runtime_error("Stitch cancelled")
+    {
+    }
+};
+
+/**
+ * @brief OperationWork
+ * The progress and work counters of the current operation, updated
+ * lock-free by the threads working on it.
+ */
+class OperationWork {
+public:
+    OperationWork();
+
+    /**
+     * @brief add
+     * Count work done, e.g. features found.
+     * @param counter One of the counters of OperationResources.
+     * @param amount
+     * @throws std::invalid_argument If counter is not one of them.
+     */
+    void add(const std::string &counter, uint64_t amount);
+
+    /**
+     * @brief complete
+     * Count units of work completed, out of those set by setTotal.
+     */
+    void complete(uint64_t units);
+
+    /**
+     * @brief counters
+     * The work counted, of the counters that counted any.
+     */
+    std::map<std::string, uint64_t> counters() const;
+
+    /**
+     * @brief progress
+     * The units completed out of the total, if set, or else the progress
+     * set, between 0 and 1.
+     */
+    double progress() const;
+
+    /**
+     * @brief reset
+     * Clear the progress and counters, for the next operation.  Not while
+     * threads work on the current one.
+     */
+    void reset();
+
+    /**
+     * @brief setProgress
+     * Set the progress, between 0 and 1, of an operation without units.
+     */
+    void setProgress(double progress);
+
+    /**
+     * @brief setTotal
+     * Set the number of units of work of the operation, none completed.
+     */
+    void setTotal(uint64_t total);
+
+private:
+    static constexpr size_t CounterCount = 4;
+    static const std::array<const char *, CounterCount> CounterNames;
+
+    std::atomic<uint64_t> _total;
+    std::atomic<uint64_t> _completed;
+    std::atomic<double> _progress;
+    std::array<std::atomic<uint64_t>, CounterCount> _counters;
+};
+
 /**
  * @brief Monitor
  * Manages operation timer, estimates, and progress.
+ *
+ * The thread that changes the operation, the stitching thread, reports
+ * progress: it updates the estimator, which logs and calls its UpdatedCb,
+ * writes the progress channel and traces memory, at most once per report
+ * interval.  Other threads working on the operation, e.g. of a parallel
+ * loop, only count their progress and work, lock-free, and never block on
+ * reporting.  While the stitching thread doesn't report, e.g. blocked
+ * waiting for such a loop, a reporter thread, from the start of the stitch
+ * to its completion or failure, reports for it.  Reports, and the
+ * estimator, are serialized by a mutex, so the stitching thread must reach
+ * the estimator through the monitor while the stitch runs.
  */
 class Monitor {
 public:
@@ -24,6 +125,7 @@ public:
     Monitor(OperationsEstimator::SharedPtr estimator,
             std::shared_ptr<airmap::logging::Logger> logger, bool enabled = false,
             bool logEnabled = false);
+    ~Monitor();
 
     static Monitor::SharedPtr create(OperationsEstimator::SharedPtr estimator,
                                      std::shared_ptr<airmap::logging::Logger> logger,
@@ -33,19 +135,73 @@ public:
                                      std::shared_ptr<airmap::logging::Logger> logger,
                                      bool enabled = false, bool logEnabled = false);
 
+    /**
+     * @brief addWork
+     * Count work done by the current operation, e.g. features found.
+     * Lock-free, from any thread.
+     * @param counter One of the counters of OperationResources.
+     * @param amount
+     * @throws std::invalid_argument If counter is not one of them.
+     */
+    void addWork(const std::string &counter, uint64_t amount);
+
+    /**
+     * @brief allocations
+     * The tracker of the OpenCV matrices of the stitch, charged to the
+     * current operation.  Bind it to the
+     * stitching thread for the stitch, see AllocationTracker::bind.
+     */
+    AllocationTracker::SharedPtr allocations();
+
+    /**
+     * @brief cancel
+     * Cancel the stitch.  The next change or update of the current
+     * operation throws Cancelled, from the stitching thread.
+     */
+    void cancel();
+
+    /**
+     * @brief cancelled
+     * Whether the stitch was cancelled.
+     */
+    bool cancelled() const;
+
     /**
      * @brief changeOperation
      * Change the current operation.
      * @param operation The current operation.
+     * @throws Cancelled If the stitch was cancelled.
      */
     void changeOperation(const Operation &operation);
 
+    /**
+     * @brief completeWork
+     * Count units of work of the current operation completed, out of
+     * those set by setOperationWork.  Lock-free, from any thread; reports
+     * progress if called from the stitching thread and a report is due.
+     * @throws Cancelled If the stitch was cancelled, from the stitching
+     * thread only.
+     */
+    void completeWork(uint64_t units = 1);
+
+    /**
+     * @brief currentEstimate
+     * Returns the estimated time remaining of the stitch.
+     */
+    const ElapsedTime currentEstimate();
+
     /**
      * @brief currentOperation
      * Returns the current operation.
      */
     Operation currentOperation();
 
+    /**
+     * @brief currentOperationProgress
+     * Returns the progress of the current operation, between 0 and 1.
+     */
+    double currentOperationProgress() const;
+
     /**
      * @brief disable
      * Disable monitoring of operation elapsed times.
@@ -58,6 +214,12 @@ public:
      */
     void disableLog();
 
+    /**
+     * @brief elapsed
+     * Returns the time elapsed since the stitch started.
+     */
+    const ElapsedTime elapsed() const;
+
     /**
      * @brief enable
      * Enables monitoring of operation elapsed times.
@@ -82,14 +244,98 @@ public:
      */
     const OperationElapsedTimesMap operationTimes() const;
 
+    /**
+     * @brief operationResources
+     * Returns the resources each finished operation used: wall and CPU
+     * time, peak and delta resident memory, OpenCV matrices allocated, and
+     * work counters.
+     */
+    const OperationResourcesMap operationResources() const;
+
+    /**
+     * @brief operationFailed
+     * Ends the trace span of the current operation, when it throws.
+     */
+    void operationFailed();
+
+    /**
+     * @brief outputWritten
+     * Report an output written by the stitch, with the time elapsed
+     * since the stitch started.
+     * @param output Path of the output.
+     */
+    void outputWritten(const std::string &output);
+
+    /**
+     * @brief setJobFeatures
+     * Set the features of the stitch, which its estimates depend on, see
+     * OperationsEstimator::setJobFeatures.
+     */
+    void setJobFeatures(const JobFeatures &features);
+
+    /**
+     * @brief setOperationWork
+     * Set the number of units of work of the current operation, e.g. of
+     * the iterations of a parallel loop, none completed.  Its progress is
+     * then the units completed, see completeWork.
+     */
+    void setOperationWork(uint64_t total);
+
+    /**
+     * @brief setProgressWriter
+     * Write the progress of the stitch to a progress channel, at each
+     * change of operation, output written and, rate limited, update of
+     * the current operation.  Enables the monitor and its estimator.
+     * @param writer
+     */
+    void setProgressWriter(ProgressWriter::SharedPtr writer);
+
+    /**
+     * @brief setReportInterval
+     * Report the progress of an operation at most once per interval, 100
+     * milliseconds by default.  Changes of operation and outputs are always
+     * reported.
+     */
+    void setReportInterval(std::chrono::milliseconds interval);
+
+    /**
+     * @brief setTracer
+     * Trace the operations of the stitch, their steps and the resident
+     * memory.  Enables the monitor.
+     * @param tracer
+     */
+    void setTracer(Tracer::SharedPtr tracer);
+
+    /**
+     * @brief span
+     * Trace a step of the current operation, until the returned span is
+     * destroyed.  Does nothing without a tracer.
+     * @param name Name of the step, which must outlive the span.
+     * @param index Index of what the step processes, e.g. of an image.
+     */
+    Tracer::Span span(const char *name, int64_t index = -1) const
+    {
+        return { _tracer.get(), name, "step", index };
+    }
+
     /**
      * @brief updateCurrentOperation
+     * Lock-free, from any thread; reports progress if called from the
+     * stitching thread and a report is due.
      * @param progress Progress of the current operation.  A number
      * between 0 and 1.
+     * @throws Cancelled If the stitch was cancelled, from the stitching
+     * thread only.
      */
     void updateCurrentOperation(double progress);
 
 private:
+    /**
+     * @brief _cancelled
+     * Whether the stitch was cancelled, from any thread.
+     */
+    std::shared_ptr<std::atomic<bool>> _cancelled;
+
     /**
      * @brief _estimator
      * A pointer to an instance of an estimator.
@@ -120,12 +366,108 @@ private:
      */
     bool _logEnabled;
 
+    /**
+     * @brief _progressWriter
+     * Where to write the progress of the stitch, if anywhere.
+     */
+    ProgressWriter::SharedPtr _progressWriter;
+
+    /**
+     * @brief _tracer
+     * Where to trace the stitch, if anywhere, and whether the span of the
+     * current operation is open.
+     */
+    Tracer::SharedPtr _tracer;
+    bool _operationTraced;
+
+    /**
+     * @brief _currentOperation
+     * The current operation, for the progress channel.
+     */
+    Operation _currentOperation;
+
+    /**
+     * @brief _work
+     * The progress and work counters of the current operation, counted by
+     * any thread.
+     */
+    std::shared_ptr<OperationWork> _work;
+
+    /**
+     * @brief _allocations
+     * The OpenCV matrices allocated by each operation.
+     */
+    AllocationTracker::SharedPtr _allocations;
+
+    /**
+     * @brief _stitchingThread
+     * The thread that last changed the operation, which reports progress.
+     */
+    std::thread::id _stitchingThread;
+
+    /**
+     * @brief _reportInterval
+     * The least time between reports of the progress of an operation, and
+     * when it was last reported.
+     */
+    std::chrono::steady_clock::duration _reportInterval;
+    std::chrono::steady_clock::time_point _lastReport;
+
+    /**
+     * @brief Reporter
+     * The thread reporting while the stitching thread doesn't, whether it
+     * should keep reporting, how to wake it to stop, and the mutex that
+     * serializes the reports, of the stitching thread and of the reporter,
+     * the changes of operation and the estimator.  A copy of the monitor
+     * starts without a reporter.
+     */
+    struct Reporter
+    {
+        Reporter() = default;
+        Reporter(const Reporter &) {}
+        Reporter &operator=(const Reporter &) { return *this; }
+
+        std::mutex mutex;
+        std::thread thread;
+        bool running = false;
+        std::condition_variable wakeup;
+    };
+    Reporter _reporter;
+
+    /**
+     * @brief _operationResources
+     * The resources used by each finished operation.
+     */
+    OperationResourcesMap _operationResources;
+
+    /**
+     * @brief _operationStartUsage
+     * The resources used by the process when the current operation
+     * started, and whether its peak resident memory was reset then.
+     */
+    ResourceUsage _operationStartUsage;
+    bool _operationPeakReset;
+
     /**
      * @brief _timer
      * An instance of a timer.  Used to time each operation.
      */
     Timer _timer;
 
+    /**
+     * @brief _stitchTimer
+     * An instance of a timer.  Used to time the whole stitch, until each
+     * output is written.
+     */
+    Timer _stitchTimer;
+
+    /**
+     * @brief changeMonitoredOperation
+     * Time, record, log, trace and report the change of operation, with the
+     * report mutex locked.
+     */
+    void changeMonitoredOperation(const Operation &operation);
+
     /**
      * @brief logComplete
      * Logs the total elapsed time of the stitch when complete.
@@ -134,9 +476,64 @@ private:
 
     /**
      * @brief logOperation
-     * Logs the elapsed time for an operation, when complete.
+     * Logs the elapsed time and resources of an operation that just
+     * finished.
      */
     void logOperation(const Operation &operation) const;
+
+    /**
+     * @brief recordResources
+     * Records the resources used by an operation that just finished, added
+     * to those of its previous runs.
+     */
+    void recordResources(const Operation &operation);
+
+    /**
+     * @brief publish
+     * Report the progress of the current operation, if a report is due.
+     * With the report mutex locked.
+     */
+    void publish();
+
+    /**
+     * @brief report
+     * Report the progress of the current operation, if called from the
+     * stitching thread and a report is due.
+     * @throws Cancelled If the stitch was cancelled.
+     */
+    void report();
+
+    /**
+     * @brief reportInBackground
+     * The reporter: report whenever a report is due, until stopped.
+     */
+    void reportInBackground();
+
+    /**
+     * @brief startReporter
+     * Start the reporter, unless it runs.
+     */
+    void startReporter();
+
+    /**
+     * @brief stopReporter
+     * Stop the reporter, if it runs, and wait for it.
+     */
+    void stopReporter();
+
+    /**
+     * @brief traceOperation
+     * Ends the trace span of the current operation, and begins that of
+     * the next one.
+     */
+    void traceOperation(const Operation &operation);
+
+    /**
+     * @brief writeProgress
+     * Write the progress of the stitch to the progress channel, if any.
+     * @param force Whether to write it even if rate limited.
+     */
+    void writeProgress(bool force);
 };
 
 } // namespace monitor
@@ -8,18 +8,31 @@ namespace airmap {
 namespace stitcher {
 namespace monitor {
 
+/**
+ * @brief Operation
+ * The phases of a stitch, in the order they run.  Phases that don't apply
+ * to a stitch, e.g. ShouldRotate to panoramas other than 360s, are skipped.
+ */
 class Operation {
 public:
     enum class Enum {
         Start,
+        LoadImages,
         UndistortImages,
+        ScaleImages,
         FindFeatures,
         MatchFeatures,
         EstimateCameraParameters,
+        ComposePreview,
         AdjustCameraParameters,
+        WarpImages,
         PrepareExposureCompensation,
+        ShouldRotate,
         FindSeams,
         Compose,
+        CropPanorama,
+        WritePanorama,
+        WriteCubemap,
         Complete
     };
 
@@ -49,12 +62,16 @@ public:
 
     bool operator>=(const Operation &other) const { return !(*this < other); }
 
-    static constexpr int count = 10;
+    static constexpr int count = 18;
 
     static const Operation Start() { return { Enum::Start }; }
 
+    static const Operation LoadImages() { return { Enum::LoadImages }; }
+
     static const Operation UndistortImages() { return { Enum::UndistortImages }; }
 
+    static const Operation ScaleImages() { return { Enum::ScaleImages }; }
+
     static const Operation FindFeatures() { return { Enum::FindFeatures }; }
 
     static const Operation MatchFeatures() { return { Enum::MatchFeatures }; }
@@ -64,26 +81,38 @@ public:
         return { Enum::EstimateCameraParameters };
     }
 
+    static const Operation ComposePreview() { return {Enum::ComposePreview}; }
+
     static const Operation AdjustCameraParameters()
     {
         return {Enum::AdjustCameraParameters};
     }
 
+    static const Operation WarpImages() { return {Enum::WarpImages}; }
+
     static const Operation PrepareExposureCompensation()
     {
         return {Enum::PrepareExposureCompensation};
     }
 
+    static const Operation ShouldRotate() { return {Enum::ShouldRotate}; }
+
     static const Operation FindSeams() { return {Enum::FindSeams}; }
 
     static const Operation Compose() { return {Enum::Compose}; }
 
+    static const Operation CropPanorama() { return {Enum::CropPanorama}; }
+
+    static const Operation WritePanorama() { return {Enum::WritePanorama}; }
+
+    static const Operation WriteCubemap() { return {Enum::WriteCubemap}; }
+
     static const Operation Complete() { return {Enum::Complete}; }
 
     const Operation previous() const
     {
         int value = toInt();
-        value = value >= 0 ? value - 1 : count;
+        value = value > 0 ? value - 1 : count - 1;
         return {static_cast<Operation::Enum>(value)};
     }
 
@@ -97,22 +126,38 @@ public:
         switch (_value) {
         case Enum::Start:
             return "Start";
+        case Enum::LoadImages:
+            return "LoadImages";
         case Enum::UndistortImages:
             return "UndistortImages";
+        case Enum::ScaleImages:
+            return "ScaleImages";
         case Enum::FindFeatures:
             return "FindFeatures";
         case Enum::MatchFeatures:
             return "MatchFeatures";
         case Enum::EstimateCameraParameters:
             return "EstimateCameraParameters";
+        case Enum::ComposePreview:
+            return "ComposePreview";
         case Enum::AdjustCameraParameters:
             return "AdjustCameraParameters";
+        case Enum::WarpImages:
+            return "WarpImages";
         case Enum::PrepareExposureCompensation:
             return "PrepareExposureCompensation";
+        case Enum::ShouldRotate:
+            return "ShouldRotate";
         case Enum::FindSeams:
             return "FindSeams";
         case Enum::Compose:
             return "Compose";
+        case Enum::CropPanorama:
+            return "CropPanorama";
+        case Enum::WritePanorama:
+            return "WritePanorama";
+        case Enum::WriteCubemap:
+            return "WriteCubemap";
         case Enum::Complete:
             return "Complete";
         default:
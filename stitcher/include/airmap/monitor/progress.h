@@ -0,0 +1,161 @@
+#pragma once
+
+#include "airmap/monitor/estimator.h"
+#include "airmap/monitor/resources.h"
+#include "airmap/monitor/timer.h"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+/**
+ * @brief ProgressRecord
+ * The state of a stitch, as written to a progress channel.  Serialized as
+ * a single line of JSON, with times in milliseconds:
+ *
+ *   {"operation":"FindSeams","operation_progress":0.5,"progress":62.5,
+ *    "estimate_ms":12345,"elapsed_ms":6789,"rss_mb":1234,
+ *    "output":"preview.jpg","output_elapsed_ms":3000,
+ *    "stages":{"Start":{"elapsed_ms":1,"peak_rss_mb":100,
+ *                       "peak_allocated_mb":10},...}}
+ */
+struct ProgressRecord
+{
+    /**
+     * @brief Stage
+     * A finished operation of the stitch.
+     */
+    struct Stage
+    {
+        ElapsedTime elapsed;
+        //! Peak resident memory during the operation.
+        size_t peakRssMB = 0;
+        //! Most MB of OpenCV matrices allocated at once during the
+        //! operation, 0 if not tracked.
+        size_t peakAllocatedMB = 0;
+    };
+
+    //! The current operation.
+    std::string operation;
+    //! Progress of the current operation, between 0 and 1.
+    double operationProgress = 0.;
+    //! Progress of the stitch, as given by Estimator::currentProgress.
+    double progress = 0.;
+    //! Estimated time remaining.
+    ElapsedTime estimate;
+    //! Elapsed time of the stitch.
+    ElapsedTime elapsed;
+    //! Resident memory of the stitcher.
+    size_t rssMB = 0;
+    //! The latest output written, if any.
+    std::string output;
+    //! Elapsed time of the stitch when the latest output was written.
+    ElapsedTime outputElapsed;
+    //! The finished operations, by name.
+    std::map<std::string, Stage> stages;
+
+    /**
+     * @brief parse
+     * Parse a record from its line.
+     * @throws std::invalid_argument If the line is not a record.
+     */
+    static ProgressRecord parse(const std::string &line);
+
+    /**
+     * @brief str
+     * The line of the record, without its newline.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief ProgressWriter
+ * Writes progress records as newline delimited JSON to a file descriptor,
+ * e.g. a pipe to a parent process.  Updates of the progress of an
+ * operation are rate limited, changes of operation and outputs are always
+ * written.
+ */
+class ProgressWriter
+{
+public:
+    using SharedPtr = std::shared_ptr<ProgressWriter>;
+
+    /**
+     * @brief ProgressWriter
+     * @param fd The file descriptor to write to.  It is not closed.
+     * @param maxRate The maximum number of rate limited records per second.
+     */
+    ProgressWriter(int fd, double maxRate = 10.);
+
+    /**
+     * @brief due
+     * Whether a rate limited record would be written now.
+     */
+    bool due() const;
+
+    /**
+     * @brief write
+     * Write a record.
+     * @param record
+     * @param force Whether to write it even if not due.
+     */
+    void write(const ProgressRecord &record, bool force = false);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    const int _fd;
+    const Clock::duration _minInterval;
+    Clock::time_point _lastWritten;
+    mutable std::mutex _mutex;
+};
+
+/**
+ * @brief ProgressParser
+ * Parses the progress records a child stitcher writes to a progress
+ * channel, from chunks of any size read from it.
+ */
+class ProgressParser
+{
+public:
+    using RecordCb = std::function<void(const ProgressRecord &)>;
+
+    /**
+     * @brief ProgressParser
+     * @param recordCb Called with each record parsed.
+     */
+    explicit ProgressParser(RecordCb recordCb);
+
+    /**
+     * @brief apply
+     * Set the estimate, progress and output of an estimator, e.g. of the
+     * stitcher wrapping the child process, from a record.
+     * @param record
+     * @param estimator
+     */
+    static void apply(const ProgressRecord &record, Estimator &estimator);
+
+    /**
+     * @brief feed
+     * Parse the records completed by a chunk read from the channel.
+     * @param data
+     * @param size
+     * @throws std::invalid_argument If a line is not a record.
+     */
+    void feed(const char *data, size_t size);
+
+private:
+    RecordCb _recordCb;
+    std::string _buffer;
+};
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "airmap/monitor/operation.h"
+#include "airmap/monitor/timer.h"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+/**
+ * @brief residentMemoryMB
+ * Returns the resident memory of the process, 0 if unknown.
+ */
+size_t residentMemoryMB();
+
+/**
+ * @brief processUptime
+ * Returns the time since the process started, to the 10 milliseconds, 0 if
+ * unknown.  Unlike a timer started in main, it includes loading the
+ * process and its libraries.
+ */
+ElapsedTime processUptime();
+
+/**
+ * @brief ResourceUsage
+ * The resources used by the process so far.
+ */
+struct ResourceUsage
+{
+    //! CPU time of all the threads of the process, in user and kernel mode.
+    ElapsedTime userCpu;
+    ElapsedTime systemCpu;
+    //! Resident memory.
+    size_t rssMB = 0;
+    //! Peak resident memory since the process started, or since resetPeak.
+    size_t peakRssMB = 0;
+
+    /**
+     * @brief now
+     * Sample the resources used by the process.
+     */
+    static ResourceUsage now();
+
+    /**
+     * @brief resetPeak
+     * Reset the peak resident memory of the process to its resident
+     * memory, so that the next sample has the peak from now on.
+     * @return Whether the peak was reset, which needs Linux 4.0.
+     */
+    static bool resetPeak();
+};
+
+/**
+ * @brief OperationResources
+ * The resources an operation used, and the work it did.
+ */
+struct OperationResources
+{
+    //! Work counters of the operations that do such work.
+    static constexpr const char *Features = "features";
+    static constexpr const char *MatchedPairs = "matched_pairs";
+    static constexpr const char *WarpedPixels = "warped_pixels";
+    static constexpr const char *GraphVertices = "graph_vertices";
+
+    ElapsedTime wall;
+    ElapsedTime userCpu;
+    ElapsedTime systemCpu;
+    //! Peak resident memory during the operation.
+    size_t peakRssMB = 0;
+    //! Resident memory at the end of the operation less at its start.
+    int64_t deltaRssMB = 0;
+    //! OpenCV matrices allocated during the operation, see
+    //! AllocationTracker: how many, their MB in all, the most MB of all
+    //! matrices allocated at once, and the MB of its own still allocated
+    //! once it finished.
+    uint64_t allocations = 0;
+    size_t allocatedMB = 0;
+    size_t peakAllocatedMB = 0;
+    size_t liveAllocatedMB = 0;
+    //! Work done, by counter.
+    std::map<std::string, uint64_t> work;
+
+    /**
+     * @brief cpuUtilization
+     * CPU time per wall time, the number of cores kept busy on average.
+     * Far below the number of threads, the operation was starved or
+     * waiting, e.g. on swap.
+     */
+    double cpuUtilization() const;
+
+    /**
+     * @brief str
+     * The resources, as logged.
+     */
+    std::string str() const;
+};
+
+using OperationResourcesMap = std::map<Operation::Enum, OperationResources>;
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
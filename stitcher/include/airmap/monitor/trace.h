@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+/**
+ * @brief Tracer
+ * Writes a trace of a stitch as Chrome trace events, a JSON array which
+ * chrome://tracing and https://ui.perfetto.dev open: a span per operation,
+ * nested spans of its steps, on the threads they ran on, and counters of
+ * the resident memory.  Safe to use from several threads.
+ */
+class Tracer
+{
+public:
+    using SharedPtr = std::shared_ptr<Tracer>;
+
+    /**
+     * @brief Span
+     * Traces a span from its construction to its destruction.  Does
+     * nothing, besides a branch, without a tracer.
+     */
+    class Span
+    {
+    public:
+        /**
+         * @brief Span
+         * @param tracer The tracer, nullptr if tracing is disabled.
+         * @param name Name of the span, which must outlive it.
+         * @param category Category of the span, which must outlive it.
+         * @param index Index of what the span processes, e.g. of an image,
+         * -1 if none.
+         */
+        Span(Tracer *tracer, const char *name, const char *category,
+             int64_t index = -1)
+            : _tracer(tracer)
+            , _name(name)
+            , _category(category)
+        {
+            if (_tracer) {
+                _tracer->begin(_name, _category, index);
+            }
+        }
+
+        Span(Span &&other)
+            : _tracer(other._tracer)
+            , _name(other._name)
+            , _category(other._category)
+        {
+            other._tracer = nullptr;
+        }
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+        Span &operator=(Span &&) = delete;
+
+        ~Span()
+        {
+            if (_tracer) {
+                _tracer->end(_name, _category);
+            }
+        }
+
+    private:
+        Tracer *_tracer;
+        const char *_name;
+        const char *_category;
+    };
+
+    /**
+     * @brief Tracer
+     * @param path Path of the trace to write.
+     * @throws std::invalid_argument If the trace can't be written.
+     */
+    explicit Tracer(const std::string &path);
+
+    /**
+     * @brief ~Tracer
+     * Closes the trace.
+     */
+    ~Tracer();
+
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+    /**
+     * @brief begin
+     * Begin a span on the calling thread.
+     * @param index Index of what the span processes, -1 if none.
+     */
+    void begin(const std::string &name, const std::string &category,
+               int64_t index = -1);
+
+    /**
+     * @brief counter
+     * Trace the value of a counter.
+     */
+    void counter(const std::string &name, double value);
+
+    /**
+     * @brief end
+     * End the latest span begun on the calling thread.
+     */
+    void end(const std::string &name, const std::string &category);
+
+    /**
+     * @brief span
+     * Trace a span if tracer isn't nullptr.
+     */
+    static Span span(const SharedPtr &tracer, const char *name,
+                     const char *category, int64_t index = -1)
+    {
+        return { tracer.get(), name, category, index };
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    const Clock::time_point _start;
+    const int _pid;
+    std::ofstream _trace;
+    bool _empty;
+    std::mutex _mutex;
+
+    /**
+     * @brief write
+     * Write an event, without its time, process and thread.
+     */
+    void write(const std::string &event);
+};
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <opencv2/stitching/detail/motion_estimators.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+/**
+ * @brief SparseBundleAdjusterRay
+ * Minimizes the same ray distance error as cv::detail::BundleAdjusterRay,
+ * over the focal length and rotation of each camera, but exploits the
+ * structure of the problem: the error of a match only depends on the
+ * parameters of the two cameras of its pair.
+ *
+ * BundleAdjusterRay differentiates every error with respect to every camera
+ * parameter and solves the dense normal equations, so an iteration costs
+ * O(matches * cameras + cameras^3).  This adjuster differentiates each pair
+ * only with respect to its two cameras, in parallel over the pairs, and
+ * keeps the normal equations as 4x4 blocks per camera and per pair.  They
+ * are solved with a Cholesky factorization restricted to the envelope of
+ * the matrix, after ordering the cameras to keep neighbours close, which
+ * for the strips and grids of a survey stays narrow as cameras are added.
+ *
+ * The errors of the matches are weighted with a Huber loss, so that the
+ * few outliers left by RANSAC do not dominate the solution.
+ *
+ * Only the focal length entry (0, 0) of the refinement mask is used, as the
+ * ray error does not depend on the principal point or aspect ratio.
+ *
+ * Besides the term criteria, the estimation can be stopped by a time budget
+ * or once an iteration improves the error by too little, and reports each
+ * iteration through a callback.
+ */
+class SparseBundleAdjusterRay : public cv::detail::BundleAdjusterBase {
+public:
+    /**
+     * @brief IterationCb
+     * Called after each iteration with its number, starting from 1, and the
+     * root mean square error of the matches.
+     */
+    using IterationCb = std::function<void(int iteration, double rms_error)>;
+
+    SparseBundleAdjusterRay();
+
+    /**
+     * @brief huberThreshold
+     * Error of a match, in pixels, above which the loss grows linearly.
+     */
+    double huberThreshold() const { return huber_threshold_; }
+
+    /**
+     * @brief setHuberThreshold
+     * @param threshold A threshold <= 0 disables the robust loss.
+     */
+    void setHuberThreshold(double threshold) { huber_threshold_ = threshold; }
+
+    /**
+     * @brief minRelativeImprovement
+     * Relative decrease of the cost below which an iteration ends the
+     * estimation.
+     */
+    double minRelativeImprovement() const
+    {
+        return min_relative_improvement_;
+    }
+
+    /**
+     * @brief setMinRelativeImprovement
+     * @param threshold A threshold <= 0 leaves convergence to the term
+     * criteria.
+     */
+    void setMinRelativeImprovement(double threshold)
+    {
+        min_relative_improvement_ = threshold;
+    }
+
+    /**
+     * @brief timeBudget
+     * Time, in seconds, after which no further iteration is started.
+     */
+    double timeBudget() const { return time_budget_; }
+
+    /**
+     * @brief setTimeBudget
+     * @param seconds A budget <= 0 does not limit the estimation time.
+     */
+    void setTimeBudget(double seconds) { time_budget_ = seconds; }
+
+    /**
+     * @brief setIterationCallback
+     * @param callback
+     */
+    void setIterationCallback(IterationCb callback)
+    {
+        iteration_cb_ = std::move(callback);
+    }
+
+    /**
+     * @brief exceededTimeBudget
+     * Whether the last estimation was stopped by the time budget.
+     */
+    bool exceededTimeBudget() const { return exceeded_time_budget_; }
+
+    /**
+     * @brief iterations
+     * Number of iterations performed by the last estimation.
+     */
+    int iterations() const { return iterations_; }
+
+    /**
+     * @brief rmsError
+     * Root mean square error of the matches after the last estimation, as
+     * logged by BundleAdjusterRay.
+     */
+    double rmsError() const { return rms_error_; }
+
+    /**
+     * @brief progress
+     * How far the estimation is towards stopping, from 0 to 1, as of the
+     * last iteration: the largest of the fractions of the iteration limit
+     * and of the time budget used, and of how far the relative improvement
+     * of the cost has decreased, on a log scale, from that of the first
+     * iteration to the threshold that ends the estimation.  1 once the
+     * estimation stops, which the iteration callback can read.
+     */
+    double progress() const { return progress_; }
+
+protected:
+    bool estimate(const std::vector<cv::detail::ImageFeatures> &features,
+                  const std::vector<cv::detail::MatchesInfo> &pairwise_matches,
+                  std::vector<cv::detail::CameraParams> &cameras) override;
+
+    void setUpInitialCameraParams(
+        const std::vector<cv::detail::CameraParams> &cameras) override;
+    void obtainRefinedCameraParams(
+        std::vector<cv::detail::CameraParams> &cameras) const override;
+    void calcError(cv::Mat &err) override;
+    void calcJacobian(cv::Mat &jac) override;
+
+private:
+    struct NormalEquations;
+
+    void setUpEdges(const std::vector<cv::detail::MatchesInfo> &pairwise_matches);
+    void edgeErrors(size_t edge, const cv::Mat &params,
+                    std::vector<double> &errors) const;
+    void edgeJacobian(size_t edge, const cv::Mat &params,
+                      std::vector<double> &errors,
+                      std::vector<double> &jacobian) const;
+    double evaluate(const cv::Mat &params, NormalEquations *equations,
+                    double &squared_error) const;
+    double loss(double squared_error, double &weight) const;
+
+    double huber_threshold_;
+    double min_relative_improvement_;
+    double time_budget_;
+    IterationCb iteration_cb_;
+    int iterations_;
+    double rms_error_;
+    double progress_;
+    bool exceeded_time_budget_;
+    //! Index of the first match of each edge, and the match count at the end.
+    std::vector<int> edge_offsets_;
+};
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "airmap/camera.h"
+#include "airmap/gimbal.h"
+
+#include <opencv2/stitching/detail/motion_estimators.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+/**
+ * @brief GimbalBasedEstimator
+ * Estimates camera parameters from the metadata of the images instead of
+ * from the pairwise homographies: rotations from the gimbal orientation of
+ * each image, and focal length and principal point from the intrinsics of
+ * the camera, scaled to the size the features were found at.
+ *
+ * These are usually closer to the solution than HomographyBasedEstimator's,
+ * so bundle adjustment only has to refine them.
+ */
+class GimbalBasedEstimator : public cv::detail::Estimator {
+public:
+    /**
+     * @brief GimbalBasedEstimator
+     * @param camera
+     * @param gimbal_orientations One per image, in the order of the features.
+     */
+    GimbalBasedEstimator(std::shared_ptr<Camera> camera,
+                         std::vector<GimbalOrientation> gimbal_orientations);
+
+    /**
+     * @brief available
+     * Whether the camera intrinsics and the orientation of every image are
+     * known, so that the estimator can be used.
+     * @param camera
+     * @param gimbal_orientations
+     */
+    static bool
+    available(const std::shared_ptr<Camera> &camera,
+              const std::vector<GimbalOrientation> &gimbal_orientations);
+
+private:
+    bool estimate(const std::vector<cv::detail::ImageFeatures> &features,
+                  const std::vector<cv::detail::MatchesInfo> &pairwise_matches,
+                  std::vector<cv::detail::CameraParams> &cameras) override;
+
+    std::shared_ptr<Camera> _camera;
+    std::vector<GimbalOrientation> _gimbal_orientations;
+};
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
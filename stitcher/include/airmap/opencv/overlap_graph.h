@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+/**
+ * @brief OverlapGraph
+ * Index of which warped images overlap, built once after warping, so that
+ * the graph cut seam finder visits only the pairs in it instead of
+ * intersecting every pair of image rectangles again.
+ *
+ * Pairs whose overlap has fewer pixels than a threshold are left out of the
+ * graph, so that the seam finder skips them.
+ */
+class OverlapGraph {
+public:
+    /**
+     * @brief Pair
+     * Two overlapping images, first < second.
+     */
+    struct Pair {
+        size_t first;
+        size_t second;
+        //! Intersection of the image rectangles, in panorama coordinates.
+        cv::Rect roi;
+        /*!
+            * Number of pixels within both warped masks, or the area of roi
+            * when the graph was built without masks or without a threshold.
+            */
+        int overlap_pixels;
+    };
+
+    /**
+     * @brief OverlapGraph
+     * An empty graph, with no images.
+     */
+    OverlapGraph() = default;
+
+    /**
+     * @brief OverlapGraph
+     * Build the graph of the images positioned at corners.
+     * @param corners Top left corners of the warped images.
+     * @param sizes Sizes of the warped images.
+     * @param masks Optional warped masks, used to count overlap pixels.
+     * @param min_overlap_pixels Pairs with fewer overlapping pixels are left
+     * out of the graph.
+     */
+    OverlapGraph(const std::vector<cv::Point> &corners,
+                 const std::vector<cv::Size> &sizes,
+                 const std::vector<cv::UMat> &masks = {},
+                 int min_overlap_pixels = 0);
+
+    /**
+     * @brief empty
+     * Whether the graph was built for no images.
+     */
+    bool empty() const { return _corners.empty(); }
+
+    /**
+     * @brief imageCount
+     * Number of images the graph was built for.
+     */
+    size_t imageCount() const { return _corners.size(); }
+
+    /**
+     * @brief neighbours
+     * Indices of the pairs that image i is part of, in ascending order.
+     * @param i
+     */
+    const std::vector<size_t> &neighbours(size_t i) const
+    {
+        return _adjacency[i];
+    }
+
+    /**
+     * @brief pairs
+     * Overlapping pairs, sorted by first then second image, which is the
+     * order PairwiseSeamFinder visits them in.
+     */
+    const std::vector<Pair> &pairs() const { return _pairs; }
+
+    /**
+     * @brief resultRoi
+     * Bounding rectangle of all images, as cv::detail::resultRoi.
+     */
+    cv::Rect resultRoi() const { return _result_roi; }
+
+    /**
+     * @brief skippedPairs
+     * Number of overlapping pairs left out for being below the threshold.
+     */
+    size_t skippedPairs() const { return _skipped_pairs; }
+
+    /**
+     * @brief matches
+     * Whether the graph was built for the given corners and sizes, and so
+     * can be used in place of computing their overlaps.
+     * @param corners
+     * @param sizes
+     */
+    bool matches(const std::vector<cv::Point> &corners,
+                 const std::vector<cv::Size> &sizes) const;
+
+private:
+    std::vector<cv::Point> _corners;
+    std::vector<cv::Size> _sizes;
+    std::vector<Pair> _pairs;
+    std::vector<std::vector<size_t>> _adjacency;
+    cv::Rect _result_roi;
+    size_t _skipped_pairs = 0;
+};
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
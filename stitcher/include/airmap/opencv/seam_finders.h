@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "airmap/monitor/monitor.h"
+#include "airmap/opencv/overlap_graph.h"
 #include <opencv2/stitching/detail/seam_finders.hpp>
 
 using airmap::stitcher::monitor::Monitor;
@@ -12,12 +13,24 @@ namespace stitcher {
 namespace opencv {
 namespace detail {
 
+/**
+ * @brief MaxFlowType
+ * The max-flow/min-cut solver used to cut each pair of images.
+ * Generic uses OpenCV's GCGraph, Grid uses GridGraph, which produces the
+ * same cut but is specialised for the seam finder's grid graphs.
+ */
+enum class MaxFlowType {
+    Generic,
+    Grid
+};
+
 class MonitoredGraphCutSeamFinder : public cv::detail::GraphCutSeamFinder {
 public:
     MonitoredGraphCutSeamFinder(
         Monitor::SharedPtr monitor,
         int cost_type = cv::detail::GraphCutSeamFinder::COST_COLOR_GRAD,
-        float terminal_cost = 10000.0f, float bad_region_penalty = 1000.0f);
+        float terminal_cost = 10000.0f, float bad_region_penalty = 1000.0f,
+        MaxFlowType max_flow_type = MaxFlowType::Generic);
 
     ~MonitoredGraphCutSeamFinder();
 
@@ -25,9 +38,19 @@ public:
               const std::vector<cv::Point> &corners,
               std::vector<cv::UMat> &masks) override;
 
+    /**
+     * @brief setOverlapGraph
+     * Use the given overlap graph to enumerate the pairs of images to cut,
+     * rather than intersecting every pair.  Pairs left out of the graph
+     * are not cut.  Ignored if the graph was built for other corners or
+     * sizes than those given to find().
+     * @param overlaps
+     */
+    void setOverlapGraph(const OverlapGraph &overlaps);
+
 private:
     class Impl; // avoid GCGraph dependency in header
-    cv::Ptr<cv::detail::PairwiseSeamFinder> _impl;
+    cv::Ptr<Impl> _impl;
 };
 
 } // namespace detail
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <vector>
+
+#include "airmap/opencv/grid_graph.h"
+#include <opencv2/core.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+/**
+ * @brief SeamGraphWorkspace
+ * Scratch buffers for building the graph of a pair of images, reused from
+ * pair to pair so that once the buffers have grown to the largest overlap,
+ * cutting a pair does not allocate.
+ */
+class SeamGraphWorkspace {
+public:
+    enum Buffer {
+        Image1,
+        Image2,
+        Mask1,
+        Mask2,
+        Dx1,
+        Dx2,
+        Dy1,
+        Dy2,
+        Cost,
+        Valid,
+        Horizontal,
+        Vertical,
+        BufferCount
+    };
+
+    /**
+     * @brief get
+     * Returns a continuous matrix backed by the given buffer, growing the
+     * buffer if needed.  The contents are undefined, and the matrix is only
+     * valid until the same buffer is requested again.
+     * @param buffer
+     * @param size
+     * @param type
+     */
+    cv::Mat get(Buffer buffer, cv::Size size, int type);
+
+    /**
+     * @brief zeros
+     * As get(), with the contents set to zero.
+     * @param buffer
+     * @param size
+     * @param type
+     */
+    cv::Mat zeros(Buffer buffer, cv::Size size, int type);
+
+private:
+    std::vector<uchar> _buffers[BufferCount];
+};
+
+/**
+ * @brief extractSubimage
+ * Copy the part of src that falls within roi, expanded by gap on each side,
+ * into dst.  src is positioned at tl, roi is in the same coordinates.
+ * Pixels of dst outside of src are left untouched, dst is expected to be
+ * zero-initialised.
+ * @param src
+ * @param tl
+ * @param roi
+ * @param gap
+ * @param dst Of size roi expanded by gap and of the same type as src.
+ */
+void extractSubimage(const cv::Mat &src, cv::Point tl, cv::Rect roi, int gap,
+                     cv::Mat &dst);
+
+/**
+ * @brief seamGraphGradients
+ * Compute the squared magnitudes of the horizontal and vertical Sobel
+ * derivatives of img within roi, in a single pass over the image.
+ * Equivalent to running Sobel over the whole image and summing the squares
+ * of the channels, but only for the pixels in roi.
+ * @param img CV_32FC3.
+ * @param roi Part of img to compute the gradients for.
+ * @param dx Output, CV_32F of the size of roi.
+ * @param dy Output, CV_32F of the size of roi.
+ */
+void seamGraphGradients(const cv::Mat &img, cv::Rect roi, cv::Mat &dx,
+                        cv::Mat &dy);
+
+/**
+ * @brief seamGraphWeightsColor
+ * Compute the weights of the edges of the graph of a pair of subimages
+ * using the color cost.  Equivalent to GraphCutSeamFinder::COST_COLOR.
+ * @param img1 CV_32FC3.
+ * @param img2 CV_32FC3.
+ * @param mask1
+ * @param mask2
+ * @param bad_region_penalty
+ * @param workspace
+ * @param horizontal Output, the weights of the edges from each vertex to
+ * its right neighbour.
+ * @param vertical Output, the weights of the edges from each vertex to its
+ * lower neighbour.
+ */
+void seamGraphWeightsColor(const cv::Mat &img1, const cv::Mat &img2,
+                           const cv::Mat &mask1, const cv::Mat &mask2,
+                           float bad_region_penalty,
+                           SeamGraphWorkspace &workspace, cv::Mat &horizontal,
+                           cv::Mat &vertical);
+
+/**
+ * @brief seamGraphWeightsColorGrad
+ * Compute the weights of the edges of the graph of a pair of subimages
+ * using the color and gradient cost.  Equivalent to
+ * GraphCutSeamFinder::COST_COLOR_GRAD.
+ * @param img1 CV_32FC3.
+ * @param img2 CV_32FC3.
+ * @param dx1 Squared horizontal gradient magnitudes of img1.
+ * @param dx2 Squared horizontal gradient magnitudes of img2.
+ * @param dy1 Squared vertical gradient magnitudes of img1.
+ * @param dy2 Squared vertical gradient magnitudes of img2.
+ * @param mask1
+ * @param mask2
+ * @param bad_region_penalty
+ * @param workspace
+ * @param horizontal Output, the weights of the edges from each vertex to
+ * its right neighbour.
+ * @param vertical Output, the weights of the edges from each vertex to its
+ * lower neighbour.
+ */
+void seamGraphWeightsColorGrad(const cv::Mat &img1, const cv::Mat &img2,
+                               const cv::Mat &dx1, const cv::Mat &dx2,
+                               const cv::Mat &dy1, const cv::Mat &dy2,
+                               const cv::Mat &mask1, const cv::Mat &mask2,
+                               float bad_region_penalty,
+                               SeamGraphWorkspace &workspace,
+                               cv::Mat &horizontal, cv::Mat &vertical);
+
+/**
+ * @brief buildSeamGraph
+ * Add the vertices, terminal weights and edges of the graph of a pair of
+ * subimages to graph, in the same order as GraphCutSeamFinder.
+ * @param mask1
+ * @param mask2
+ * @param terminal_cost
+ * @param horizontal As computed by seamGraphWeights*.
+ * @param vertical As computed by seamGraphWeights*.
+ * @param graph A GCGraph, or any graph with the same interface.
+ */
+template <class Graph>
+void buildSeamGraph(const cv::Mat &mask1, const cv::Mat &mask2,
+                    float terminal_cost, const cv::Mat &horizontal,
+                    const cv::Mat &vertical, Graph &graph)
+{
+    const cv::Size img_size = mask1.size();
+
+    for (int y = 0; y < img_size.height; ++y) {
+        const uchar *mask1_row = mask1.ptr<uchar>(y);
+        const uchar *mask2_row = mask2.ptr<uchar>(y);
+        for (int x = 0; x < img_size.width; ++x) {
+            int v = graph.addVtx();
+            graph.addTermWeights(v, mask1_row[x] ? terminal_cost : 0.f,
+                                 mask2_row[x] ? terminal_cost : 0.f);
+        }
+    }
+
+    for (int y = 0; y < img_size.height; ++y) {
+        const float *horizontal_row = horizontal.ptr<float>(y);
+        const float *vertical_row =
+            y < img_size.height - 1 ? vertical.ptr<float>(y) : nullptr;
+        for (int x = 0; x < img_size.width; ++x) {
+            int v = y * img_size.width + x;
+            if (x < img_size.width - 1) {
+                graph.addEdges(v, v + 1, horizontal_row[x], horizontal_row[x]);
+            }
+            if (vertical_row) {
+                graph.addEdges(v, v + img_size.width, vertical_row[x],
+                               vertical_row[x]);
+            }
+        }
+    }
+}
+
+/**
+ * @brief buildSeamGraph
+ * As above, adding the edges a row at a time.
+ */
+void buildSeamGraph(const cv::Mat &mask1, const cv::Mat &mask2,
+                    float terminal_cost, const cv::Mat &horizontal,
+                    const cv::Mat &vertical, GridGraph &graph);
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
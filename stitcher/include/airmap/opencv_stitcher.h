@@ -6,10 +6,15 @@
 #include "airmap/gimbal.h"
 #include "airmap/images.h"
 #include "airmap/logging.h"
+#include "airmap/memory_planner.h"
 #include "airmap/monitor/estimator.h"
+#include "airmap/opencv/bundle_adjusters.h"
+#include "airmap/opencv/estimators.h"
 #include "airmap/opencv/forward.h"
 #include "airmap/opencv/matchers.h"
+#include "airmap/opencv/overlap_graph.h"
 #include "airmap/opencv/seam_finders.h"
+#include "airmap/recipe.h"
 #include "airmap/stitcher.h"
 #include "airmap/stitcher_configuration.h"
 
@@ -36,6 +41,7 @@
 using boost::filesystem::path;
 
 using airmap::stitcher::opencv::detail::MonitoredGraphCutSeamFinder;
+using airmap::stitcher::opencv::detail::OverlapGraph;
 using airmap::stitcher::opencv::detail::ThreeSixtyPanoramaOrientationMatcher;
 
 namespace airmap {
@@ -57,8 +63,11 @@ public:
 
     Report stitch() override;
     void cancel() override;
-    void postprocess(cv::Mat&& result);
+    void postprocess(cv::Mat&& result, bool preview = false);
+    void postprocess(cv::Mat&& result, const std::string &outputPath,
+                     bool preview = false);
     void setFallbackMode() override;
+    void setMemoryBudgetExceeded(const MemoryBudgetExceededError &error) override;
     void setUseOpenCL(bool enabled = true);
 
 protected:
@@ -68,6 +77,26 @@ protected:
     Panorama _panorama;
     Panorama::Parameters _parameters;
     std::string _outputPath;
+
+    /**
+     * @brief _memoryBudgetFraction
+     * The fraction of the memory budget, above the baseline of the
+     * process, planned for: less than 1 once a stitch exceeded it.
+     */
+    double _memoryBudgetFraction;
+
+    /**
+     * @brief plannedParameters
+     * The parameters, with the memory budget planned for.
+     */
+    Panorama::Parameters plannedParameters() const;
+
+    /**
+     * @brief trackAllocations
+     * Bind the monitor's allocation tracker to the stitching thread, with
+     * the memory budget, if enforced, less the baseline of the process.
+     */
+    monitor::AllocationTracker::Binding trackAllocations();
 };
 
 /**
@@ -100,6 +129,12 @@ public:
         std::vector<cv::Size> sizes;
         //! Masks used for warping images.
         std::vector<cv::UMat> masks;
+        /*!
+            * Which of the warped images overlap, shared by the stages that
+            * work on pairs of images.  Built after warping, and rebuilt
+            * when corners and sizes are updated for composition.
+            */
+        OverlapGraph overlaps;
 
         /**
          * @brief WarpResults
@@ -117,6 +152,18 @@ public:
         }
     };
 
+    /**
+     * @brief RenderTarget
+     * A panorama to render from a stitch recipe.
+     */
+    struct RenderTarget
+    {
+        //! Megapixels the images are scaled to for composition, -1 for full size.
+        double compose_megapix;
+        //! Path to write the panorama to.
+        std::string output_path;
+    };
+
     /**
      * @brief Stitcher
      * Create an instance of the stitcher with the given configuration.
@@ -132,12 +179,91 @@ public:
     Report stitch() override;
     void cancel() override;
 
+    /**
+     * @brief setPreview
+     * Write a low resolution preview of the panorama to the output path as
+     * soon as the cameras are estimated, with Voronoi seams and without
+     * blending, before stitching it at full quality and overwriting it.
+     * @param enabled
+     */
+    void setPreview(bool enabled = true);
+
+    /**
+     * @brief setRecipe
+     * Stitch from a recipe made from an earlier panorama of the same capture
+     * pattern, instead of finding, matching and adjusting features.  The
+     * images are stitched from scratch if the recipe doesn't fit them.
+     * @param recipe
+     */
+    void setRecipe(const StitchRecipe &recipe);
+
+    /**
+     * @brief setRecipeOutputPath
+     * Write the recipe of each successful stitch to the given path.
+     * @param path
+     */
+    void setRecipeOutputPath(const std::string &path);
+
+    /**
+     * @brief render
+     * Compose and postprocess panoramas of the images a recipe was made
+     * from, at several resolutions, skipping every other stage.  The
+     * images are composed once, at the largest resolution, and the smaller
+     * panoramas are scaled down from it.  Memory is planned for the largest
+     * resolution, which caps every target.
+     * @param recipe The recipe of an earlier stitch of the same images.
+     * @param targets
+     * @throws std::invalid_argument If the recipe is not for these images.
+     */
+    Report render(const StitchRecipe &recipe,
+                  const std::vector<RenderTarget> &targets);
+
 protected:
+    /**
+     * @brief Degradation
+     * Cheaper settings the remaining stages of a stitch can be stepped down
+     * to, in the order of the stages they apply to.
+     */
+    enum class Degradation { SeamMegapix, SeamFinder, BlendBands, ComposeMegapix };
+
     /**
      * @brief _config
-     * The stitcher configuration.
+     * The stitcher configuration, stepped down to cheaper settings while a
+     * stitch is projected to miss its deadline.
+     */
+    Configuration _config;
+
+    /**
+     * @brief _fullQualityConfig
+     * The stitcher configuration before any step down, restored at the
+     * start of each stitch.
+     */
+    const Configuration _fullQualityConfig;
+
+    /**
+     * @brief _memoryPlan
+     * The scales planned for the memory budget of the stitch, which caps
+     * the compose scale.
      */
-    const Configuration _config;
+    MemoryPlan _memoryPlan;
+
+    /**
+     * @brief _preview
+     * Whether to write a preview before the full quality panorama.
+     */
+    bool _preview;
+
+    /**
+     * @brief _recipe
+     * The recipe to stitch from, if not empty.
+     */
+    StitchRecipe _recipe;
+
+    /**
+     * @brief _recipeOutputPath
+     * Where to write the recipe of a successful stitch, if not empty.
+     */
+    std::string _recipeOutputPath;
 
     /**
      * @brief stitch
@@ -152,10 +278,41 @@ protected:
      * @param features
      * @param matches
      * @param cameras
+     * @param report Receives the iterations and final error, if the bundle
+     * adjuster reports them.
      */
     void adjustCameraParameters(std::vector<cv::detail::ImageFeatures> &features,
                                 std::vector<cv::detail::MatchesInfo> &matches,
-                                std::vector<cv::detail::CameraParams> &cameras);
+                                std::vector<cv::detail::CameraParams> &cameras,
+                                Stitcher::Report &report);
+
+    /**
+     * @brief alignPreview
+     * Refine the estimated camera parameters with at most
+     * _config.preview_bundle_adjustment_iterations of bundle adjustment,
+     * enough for a preview and for adjustCameraParameters to carry on from.
+     * Keeps the estimated camera parameters if bundle adjustment fails.
+     * @param features
+     * @param matches
+     * @param cameras
+     */
+    void alignPreview(std::vector<cv::detail::ImageFeatures> &features,
+                      std::vector<cv::detail::MatchesInfo> &matches,
+                      std::vector<cv::detail::CameraParams> &cameras);
+
+    /**
+     * @brief camerasFromRecipe
+     * Align the recipe's cameras to the source images with their gimbal
+     * orientations, and verify and refine them with a few matches between
+     * the images that overlap in the recipe.
+     * @param source_images Source images, scaled to work scale.
+     * @param keep_indices Receives the indices of the images to keep.
+     * @param cameras Receives the camera parameters of the kept images.
+     * @return Whether the recipe fits the source images.
+     */
+    bool camerasFromRecipe(const SourceImages &source_images,
+                           std::vector<int> &keep_indices,
+                           std::vector<cv::detail::CameraParams> &cameras);
 
     /**
      * @brief compose
@@ -174,6 +331,35 @@ protected:
                  WarpResults &warp_results, double work_scale,
                  double compose_scale, float warped_image_scale, cv::Mat &result);
 
+    /**
+     * @brief composePreview
+     * Compose a low resolution preview of the panorama, of
+     * _config.preview_width, with Voronoi seams and without exposure
+     * compensation or blending.  Scales the source images to the preview's
+     * scale.
+     * @param source_images
+     * @param cameras Camera parameters at work scale.
+     * @param work_scale
+     * @return The preview, to write with writePreview.
+     */
+    cv::Mat composePreview(SourceImages &source_images,
+                           const std::vector<cv::detail::CameraParams> &cameras,
+                           double work_scale);
+
+    /**
+     * @brief degradeForDeadline
+     * If the elapsed time and the estimated time remaining add up to more
+     * than Panorama::Parameters::deadlineSeconds, step the settings of the
+     * given stage and the ones after it down to cheaper ones, each at most
+     * once, and record them in the report.
+     * @param first The first of the remaining degradations.
+     * @param source_images
+     * @param report
+     * @return Whether any setting was stepped down.
+     */
+    bool degradeForDeadline(Degradation first, SourceImages &source_images,
+                            Stitcher::Report &report);
+
     /**
      * @brief debugFeatures
      * Draw features on source images and save the results.
@@ -220,12 +406,14 @@ protected:
      * @brief estimateCameraParameters
      * Takes features of all images, pairwise matches between all images, and
      * estimates rotations between camera frames.
+     * @param source_images
      * @param features
      * @param matches
      * @return
      */
     std::vector<cv::detail::CameraParams>
-    estimateCameraParameters(std::vector<cv::detail::ImageFeatures> &features,
+    estimateCameraParameters(const SourceImages &source_images,
+                             std::vector<cv::detail::ImageFeatures> &features,
                              std::vector<cv::detail::MatchesInfo> &matches);
 
     /**
@@ -243,7 +431,7 @@ protected:
      * @param cameras
      * @return
      */
-    double findMedianFocalLength(std::vector<cv::detail::CameraParams> &cameras);
+    double findMedianFocalLength(const std::vector<cv::detail::CameraParams> &cameras);
 
     /**
      * @brief findSeams
@@ -261,18 +449,32 @@ protected:
 
     /**
      * @brief getComposeScale
-     * Determine compose scale from source image sizes and _config.compose_megapix.
+     * Determine compose scale from source image sizes and _config.compose_megapix,
+     * capped by the compose scale of _memoryPlan.
      * @param source_images
      * @return
      */
     double getComposeScale(SourceImages &source_images);
 
+    /**
+     * @brief getComposeScale
+     * Determine compose scale from source image sizes and compose_megapix.
+     * @param source_images
+     * @param compose_megapix
+     * @return
+     */
+    double getComposeScale(SourceImages &source_images, double compose_megapix);
+
     /**
      * @brief getEstimator
      * Create and return a camera rotation estimator according to configuration..
+     * Falls back to the homography based estimator when the gimbal based
+     * estimator is configured but the metadata it needs is missing.
+     * @param source_images
      * @return
      */
-    cv::Ptr<cv::detail::Estimator> getEstimator();
+    cv::Ptr<cv::detail::Estimator>
+    getEstimator(const SourceImages &source_images);
 
     /**
      * @brief getExposureCompensator
@@ -281,6 +483,16 @@ protected:
      */
     cv::Ptr<cv::detail::ExposureCompensator> getExposureCompensator();
 
+    /**
+     * @brief getExposureCompensator
+     * Create and return an exposure compensator of the given type, set up
+     * according to configuration, e.g. to apply the gains of a recipe.
+     * @param type
+     * @return
+     */
+    cv::Ptr<cv::detail::ExposureCompensator>
+    getExposureCompensator(ExposureCompensatorType type);
+
     /**
      * @brief getFeaturesFinder
      * Create and return a feature finder according to configuration.
@@ -332,6 +544,41 @@ protected:
      */
     double getWorkScale(SourceImages &source_images);
 
+    /**
+     * @brief jobFeatures
+     * The features of the stitch the elapsed times of its operations
+     * depend on, to estimate them from the history of past stitches.
+     * @param source_images
+     * @param input_megapix Megapixels of the images as loaded.
+     * @param work_scale
+     * @param seam_scale
+     * @param compose_scale
+     * @return
+     */
+    monitor::JobFeatures jobFeatures(const SourceImages &source_images,
+                                     double input_megapix, double work_scale,
+                                     double seam_scale, double compose_scale) const;
+
+    /**
+     * @brief memoryPlanner
+     * A memory planner of the effective configuration, the parameters, and
+     * the detected camera's focal length and distortion model.
+     * @param source_images Source images, as loaded.
+     * @return
+     */
+    MemoryPlanner memoryPlanner(const SourceImages &source_images) const;
+
+    /**
+     * @brief memoryPlanner
+     * A memory planner as above, of images composed at compose_megapix
+     * instead of the configuration's.
+     * @param source_images Source images, as loaded.
+     * @param compose_megapix
+     * @return
+     */
+    MemoryPlanner memoryPlanner(const SourceImages &source_images,
+                                double compose_megapix) const;
+
     /**
      * @brief matchFeatures
      * Matches features seen in multiple images and populates pairwise matches.
@@ -416,6 +663,14 @@ protected:
      * @param cameras
      */
     void waveCorrect(std::vector<cv::detail::CameraParams> &cameras);
+
+    /**
+     * @brief writePreview
+     * Postprocess and write a preview composed by composePreview.
+     * @param preview
+     * @param rotate_result Whether to rotate the preview by 180 degrees.
+     */
+    void writePreview(const cv::Mat &preview, bool rotate_result);
 };
 
 } // namespace stitcher
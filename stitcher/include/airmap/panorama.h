@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <list>
 #include <memory>
@@ -162,6 +163,9 @@ struct GeoImage
     double cameraYawDeg;
     time_t createdTimestampSec;
     time_t downloadedTimestampSec;
+    //! Size of the image as reported in EXIF, 0 if unknown.
+    uint32_t widthPixels;
+    uint32_t heightPixels;
     //... grow it as needed
 
     /**
@@ -207,7 +211,8 @@ public:
                 size_t _retries = 6,
                 double _maximumCropRatio = 99. / 100,
                 size_t _maxInputImageSize =
-                        12740198 // empirical (Anafi image cols x rows scaled to 0.8)
+                        12740198, // empirical (Anafi image cols x rows scaled to 0.8)
+                size_t _deadlineSeconds = 0
                 )
             : memoryBudgetMB { _memoryBudgetMB }
             , alsoCreateCubeMap(_alsoCreateCubeMap)
@@ -219,6 +224,7 @@ public:
             , retries(_retries)
             , maxInputImageSize { _maxInputImageSize }
             , maximumCropRatio { _maximumCropRatio }
+            , deadlineSeconds { _deadlineSeconds }
 
         {
         }
@@ -284,6 +290,39 @@ public:
          * imag is returned as if no cropping was performed.
          */
         double maximumCropRatio;
+
+        /**
+         * @brief deadlineSeconds
+         *  How long a stitch may take, in seconds, or 0 for no deadline.
+         * @details
+         *  When the elapsed time and the estimated time remaining add up to
+         *  more than this after a stage, the remaining stages are stepped down
+         *  to cheaper settings.  Enables the monitor and estimator.
+         */
+        size_t deadlineSeconds;
+
+        /**
+         * @brief historyPath
+         *  Path of the history of past stitches, or empty for none.
+         * @details
+         *  The operations of a stitch are estimated from the stitches of
+         *  the history like it, and the stitch is appended to it once
+         *  complete.  Enables the monitor and estimator.
+         */
+        std::string historyPath;
+
+        /**
+         * @brief enforceMemoryBudget
+         *  Whether to refuse OpenCV matrices beyond memoryBudgetMB.
+         * @details
+         *  The matrices of a stitch are kept within memoryBudgetMB, less
+         *  the memory of the process before it loads any image: an
+         *  allocation that would exceed it throws
+         *  Stitcher::MemoryBudgetExceededError, which RetryingStitcher
+         *  retries with less memory planned, rather than the process
+         *  growing until the kernel kills it.
+         */
+        bool enforceMemoryBudget = false;
     };
 
     inline Panorama()
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "airmap/gimbal.h"
+#include "airmap/stitcher_configuration.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/stitching/detail/camera.hpp>
+
+#include <string>
+#include <vector>
+
+namespace airmap {
+namespace stitcher {
+
+/**
+ * @brief StitchRecipe
+ * The solution of a successful stitch: which images were kept, their camera
+ * parameters, the exposure gains and the seams between the images.
+ *
+ * Panoramas captured by repeating the same automated pattern with the same
+ * camera have nearly the same relative rotations between their images, so
+ * they can be stitched from the recipe of an earlier panorama, aligned with
+ * the gimbal orientations of the new images, instead of finding, matching
+ * and adjusting features from scratch.
+ */
+struct StitchRecipe
+{
+    //! Number of input images the recipe was made from.
+    int image_count = 0;
+
+    //! Indices of the input images kept for stitching.
+    std::vector<int> image_indices;
+
+    //! Size of the images the cameras were estimated at.
+    cv::Size work_size;
+
+    //! Scale of the warper at work scale, the median focal length.
+    float warped_image_scale = 1.f;
+
+    //! Whether the composed panorama was rotated by 180 degrees.
+    bool rotate_result = false;
+
+    //! Wave corrected camera parameters of the kept images, at work scale.
+    std::vector<cv::detail::CameraParams> cameras;
+
+    //! Gimbal orientations of the kept images.
+    std::vector<GimbalOrientation> gimbal_orientations;
+
+    /*!
+        * Type of the exposure compensator the gains are of, which is the
+        * one to apply them with, whatever the current configuration's.
+        */
+    ExposureCompensatorType exposure_compensator_type =
+            ExposureCompensatorType::No;
+
+    /*!
+        * Gains of the exposure compensator, as returned by
+        * cv::detail::ExposureCompensator::getMatGains.  Empty if the
+        * images were not compensated.
+        */
+    std::vector<cv::Mat> exposure_gains;
+
+    //! Top left corners of the seam masks, at seam scale.
+    std::vector<cv::Point> corners;
+
+    //! Warped image masks cut along the seams, at seam scale.
+    std::vector<cv::Mat> seam_masks;
+
+    /**
+     * @brief empty
+     * Whether the recipe holds no cameras, and so can't be stitched from.
+     */
+    bool empty() const { return cameras.empty(); }
+
+    /**
+     * @brief load
+     * Read a recipe written by save.
+     * @param path
+     * @throws std::invalid_argument If the file can't be read or is not a
+     * consistent recipe, e.g. its exposure gains are not those of its
+     * exposure compensator.
+     */
+    static StitchRecipe load(const std::string &path);
+
+    /**
+     * @brief save
+     * Write the recipe with cv::FileStorage, compressed if path ends in .gz.
+     * @param path
+     * @throws std::invalid_argument If the file can't be written.
+     */
+    void save(const std::string &path) const;
+
+    /**
+     * @brief alignedCameras
+     * Camera parameters for new images of the kept images' pattern.  Each
+     * camera is rotated by the change of its gimbal orientation since the
+     * recipe, when both are known, and the cameras are then rotated
+     * together back into the frame of the recipe, so that the panorama
+     * lines up with the recipe's seams even if the whole pattern was flown
+     * at a different heading.
+     * @param gimbal_orientations Orientations of the new kept images.
+     * @param work_size Size of the new images at work scale.
+     */
+    std::vector<cv::detail::CameraParams>
+    alignedCameras(const std::vector<GimbalOrientation> &gimbal_orientations,
+                   const cv::Size &work_size) const;
+
+    /**
+     * @brief cutAlongSeams
+     * Cut the masks of newly warped images along the recipe's seams, in
+     * place of finding seams.  Pixels outside the recipe's masks are kept.
+     * @param corners Top left corners of the warped masks, at seam scale.
+     * @param masks_warped
+     */
+    void cutAlongSeams(const std::vector<cv::Point> &corners,
+                       std::vector<cv::UMat> &masks_warped) const;
+
+    /**
+     * @brief seamSizes
+     * Sizes of the seam masks.
+     */
+    std::vector<cv::Size> seamSizes() const;
+
+    /**
+     * @brief alignRotations
+     * Rotate all cameras together so that their rotations best match the
+     * reference rotations, in the least squares sense.
+     * @param reference
+     * @param cameras
+     */
+    static void
+    alignRotations(const std::vector<cv::detail::CameraParams> &reference,
+                   std::vector<cv::detail::CameraParams> &cameras);
+};
+
+} // namespace stitcher
+} // namespace airmap
@@ -2,6 +2,8 @@
 
 #include <atomic>
 #include <sstream>
+#include <string>
+#include <vector>
 
 #include "airmap/camera.h"
 #include "airmap/logging.h"
@@ -39,6 +41,28 @@ public:
          */
         double inputScaled = 1.0;
         size_t inputSizeMB = 0;
+        /**
+         * @brief bundleAdjustmentIterations, bundleAdjustmentError - the
+         * iterations performed by bundle adjustment and the final root mean
+         * square error of the matches, in pixels.  Only reported by the
+         * sparse bundle adjuster, 0 otherwise.
+         */
+        int bundleAdjustmentIterations = 0;
+        double bundleAdjustmentError = 0.0;
+        /**
+         * @brief degradations - the settings stepped down to cheaper ones
+         * because the stitch was projected to miss
+         * Panorama::Parameters::deadlineSeconds, e.g.
+         * "seam_megapix 0.1 -> 0.05".  Empty if none were.
+         */
+        std::vector<std::string> degradations;
+        /**
+         * @brief operationResources - the wall and CPU time, peak and delta
+         * resident memory, OpenCV matrices allocated, and work counters of
+         * each operation, e.g. to tune the MemoryPlanner model and thread
+         * counts.  Empty unless elapsed times are enabled.
+         */
+        monitor::OperationResourcesMap operationResources;
     };
 
     /**
@@ -55,6 +79,38 @@ public:
         }
     };
 
+    /**
+     * @brief The MemoryBudgetExceededError class conveys that the OpenCV
+     * matrices of a stitch would have exceeded its memory budget.
+     * @details Thrown instead of allocating them, when the budget is
+     * enforced, see Panorama::Parameters::enforceMemoryBudget.  Retried on
+     * with less memory planned, see setMemoryBudgetExceeded.
+     */
+    class MemoryBudgetExceededError : public RetriableError {
+    public:
+        MemoryBudgetExceededError(const std::string &what,
+                                  monitor::Operation::Enum operation,
+                                  size_t budgetMB, size_t requiredMB)
+            : RetriableError(what)
+            , _operation(operation)
+            , _budgetMB(budgetMB)
+            , _requiredMB(requiredMB)
+        {
+        }
+
+        //! The operation that would have exceeded the budget.
+        monitor::Operation::Enum operation() const { return _operation; }
+        //! The budget of the matrices, in MB.
+        size_t budgetMB() const { return _budgetMB; }
+        //! The matrices live once the refused one allocated, in MB.
+        size_t requiredMB() const { return _requiredMB; }
+
+    private:
+        monitor::Operation::Enum _operation;
+        size_t _budgetMB;
+        size_t _requiredMB;
+    };
+
     using SharedPtr = std::shared_ptr<Stitcher>;
     virtual ~Stitcher() = default;
 
@@ -72,6 +128,14 @@ public:
      */
     virtual void setFallbackMode() {}
 
+    /**
+     * @brief setMemoryBudgetExceeded
+     * Set after a stitch exceeded its memory budget, so that the stitcher
+     * can plan the next one for less memory (e.g. scaling the input
+     * further).
+     */
+    virtual void setMemoryBudgetExceeded(const MemoryBudgetExceededError &) {}
+
     /**
      * @brief stitch is the Stitcher's main entry - subclasses should
      * fill with the actual stitching.
@@ -162,12 +226,21 @@ protected:
  */
 class RetryingStitcher : public Stitcher {
 public:
+    /**
+     * @brief RetryingStitcher
+     * @param underlying
+     * @param parameters
+     * @param logger
+     * @param tracer Where to trace each attempt, if anywhere.
+     */
     RetryingStitcher(MonitoredStitcher::SharedPtr underlying,
                      const Panorama::Parameters &parameters,
-                     std::shared_ptr<logging::Logger> logger)
+                     std::shared_ptr<logging::Logger> logger,
+                     monitor::Tracer::SharedPtr tracer = nullptr)
         : _underlying(underlying)
         , _retries(parameters.retries)
         , _logger(logger)
+        , _tracer(tracer)
     {
     }
 
@@ -181,12 +254,19 @@ public:
     {
         for (size_t i = 0; i < _retries; i++) {
             try {
+                auto span = monitor::Tracer::span(_tracer, "Attempt", "retry",
+                                                  static_cast<int64_t>(i));
                 return _underlying->stitch();
             } catch (const RetriableError &e) {
                 if (_retries == 0) {
                     throw;
                 }
-                _underlying->setFallbackMode();
+                auto exceeded = dynamic_cast<const MemoryBudgetExceededError *>(&e);
+                if (exceeded) {
+                    _underlying->setMemoryBudgetExceeded(*exceeded);
+                } else {
+                    _underlying->setFallbackMode();
+                }
                 std::stringstream ss;
                 ss << "Stitching failed with " << e.what()
                    << ", retrying, retries left " << _retries - i;
@@ -194,6 +274,8 @@ public:
                              "stitcher");
             }
         }
+        auto span = monitor::Tracer::span(_tracer, "Attempt", "retry",
+                                          static_cast<int64_t>(_retries));
         return _underlying->stitch();
     }
 
@@ -201,6 +283,7 @@ protected:
     MonitoredStitcher::SharedPtr _underlying;
     std::atomic<size_t> _retries;
     std::shared_ptr<logging::Logger> _logger;
+    monitor::Tracer::SharedPtr _tracer;
 };
 
 } // namespace stitcher
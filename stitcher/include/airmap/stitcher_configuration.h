@@ -7,11 +7,13 @@ enum class BundleAdjusterType{
     Ray,
     Reproj,
     AffinePartial,
-    No
+    No,
+    SparseRay
 };
 
 enum class EstimatorType {
     Affine,
+    Gimbal,
     Homography
 };
 
@@ -40,6 +42,8 @@ enum class SeamFinderType {
     DpColorGrad,
     GraphCutColor,
     GraphCutColorGrad,
+    GraphCutGridColor,
+    GraphCutGridColorGrad,
     No,
     Voronoi
 };
@@ -99,6 +103,19 @@ struct Configuration
         */
     BundleAdjusterType bundle_adjuster_type;
 
+    /*!
+        * The sparse bundle adjuster stops once an iteration decreases its
+        * cost by less than this fraction.  0 leaves convergence to the term
+        * criteria.
+        */
+    double bundle_adjustment_min_improvement;
+
+    /*!
+        * Seconds after which the sparse bundle adjuster starts no further
+        * iteration, keeping the parameters refined so far.  0 is unlimited.
+        */
+    double bundle_adjustment_time_budget;
+
     //! Megapixels an image will be scaled down to for the composition step.
     double compose_megapix;
 
@@ -149,6 +166,27 @@ struct Configuration
         */
     double match_conf_thresh;
 
+    /*!
+        * Pairs of warped images with fewer overlapping pixels than this, at
+        * seam scale, are treated as not overlapping by the graph cut seam
+        * finder.  The other seam finders, exposure compensation and blending
+        * still use every overlapping pair.  0 keeps every overlapping pair.
+        */
+    int min_overlap_pixels;
+
+    /*!
+        * The most iterations of bundle adjustment of the cameras the preview
+        * is composed from, which the full adjustment then carries on from.
+        */
+    int preview_bundle_adjustment_iterations;
+
+    /*!
+        * Width in pixels of the preview panorama, when a preview is written
+        * before the full quality one.  A full turn of a spherical panorama
+        * is this wide.
+        */
+    int preview_width;
+
     /*!
         * If a homography features matcher is used, a value of -1 will
         * use a BestOf2NearestMatcher.  Otherwise, a BestOf2NearestRangeMatcher
@@ -159,12 +197,28 @@ struct Configuration
         */
     int range_width;
 
+    /*!
+        * The maximum number of features kept per image when verifying the
+        * cameras aligned from a stitch recipe.  Only images that overlap in
+        * the recipe are matched, so a few are enough.
+        */
+    int recipe_features_maximum;
+
+    /*!
+        * The root mean square error, in pixels, of the verification matches
+        * above which a stitch recipe is rejected and the images are
+        * stitched from scratch.
+        */
+    double recipe_max_error;
+
     //! Megapixels an image will be scaled down to after finding features.
     double seam_megapix;
 
     /*!
         * The type of seam finder (e.g. GraphCut, GraphCustColorGrad, Voronoi,
         * etc.) to use to find seams between warped images.
+        * The GraphCutGrid types find the same seams as their GraphCut
+        * counterparts using a max-flow solver specialised for grids.
         */
     SeamFinderType seam_finder_type;
 
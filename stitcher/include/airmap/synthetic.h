@@ -0,0 +1,127 @@
+#pragma once
+
+#include "airmap/camera.h"
+#include "airmap/gimbal.h"
+#include "airmap/panorama.h"
+
+#include <opencv2/core.hpp>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace airmap {
+namespace stitcher {
+
+/**
+ * @brief SyntheticFrame
+ * A frame rendered of a synthetic panorama, and its ground truth.
+ */
+struct SyntheticFrame
+{
+    //! Path the frame was written to.
+    std::string path;
+
+    //! Gimbal orientation the frame was rendered at, as written to its EXIF.
+    GimbalOrientation orientation;
+
+    //! Rotation of the camera, as cv::detail::CameraParams::R.
+    cv::Mat R;
+};
+
+/**
+ * @brief SyntheticPanorama
+ * Renders the frames a camera would capture of a scene, given as an
+ * equirectangular panorama, at chosen gimbal orientations: a perspective
+ * projection through the camera's intrinsics, distorted by its distortion
+ * model if any.  Each frame is written as a JPEG with the EXIF and XMP
+ * metadata GeoImage::fromExif reads, i.e. make, model, time, size, GPS and
+ * gimbal pitch, roll and yaw, so that the frames stitch like a capture of
+ * the camera, with ground truth rotations to compare the stitch against.
+ */
+class SyntheticPanorama
+{
+public:
+    struct Parameters
+    {
+        //! Camera make and model written to the EXIF of the frames.  The
+        //! model selects the camera of CameraModels::detect.
+        std::string make = "Synthetic";
+        std::string model;
+
+        //! Size of the frames relative to the camera's sensor.
+        double scale = 1.;
+
+        //! Where and when the frames are captured, one after another.
+        geocoordinate_t location = geocoordinate_t(151.2093, -33.8688);
+        double altitudeMeters = 50.;
+        std::time_t startTime = 1609459200;
+        int secondsBetweenFrames = 2;
+
+        //! Whether to distort the frames by the camera's distortion model.
+        bool distort = true;
+
+        int jpegQuality = 95;
+    };
+
+    /**
+     * @brief SyntheticPanorama
+     * @param equirectangular The scene, a 2:1 equirectangular panorama
+     * with yaw 0 at its centre.
+     * @param camera The camera capturing the frames.
+     * @param parameters
+     * @throws std::invalid_argument If the panorama is empty.
+     */
+    SyntheticPanorama(const cv::Mat &equirectangular, const Camera &camera,
+                      const Parameters &parameters);
+
+    /**
+     * @brief K
+     * Intrinsics of the frames as undistorted, which they are projected
+     * through.
+     */
+    cv::Mat K() const;
+
+    /**
+     * @brief render
+     * Render the frame of a gimbal orientation.
+     */
+    cv::Mat render(const GimbalOrientation &orientation) const;
+
+    /**
+     * @brief write
+     * Render and write the frames of the gimbal orientations to a
+     * directory, as frame_<index>.jpg, and their ground truth as
+     * ground_truth.yml.
+     * @throws std::invalid_argument If a file can't be written.
+     */
+    std::vector<SyntheticFrame>
+    write(const std::vector<GimbalOrientation> &orientations,
+          const std::string &directory) const;
+
+    /**
+     * @brief loadGroundTruth
+     * Read the ground truth of the frames written by write.
+     * @throws std::invalid_argument If the file can't be read.
+     */
+    static std::vector<SyntheticFrame> loadGroundTruth(const std::string &path);
+
+    /**
+     * @brief spiral
+     * Orientations of count frames spread evenly over the sphere between
+     * two pitches, along a golden angle spiral from the lowest pitch, as a
+     * capture pattern of any number of frames.
+     */
+    static std::vector<GimbalOrientation>
+    spiral(size_t count, double min_pitch = -90., double max_pitch = 30.);
+
+private:
+    cv::Mat _equirectangular;
+    Camera _camera;
+    Parameters _parameters;
+    int _width;
+    int _height;
+};
+
+} // namespace stitcher
+} // namespace airmap
@@ -1,8 +1,22 @@
 #include <boost/program_options.hpp>
+#include <atomic>
+#include <csignal>
+#include <exception>
+#include <fstream>
 #include <iostream>
+#include <pthread.h>
+#include <sstream>
+#include <thread>
 #include <unistd.h>
 
+#include "airmap/batch.h"
+#include "airmap/camera_models.h"
+#include "airmap/daemon.h"
+#include "airmap/monitor/resources.h"
 #include "airmap/opencv_stitcher.h"
+#include "airmap/synthetic.h"
+
+#include <opencv2/imgcodecs.hpp>
 using namespace airmap::stitcher;
 using namespace airmap::logging;
 
@@ -22,9 +36,18 @@ int main(int argc, char *argv[])
             ("ram_budget",
                 boost::program_options::value<size_t>()->default_value(Panorama::Parameters::defaultMemoryBudgetMB()),
                 "RAM buget (in MB) the stitcher can assume it can use")
+            ("enforce_ram_budget", "Refuse the images and buffers of the stitch beyond ram_budget, and retry it with its input scaled further, rather than risk being killed for running out of memory.")
             ("retries",
                 boost::program_options::value<size_t>()->default_value(6),
                 "The stitching process is non-deterministic, this increases chances to succeed")
+            ("bundle_adjuster", boost::program_options::value<std::string>()->default_value("sparse_ray"),
+                "The bundle adjuster, sparse_ray or OpenCV's ray.  Only sparse_ray reports its progress and honours bundle_adjustment_time_budget and bundle_adjustment_min_improvement.")
+            ("estimator", boost::program_options::value<std::string>()->default_value("homography"),
+                "The initial estimation of the cameras, homography, or gimbal to start from the gimbal orientation and intrinsics of each image, falling back to homography when they are unknown.")
+            ("bundle_adjustment_time_budget", boost::program_options::value<double>()->default_value(0.),
+                "Seconds after which bundle adjustment starts no further iteration.  0 for no budget.")
+            ("bundle_adjustment_min_improvement", boost::program_options::value<double>()->default_value(0.),
+                "Stop bundle adjustment once an iteration decreases its cost by less than this fraction.  0 to leave it to the iteration limit.")
             ("debug", "If set, debug artifacts (e.g. detected features, matches, warping, etc.) will be created in <debug_output>.")
             ("debug_path", boost::program_options::value<std::string>()->default_value("debug"),
                 "Path to the debug output.")
@@ -33,6 +56,48 @@ int main(int argc, char *argv[])
             ("elapsed_time_log", "Log elapsed times of stitch operations.")
             ("estimate", "Estimate time remaining during stitch.  Always enabled if elapsed_time or estimate_log are.")
             ("estimate_log", "Log estimates of remaining time.  Always enabled if elapsed_time_log is.")
+            ("progress_fd", boost::program_options::value<int>(),
+                "Write the operation, progress, estimate, elapsed times and memory of the stitch as newline delimited JSON to this file descriptor, e.g. a pipe to a parent process.")
+            ("trace", boost::program_options::value<std::string>(),
+                "Write a trace of the stitch to this path, as Chrome trace events to open in chrome://tracing or https://ui.perfetto.dev.")
+            ("progress_rate", boost::program_options::value<double>()->default_value(10.),
+                "The maximum number of progress_fd records per second within an operation.  Changes of operation and outputs are always written.")
+            ("preview", "Write a quick, low resolution preview of the panorama to <output>, overwritten by the full quality panorama when it is done.")
+            ("batch", boost::program_options::value<std::string>(),
+                "Instead of stitching the input images, find the panoramas among the images of this directory and stitch each to <first image>.panorama.jpg.")
+            ("batch_output", boost::program_options::value<std::string>(),
+                "Write the panoramas of a batch to this directory instead of next to their images.")
+            ("batch_jobs", boost::program_options::value<size_t>()->default_value(2),
+                "The maximum number of panoramas of a batch stitched at once.  As many are stitched at once as their predicted peak memory fits in ram_budget.")
+            ("threads", boost::program_options::value<size_t>()->default_value(std::max(1u, std::thread::hardware_concurrency())),
+                "The number of threads of the stitch, or of all the panoramas of a batch stitched at once.")
+            ("deadline", boost::program_options::value<size_t>()->default_value(0),
+                "Seconds the stitch may take.  If it is projected to take longer, the remaining stages are stepped down to cheaper settings.  0 for no deadline.")
+            ("history", boost::program_options::value<std::string>(),
+                "Estimate the stitch from the past stitches recorded in this file, and record it there once complete.")
+            ("history_evaluate", "Instead of stitching, print how far the estimates of <history> are from the stitches it records, each estimated from the others.")
+            ("recipe", boost::program_options::value<std::string>(),
+                "Stitch from the recipe of an earlier panorama of the same capture pattern, skipping feature matching and bundle adjustment if it fits.")
+            ("recipe_output", boost::program_options::value<std::string>(),
+                "Write the recipe of the stitch to this path (.yml, or .yml.gz to compress it).")
+            ("render", boost::program_options::value<std::vector<std::string>>(),
+                "Instead of stitching, render the images of <recipe> as <compose_megapix>:<path>, e.g. --render=-1:full.jpg.  Can be repeated to render several resolutions at once.")
+            ("daemon", boost::program_options::value<std::string>(),
+                "Instead of stitching, stay up and stitch the panoramas submitted to this Unix socket, one at a time.")
+            ("submit", boost::program_options::value<std::string>(),
+                "Instead of stitching, submit the stitch to the daemon listening on this Unix socket and stream its progress.")
+            ("synthesize", boost::program_options::value<std::string>(),
+                "Instead of stitching, render the frames <synthesize_camera> would capture of this equirectangular panorama to <synthesize_output>, with their EXIF and ground truth rotations.")
+            ("synthesize_output", boost::program_options::value<std::string>()->default_value("synthetic"),
+                "Directory of the synthesized frames.")
+            ("synthesize_camera", boost::program_options::value<std::string>()->default_value("AnafiThermal"),
+                "Camera model of the synthesized frames, as detected from their EXIF, e.g. AnafiThermal or \"GreenSeer EO Navigation Lens\".")
+            ("synthesize_count", boost::program_options::value<size_t>()->default_value(25),
+                "The number of frames synthesized, spread evenly from the nadir to 30 degrees up.")
+            ("synthesize_orientations", boost::program_options::value<std::string>(),
+                "Instead of synthesize_count frames, synthesize a frame at each <pitch> <roll> <yaw> line of this file, in degrees.")
+            ("synthesize_scale", boost::program_options::value<double>()->default_value(1.),
+                "The size of the synthesized frames, relative to the sensor of the camera.")
             ;
     try {
         boost::program_options::positional_options_description positional;
@@ -48,19 +113,11 @@ int main(int argc, char *argv[])
         );
         boost::program_options::notify(vm);
 
-        if(vm.count("help") || !vm.count("input")) {
+        if(vm.count("help") || (!vm.count("input") && !vm.count("batch") && !vm.count("daemon") && !vm.count("history_evaluate") && !vm.count("synthesize"))) {
           std::cout << desc << "\n";
           return EXIT_FAILURE;
         }
 
-        std::list<GeoImage> input;
-        for (std::string path : vm["input"].as<std::vector<std::string>>()) {
-            if (vm.count("input_path")) {
-                path = (boost::filesystem::path(vm["input_path"].as<std::string>()) / path).string();
-            }
-            input.push_back(GeoImage::fromExif(path));
-        }
-
         std::string debugPath;
         if (vm.count("debug")) {
             debugPath = boost::filesystem::path(vm["debug_path"].as<std::string>()).string();
@@ -77,18 +134,248 @@ int main(int argc, char *argv[])
             vm.count("estimate_log") > 0,
             vm["retries"].as<size_t>()
         };
-        RetryingStitcher{
-            std::make_shared<LowLevelOpenCVStitcher>(
-                Configuration(
-                    StitchType::ThreeSixty),
-                Panorama{input},
+        parameters.deadlineSeconds = vm["deadline"].as<size_t>();
+        parameters.enforceMemoryBudget = vm.count("enforce_ram_budget") > 0;
+        Configuration configuration(StitchType::ThreeSixty);
+        const std::string bundleAdjuster = vm["bundle_adjuster"].as<std::string>();
+        if (bundleAdjuster == "ray") {
+            configuration.bundle_adjuster_type = BundleAdjusterType::Ray;
+        } else if (bundleAdjuster == "sparse_ray") {
+            configuration.bundle_adjuster_type = BundleAdjusterType::SparseRay;
+        } else {
+            throw std::invalid_argument("Unknown bundle adjuster " + bundleAdjuster);
+        }
+        const std::string estimator = vm["estimator"].as<std::string>();
+        if (estimator == "homography") {
+            configuration.estimator_type = EstimatorType::Homography;
+        } else if (estimator == "gimbal") {
+            configuration.estimator_type = EstimatorType::Gimbal;
+        } else {
+            throw std::invalid_argument("Unknown estimator " + estimator);
+        }
+        configuration.bundle_adjustment_time_budget =
+                vm["bundle_adjustment_time_budget"].as<double>();
+        configuration.bundle_adjustment_min_improvement =
+                vm["bundle_adjustment_min_improvement"].as<double>();
+
+        if (vm.count("history")) {
+            parameters.historyPath = vm["history"].as<std::string>();
+        }
+
+        if (vm.count("history_evaluate")) {
+            if (parameters.historyPath.empty()) {
+                throw std::invalid_argument("history_evaluate requires a history");
+            }
+            std::cout << monitor::History::load(parameters.historyPath, logger)->evaluate().str()
+                      << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        if (vm.count("synthesize")) {
+            const std::string model = vm["synthesize_camera"].as<std::string>();
+            const CameraModels camera_models;
+            auto camera = camera_models.models.find(model);
+            if (camera == camera_models.models.end()) {
+                throw std::invalid_argument("Unknown camera model " + model);
+            }
+
+            std::vector<GimbalOrientation> orientations;
+            if (vm.count("synthesize_orientations")) {
+                const std::string orientationsPath = vm["synthesize_orientations"].as<std::string>();
+                std::ifstream file(orientationsPath);
+                if (!file) {
+                    throw std::invalid_argument("Can't read orientations " + orientationsPath);
+                }
+                std::string line;
+                for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber) {
+                    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                        continue;
+                    }
+                    std::istringstream fields(line);
+                    double pitch, roll, yaw;
+                    std::string extra;
+                    if (!(fields >> pitch >> roll >> yaw) || fields >> extra) {
+                        throw std::invalid_argument("Line " + std::to_string(lineNumber) + " of " + orientationsPath
+                                                    + " is not <pitch> <roll> <yaw>");
+                    }
+                    orientations.emplace_back(pitch, roll, yaw);
+                }
+                if (file.bad()) {
+                    throw std::invalid_argument("Can't read orientations " + orientationsPath);
+                }
+                if (orientations.empty()) {
+                    throw std::invalid_argument("No orientations in " + orientationsPath);
+                }
+            } else {
+                orientations = SyntheticPanorama::spiral(vm["synthesize_count"].as<size_t>());
+            }
+
+            SyntheticPanorama::Parameters synthetic_parameters;
+            synthetic_parameters.model = model;
+            synthetic_parameters.scale = vm["synthesize_scale"].as<double>();
+            cv::setNumThreads(static_cast<int>(vm["threads"].as<size_t>()));
+            SyntheticPanorama synthetic{ cv::imread(vm["synthesize"].as<std::string>()),
+                                         camera->second, synthetic_parameters };
+            const std::string output = vm["synthesize_output"].as<std::string>();
+            auto frames = synthetic.write(orientations, output);
+
+            std::stringstream message;
+            message << "Written " << frames.size() << " synthetic frames to " << output << ".";
+            logger->log(Logger::Severity::info, message, "synthetic");
+            return EXIT_SUCCESS;
+        }
+
+        if (vm.count("batch")) {
+            BatchStitcher batch{
+                configuration,
+                parameters,
+                vm["batch_jobs"].as<size_t>(),
+                vm["threads"].as<size_t>(),
+                logger
+            };
+            auto jobs = BatchStitcher::jobs(
+                BatchStitcher::group(batch.scan(vm["batch"].as<std::string>())),
+                vm.count("batch_output") ? vm["batch_output"].as<std::string>() : "");
+            auto summaries = batch.stitch(jobs);
+            bool successful = std::all_of(summaries.begin(), summaries.end(),
+                [](const BatchStitcher::Summary &summary) { return summary.successful; });
+            return successful ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        if (vm.count("daemon")) {
+            // Stop on SIGTERM and SIGINT, removing the socket and cancelling
+            // the current stitch.  stop isn't async-signal-safe, so the
+            // signals are blocked in every thread, OpenCV's included, and
+            // waited for by a thread of their own.
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGINT);
+            sigaddset(&signals, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+            StitchDaemon daemon{
+                vm["daemon"].as<std::string>(),
+                configuration,
                 parameters,
-                vm["output"].as<std::string>(),
-                logger,
-                []() {},
-                vm.count("debug") > 0,
-                debugPath
-            ), parameters, logger
+                vm["threads"].as<size_t>(),
+                logger
+            };
+            std::atomic<bool> ended(false);
+            std::thread signalThread([&daemon, &signals, &ended, &logger]() {
+                int signal = 0;
+                if (sigwait(&signals, &signal) == 0 && !ended) {
+                    logger->log(Logger::Severity::info, "Stopping on signal.", "daemon");
+                    daemon.stop();
+                }
+            });
+
+            std::exception_ptr error;
+            try {
+                daemon.run();
+            } catch (...) {
+                error = std::current_exception();
+            }
+            // Wake the signal thread if the daemon ended on its own.
+            ended = true;
+            pthread_kill(signalThread.native_handle(), SIGTERM);
+            signalThread.join();
+            if (error) {
+                std::rethrow_exception(error);
+            }
+            return EXIT_SUCCESS;
+        }
+
+        std::vector<std::string> inputPaths;
+        for (std::string path : vm["input"].as<std::vector<std::string>>()) {
+            if (vm.count("input_path")) {
+                path = (boost::filesystem::path(vm["input_path"].as<std::string>()) / path).string();
+            }
+            inputPaths.push_back(path);
+        }
+
+        if (vm.count("submit")) {
+            // The daemon doesn't share the working directory of the client.
+            StitchDaemon::Request request{ {}, "", parameters, vm.count("preview") > 0 };
+            for (const std::string &path : inputPaths) {
+                request.inputPaths.push_back(boost::filesystem::absolute(path).string());
+            }
+            request.outputPath = boost::filesystem::absolute(vm["output"].as<std::string>()).string();
+            StitchDaemon::Client client{ vm["submit"].as<std::string>() };
+            StitchDaemon::Response response = client.submit(request,
+                [&logger](const StitchDaemon::Response &response) {
+                    std::stringstream message;
+                    for (size_t i = 0; i < response.size(); ++i) {
+                        message << (i > 0 ? " " : "") << response[i];
+                    }
+                    logger->log(Logger::Severity::info, message, "daemon");
+                });
+            return response.front() == "done" ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        std::list<GeoImage> input;
+        for (const std::string &path : inputPaths) {
+            input.push_back(GeoImage::fromExif(path));
+        }
+        // What the daemon does once, for comparison with its setup time.
+        const monitor::ElapsedTime warmUpTime = StitchDaemon::warmUp(
+            vm["threads"].as<size_t>(), parameters.enableOpenCL);
+
+        auto stitcher = std::make_shared<LowLevelOpenCVStitcher>(
+            configuration,
+            Panorama{input},
+            parameters,
+            vm["output"].as<std::string>(),
+            logger,
+            []() {},
+            vm.count("debug") > 0,
+            debugPath
+        );
+        if (vm.count("render")) {
+            if (!vm.count("recipe")) {
+                throw std::invalid_argument("render requires a recipe");
+            }
+            std::vector<LowLevelOpenCVStitcher::RenderTarget> targets;
+            for (const std::string &render : vm["render"].as<std::vector<std::string>>()) {
+                size_t separator = render.find(':');
+                if (separator == std::string::npos) {
+                    throw std::invalid_argument("render " + render + " is not <compose_megapix>:<path>");
+                }
+                targets.push_back({ std::stod(render.substr(0, separator)),
+                                    render.substr(separator + 1) });
+            }
+            stitcher->render(StitchRecipe::load(vm["recipe"].as<std::string>()), targets);
+            return EXIT_SUCCESS;
+        }
+        if (vm.count("progress_fd")) {
+            // A parent that went away must not end the stitch.
+            std::signal(SIGPIPE, SIG_IGN);
+            stitcher->monitor()->setProgressWriter(
+                std::make_shared<monitor::ProgressWriter>(
+                    vm["progress_fd"].as<int>(), vm["progress_rate"].as<double>()));
+        }
+        monitor::Tracer::SharedPtr tracer;
+        if (vm.count("trace")) {
+            tracer = std::make_shared<monitor::Tracer>(vm["trace"].as<std::string>());
+            stitcher->monitor()->setTracer(tracer);
+        }
+        if (vm.count("preview")) {
+            stitcher->setPreview();
+        }
+        if (vm.count("recipe")) {
+            stitcher->setRecipe(StitchRecipe::load(vm["recipe"].as<std::string>()));
+        }
+        if (vm.count("recipe_output")) {
+            stitcher->setRecipeOutputPath(vm["recipe_output"].as<std::string>());
+        }
+        if (parameters.enableElapsedTimeLog) {
+            std::stringstream setup;
+            setup << "Set up in " << monitor::processUptime()
+                  << " since the process started, " << warmUpTime
+                  << " of it warming up OpenCV.";
+            logger->log(Logger::Severity::info, setup, "setup");
+        }
+        RetryingStitcher{
+            stitcher, parameters, logger, tracer
         }.stitch();
         return EXIT_SUCCESS;
     } catch (const std::exception& e) {
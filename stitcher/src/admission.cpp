@@ -0,0 +1,79 @@
+#include "airmap/admission.h"
+#include "airmap/camera_models.h"
+#include "airmap/memory_planner.h"
+
+#include <algorithm>
+
+namespace airmap {
+namespace stitcher {
+
+AdmissionController::AdmissionController(size_t memoryBudgetMB, size_t maxJobs)
+    : _memoryBudgetMB(std::max<size_t>(1, memoryBudgetMB))
+    , _maxJobs(std::max<size_t>(1, maxJobs))
+    , _usedMemoryMB(0)
+    , _running(0)
+{
+}
+
+size_t AdmissionController::predictPeakMB(size_t imageCount, size_t imagePixels,
+                                          const Panorama::Parameters &parameters,
+                                          const Configuration &config,
+                                          double focalPixels)
+{
+    const size_t pixels = imagePixels > 0 ? imagePixels : parameters.maxInputImageSize;
+    const MemoryPlanner planner(config, parameters, focalPixels);
+    const double inputScale = planner.maxInputScale(pixels);
+    return planner
+            .predict(imageCount, pixels, inputScale,
+                     planner.configuredComposeScale(pixels, inputScale))
+            .peakMB();
+}
+
+size_t AdmissionController::predictPeakMB(const Panorama &panorama,
+                                          const Panorama::Parameters &parameters,
+                                          const Configuration &config)
+{
+    // Images of a panorama are normally all the same size, the largest
+    // is taken if not.
+    size_t imagePixels = 0;
+    const GeoImage *largest = nullptr;
+    for (const auto &image : panorama) {
+        const size_t pixels = static_cast<size_t>(image.widthPixels) * image.heightPixels;
+        if (!largest || pixels > imagePixels) {
+            imagePixels = pixels;
+            largest = &image;
+        }
+    }
+
+    // The focal length of a known camera bounds the panorama.
+    double focalPixels = 0.;
+    const auto camera = largest ? CameraModels().detect(*largest) : nullptr;
+    if (camera && largest->widthPixels > 0) {
+        focalPixels = camera->focalLengthPixels().x * largest->widthPixels
+                / camera->sensorDimensionsPixels().x;
+    }
+    return predictPeakMB(panorama.size(), imagePixels, parameters, config, focalPixels);
+}
+
+bool AdmissionController::admit(size_t peakMB, Admission &admission)
+{
+    if (_running > 0
+        && (_running >= _maxJobs || peakMB > availableMemoryMB())) {
+        return false;
+    }
+
+    admission.peakMB = peakMB;
+    admission.memoryBudgetMB = std::min(peakMB, availableMemoryMB());
+    _usedMemoryMB += admission.memoryBudgetMB;
+    ++_running;
+    return true;
+}
+
+void AdmissionController::release(const Admission &admission)
+{
+    _usedMemoryMB -= admission.memoryBudgetMB;
+    --_running;
+}
+
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,232 @@
+#include "airmap/batch.h"
+#include "airmap/opencv_stitcher.h"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core/utility.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
+namespace airmap {
+namespace stitcher {
+
+BatchStitcher::BatchStitcher(const Configuration &config,
+                             const Panorama::Parameters &parameters,
+                             size_t concurrentJobs, size_t threads,
+                             std::shared_ptr<logging::Logger> logger)
+    : _config(config)
+    , _parameters(parameters)
+    , _concurrentJobs(std::max<size_t>(1, concurrentJobs))
+    , _threads(std::max<size_t>(1, threads))
+    , _logger(logger)
+    , _cancelled(false)
+{
+}
+
+void BatchStitcher::cancel()
+{
+    _cancelled = true;
+}
+
+std::vector<Panorama> BatchStitcher::group(std::vector<GeoImage> images,
+                                           size_t minImageCount)
+{
+    std::sort(images.begin(), images.end(), GeoImage::Earlier());
+
+    std::vector<Panorama> panoramas;
+    Panorama panorama;
+    for (const auto &image : images) {
+        if (!panorama.add(image)) {
+            panoramas.push_back(panorama);
+            panorama = Panorama(image);
+        }
+    }
+    if (!panorama.empty()) {
+        panoramas.push_back(panorama);
+    }
+
+    panoramas.erase(std::remove_if(panoramas.begin(), panoramas.end(),
+                                   [minImageCount](const Panorama &panorama) {
+                                       return panorama.size() < minImageCount;
+                                   }),
+                    panoramas.end());
+    return panoramas;
+}
+
+std::vector<BatchStitcher::Job>
+BatchStitcher::jobs(const std::vector<Panorama> &panoramas,
+                    const std::string &outputDirectory)
+{
+    std::vector<Job> jobs;
+    for (const auto &panorama : panoramas) {
+        boost::filesystem::path first(panorama.front().path);
+        boost::filesystem::path directory = outputDirectory.empty()
+                ? first.parent_path()
+                : boost::filesystem::path(outputDirectory);
+        jobs.push_back({ panorama,
+                         (directory
+                          / (first.stem().string() + Panorama::PanoramaFileExtension))
+                                 .string() });
+    }
+    return jobs;
+}
+
+std::vector<GeoImage> BatchStitcher::scan(const std::string &directory) const
+{
+    std::vector<std::string> paths;
+    for (const auto &entry : boost::filesystem::directory_iterator(directory)) {
+        if (!boost::filesystem::is_regular_file(entry.status())) {
+            continue;
+        }
+        const std::string path = entry.path().string();
+        const std::string extension = entry.path().extension().string();
+        if (!boost::algorithm::iequals(extension, ".jpg")
+            && !boost::algorithm::iequals(extension, ".jpeg")) {
+            continue;
+        }
+
+        // Stitched panoramas and their cubemap faces are named after the
+        // first image of the panorama, followed by two extensions.
+        if (boost::filesystem::path(entry.path().stem()).has_extension()) {
+            continue;
+        }
+        paths.push_back(path);
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<GeoImage> images;
+    for (const auto &path : paths) {
+        try {
+            images.push_back(GeoImage::fromExif(path));
+        } catch (const std::exception &e) {
+            _logger->log(logging::Logger::Severity::error, e.what(), "batch");
+        }
+    }
+    return images;
+}
+
+std::vector<BatchStitcher::Summary>
+BatchStitcher::stitch(const std::vector<Job> &jobs)
+{
+    monitor::Timer timer;
+    timer.start();
+
+    // The largest panoramas first, so that the batch doesn't wait on a
+    // long one started last, and smaller ones fill the budget left.
+    std::vector<size_t> peaksMB;
+    for (const auto &job : jobs) {
+        peaksMB.push_back(AdmissionController::predictPeakMB(job.panorama, _parameters, _config));
+    }
+    std::list<size_t> pending(jobs.size());
+    std::iota(pending.begin(), pending.end(), 0);
+    pending.sort([&peaksMB](size_t a, size_t b) { return peaksMB[a] > peaksMB[b]; });
+
+    // OpenCV's threads are shared by the whole process, so the stitches
+    // share the pool rather than get a count each, and no more of them run
+    // at once than there are threads.
+    cv::setNumThreads(static_cast<int>(_threads));
+    AdmissionController admissions(_parameters.memoryBudgetMB,
+                                   std::min(_concurrentJobs, _threads));
+
+    std::stringstream message;
+    message << "Stitching " << jobs.size() << " panoramas, at most "
+            << _concurrentJobs << " at a time within " << _parameters.memoryBudgetMB
+            << " MB and " << _threads << " threads.";
+    _logger->log(logging::Logger::Severity::info, message, "batch");
+
+    std::vector<Summary> summaries(jobs.size());
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<std::thread> threads;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!pending.empty() && !_cancelled) {
+        for (auto it = pending.begin(); it != pending.end();) {
+            AdmissionController::Admission admission;
+            if (!admissions.admit(peaksMB[*it], admission)) {
+                ++it;
+                continue;
+            }
+
+            const size_t index = *it;
+            it = pending.erase(it);
+            threads.emplace_back([&, index, admission]() {
+                Panorama::Parameters parameters = _parameters;
+                parameters.memoryBudgetMB = admission.memoryBudgetMB;
+                Summary summary = stitch(jobs[index], parameters);
+                summary.admission = admission;
+
+                std::lock_guard<std::mutex> guard(mutex);
+                summaries[index] = summary;
+                admissions.release(admission);
+                finished.notify_one();
+            });
+        }
+        if (!pending.empty()) {
+            finished.wait(lock);
+        }
+    }
+    lock.unlock();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    timer.stop();
+    const size_t successful = std::count_if(
+            summaries.begin(), summaries.end(),
+            [](const Summary &summary) { return summary.successful; });
+    const double hours = timer.elapsed().milliseconds(false) / 3600000.;
+    message.str("");
+    message << "Stitched " << successful << " of " << jobs.size()
+            << " panoramas in " << timer.elapsed() << ", "
+            << (hours > 0 ? successful / hours : 0.) << " panoramas per hour.";
+    _logger->log(logging::Logger::Severity::info, message, "batch");
+
+    return summaries;
+}
+
+BatchStitcher::Summary BatchStitcher::stitch(const Job &job,
+                                             const Panorama::Parameters &parameters)
+{
+    monitor::Timer timer;
+    timer.start();
+
+    Summary summary;
+    summary.outputPath = job.outputPath;
+    summary.imageCount = job.panorama.size();
+    try {
+        auto stitcher = std::make_shared<LowLevelOpenCVStitcher>(
+                _config, job.panorama, parameters, job.outputPath, _logger);
+        summary.report = RetryingStitcher { stitcher, parameters, _logger }.stitch();
+        summary.successful = true;
+    } catch (const std::exception &e) {
+        summary.error = e.what();
+    }
+    timer.stop();
+    summary.elapsed = timer.elapsed();
+
+    std::stringstream message;
+    if (summary.successful) {
+        message << "Stitched " << summary.outputPath << " from "
+                << summary.imageCount << " images in " << summary.elapsed
+                << " with a budget of " << parameters.memoryBudgetMB << " MB.";
+    } else {
+        message << "Failed to stitch " << summary.outputPath << " from "
+                << summary.imageCount << " images in " << summary.elapsed << ": "
+                << summary.error;
+    }
+    _logger->log(summary.successful ? logging::Logger::Severity::info
+                                    : logging::Logger::Severity::error,
+                 message, "batch");
+
+    return summary;
+}
+
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,520 @@
+#include "airmap/daemon.h"
+#include "airmap/opencv_stitcher.h"
+
+#include <opencv2/core/ocl.hpp>
+#include <opencv2/core/utility.hpp>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <list>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace airmap {
+namespace stitcher {
+
+namespace {
+
+/**
+ * @brief LineReader
+ * Reads the newline terminated lines of a socket.
+ */
+class LineReader
+{
+public:
+    explicit LineReader(int socket)
+        : _socket(socket)
+    {
+    }
+
+    /**
+     * @brief next
+     * Read the next line, without its newline.
+     * @return false at the end of the stream or on error.
+     */
+    bool next(std::string &line)
+    {
+        size_t newline;
+        while ((newline = _buffer.find('\n')) == std::string::npos) {
+            char chunk[4096];
+            ssize_t received = ::recv(_socket, chunk, sizeof(chunk), 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                return false;
+            }
+            _buffer.append(chunk, static_cast<size_t>(received));
+        }
+        line = _buffer.substr(0, newline);
+        _buffer.erase(0, newline + 1);
+        return true;
+    }
+
+private:
+    int _socket;
+    std::string _buffer;
+};
+
+/**
+ * @brief split
+ * Split a line into its tab separated fields.
+ */
+std::vector<std::string> split(const std::string &line)
+{
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '\t')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+/**
+ * @brief field
+ * A field of a line, with the separators it can't contain replaced.
+ */
+std::string field(std::string value)
+{
+    std::replace(value.begin(), value.end(), '\t', ' ');
+    std::replace(value.begin(), value.end(), '\n', ' ');
+    return value;
+}
+
+/**
+ * @brief sendLine
+ * Send the fields of a line.  A client that went away is noticed by the
+ * reader of its socket, so errors are ignored.
+ */
+void sendLine(int socket, const std::vector<std::string> &fields)
+{
+    std::string line;
+    for (const auto &value : fields) {
+        line += (line.empty() ? "" : "\t") + field(value);
+    }
+    line += '\n';
+
+    size_t sent = 0;
+    while (sent < line.size()) {
+        ssize_t result =
+                ::send(socket, line.data() + sent, line.size() - sent, MSG_NOSIGNAL);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return;
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+sockaddr_un socketAddress(const std::string &socketPath)
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("socket path " + socketPath + " is too long");
+    }
+    std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+    return address;
+}
+
+std::runtime_error socketError(const std::string &what)
+{
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+/**
+ * @brief removeStaleSocket
+ * Remove the socket left at a path by a daemon that is gone, which nothing
+ * listens on any more.
+ * @throws std::runtime_error If something else is at the path, or a daemon
+ * still listens on it.
+ */
+void removeStaleSocket(const std::string &socketPath)
+{
+    struct stat status;
+    if (::lstat(socketPath.c_str(), &status) < 0) {
+        if (errno == ENOENT) {
+            return;
+        }
+        throw socketError("can't stat " + socketPath);
+    }
+    if (!S_ISSOCK(status.st_mode)) {
+        throw std::runtime_error(socketPath + " exists and is not a socket");
+    }
+
+    sockaddr_un address = socketAddress(socketPath);
+    int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) {
+        throw socketError("can't create socket");
+    }
+    const int connected =
+            ::connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    const int error = errno;
+    ::close(probe);
+    if (connected == 0) {
+        throw std::runtime_error("a stitch daemon already listens on " + socketPath);
+    }
+    if (error != ECONNREFUSED) {
+        errno = error;
+        throw socketError("can't connect to " + socketPath);
+    }
+
+    if (::unlink(socketPath.c_str()) < 0 && errno != ENOENT) {
+        throw socketError("can't remove stale socket " + socketPath);
+    }
+}
+
+} // namespace
+
+//
+//
+// StitchDaemon::Request
+//
+//
+StitchDaemon::Request
+StitchDaemon::Request::parse(const std::string &line,
+                             const Panorama::Parameters &defaults)
+{
+    std::vector<std::string> fields = split(line);
+    if (fields.empty() || fields.front() != "stitch") {
+        throw std::invalid_argument("not a stitch request: " + line);
+    }
+
+    Request request{ {}, "", defaults, false };
+    for (auto it = std::next(fields.begin()); it != fields.end(); ++it) {
+        const size_t separator = it->find('=');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("field " + *it + " is not <key>=<value>");
+        }
+        const std::string key = it->substr(0, separator);
+        const std::string value = it->substr(separator + 1);
+        if (key == "input") {
+            request.inputPaths.push_back(value);
+        } else if (key == "output") {
+            request.outputPath = value;
+        } else if (key == "ram_budget") {
+            request.parameters.memoryBudgetMB = std::stoul(value);
+        } else if (key == "retries") {
+            request.parameters.retries = std::stoul(value);
+        } else if (key == "deadline") {
+            request.parameters.deadlineSeconds = std::stoul(value);
+        } else if (key == "cubemap") {
+            request.parameters.alsoCreateCubeMap = value == "1";
+        } else if (key == "preview") {
+            request.preview = value == "1";
+        } else {
+            throw std::invalid_argument("unknown field " + key);
+        }
+    }
+
+    if (request.inputPaths.empty()) {
+        throw std::invalid_argument("stitch request without input");
+    }
+    if (request.outputPath.empty()) {
+        throw std::invalid_argument("stitch request without output");
+    }
+    return request;
+}
+
+std::string StitchDaemon::Request::str() const
+{
+    std::stringstream line;
+    line << "stitch";
+    for (const auto &inputPath : inputPaths) {
+        line << "\tinput=" << inputPath;
+    }
+    line << "\toutput=" << outputPath << "\tram_budget=" << parameters.memoryBudgetMB
+         << "\tretries=" << parameters.retries
+         << "\tdeadline=" << parameters.deadlineSeconds
+         << "\tcubemap=" << parameters.alsoCreateCubeMap << "\tpreview=" << preview;
+    return line.str();
+}
+
+//
+//
+// StitchDaemon::Client
+//
+//
+StitchDaemon::Client::Client(const std::string &socketPath)
+    : _socket(-1)
+{
+    sockaddr_un address = socketAddress(socketPath);
+    _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_socket < 0) {
+        throw socketError("can't create socket");
+    }
+    if (::connect(_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address))
+        < 0) {
+        std::runtime_error error = socketError("can't connect to " + socketPath);
+        ::close(_socket);
+        throw error;
+    }
+}
+
+StitchDaemon::Client::~Client()
+{
+    ::close(_socket);
+}
+
+void StitchDaemon::Client::cancel()
+{
+    sendLine(_socket, { "cancel" });
+}
+
+StitchDaemon::Response StitchDaemon::Client::submit(const Request &request,
+                                                    ResponseCb responseCb)
+{
+    sendLine(_socket, split(request.str()));
+
+    LineReader reader(_socket);
+    std::string line;
+    while (reader.next(line)) {
+        Response response = split(line);
+        if (response.empty()) {
+            continue;
+        }
+        responseCb(response);
+        if (response.front() == "done" || response.front() == "cancelled"
+            || response.front() == "error") {
+            return response;
+        }
+    }
+    throw std::runtime_error("lost connection to the stitch daemon");
+}
+
+//
+//
+// StitchDaemon
+//
+//
+StitchDaemon::StitchDaemon(const std::string &socketPath,
+                           const Configuration &config,
+                           const Panorama::Parameters &defaults, size_t threads,
+                           std::shared_ptr<logging::Logger> logger)
+    : _socketPath(socketPath)
+    , _config(config)
+    , _defaults(defaults)
+    , _threads(std::max<size_t>(1, threads))
+    , _logger(logger)
+    , _stopped(false)
+    , _socket(-1)
+    , _boundSocket(false)
+{
+}
+
+StitchDaemon::~StitchDaemon()
+{
+    if (_socket >= 0) {
+        ::close(_socket);
+    }
+    if (_boundSocket) {
+        ::unlink(_socketPath.c_str());
+    }
+}
+
+void StitchDaemon::run()
+{
+    monitor::ElapsedTime warmUpTime = warmUp(_threads, _defaults.enableOpenCL);
+
+    sockaddr_un address = socketAddress(_socketPath);
+    _socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_socket < 0) {
+        throw socketError("can't create socket");
+    }
+    removeStaleSocket(_socketPath);
+    if (::bind(_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        throw socketError("can't bind " + _socketPath);
+    }
+    _boundSocket = true;
+    // Requests read and write any path the daemon's user may, so only that
+    // user may connect.  Connections are refused until listen, so nobody
+    // else can connect before the mode is set.
+    if (::chmod(_socketPath.c_str(), S_IRUSR | S_IWUSR) < 0) {
+        throw socketError("can't restrict " + _socketPath + " to its owner");
+    }
+    if (::listen(_socket, SOMAXCONN) < 0) {
+        throw socketError("can't listen on " + _socketPath);
+    }
+
+    std::stringstream message;
+    message << "Warmed up in " << warmUpTime
+            << ", saved from each stitch, listening on " << _socketPath << ".";
+    _logger->log(logging::Logger::Severity::info, message, "daemon");
+
+    while (!_stopped) {
+        int client = ::accept(_socket, nullptr, nullptr);
+        if (client < 0) {
+            if (_stopped) {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw socketError("can't accept on " + _socketPath);
+        }
+        serve(client);
+        ::close(client);
+    }
+}
+
+void StitchDaemon::stop()
+{
+    _stopped = true;
+    if (_socket >= 0) {
+        ::shutdown(_socket, SHUT_RDWR);
+    }
+
+    std::lock_guard<std::mutex> guard(_currentMutex);
+    if (_current) {
+        _current->cancel();
+    }
+}
+
+void StitchDaemon::serve(int client)
+{
+    monitor::Timer setupTimer;
+    setupTimer.start();
+
+    LineReader reader(client);
+    std::string line;
+    if (!reader.next(line)) {
+        return;
+    }
+
+    Request request{ {}, "", _defaults, false };
+    std::string lastProgress;
+    std::string lastOutput;
+    monitor::Estimator *estimator = nullptr;
+    // Declared after the locals its progress callback uses, so that the
+    // stitcher, and its monitor's reporter thread, goes first.
+    std::shared_ptr<LowLevelOpenCVStitcher> stitcher;
+    try {
+        request = Request::parse(line, _defaults);
+
+        std::list<GeoImage> input;
+        for (const auto &inputPath : request.inputPaths) {
+            input.push_back(GeoImage::fromExif(inputPath));
+        }
+
+        // Progress is streamed from the updates of the estimator.
+        Panorama::Parameters &parameters = request.parameters;
+        parameters.enableElapsedTime = true;
+        parameters.enableEstimate = true;
+
+        stitcher = std::make_shared<LowLevelOpenCVStitcher>(
+                _config, Panorama { input }, parameters, request.outputPath,
+                _logger, [&]() {
+                    if (!estimator) {
+                        return;
+                    }
+                    std::stringstream progress;
+                    progress << std::fixed << std::setprecision(2)
+                             << estimator->currentProgress();
+                    if (progress.str() != lastProgress) {
+                        lastProgress = progress.str();
+                        sendLine(client, { "estimate",
+                                           estimator->currentEstimate().str() });
+                        sendLine(client, { "progress", lastProgress });
+                    }
+                    if (estimator->currentOutput() != lastOutput) {
+                        lastOutput = estimator->currentOutput();
+                        sendLine(client, { "output",
+                                           estimator->currentOutputElapsed().str(),
+                                           lastOutput });
+                    }
+                });
+        estimator = stitcher->estimator().get();
+        stitcher->setPreview(request.preview);
+    } catch (const std::exception &e) {
+        sendLine(client, { "error", e.what() });
+        return;
+    }
+
+    auto retrying = std::make_shared<RetryingStitcher>(stitcher, request.parameters,
+                                                       _logger);
+    {
+        std::lock_guard<std::mutex> guard(_currentMutex);
+        _current = retrying;
+        if (_stopped) {
+            retrying->cancel();
+        }
+    }
+
+    // The client cancels by asking to, or by going away.
+    std::atomic<bool> finished(false);
+    std::thread cancellation([&]() {
+        std::string line;
+        while (reader.next(line) && line != "cancel") {
+        }
+        if (!finished) {
+            retrying->cancel();
+        }
+    });
+
+    setupTimer.stop();
+    monitor::Timer stitchTimer;
+    stitchTimer.start();
+
+    std::stringstream message;
+    try {
+        retrying->stitch();
+        stitchTimer.stop();
+        sendLine(client, { "done", setupTimer.elapsed().str(),
+                           stitchTimer.elapsed().str() });
+        message << "Stitched " << request.outputPath << " from "
+                << request.inputPaths.size() << " images in " << stitchTimer.elapsed()
+                << ", set up in " << setupTimer.elapsed() << ".";
+    } catch (const std::exception &e) {
+        stitchTimer.stop();
+        if (stitcher->monitor()->cancelled()) {
+            sendLine(client, { "cancelled" });
+            message << "Cancelled " << request.outputPath << " after "
+                    << stitchTimer.elapsed() << ".";
+        } else {
+            sendLine(client, { "error", e.what() });
+            message << "Failed to stitch " << request.outputPath << " in "
+                    << stitchTimer.elapsed() << ": " << e.what();
+        }
+    }
+    _logger->log(logging::Logger::Severity::info, message, "daemon");
+
+    {
+        std::lock_guard<std::mutex> guard(_currentMutex);
+        _current.reset();
+    }
+    finished = true;
+    ::shutdown(client, SHUT_RD);
+    cancellation.join();
+}
+
+monitor::ElapsedTime StitchDaemon::warmUp(size_t threads, bool enableOpenCL)
+{
+    monitor::Timer timer;
+    timer.start();
+
+    cv::setNumThreads(static_cast<int>(threads));
+    cv::parallel_for_(cv::Range(0, static_cast<int>(threads)),
+                      [](const cv::Range &) {});
+    cv::ocl::setUseOpenCL(enableOpenCL);
+    if (cv::ocl::useOpenCL()) {
+        cv::ocl::Context::getDefault();
+    }
+
+    timer.stop();
+    return timer.elapsed();
+}
+
+} // namespace stitcher
+} // namespace airmap
@@ -34,6 +34,11 @@ void DistortionModel::crop(cv::Mat &image, cv::Rect &roi) {
     }
 }
 
+cv::Mat DistortionModel::undistortedK(int width, int height, cv::InputArray K) const
+{
+    return K.getMat().clone();
+}
+
 void DistortionModel::crop(std::vector<cv::Mat> &images) {
     if (_crop_roi_cb) {
         cv::Rect roi = _crop_roi_cb(images[0]);
@@ -162,6 +167,29 @@ void PinholeDistortionModel::undistort(std::vector<cv::Mat> &images,
     }
 }
 
+void PinholeDistortionModel::distort(cv::Mat &image, cv::InputArray K)
+{
+    // Where each pixel of the distorted image is in the undistorted image,
+    // a row at a time.
+    cv::Mat map(image.size(), CV_32FC2);
+    std::vector<cv::Point2f> distorted_points(image.cols);
+    std::vector<cv::Point2f> undistorted_points;
+    for (int y = 0; y < image.rows; ++y) {
+        for (int x = 0; x < image.cols; ++x) {
+            distorted_points[x] = cv::Point2f(x, y);
+        }
+        cv::undistortPoints(distorted_points, undistorted_points, K,
+                            _parameters.coefficients(), cv::noArray(), K);
+        std::copy(undistorted_points.begin(), undistorted_points.end(),
+                  map.ptr<cv::Point2f>(y));
+    }
+
+    cv::Mat distorted_image;
+    cv::remap(image, distorted_image, map, cv::noArray(), cv::INTER_LINEAR,
+              cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    image = distorted_image;
+}
+
 //
 // 
 // ScaramuzzaDistortionModel::Parameters
@@ -217,6 +245,55 @@ void ScaramuzzaDistortionModel::createPerspectiveUndistortionMaps(cv::Mat &map_x
     }
 }
 
+void ScaramuzzaDistortionModel::createPerspectiveDistortionMaps(cv::Mat &map_x,
+                                                                cv::Mat &map_y)
+{
+    int width = map_x.cols;
+    int height = map_x.rows;
+    float x_center = width / 2.0;
+    float y_center = height / 2.0;
+    float z = -width / _parameters.scale_factor;
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            cv::Point2d camera_point(x, y);
+            cv::Point3d world_point;
+            cameraToWorld(camera_point, world_point);
+
+            // Rays at or behind the perspective image plane aren't in it.
+            if (world_point.z >= 0) {
+                map_x.at<float>(y, x) = -1.f;
+                map_y.at<float>(y, x) = -1.f;
+                continue;
+            }
+            double t = z / world_point.z;
+            map_x.at<float>(y, x) = static_cast<float>(x_center + t * world_point.x);
+            map_y.at<float>(y, x) = static_cast<float>(y_center + t * world_point.y);
+        }
+    }
+}
+
+void ScaramuzzaDistortionModel::distort(cv::Mat &image, cv::InputArray K)
+{
+    cv::Mat map_x(image.size().height, image.size().width, CV_32FC1);
+    cv::Mat map_y(image.size().height, image.size().width, CV_32FC1);
+
+    createPerspectiveDistortionMaps(map_x, map_y);
+
+    cv::Mat distorted_image;
+    cv::remap(image, distorted_image, map_x, map_y, cv::INTER_LINEAR,
+              cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    image = distorted_image;
+}
+
+cv::Mat ScaramuzzaDistortionModel::undistortedK(int width, int height,
+                                                cv::InputArray K) const
+{
+    double focal_length = width / _parameters.scale_factor;
+    return (cv::Mat_<double>(3, 3) << focal_length, 0, width / 2.0, 0,
+            focal_length, height / 2.0, 0, 0, 1);
+}
+
 void ScaramuzzaDistortionModel::undistort(cv::Mat &image,
                                           cv::InputArray K)
 {
@@ -239,6 +316,35 @@ void ScaramuzzaDistortionModel::undistort(std::vector<cv::Mat> &images,
     }
 }
 
+void ScaramuzzaDistortionModel::cameraToWorld(cv::Point2d &camera_point,
+                                              cv::Point3d &world_point)
+{
+    std::vector<double> pol = _parameters.pol;
+    double xc = _parameters.xc * _parameters.resolution_scale;
+    double yc = _parameters.yc * _parameters.resolution_scale;
+    double c = _parameters.c;
+    double d = _parameters.d;
+    double e = _parameters.e;
+
+    // Undo the affine transformation and the resolution scale.
+    double u = camera_point.x - xc;
+    double v = camera_point.y - yc;
+    double x = (u - d * v) / (c - d * e);
+    double y = v - e * x;
+    x /= _parameters.resolution_scale;
+    y /= _parameters.resolution_scale;
+
+    double rho = sqrt(pow(x, 2) + pow(y, 2));
+    double z = pol[0];
+    double rho_i = 1;
+    for (int i = 1; i < static_cast<int>(pol.size()); ++i) {
+        rho_i *= rho;
+        z += rho_i * pol[i];
+    }
+
+    world_point = cv::Point3d(x, y, z);
+}
+
 void ScaramuzzaDistortionModel::worldToCamera(cv::Point3d &world_point,
                                               cv::Point2d &camera_point)
 {
@@ -1,5 +1,7 @@
 #include "airmap/gimbal.h"
 
+#include <cfloat>
+
 #include <opencv2/core/utility.hpp>
 
 namespace airmap {
@@ -22,6 +24,26 @@ GimbalOrientation::GimbalOrientation(const GimbalOrientation &other)
 {
 }
 
+cv::Mat GimbalOrientation::cameraRotation()
+{
+    GimbalOrientation gimbal_orientation = convertTo(Units::Radians);
+
+    double x = gimbal_orientation.pitch;
+    double y = gimbal_orientation.yaw;
+    double z = gimbal_orientation.roll;
+
+    cv::Mat Rx =
+            (cv::Mat_<double>(3, 3) << 1, 0, 0, 0, cos(x), -sin(x), 0, sin(x), cos(x));
+
+    cv::Mat Ry =
+            (cv::Mat_<double>(3, 3) << cos(y), 0, sin(y), 0, 1, 0, -sin(y), 0, cos(y));
+
+    cv::Mat Rz =
+            (cv::Mat_<double>(3, 3) << cos(z), -sin(z), 0, sin(z), cos(z), 0, 0, 0, 1);
+
+    return Ry * Rx * Rz;
+}
+
 GimbalOrientation GimbalOrientation::convertTo(Units _units)
 {
     if (_units == units) {
@@ -51,6 +73,16 @@ cv::Mat GimbalOrientation::homography(cv::Mat K)
     return H;
 }
 
+bool GimbalOrientation::hasOrientation() const
+{
+    for (double angle : {pitch, roll, yaw}) {
+        if (!std::isfinite(angle) || angle == DBL_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
 cv::Mat GimbalOrientation::rotationMatrix()
 {
     GimbalOrientation gimbal_orientation = convertTo(Units::Radians);
@@ -71,7 +103,6 @@ cv::Mat GimbalOrientation::rotationMatrix()
     cv::Mat R = Rx * Ry.inv() * Rz;
     R.at<double>(1, 1) *= -1;
     R.at<double>(2, 1) *= -1;
-    R.at<double>(3, 1) *= -1;
     return R;
 }
 
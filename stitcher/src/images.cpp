@@ -121,49 +121,35 @@ void SourceImages::scale(double scale, int interpolation)
     }
 }
 
-void SourceImages::scaleToAvailableMemory(size_t memoryBudgetMB,
-                        size_t &maxInputImageSize, size_t &inputSizeMB,
-                        double &inputScaled, int interpolation)
+MemoryPlan SourceImages::scaleToAvailableMemory(const MemoryPlanner &planner,
+                                                size_t &inputSizeMB,
+                                                double &inputScaled, int interpolation)
 {
-    size_t totalNoOfInputPixels = 0;
+    size_t imagePixels = 0;
     for (auto &image : images) {
         size_t pixels = image.cols * image.rows;
         inputSizeMB += (image.elemSize() * pixels) / (1024 * 1024);
-        totalNoOfInputPixels += pixels;
+        imagePixels = std::max(imagePixels, pixels);
     }
 
-    double maxInputImageScale = 
-        std::min(1.0, (1.0 * images.size() * maxInputImageSize)
-            / totalNoOfInputPixels);
-
-    // From this vantage point we consider the stitching algorithm a given. It needs a
-    // lot of RAM, or, more practically, to process an input of size X it needs Y
-    // megabytes of RAM and there's likely a linear relationship between X and Y,
-    // i.e.: Y = inputBudgetMultiplier * X. If Y is greater than
-    // parameters.memoryBudgetMB we'll stand no chance of succeeding and so we have no
-    // choice, but to scale the input. We've empirically established and will continue
-    // to calibrate the value of:
-    static constexpr double inputBudgetMultiplier = 5;
-    double maxRAMBudgetScale = memoryBudgetMB
-                                    / (inputBudgetMultiplier * inputSizeMB);
-    inputScaled = std::min(maxRAMBudgetScale, maxInputImageScale);
+    // Rather than assume the stitch needs a multiple of its input, predict
+    // the peak of each stage from the size of the images and the
+    // configuration, and scale the input no further than the stages need.
+    MemoryPlan plan = planner.plan(images.size(), imagePixels);
+    _logger->log(Logger::Severity::info, plan.str().c_str(), "stitcher");
+    inputScaled = plan.inputScale;
 
     if (inputScaled < 1.0) {
-        if (inputScaled < 0.2) {
-            std::stringstream ss;
-            ss << "The RAM budget given ( " << memoryBudgetMB
-               << "MB) enforces too much scaling (" << inputScaled << ") of the ("
-               << inputSizeMB << " MB of) input, aborting.";
-            throw std::invalid_argument(ss.str());
-        }
-
         // Stitching is indeterministic and it may be retried on it - knowing that,
         // nudge the calculated scale by a small, random amount to hopefully push the
-        // stitcher from a hypothetical sticky error condition.
+        // stitcher from a hypothetical sticky error condition.  The plan is the
+        // largest scale that fits, so the nudge only ever scales further, by up
+        // to 2%.
         std::random_device rd;
         std::mt19937 gen(rd());
-        std::uniform_real_distribution<> dis(-0.01, 0.01);
-        inputScaled += dis(gen);
+        std::uniform_real_distribution<> dis(-0.02, 0.);
+        inputScaled *= 1.0 + dis(gen);
+        plan.inputScale = inputScaled;
 
         // Scale the images.
         scale(inputScaled, interpolation);
@@ -171,22 +157,11 @@ void SourceImages::scaleToAvailableMemory(size_t memoryBudgetMB,
 
         std::stringstream message;
         message << "Scaled " << inputSizeMB << " MB of input to "
-                << inputSizeMB * inputScaled << " MB (by "
-                << inputScaled << "), the lesser of: ";
-        _logger->log(Logger::Severity::info, message, "stitcher");
-
-        message.str("");
-        message << " - " << maxRAMBudgetScale << " to fit the given RAM budget of "
-                << memoryBudgetMB << " MB and ";
-        _logger->log(Logger::Severity::info, message, "stitcher");
-
-        size_t maxInputImgWidth = std::sqrt(4 * maxInputImageSize / 3);
-        size_t maxInputImgHeight = 3 * maxInputImgWidth / 4;
-        message.str("");
-        message << " - " << maxInputImageScale << " max input image size of "
-                << maxInputImgWidth << "x" << maxInputImgHeight;
+                << inputSizeMB * inputScaled * inputScaled << " MB (by "
+                << inputScaled << ").";
         _logger->log(Logger::Severity::info, message, "stitcher");
     }
+    return plan;
 }
 
 } // namespace stitcher
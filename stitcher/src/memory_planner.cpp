@@ -0,0 +1,334 @@
+#include "airmap/memory_planner.h"
+
+#include <opencv2/stitching/detail/blenders.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+
+namespace {
+
+constexpr double bytes_per_mb = 1024. * 1024.;
+
+//! A decoded 8 bit, 3 channel pixel.
+constexpr double image_bytes = 3;
+
+//! How much larger the bounding box of a warped image is than the image,
+//! the more so towards the poles of a spherical projection.
+constexpr double warp_expansion = 1.5;
+
+//! Per pixel of the maps an image is undistorted with, two floats.
+constexpr double remap_bytes = 8;
+
+//! Per keypoint, its position, size, angle, response, octave and class.
+constexpr double keypoint_bytes = 28;
+
+//! Per match of a pair of images, the match and its inlier flag.
+constexpr double match_bytes = 17;
+
+//! Per warped pixel at seam scale: the warped image, its float copy for
+//! the seam finder, and the warped masks.
+constexpr double seam_warp_bytes = 3 + 12 + 1 + 1;
+
+//! Per warped pixel of a pair of images, the graph cut seam finders'
+//! vertices, edges and their costs.
+constexpr double graph_cut_bytes = 48;
+
+//! Per warped pixel of a pair of images, the dynamic programming seam
+//! finders' costs and labels.
+constexpr double dp_bytes = 8;
+
+//! Per panorama pixel, the blender's 16 bit image and float weights, over
+//! all levels of the pyramid of a multi-band blender.
+constexpr double multi_band_bytes = (6 + 4) * 4. / 3;
+constexpr double feather_bytes = 6 + 4;
+constexpr double no_blend_bytes = 6 + 1;
+
+//! Per warped pixel of the image being fed to the blender: the warped
+//! image, its 16 bit copy and its masks, and for a multi-band blender the
+//! pyramids of the image and its weights.
+constexpr double feed_bytes = 3 + 6 + 3;
+constexpr double feed_pyramid_bytes = (6 + 4) * 4. / 3;
+
+//! Per panorama pixel, the 16 bit panorama.
+constexpr double panorama_bytes = 6;
+
+//! Per pixel of a cube map face, the face and the maps it is remapped with.
+constexpr double cubemap_face_bytes = 3 + remap_bytes;
+
+double descriptorBytes(FeaturesFinderType type)
+{
+    switch (type) {
+    case FeaturesFinderType::Akaze:
+        return 61;
+    case FeaturesFinderType::Orb:
+        return 32;
+    case FeaturesFinderType::Sift:
+        return 128 * 4;
+    case FeaturesFinderType::Surf:
+        return 64 * 4;
+    }
+    return 32;
+}
+
+double seamFinderBytes(SeamFinderType type)
+{
+    switch (type) {
+    case SeamFinderType::GraphCutColor:
+    case SeamFinderType::GraphCutColorGrad:
+    case SeamFinderType::GraphCutGridColor:
+    case SeamFinderType::GraphCutGridColorGrad:
+        return graph_cut_bytes;
+    case SeamFinderType::DpColor:
+    case SeamFinderType::DpColorGrad:
+        return dp_bytes;
+    case SeamFinderType::No:
+    case SeamFinderType::Voronoi:
+        return 0;
+    }
+    return graph_cut_bytes;
+}
+
+double megapixScale(double megapix, double pixels)
+{
+    if (megapix < 0 || pixels <= 0) {
+        return 1.;
+    }
+    return std::min(1., std::sqrt(megapix * 1e6 / pixels));
+}
+
+/**
+ * @brief largestScale
+ * The largest scale up to upper that fits, assuming the smaller a scale
+ * the more it fits, 0 if none does.
+ */
+double largestScale(double upper, const std::function<bool(double)> &fits)
+{
+    if (fits(upper)) {
+        return upper;
+    }
+    double lower = 0.;
+    for (int i = 0; i < 32; ++i) {
+        const double scale = (lower + upper) / 2;
+        if (fits(scale)) {
+            lower = scale;
+        } else {
+            upper = scale;
+        }
+    }
+    return lower;
+}
+
+bool isLoadStage(monitor::Operation::Enum stage)
+{
+    return stage == monitor::Operation::Enum::LoadImages
+            || stage == monitor::Operation::Enum::UndistortImages
+            || stage == monitor::Operation::Enum::ScaleImages;
+}
+
+} // namespace
+
+constexpr double MemoryPlanner::baselineMB;
+constexpr double MemoryPlanner::minimumScale;
+
+size_t MemoryPlan::peakMB() const
+{
+    size_t peak = 0;
+    for (const auto &stage : peaksMB) {
+        if (!isLoadStage(stage.first)) {
+            peak = std::max(peak, stage.second);
+        }
+    }
+    return peak;
+}
+
+size_t MemoryPlan::loadPeakMB() const
+{
+    size_t peak = 0;
+    for (const auto &stage : peaksMB) {
+        if (isLoadStage(stage.first)) {
+            peak = std::max(peak, stage.second);
+        }
+    }
+    return peak;
+}
+
+std::string MemoryPlan::str() const
+{
+    std::stringstream ss;
+    ss << std::setprecision(3) << "Memory plan: input scale " << inputScale
+       << ", work scale " << workScale << ", seam scale " << seamScale
+       << ", compose scale " << composeScale << ", panorama of "
+       << panoramaPixels / 1e6 << " MP, predicted peaks of";
+    const char *separator = " ";
+    for (const auto &stage : peaksMB) {
+        ss << separator << monitor::Operation(stage.first).str() << " " << stage.second
+           << " MB";
+        separator = ", ";
+    }
+    ss << ".";
+    return ss.str();
+}
+
+MemoryPlanner::MemoryPlanner(const Configuration &config,
+                             const Panorama::Parameters &parameters,
+                             double focalPixels, bool undistort)
+    : _config(config)
+    , _parameters(parameters)
+    , _focalPixels(focalPixels)
+    , _undistort(undistort)
+{
+}
+
+double MemoryPlanner::maxInputScale(size_t imagePixels) const
+{
+    if (imagePixels == 0) {
+        return 1.;
+    }
+    return std::min(1., std::sqrt(static_cast<double>(_parameters.maxInputImageSize)
+                                  / imagePixels));
+}
+
+double MemoryPlanner::configuredComposeScale(size_t imagePixels, double inputScale) const
+{
+    return megapixScale(_config.compose_megapix,
+                        imagePixels * inputScale * inputScale);
+}
+
+MemoryPlan MemoryPlanner::predict(size_t imageCount, size_t imagePixels,
+                                  double inputScale, double composeScale) const
+{
+    const double n = static_cast<double>(imageCount);
+    const double original = static_cast<double>(imagePixels);
+    const double input = original * inputScale * inputScale;
+
+    MemoryPlan plan;
+    plan.inputScale = inputScale;
+    plan.composeScale = composeScale;
+    plan.workScale = megapixScale(_config.work_megapix, input);
+    plan.seamScale = megapixScale(_config.seam_megapix, input);
+
+    const double work = input * plan.workScale * plan.workScale;
+    const double seam = input * plan.seamScale * plan.seamScale;
+    const double compose = input * composeScale * composeScale;
+    const double seamWarped = seam * warp_expansion;
+    const double composeWarped = compose * warp_expansion;
+
+    // The panorama is at most a full sphere, which an equirectangular
+    // projection spans twice as wide as high, and padded to.
+    const double focal = _focalPixels * inputScale * composeScale;
+    const double sphere = 2 * M_PI * M_PI * focal * focal;
+    const double panorama = focal > 0 ? std::min(sphere, n * composeWarped)
+                                      : n * composeWarped;
+    const double padded = focal > 0 ? sphere : panorama;
+    plan.panoramaPixels = static_cast<size_t>(panorama);
+
+    double blenderBytes = no_blend_bytes;
+    double feedBytes = feed_bytes;
+    if (std::sqrt(panorama) * _config.blend_strength / 100. >= 1.) {
+        if (_config.blender_type == cv::detail::Blender::MULTI_BAND) {
+            blenderBytes = multi_band_bytes;
+            feedBytes += feed_pyramid_bytes;
+        } else if (_config.blender_type == cv::detail::Blender::FEATHER) {
+            blenderBytes = feather_bytes;
+        }
+    }
+
+    const double features = n * _config.features_maximum
+            * (keypoint_bytes + descriptorBytes(_config.features_finder_type));
+    const double matches = n * n * _config.features_maximum * match_bytes;
+    // Seams are found one pair of images at a time.
+    const double seamFinder = 2 * seamWarped * seamFinderBytes(_config.seam_finder_type);
+
+    std::map<monitor::Operation::Enum, double> bytes;
+    bytes[monitor::Operation::Enum::LoadImages] = n * original * image_bytes;
+    if (_undistort) {
+        bytes[monitor::Operation::Enum::UndistortImages] =
+                n * original * image_bytes + original * (image_bytes + remap_bytes);
+    }
+    bytes[monitor::Operation::Enum::ScaleImages] =
+            n * original * image_bytes + (inputScale < 1. ? n * input * image_bytes : 0.);
+    bytes[monitor::Operation::Enum::FindFeatures] =
+            n * (input + work) * image_bytes + features;
+    bytes[monitor::Operation::Enum::MatchFeatures] =
+            n * (input + work) * image_bytes + features + matches;
+    bytes[monitor::Operation::Enum::WarpImages] =
+            n * (input + seam) * image_bytes + n * seamWarped * seam_warp_bytes;
+    // The images are scaled to compose scale as the last step of finding
+    // seams, once the warped images are released but their seam masks.
+    bytes[monitor::Operation::Enum::FindSeams] = n * input * image_bytes
+            + std::max(n * seam * image_bytes + n * seamWarped * (seam_warp_bytes - 3)
+                               + seamFinder,
+                       n * seamWarped + n * compose * image_bytes);
+    bytes[monitor::Operation::Enum::Compose] = n * compose * image_bytes
+            + n * seamWarped + panorama * blenderBytes
+            + std::min(panorama, composeWarped) * feedBytes;
+    bytes[monitor::Operation::Enum::CropPanorama] = (panorama + padded) * panorama_bytes;
+    bytes[monitor::Operation::Enum::WritePanorama] =
+            padded * (panorama_bytes + image_bytes);
+    if (_parameters.alsoCreateCubeMap) {
+        // One face, a quarter of the width of the panorama, at a time.
+        bytes[monitor::Operation::Enum::WriteCubemap] =
+                padded * panorama_bytes + padded / 8 * cubemap_face_bytes;
+    }
+
+    for (const auto &stage : bytes) {
+        plan.peaksMB[stage.first] =
+                static_cast<size_t>(std::ceil(baselineMB + stage.second / bytes_per_mb));
+    }
+    return plan;
+}
+
+MemoryPlan MemoryPlanner::plan(size_t imageCount, size_t imagePixels) const
+{
+    const size_t budgetMB = _parameters.memoryBudgetMB;
+    auto fits = [&](double inputScale, double composeScale, monitor::Operation::Enum last) {
+        const MemoryPlan plan = predict(imageCount, imagePixels, inputScale, composeScale);
+        for (const auto &stage : plan.peaksMB) {
+            if (!isLoadStage(stage.first) && stage.first <= last
+                && stage.second > budgetMB) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Work and seam scales are set in megapixels, so the input scale only
+    // matters to the resolution of the panorama: the input is scaled just
+    // as much as the stages need to compose at the configured scale.
+    double inputScale = largestScale(maxInputScale(imagePixels), [&](double scale) {
+        return fits(scale, configuredComposeScale(imagePixels, scale),
+                    monitor::Operation::Enum::Complete);
+    });
+    double composeScale = configuredComposeScale(imagePixels, inputScale);
+
+    // Below the least input scale, the stages before composition are given
+    // the least input, and composition is scaled down further.
+    const double maxComposeScale = configuredComposeScale(imagePixels, minimumScale);
+    if (inputScale < minimumScale
+        && fits(minimumScale, minimumScale * maxComposeScale,
+                monitor::Operation::Enum::FindSeams)) {
+        inputScale = minimumScale;
+        composeScale = largestScale(maxComposeScale, [&](double scale) {
+            return fits(inputScale, scale, monitor::Operation::Enum::Complete);
+        });
+    }
+
+    if (inputScale < minimumScale || composeScale < minimumScale * maxComposeScale) {
+        std::stringstream ss;
+        ss << "The RAM budget given (" << budgetMB << " MB) enforces too much scaling"
+           << " (input " << inputScale << ", compose " << composeScale << ") of the "
+           << imageCount << " images of " << imagePixels / 1e6 << " MP, aborting.";
+        throw std::invalid_argument(ss.str());
+    }
+    return predict(imageCount, imagePixels, inputScale, composeScale);
+}
+
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,436 @@
+#include "airmap/monitor/allocator.h"
+#include "airmap/stitcher.h"
+
+#include <opencv2/core/mat.hpp>
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+namespace {
+
+constexpr size_t bytes_per_mb = 1024 * 1024;
+
+/**
+ * @brief raise
+ * Raise an atomic peak to at least a value.
+ */
+void raise(std::atomic<size_t> &peak, size_t value)
+{
+    size_t current = peak.load(std::memory_order_relaxed);
+    while (current < value
+           && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Account
+ * The counters of a tracker, referenced by the tracker, its bindings and
+ * each matrix charged to it, and deleted with the last of them.
+ */
+struct AllocationTracker::Account
+{
+    struct Stage
+    {
+        Account *account;
+        std::atomic<uint64_t> allocations;
+        std::atomic<size_t> allocatedBytes;
+        std::atomic<size_t> liveBytes;
+        std::atomic<size_t> peakBytes;
+    };
+
+    std::atomic<size_t> references;
+    std::atomic<int> operation;
+    std::atomic<size_t> budgetBytes;
+    std::atomic<size_t> liveBytes;
+    std::array<Stage, Operation::count> stages;
+
+    //! The first allocation refused since the budget was set, if any.
+    mutable std::mutex exceededMutex;
+    bool exceeded;
+    Operation::Enum exceededOperation;
+    size_t exceededRequiredBytes;
+
+    Account()
+        : references(1)
+        , operation(static_cast<int>(Operation::Enum::Start))
+        , budgetBytes(0)
+        , liveBytes(0)
+        , exceeded(false)
+        , exceededOperation(Operation::Enum::Start)
+        , exceededRequiredBytes(0)
+    {
+        for (auto &stage : stages) {
+            stage.account = this;
+            stage.allocations = 0;
+            stage.allocatedBytes = 0;
+            stage.liveBytes = 0;
+            stage.peakBytes = 0;
+        }
+    }
+
+    void acquire() { references.fetch_add(1, std::memory_order_relaxed); }
+
+    void release()
+    {
+        if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    /**
+     * @brief charge
+     * Charge an allocation of the given bytes to the current operation.
+     * @throws Stitcher::MemoryBudgetExceededError If it would exceed the
+     * budget.
+     */
+    Stage *charge(size_t bytes)
+    {
+        const Operation::Enum current =
+                static_cast<Operation::Enum>(operation.load(std::memory_order_relaxed));
+        const size_t budget = budgetBytes.load(std::memory_order_relaxed);
+        const size_t live = liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        if (budget > 0 && live > budget) {
+            liveBytes.fetch_sub(bytes, std::memory_order_relaxed);
+            refuse(current, budget, live);
+        }
+
+        Stage &stage = stages[static_cast<size_t>(current)];
+        stage.allocations.fetch_add(1, std::memory_order_relaxed);
+        stage.allocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+        stage.liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+        raise(stage.peakBytes, live);
+        acquire();
+        return &stage;
+    }
+
+    [[noreturn]] void refuse(Operation::Enum current, size_t budget, size_t required)
+    {
+        {
+            std::lock_guard<std::mutex> lock(exceededMutex);
+            if (!exceeded) {
+                exceeded = true;
+                exceededOperation = current;
+                exceededRequiredBytes = required;
+            }
+        }
+        throw error(current, budget, required);
+    }
+
+    Stitcher::MemoryBudgetExceededError error(Operation::Enum current, size_t budget,
+                                              size_t required) const
+    {
+        std::stringstream message;
+        message << Operation(current).str() << " needs " << required / bytes_per_mb
+                << " MB of matrices, over the budget of " << budget / bytes_per_mb
+                << " MB";
+        return Stitcher::MemoryBudgetExceededError(message.str(), current,
+                                                   budget / bytes_per_mb,
+                                                   required / bytes_per_mb);
+    }
+};
+
+namespace {
+
+thread_local AllocationTracker::Account *boundAccount = nullptr;
+
+/**
+ * @brief TrackingAllocator
+ * OpenCV's standard allocator, which charges the matrices it allocates to
+ * the tracker bound to the allocating thread, and credits them back to it
+ * once deallocated.  Installed once per process and never destroyed, as
+ * matrices may outlive any stitch.
+ */
+class TrackingAllocator : public cv::MatAllocator
+{
+public:
+    static TrackingAllocator &instance()
+    {
+        static TrackingAllocator *allocator = new TrackingAllocator();
+        return *allocator;
+    }
+
+    void bind(AllocationTracker::Account *account)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_installed) {
+            cv::Mat::setDefaultAllocator(this);
+            _installed = true;
+        }
+        ++_bindings[account];
+        account->acquire();
+        publishSole();
+    }
+
+    void unbind(AllocationTracker::Account *account)
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto binding = _bindings.find(account);
+            if (--binding->second == 0) {
+                _bindings.erase(binding);
+            }
+            publishSole();
+        }
+        account->release();
+    }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                           size_t *step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override
+    {
+        AllocationTracker::Account::Stage *stage = nullptr;
+        size_t bytes = CV_ELEM_SIZE(type);
+        for (int i = 0; i < dims; ++i) {
+            bytes *= static_cast<size_t>(sizes[i]);
+        }
+        // Matrices of user data allocate nothing.
+        AllocationTracker::Account *account = data ? nullptr : chargedAccount();
+        if (account) {
+            try {
+                stage = account->charge(bytes);
+            } catch (...) {
+                account->release();
+                throw;
+            }
+            account->release();
+        }
+
+        cv::UMatData *u = nullptr;
+        try {
+            u = _std->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        } catch (...) {
+            credit(stage, bytes);
+            throw;
+        }
+        // Deallocated by this allocator, or by OpenCL's once it's done with
+        // the matrix, which deallocates it with the previous allocator.
+        u->currAllocator = this;
+        u->prevAllocator = this;
+        // The allocators of OpenCV leave userdata alone.
+        u->userdata = stage;
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessFlags,
+                  cv::UMatUsageFlags usageFlags) const override
+    {
+        return _std->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *u) const override
+    {
+        if (!u) {
+            return;
+        }
+        auto *stage = static_cast<AllocationTracker::Account::Stage *>(u->userdata);
+        const size_t size = u->size;
+        u->userdata = nullptr;
+        _std->deallocate(u);
+        if (stage) {
+            credit(stage, size);
+        }
+    }
+
+private:
+    TrackingAllocator()
+        : _std(cv::Mat::getStdAllocator())
+        , _installed(false)
+        , _sole(nullptr)
+        , _soleReaders(0)
+    {
+    }
+
+    /**
+     * @brief chargedAccount
+     * The account to charge the calling thread's matrices to, acquired, or
+     * nullptr if none.  Lock-free, as OpenCV's workers allocate unbound.
+     */
+    AllocationTracker::Account *chargedAccount() const
+    {
+        if (boundAccount) {
+            boundAccount->acquire();
+            return boundAccount;
+        }
+        _soleReaders.fetch_add(1);
+        AllocationTracker::Account *account = _sole.load();
+        if (account) {
+            account->acquire();
+        }
+        _soleReaders.fetch_sub(1);
+        return account;
+    }
+
+    /**
+     * @brief publishSole
+     * Publish the account bound, if it is the only one, to the threads
+     * bound to none, with a reference of its own.  With the mutex locked.
+     */
+    void publishSole()
+    {
+        AllocationTracker::Account *sole =
+                _bindings.size() == 1 ? _bindings.begin()->first : nullptr;
+        if (sole == _sole.load()) {
+            return;
+        }
+        if (sole) {
+            sole->acquire();
+        }
+        AllocationTracker::Account *previous = _sole.exchange(sole);
+        // Threads that loaded the previous account acquire it before they
+        // stop reading, so its published reference is released after they
+        // have, never while one is about to acquire it.
+        while (_soleReaders.load() > 0) {
+            std::this_thread::yield();
+        }
+        if (previous) {
+            previous->release();
+        }
+    }
+
+    static void credit(AllocationTracker::Account::Stage *stage, size_t size)
+    {
+        if (!stage) {
+            return;
+        }
+        stage->liveBytes.fetch_sub(size, std::memory_order_relaxed);
+        stage->account->liveBytes.fetch_sub(size, std::memory_order_relaxed);
+        stage->account->release();
+    }
+
+    cv::MatAllocator *_std;
+    mutable std::mutex _mutex;
+    std::map<AllocationTracker::Account *, size_t> _bindings;
+    bool _installed;
+    //! The only account bound, if only one is, and the threads reading it.
+    std::atomic<AllocationTracker::Account *> _sole;
+    mutable std::atomic<size_t> _soleReaders;
+};
+
+} // namespace
+
+//
+//
+// AllocationTracker::Binding
+//
+//
+AllocationTracker::Binding::Binding(Account *account)
+    : _account(account)
+    , _previous(boundAccount)
+{
+    TrackingAllocator::instance().bind(_account);
+    boundAccount = _account;
+}
+
+AllocationTracker::Binding::Binding(Binding &&other)
+    : _account(other._account)
+    , _previous(other._previous)
+{
+    other._account = nullptr;
+}
+
+AllocationTracker::Binding::~Binding()
+{
+    if (_account) {
+        boundAccount = _previous;
+        TrackingAllocator::instance().unbind(_account);
+    }
+}
+
+//
+//
+// AllocationTracker
+//
+//
+AllocationTracker::AllocationTracker()
+    : _account(new Account())
+{
+}
+
+AllocationTracker::~AllocationTracker()
+{
+    _account->release();
+}
+
+AllocationTracker::SharedPtr AllocationTracker::create()
+{
+    return std::make_shared<AllocationTracker>();
+}
+
+AllocationTracker::Binding AllocationTracker::bind()
+{
+    return Binding(_account);
+}
+
+size_t AllocationTracker::budgetMB() const
+{
+    return _account->budgetBytes.load(std::memory_order_relaxed) / bytes_per_mb;
+}
+
+void AllocationTracker::changeOperation(Operation::Enum operation)
+{
+    _account->operation.store(static_cast<int>(operation), std::memory_order_relaxed);
+    raise(_account->stages[static_cast<size_t>(operation)].peakBytes,
+          _account->liveBytes.load(std::memory_order_relaxed));
+}
+
+void AllocationTracker::checkBudget() const
+{
+    std::lock_guard<std::mutex> lock(_account->exceededMutex);
+    if (_account->exceeded) {
+        throw _account->error(_account->exceededOperation,
+                              _account->budgetBytes.load(std::memory_order_relaxed),
+                              _account->exceededRequiredBytes);
+    }
+}
+
+size_t AllocationTracker::liveBytes() const
+{
+    return _account->liveBytes.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::reset()
+{
+    const size_t live = _account->liveBytes.load(std::memory_order_relaxed);
+    for (auto &stage : _account->stages) {
+        stage.allocations = 0;
+        stage.allocatedBytes = 0;
+        stage.peakBytes = 0;
+    }
+    raise(_account->stages[static_cast<size_t>(_account->operation.load())].peakBytes,
+          live);
+
+    std::lock_guard<std::mutex> lock(_account->exceededMutex);
+    _account->exceeded = false;
+}
+
+void AllocationTracker::setBudgetMB(size_t budgetMB)
+{
+    _account->budgetBytes.store(budgetMB * bytes_per_mb, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(_account->exceededMutex);
+    _account->exceeded = false;
+}
+
+AllocationStats AllocationTracker::stats(Operation::Enum operation) const
+{
+    const Account::Stage &stage = _account->stages[static_cast<size_t>(operation)];
+    AllocationStats stats;
+    stats.allocations = stage.allocations.load(std::memory_order_relaxed);
+    stats.allocatedBytes = stage.allocatedBytes.load(std::memory_order_relaxed);
+    stats.liveBytes = stage.liveBytes.load(std::memory_order_relaxed);
+    stats.peakBytes = stage.peakBytes.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
@@ -1,5 +1,7 @@
 #include "airmap/monitor/estimator.h"
 
+#include <cmath>
+
 namespace airmap {
 namespace stitcher {
 namespace monitor {
@@ -37,6 +39,10 @@ void OperationsEstimator::changeOperation(const Operation &operation)
             OperationElapsedTimesMoveIter(std::begin(operationEstimates)),
             OperationElapsedTimesMoveIter(std::end(operationEstimates)));
 
+    if (operation == Operation::Complete()) {
+        recordJob();
+    }
+
     log();
     updated();
 }
@@ -86,16 +92,21 @@ double OperationsEstimator::currentProgress() const
 double OperationsEstimator::elapsedToEstimateRatio() const
 {
     OperationDoubleMap _elapsedToEstimateRatios = elapsedToEstimateRatios();
+    // Average over the operations that ran, as skipped ones have no ratio.
+    int finishedOperations = 0;
     double _elapsedToEstimateRatio { std::accumulate(
             std::begin(_elapsedToEstimateRatios), std::end(_elapsedToEstimateRatios), 0.,
-            [this](const double &previous, const OperationDoublePair &current) {
+            [this, &finishedOperations](const double &previous,
+                                        const OperationDoublePair &current) {
                 if (Operation { current.first } < _currentOperation) {
+                    finishedOperations++;
                     return previous + current.second;
                 }
                 return previous;
             }) };
-    _elapsedToEstimateRatio =
-        _elapsedToEstimateRatio / _currentOperation.toInt();
+    _elapsedToEstimateRatio = finishedOperations > 0
+        ? _elapsedToEstimateRatio / finishedOperations
+        : 0.;
     _elapsedToEstimateRatio =
         _elapsedToEstimateRatio > 0. ? _elapsedToEstimateRatio : 1.0;
     return _elapsedToEstimateRatio;
@@ -166,104 +177,94 @@ const ElapsedTime OperationsEstimator::estimatedTimeTotal() const
 
 const OperationElapsedTimesMap OperationsEstimator::estimateOperations() const
 {
-    OperationElapsedTimesMap operationEstimates;
-
     if (!_enabled) {
+        return {};
+    }
+
+    OperationElapsedTimesMap operationEstimates = cameraOperationEstimates();
+    if (!_history || _jobFeatures.empty()) {
         return operationEstimates;
     }
 
-    if (_camera) {
-        if (_camera->distortion_model) {
-            PinholeDistortionModel *pinholeDistortionModel =
-                dynamic_cast<PinholeDistortionModel *>(
-                    _camera->distortion_model.get());
-            if (pinholeDistortionModel) {
-                operationEstimates.clear();
-                operationEstimates.insert(std::make_pair(
-                        Operation::Start().value(), ElapsedTime::fromMilliseconds(2500)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::UndistortImages().value(),
-                                       ElapsedTime::fromMilliseconds(400)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::FindFeatures().value(),
-                                       ElapsedTime::fromMilliseconds(500)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::MatchFeatures().value(),
-                                       ElapsedTime::fromMilliseconds(1500)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::EstimateCameraParameters().value(),
-                                       ElapsedTime::fromMilliseconds(100)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::AdjustCameraParameters().value(),
-                                       ElapsedTime::fromSeconds(30)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::PrepareExposureCompensation().value(),
-                                       ElapsedTime::fromMilliseconds(2500)));
-                operationEstimates.insert(std::make_pair(Operation::FindSeams().value(),
-                                                          ElapsedTime::fromSeconds(70)));
-                operationEstimates.insert(std::make_pair(Operation::Compose().value(),
-                                                          ElapsedTime::fromSeconds(100)));
-                operationEstimates.insert(std::make_pair(Operation::Complete().value(),
-                                                          ElapsedTime::fromSeconds(10)));
-                return operationEstimates;
-            }
-
-            ScaramuzzaDistortionModel *scaramuzzaDistortionModel =
-                dynamic_cast<ScaramuzzaDistortionModel *>(
-                    _camera->distortion_model.get());
-            if (scaramuzzaDistortionModel) {
-                operationEstimates.insert(std::make_pair(
-                        Operation::Start().value(), ElapsedTime::fromMilliseconds(1500)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::UndistortImages().value(),
-                                       ElapsedTime::fromSeconds(30)));
-                operationEstimates.insert(std::make_pair(
-                        Operation::FindFeatures().value(), ElapsedTime::fromSeconds(0)));
-                operationEstimates.insert(std::make_pair(
-                        Operation::MatchFeatures().value(), ElapsedTime::fromSeconds(0)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::EstimateCameraParameters().value(),
-                                       ElapsedTime::fromSeconds(0)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::AdjustCameraParameters().value(),
-                                       ElapsedTime::fromSeconds(30)));
-                operationEstimates.insert(
-                        std::make_pair(Operation::PrepareExposureCompensation().value(),
-                                       ElapsedTime::fromSeconds(10)));
-                operationEstimates.insert(std::make_pair(Operation::FindSeams().value(),
-                                                          ElapsedTime::fromSeconds(100)));
-                operationEstimates.insert(std::make_pair(Operation::Compose().value(),
-                                                          ElapsedTime::fromSeconds(100)));
-                operationEstimates.insert(std::make_pair(Operation::Complete().value(),
-                                                          ElapsedTime::fromSeconds(10)));
-                return operationEstimates;
-            }
+    // Operations the history has no records of keep their estimate.
+    for (auto &prediction : _history->predict(_jobFeatures)) {
+        operationEstimates.erase(prediction.first);
+        operationEstimates.insert(prediction);
+    }
+    return operationEstimates;
+}
+
+const OperationElapsedTimesMap OperationsEstimator::cameraOperationEstimates() const
+{
+    if (_camera && _camera->distortion_model) {
+        if (dynamic_cast<PinholeDistortionModel *>(_camera->distortion_model.get())) {
+            return {
+                { Operation::Start().value(), ElapsedTime::fromMilliseconds(100) },
+                { Operation::LoadImages().value(), ElapsedTime::fromMilliseconds(1500) },
+                { Operation::UndistortImages().value(), ElapsedTime::fromMilliseconds(400) },
+                { Operation::ScaleImages().value(), ElapsedTime::fromMilliseconds(900) },
+                { Operation::FindFeatures().value(), ElapsedTime::fromMilliseconds(500) },
+                { Operation::MatchFeatures().value(), ElapsedTime::fromMilliseconds(1500) },
+                { Operation::EstimateCameraParameters().value(), ElapsedTime::fromMilliseconds(100) },
+                { Operation::ComposePreview().value(), ElapsedTime::fromSeconds(3) },
+                { Operation::AdjustCameraParameters().value(), ElapsedTime::fromSeconds(30) },
+                { Operation::WarpImages().value(), ElapsedTime::fromSeconds(1) },
+                { Operation::PrepareExposureCompensation().value(), ElapsedTime::fromMilliseconds(1500) },
+                { Operation::ShouldRotate().value(), ElapsedTime::fromSeconds(3) },
+                { Operation::FindSeams().value(), ElapsedTime::fromSeconds(70) },
+                { Operation::Compose().value(), ElapsedTime::fromSeconds(100) },
+                { Operation::CropPanorama().value(), ElapsedTime::fromSeconds(2) },
+                { Operation::WritePanorama().value(), ElapsedTime::fromSeconds(7) },
+                { Operation::WriteCubemap().value(), ElapsedTime::fromSeconds(1) },
+                { Operation::Complete().value(), ElapsedTime::fromSeconds(0) }
+            };
+        }
+
+        if (dynamic_cast<ScaramuzzaDistortionModel *>(
+                    _camera->distortion_model.get())) {
+            return {
+                { Operation::Start().value(), ElapsedTime::fromMilliseconds(100) },
+                { Operation::LoadImages().value(), ElapsedTime::fromSeconds(1) },
+                { Operation::UndistortImages().value(), ElapsedTime::fromSeconds(30) },
+                { Operation::ScaleImages().value(), ElapsedTime::fromMilliseconds(400) },
+                { Operation::FindFeatures().value(), ElapsedTime::fromSeconds(0) },
+                { Operation::MatchFeatures().value(), ElapsedTime::fromSeconds(0) },
+                { Operation::EstimateCameraParameters().value(), ElapsedTime::fromSeconds(0) },
+                { Operation::ComposePreview().value(), ElapsedTime::fromSeconds(3) },
+                { Operation::AdjustCameraParameters().value(), ElapsedTime::fromSeconds(30) },
+                { Operation::WarpImages().value(), ElapsedTime::fromSeconds(3) },
+                { Operation::PrepareExposureCompensation().value(), ElapsedTime::fromSeconds(7) },
+                { Operation::ShouldRotate().value(), ElapsedTime::fromSeconds(3) },
+                { Operation::FindSeams().value(), ElapsedTime::fromSeconds(100) },
+                { Operation::Compose().value(), ElapsedTime::fromSeconds(100) },
+                { Operation::CropPanorama().value(), ElapsedTime::fromSeconds(2) },
+                { Operation::WritePanorama().value(), ElapsedTime::fromSeconds(7) },
+                { Operation::WriteCubemap().value(), ElapsedTime::fromSeconds(1) },
+                { Operation::Complete().value(), ElapsedTime::fromSeconds(0) }
+            };
         }
     }
 
-    operationEstimates.insert(std::make_pair(Operation::Start().value(),
-                                              ElapsedTime::fromMilliseconds(1500)));
-    operationEstimates.insert(std::make_pair(Operation::UndistortImages().value(),
-                                              ElapsedTime::fromMilliseconds(400)));
-    operationEstimates.insert(std::make_pair(Operation::FindFeatures().value(),
-                                              ElapsedTime::fromSeconds(0)));
-    operationEstimates.insert(std::make_pair(Operation::MatchFeatures().value(),
-                                              ElapsedTime::fromMilliseconds(500)));
-    operationEstimates.insert(std::make_pair(
-            Operation::EstimateCameraParameters().value(), ElapsedTime::fromSeconds(0)));
-    operationEstimates.insert(std::make_pair(Operation::AdjustCameraParameters().value(),
-                                              ElapsedTime::fromSeconds(3)));
-    operationEstimates.insert(
-            std::make_pair(Operation::PrepareExposureCompensation().value(),
-                           ElapsedTime::fromMilliseconds(2500)));
-    operationEstimates.insert(
-            std::make_pair(Operation::FindSeams().value(), ElapsedTime::fromSeconds(70)));
-    operationEstimates.insert(
-            std::make_pair(Operation::Compose().value(), ElapsedTime::fromSeconds(100)));
-    operationEstimates.insert(
-            std::make_pair(Operation::Complete().value(), ElapsedTime::fromSeconds(10)));
-   
-    return operationEstimates;
+    return {
+        { Operation::Start().value(), ElapsedTime::fromMilliseconds(100) },
+        { Operation::LoadImages().value(), ElapsedTime::fromSeconds(1) },
+        { Operation::UndistortImages().value(), ElapsedTime::fromMilliseconds(400) },
+        { Operation::ScaleImages().value(), ElapsedTime::fromMilliseconds(400) },
+        { Operation::FindFeatures().value(), ElapsedTime::fromSeconds(0) },
+        { Operation::MatchFeatures().value(), ElapsedTime::fromMilliseconds(500) },
+        { Operation::EstimateCameraParameters().value(), ElapsedTime::fromSeconds(0) },
+        { Operation::ComposePreview().value(), ElapsedTime::fromSeconds(3) },
+        { Operation::AdjustCameraParameters().value(), ElapsedTime::fromSeconds(3) },
+        { Operation::WarpImages().value(), ElapsedTime::fromSeconds(1) },
+        { Operation::PrepareExposureCompensation().value(), ElapsedTime::fromMilliseconds(1500) },
+        { Operation::ShouldRotate().value(), ElapsedTime::fromSeconds(3) },
+        { Operation::FindSeams().value(), ElapsedTime::fromSeconds(70) },
+        { Operation::Compose().value(), ElapsedTime::fromSeconds(100) },
+        { Operation::CropPanorama().value(), ElapsedTime::fromSeconds(2) },
+        { Operation::WritePanorama().value(), ElapsedTime::fromSeconds(7) },
+        { Operation::WriteCubemap().value(), ElapsedTime::fromSeconds(1) },
+        { Operation::Complete().value(), ElapsedTime::fromSeconds(0) }
+    };
 }
 
 const OperationElapsedTimesMap OperationsEstimator::operationEstimateTimes() const
@@ -271,6 +272,64 @@ const OperationElapsedTimesMap OperationsEstimator::operationEstimateTimes() con
     return _operationEstimates;
 }
 
+void OperationsEstimator::recordJob()
+{
+    if (!_history || _jobFeatures.empty() || !_operationTimesCb) {
+        return;
+    }
+
+    const JobRecord record { _jobFeatures, _operationTimesCb() };
+    int64_t elapsedMs = 0;
+    int64_t estimateMs = 0;
+    for (auto &operationTime : record.times) {
+        elapsedMs += operationTime.second.milliseconds(false);
+        auto estimate = _operationEstimates.find(operationTime.first);
+        if (estimate != _operationEstimates.end()) {
+            estimateMs += estimate->second.milliseconds(false);
+        }
+    }
+    if (_logEnabled && elapsedMs > 0) {
+        const double error = 100. * std::abs(static_cast<double>(estimateMs - elapsedMs))
+                / static_cast<double>(elapsedMs);
+        _logger->log(airmap::logging::Logger::Severity::info,
+                     ("Estimate error: " + std::to_string(error) + "% of "
+                      + ElapsedTime::fromMilliseconds(elapsedMs).str())
+                             .c_str(),
+                     "stitcher");
+    }
+
+    // A history that can't be written doesn't fail the stitch.
+    try {
+        _history->add(record);
+    } catch (const std::runtime_error &e) {
+        _logger->log(airmap::logging::Logger::Severity::error, e.what(), "stitcher");
+    }
+}
+
+void OperationsEstimator::setHistory(const History::SharedPtr history)
+{
+    _history = history;
+}
+
+void OperationsEstimator::setJobFeatures(const JobFeatures &features)
+{
+    _jobFeatures = features;
+    if (!_enabled) {
+        return;
+    }
+
+    // Finished operations keep the estimate their ratio is measured against.
+    for (auto &operationEstimate : estimateOperations()) {
+        if (Operation { operationEstimate.first } >= _currentOperation) {
+            _operationEstimates.erase(operationEstimate.first);
+            _operationEstimates.insert(operationEstimate);
+        }
+    }
+
+    log();
+    updated();
+}
+
 void OperationsEstimator::setOperationTimesCb(const OperationTimesCb operationTimesCb)
 {
     _operationTimesCb = operationTimesCb;
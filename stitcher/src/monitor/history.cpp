@@ -0,0 +1,386 @@
+#include "airmap/monitor/history.h"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+namespace {
+
+/**
+ * @brief operationFromStr
+ * The operation of a name, as given by Operation::str.
+ * @return Whether there is such an operation.
+ */
+bool operationFromStr(const std::string &name, Operation::Enum &value)
+{
+    for (int i = 0; i < Operation::count; ++i) {
+        const Operation operation { static_cast<Operation::Enum>(i) };
+        if (operation.str() == name) {
+            value = operation.value();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief similarity
+ * How many of camera, configuration and threads, in that order, two jobs
+ * share.
+ */
+int similarity(const JobFeatures &a, const JobFeatures &b)
+{
+    if (a.camera != b.camera) {
+        return 0;
+    }
+    if (a.configuration != b.configuration) {
+        return 1;
+    }
+    return a.threads == b.threads ? 3 : 2;
+}
+
+/**
+ * @brief fit
+ * Fit a line to the times of an operation against its sizes, and predict
+ * the time of a size.  A line through the origin if the fitted one would
+ * predict negative times of small jobs, the mean time if the time doesn't
+ * grow with the size.
+ */
+double fit(const std::vector<std::pair<double, double>> &points, double size)
+{
+    const double n = static_cast<double>(points.size());
+    double meanSize = 0.;
+    double meanTime = 0.;
+    for (const auto &point : points) {
+        meanSize += point.first / n;
+        meanTime += point.second / n;
+    }
+
+    double sizeVariance = 0.;
+    double covariance = 0.;
+    double sizeSquares = 0.;
+    double sizeTimes = 0.;
+    for (const auto &point : points) {
+        sizeVariance += (point.first - meanSize) * (point.first - meanSize);
+        covariance += (point.first - meanSize) * (point.second - meanTime);
+        sizeSquares += point.first * point.first;
+        sizeTimes += point.first * point.second;
+    }
+
+    if (sizeVariance > 1e-9 * sizeSquares) {
+        const double slope = covariance / sizeVariance;
+        if (slope < 0.) {
+            return meanTime;
+        }
+        const double intercept = meanTime - slope * meanSize;
+        if (intercept >= 0.) {
+            return intercept + slope * size;
+        }
+    }
+    return sizeSquares > 0. ? sizeTimes / sizeSquares * size : meanTime;
+}
+
+} // namespace
+
+//
+//
+// JobFeatures
+//
+//
+double JobFeatures::size(const Operation &operation) const
+{
+    const double images = static_cast<double>(imageCount);
+    switch (operation.value()) {
+    case Operation::Enum::LoadImages:
+    case Operation::Enum::UndistortImages:
+    case Operation::Enum::ScaleImages:
+        return inputMegapix;
+    case Operation::Enum::FindFeatures:
+    case Operation::Enum::ShouldRotate:
+    case Operation::Enum::ComposePreview:
+        return workMegapix;
+    case Operation::Enum::MatchFeatures:
+        // Every pair of images is matched.
+        return images * (images - 1.) / 2.;
+    case Operation::Enum::EstimateCameraParameters:
+    case Operation::Enum::AdjustCameraParameters:
+        return images;
+    case Operation::Enum::WarpImages:
+    case Operation::Enum::PrepareExposureCompensation:
+    case Operation::Enum::FindSeams:
+        return seamMegapix;
+    case Operation::Enum::Compose:
+    case Operation::Enum::CropPanorama:
+    case Operation::Enum::WritePanorama:
+    case Operation::Enum::WriteCubemap:
+        return composeMegapix;
+    default:
+        return 1.;
+    }
+}
+
+//
+//
+// JobRecord
+//
+//
+JobRecord JobRecord::parse(const std::string &line)
+{
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '\t')) {
+        fields.push_back(field);
+    }
+    if (fields.empty() || fields.front() != "job") {
+        throw std::invalid_argument("not a job record: " + line);
+    }
+
+    JobRecord record;
+    for (auto it = std::next(fields.begin()); it != fields.end(); ++it) {
+        const size_t separator = it->find('=');
+        if (separator == std::string::npos) {
+            throw std::invalid_argument("field " + *it + " is not <key>=<value>");
+        }
+        const std::string key = it->substr(0, separator);
+        const std::string value = it->substr(separator + 1);
+        Operation::Enum operation;
+        try {
+            if (key == "images") {
+                record.features.imageCount = std::stoul(value);
+            } else if (key == "input_mp") {
+                record.features.inputMegapix = std::stod(value);
+            } else if (key == "work_mp") {
+                record.features.workMegapix = std::stod(value);
+            } else if (key == "seam_mp") {
+                record.features.seamMegapix = std::stod(value);
+            } else if (key == "compose_mp") {
+                record.features.composeMegapix = std::stod(value);
+            } else if (key == "camera") {
+                record.features.camera = value;
+            } else if (key == "configuration") {
+                record.features.configuration = value;
+            } else if (key == "threads") {
+                record.features.threads = std::stoul(value);
+            } else if (operationFromStr(key, operation)) {
+                record.times.insert(std::make_pair(
+                        operation, ElapsedTime::fromMilliseconds(std::stoll(value))));
+            }
+            // Other fields, e.g. of operations since renamed, are ignored.
+        } catch (const std::logic_error &) {
+            throw std::invalid_argument("field " + *it + " has an invalid value");
+        }
+    }
+
+    if (record.features.empty()) {
+        throw std::invalid_argument("job record without images: " + line);
+    }
+    return record;
+}
+
+std::string JobRecord::str() const
+{
+    std::stringstream line;
+    line << "job\timages=" << features.imageCount
+         << "\tinput_mp=" << features.inputMegapix
+         << "\twork_mp=" << features.workMegapix
+         << "\tseam_mp=" << features.seamMegapix
+         << "\tcompose_mp=" << features.composeMegapix
+         << "\tcamera=" << features.camera
+         << "\tconfiguration=" << features.configuration
+         << "\tthreads=" << features.threads;
+    for (const auto &time : times) {
+        line << "\t" << Operation(time.first).str() << "="
+             << time.second.milliseconds(false);
+    }
+    return line.str();
+}
+
+//
+//
+// PredictionErrors
+//
+//
+std::string PredictionErrors::str() const
+{
+    std::stringstream errors;
+    errors.precision(1);
+    errors << std::fixed << "total " << total * 100. << "% over " << jobs << " jobs";
+    for (const auto &operation : operations) {
+        errors << ", " << Operation(operation.first).str() << " "
+               << operation.second * 100. << "%";
+    }
+    return errors.str();
+}
+
+//
+//
+// History
+//
+//
+constexpr size_t History::MinSimilarRecords;
+constexpr size_t History::MaxRecords;
+
+History::History(std::vector<JobRecord> records)
+    : _records(std::move(records))
+{
+}
+
+History::SharedPtr History::load(const std::string &path,
+                                 std::shared_ptr<logging::Logger> logger)
+{
+    std::vector<JobRecord> records;
+    std::ifstream file(path);
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        if (line.empty()) {
+            continue;
+        }
+        try {
+            // Records are appended with their newline at once, so a last line
+            // without one was cut short, even if what's left parses.
+            if (file.eof()) {
+                throw std::invalid_argument("truncated job record: " + line);
+            }
+            records.push_back(JobRecord::parse(line));
+        } catch (const std::invalid_argument &e) {
+            std::stringstream message;
+            message << "Skipped line " << lineNumber << " of the stitch history " << path
+                    << ": " << e.what();
+            logger->log(logging::Logger::Severity::info, message, "history");
+            continue;
+        }
+        if (records.size() > MaxRecords) {
+            records.erase(records.begin());
+        }
+    }
+
+    auto history = std::make_shared<History>(std::move(records));
+    history->_path = path;
+    return history;
+}
+
+void History::add(const JobRecord &record)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    _records.push_back(record);
+    if (_records.size() > MaxRecords) {
+        _records.erase(_records.begin());
+    }
+
+    if (!_path.empty()) {
+        // A line appended at once, so that stitches sharing the file don't
+        // interleave their records.
+        std::ofstream file(_path, std::ios::app);
+        file << record.str() + "\n" << std::flush;
+        if (!file) {
+            throw std::runtime_error("Can't append to the stitch history " + _path);
+        }
+    }
+}
+
+PredictionErrors History::evaluate() const
+{
+    const std::vector<JobRecord> all = records();
+
+    PredictionErrors errors;
+    std::map<Operation::Enum, size_t> counts;
+    for (size_t i = 0; i < all.size(); ++i) {
+        std::vector<JobRecord> others = all;
+        others.erase(others.begin() + static_cast<std::ptrdiff_t>(i));
+        const OperationElapsedTimesMap predicted = predict(others, all[i].features);
+        if (predicted.empty()) {
+            continue;
+        }
+
+        double time = 0.;
+        double predictedTime = 0.;
+        for (const auto &operationTime : all[i].times) {
+            const double actual = static_cast<double>(operationTime.second.milliseconds(false));
+            auto prediction = predicted.find(operationTime.first);
+            const double estimate = prediction != predicted.end()
+                    ? static_cast<double>(prediction->second.milliseconds(false))
+                    : 0.;
+            time += actual;
+            predictedTime += estimate;
+            if (actual > 0. && prediction != predicted.end()) {
+                errors.operations[operationTime.first] += std::abs(estimate - actual) / actual;
+                counts[operationTime.first]++;
+            }
+        }
+        if (time > 0.) {
+            errors.total += std::abs(predictedTime - time) / time;
+            errors.jobs++;
+        }
+    }
+
+    for (auto &operation : errors.operations) {
+        operation.second /= static_cast<double>(counts[operation.first]);
+    }
+    if (errors.jobs > 0) {
+        errors.total /= static_cast<double>(errors.jobs);
+    }
+    return errors;
+}
+
+OperationElapsedTimesMap History::predict(const JobFeatures &features) const
+{
+    return predict(records(), features);
+}
+
+OperationElapsedTimesMap History::predict(const std::vector<JobRecord> &records,
+                                          const JobFeatures &features)
+{
+    OperationElapsedTimesMap predictions;
+    for (int i = 0; i < Operation::count; ++i) {
+        const Operation operation { static_cast<Operation::Enum>(i) };
+
+        // The records of the operation, by how similar their job is.
+        std::map<int, std::vector<std::pair<double, double>>, std::greater<int>> similar;
+        for (const auto &record : records) {
+            auto time = record.times.find(operation.value());
+            if (time == record.times.end()) {
+                continue;
+            }
+            similar[similarity(record.features, features)].push_back(std::make_pair(
+                    record.features.size(operation),
+                    static_cast<double>(time->second.milliseconds(false))));
+        }
+        if (similar.empty()) {
+            continue;
+        }
+
+        // The most similar records, with less similar ones until there are
+        // enough of them.
+        std::vector<std::pair<double, double>> points;
+        for (const auto &level : similar) {
+            points.insert(points.end(), level.second.begin(), level.second.end());
+            if (points.size() >= MinSimilarRecords) {
+                break;
+            }
+        }
+
+        const double time = fit(points, features.size(operation));
+        predictions.insert(std::make_pair(
+                operation.value(),
+                ElapsedTime::fromMilliseconds(static_cast<int64_t>(std::llround(time)))));
+    }
+    return predictions;
+}
+
+std::vector<JobRecord> History::records() const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return _records;
+}
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
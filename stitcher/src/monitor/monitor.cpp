@@ -1,19 +1,114 @@
 #include "airmap/monitor/monitor.h"
 
+#include <algorithm>
+
 namespace airmap {
 namespace stitcher {
 namespace monitor {
 
+//
+//
+// OperationWork
+//
+//
+constexpr size_t OperationWork::CounterCount;
+
+const std::array<const char *, OperationWork::CounterCount> OperationWork::CounterNames
+        = { { OperationResources::Features, OperationResources::MatchedPairs,
+              OperationResources::WarpedPixels, OperationResources::GraphVertices } };
+
+OperationWork::OperationWork()
+{
+    reset();
+}
+
+void OperationWork::add(const std::string &counter, uint64_t amount)
+{
+    for (size_t i = 0; i < CounterCount; ++i) {
+        if (counter == CounterNames[i]) {
+            _counters[i].fetch_add(amount, std::memory_order_relaxed);
+            return;
+        }
+    }
+    throw std::invalid_argument("Unknown work counter " + counter);
+}
+
+void OperationWork::complete(uint64_t units)
+{
+    _completed.fetch_add(units, std::memory_order_relaxed);
+}
+
+std::map<std::string, uint64_t> OperationWork::counters() const
+{
+    std::map<std::string, uint64_t> counters;
+    for (size_t i = 0; i < CounterCount; ++i) {
+        const uint64_t amount = _counters[i].load(std::memory_order_relaxed);
+        if (amount > 0) {
+            counters[CounterNames[i]] = amount;
+        }
+    }
+    return counters;
+}
+
+double OperationWork::progress() const
+{
+    const uint64_t total = _total.load(std::memory_order_relaxed);
+    if (total == 0) {
+        return _progress.load(std::memory_order_relaxed);
+    }
+    return std::min(1., static_cast<double>(_completed.load(std::memory_order_relaxed))
+                            / static_cast<double>(total));
+}
+
+void OperationWork::reset()
+{
+    _total = 0;
+    _completed = 0;
+    _progress = 0.;
+    for (auto &counter : _counters) {
+        counter = 0;
+    }
+}
+
+void OperationWork::setProgress(double progress)
+{
+    _progress.store(progress, std::memory_order_relaxed);
+}
+
+void OperationWork::setTotal(uint64_t total)
+{
+    _completed = 0;
+    _total = total;
+}
+
+//
+//
+// Monitor
+//
+//
+
 Monitor::Monitor(OperationsEstimator::SharedPtr estimator,
                  std::shared_ptr<airmap::logging::Logger> logger, bool enabled,
                  bool logEnabled)
-    : _estimator(estimator)
+    : _cancelled(std::make_shared<std::atomic<bool>>(false))
+    , _estimator(estimator)
     , _logger(logger)
     , _enabled(enabled || logEnabled)
     , _logEnabled(logEnabled)
+    , _operationTraced(false)
+    , _currentOperation(Operation::Start())
+    , _work(std::make_shared<OperationWork>())
+    , _allocations(AllocationTracker::create())
+    , _reportInterval(std::chrono::milliseconds(100))
+    , _operationPeakReset(false)
 {
 }
 
+Monitor::~Monitor()
+{
+    stopReporter();
+}
+
 Monitor::SharedPtr Monitor::create(OperationsEstimator::SharedPtr estimator,
                                    std::shared_ptr<airmap::logging::Logger> logger,
                                    bool enabled, bool logEnabled)
@@ -30,32 +125,122 @@ Monitor::SharedPtr Monitor::create(Estimator::SharedPtr estimator,
     return std::make_shared<Monitor>(_estimator, logger, enabled, logEnabled);
 }
 
+void Monitor::addWork(const std::string &counter, uint64_t amount)
+{
+    if (!_enabled) {
+        return;
+    }
+
+    _work->add(counter, amount);
+}
+
+AllocationTracker::SharedPtr Monitor::allocations()
+{
+    return _allocations;
+}
+
+void Monitor::cancel()
+{
+    *_cancelled = true;
+}
+
+bool Monitor::cancelled() const
+{
+    return *_cancelled;
+}
+
+void Monitor::completeWork(uint64_t units)
+{
+    if (_enabled) {
+        _work->complete(units);
+    }
+    report();
+}
+
 void Monitor::changeOperation(const Operation &operation)
 {
+    _stitchingThread = std::this_thread::get_id();
+    if (*_cancelled) {
+        throw Cancelled();
+    }
+
+    // Matrices are charged to the operation whether it is monitored or not,
+    // e.g. to enforce the memory budget.
+    if (operation == Operation::Start()) {
+        _allocations->reset();
+    }
+    _allocations->changeOperation(operation.value());
+
     if (!_enabled) {
         return;
     }
 
-    if (operation.toInt() > 0) {
+    {
+        std::lock_guard<std::mutex> lock(_reporter.mutex);
+        changeMonitoredOperation(operation);
+    }
+    if (operation == Operation::Start()) {
+        startReporter();
+    } else if (operation == Operation::Complete()) {
+        stopReporter();
+    }
+}
+
+void Monitor::changeMonitoredOperation(const Operation &operation)
+{
+    if (operation == Operation::Start()) {
+        // A retry starts afresh, dropping the operation that failed.
+        _stitchTimer.start();
+        _operationTimes.clear();
+        _operationResources.clear();
+    } else {
+        // The finished operation is the current one, not the one before
+        // the next: operations can be skipped, and run again, e.g. writing
+        // each panorama rendered from a recipe.
         _timer.stop();
-        _operationTimes.insert(
-            std::make_pair(operation.previous().value(), _timer.elapsed()));
+        ElapsedTime elapsed = _timer.elapsed();
+        auto operationTime = _operationTimes.find(_currentOperation.value());
+        if (operationTime != _operationTimes.end()) {
+            elapsed = elapsed + operationTime->second;
+            _operationTimes.erase(operationTime);
+        }
+        _operationTimes.insert(std::make_pair(_currentOperation.value(), elapsed));
+        recordResources(_currentOperation);
 
-        logOperation(operation);
+        logOperation(_currentOperation);
     }
 
     _estimator->changeOperation(operation);
 
+    traceOperation(operation);
+    _currentOperation = operation;
+    _work->reset();
+    _lastReport = std::chrono::steady_clock::now();
+    writeProgress(true);
+
     if (operation == Operation::Complete()) {
         logComplete();
     } else {
+        _operationPeakReset = ResourceUsage::resetPeak();
+        _operationStartUsage = ResourceUsage::now();
         _timer.start();
     }
 }
 
+const ElapsedTime Monitor::currentEstimate()
+{
+    std::lock_guard<std::mutex> lock(_reporter.mutex);
+    return _estimator->currentEstimate();
+}
+
 Operation Monitor::currentOperation()
 {
-    return std::prev(_operationTimes.end())->first;
+    return _currentOperation;
+}
+
+double Monitor::currentOperationProgress() const
+{
+    return _work->progress();
 }
 
 void Monitor::disable()
@@ -69,6 +254,13 @@ void Monitor::disableLog()
     _logEnabled = false;
 }
 
+const ElapsedTime Monitor::elapsed() const
+{
+    Timer stitchTimer = _stitchTimer;
+    stitchTimer.stop();
+    return stitchTimer.elapsed();
+}
+
 void Monitor::enable()
 {
     _enabled = true;
@@ -110,24 +302,242 @@ void Monitor::logOperation(const Operation &operation) const
     }
 
     _logger->log(airmap::logging::Logger::Severity::info,
-                 (operation.previous().str() + " finished in "
-                  + std::prev(_operationTimes.end())->second.str())
+                 (operation.str() + " finished in "
+                  + _operationTimes.at(operation.value()).str() + ", "
+                  + _operationResources.at(operation.value()).str())
                          .c_str(),
                  "stitcher");
 }
 
+const OperationResourcesMap Monitor::operationResources() const
+{
+    return _operationResources;
+}
+
 const OperationElapsedTimesMap Monitor::operationTimes() const
 {
     return _operationTimes;
 }
 
-void Monitor::updateCurrentOperation(double progress)
+void Monitor::operationFailed()
+{
+    stopReporter();
+    if (_tracer && _operationTraced) {
+        _tracer->end(_currentOperation.str(), "operation");
+        _operationTraced = false;
+    }
+}
+
+void Monitor::outputWritten(const std::string &output)
+{
+    if (!_enabled) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_reporter.mutex);
+    _estimator->outputWritten(output, elapsed());
+    writeProgress(true);
+}
+
+void Monitor::publish()
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _lastReport < _reportInterval) {
+        return;
+    }
+    _lastReport = now;
+
+    _estimator->updateCurrentOperation(_work->progress());
+    writeProgress(false);
+    if (_tracer) {
+        _tracer->counter("rss_mb", static_cast<double>(residentMemoryMB()));
+    }
+}
+
+void Monitor::recordResources(const Operation &operation)
+{
+    const ResourceUsage end = ResourceUsage::now();
+
+    OperationResources resources;
+    resources.wall = _timer.elapsed();
+    resources.userCpu = end.userCpu - _operationStartUsage.userCpu;
+    resources.systemCpu = end.systemCpu - _operationStartUsage.systemCpu;
+    // Without a reset, the peak is that of the process, which is only the
+    // operation's if the operation raised it.
+    resources.peakRssMB = _operationPeakReset
+                    || end.peakRssMB > _operationStartUsage.peakRssMB
+            ? end.peakRssMB
+            : std::max(_operationStartUsage.rssMB, end.rssMB);
+    resources.deltaRssMB = static_cast<int64_t>(end.rssMB)
+            - static_cast<int64_t>(_operationStartUsage.rssMB);
+    resources.work = _work->counters();
+
+    // The tracker counts an operation run again as a whole already.
+    const AllocationStats allocations = _allocations->stats(operation.value());
+    resources.allocations = allocations.allocations;
+    resources.allocatedMB = allocations.allocatedBytes / (1024 * 1024);
+    resources.peakAllocatedMB = allocations.peakBytes / (1024 * 1024);
+    resources.liveAllocatedMB = allocations.liveBytes / (1024 * 1024);
+
+    // An operation run again adds to its previous runs.
+    auto previous = _operationResources.find(operation.value());
+    if (previous != _operationResources.end()) {
+        resources.wall = resources.wall + previous->second.wall;
+        resources.userCpu = resources.userCpu + previous->second.userCpu;
+        resources.systemCpu = resources.systemCpu + previous->second.systemCpu;
+        resources.peakRssMB = std::max(resources.peakRssMB, previous->second.peakRssMB);
+        resources.deltaRssMB += previous->second.deltaRssMB;
+        for (const auto &counter : previous->second.work) {
+            resources.work[counter.first] += counter.second;
+        }
+    }
+
+    _operationResources[operation.value()] = resources;
+}
+
+void Monitor::report()
 {
+    // Before the first operation, any thread is the stitching thread.
+    if (_stitchingThread != std::thread::id()
+        && _stitchingThread != std::this_thread::get_id()) {
+        return;
+    }
+
+    if (*_cancelled) {
+        throw Cancelled();
+    }
+
     if (!_enabled) {
         return;
     }
 
-    _estimator->updateCurrentOperation(progress);
+    std::lock_guard<std::mutex> lock(_reporter.mutex);
+    publish();
+}
+
+void Monitor::reportInBackground()
+{
+    // Waits at least a millisecond between reports, even without an
+    // interval, not to spin.
+    const std::chrono::steady_clock::duration interval =
+            std::max<std::chrono::steady_clock::duration>(_reportInterval,
+                                                          std::chrono::milliseconds(1));
+    std::unique_lock<std::mutex> lock(_reporter.mutex);
+    while (_reporter.running) {
+        // Reports of the stitching thread postpone the next one.
+        if (!_reporter.wakeup.wait_until(lock, _lastReport + interval,
+                                         [this]() { return !_reporter.running; })) {
+            publish();
+        }
+    }
+}
+
+void Monitor::setJobFeatures(const JobFeatures &features)
+{
+    std::lock_guard<std::mutex> lock(_reporter.mutex);
+    _estimator->setJobFeatures(features);
+}
+
+void Monitor::setOperationWork(uint64_t total)
+{
+    if (!_enabled) {
+        return;
+    }
+
+    _work->setTotal(total);
+}
+
+void Monitor::setProgressWriter(ProgressWriter::SharedPtr writer)
+{
+    _progressWriter = writer;
+    enable();
+    _estimator->enable();
+}
+
+void Monitor::setReportInterval(std::chrono::milliseconds interval)
+{
+    _reportInterval = interval;
+}
+
+void Monitor::setTracer(Tracer::SharedPtr tracer)
+{
+    _tracer = tracer;
+    enable();
+}
+
+void Monitor::startReporter()
+{
+    if (_reporter.thread.joinable()) {
+        return;
+    }
+
+    _reporter.running = true;
+    _reporter.thread = std::thread([this]() { reportInBackground(); });
+}
+
+void Monitor::stopReporter()
+{
+    if (!_reporter.thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_reporter.mutex);
+        _reporter.running = false;
+    }
+    _reporter.wakeup.notify_one();
+    _reporter.thread.join();
+}
+
+void Monitor::traceOperation(const Operation &operation)
+{
+    if (!_tracer) {
+        return;
+    }
+
+    if (_operationTraced) {
+        _tracer->end(_currentOperation.str(), "operation");
+    }
+    _operationTraced = operation != Operation::Complete();
+    if (_operationTraced) {
+        _tracer->begin(operation.str(), "operation");
+    }
+    _tracer->counter("rss_mb", static_cast<double>(residentMemoryMB()));
+}
+
+void Monitor::updateCurrentOperation(double progress)
+{
+    if (_enabled) {
+        _work->setProgress(progress);
+    }
+    report();
+}
+
+void Monitor::writeProgress(bool force)
+{
+    if (!_progressWriter || (!force && !_progressWriter->due())) {
+        return;
+    }
+
+    ProgressRecord record;
+    record.operation = _currentOperation.str();
+    record.operationProgress = _work->progress();
+    record.progress = _estimator->currentProgress();
+    record.estimate = _estimator->currentEstimate();
+    record.elapsed = elapsed();
+    record.rssMB = residentMemoryMB();
+    record.output = _estimator->currentOutput();
+    record.outputElapsed = _estimator->currentOutputElapsed();
+
+    for (const auto &operationTime : _operationTimes) {
+        ProgressRecord::Stage &stage =
+                record.stages[Operation(operationTime.first).str()];
+        stage.elapsed = operationTime.second;
+        stage.peakRssMB = _operationResources[operationTime.first].peakRssMB;
+        stage.peakAllocatedMB = _operationResources[operationTime.first].peakAllocatedMB;
+    }
+
+    _progressWriter->write(record, force);
 }
 
 } // namespace monitor
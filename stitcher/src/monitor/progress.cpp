@@ -0,0 +1,199 @@
+#include "airmap/monitor/progress.h"
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+namespace {
+
+/**
+ * @brief quoted
+ * A string as a JSON string.
+ */
+std::string quoted(const std::string &value)
+{
+    std::string result = "\"";
+    for (const char c : value) {
+        switch (c) {
+        case '"':
+            result += "\\\"";
+            break;
+        case '\\':
+            result += "\\\\";
+            break;
+        case '\n':
+            result += "\\n";
+            break;
+        case '\t':
+            result += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[7];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                result += escaped;
+            } else {
+                result += c;
+            }
+        }
+    }
+    return result + "\"";
+}
+
+} // namespace
+
+//
+//
+// ProgressRecord
+//
+//
+ProgressRecord ProgressRecord::parse(const std::string &line)
+{
+    boost::property_tree::ptree tree;
+    try {
+        std::istringstream stream(line);
+        boost::property_tree::read_json(stream, tree);
+    } catch (const boost::property_tree::json_parser_error &e) {
+        throw std::invalid_argument("Invalid progress record: " + e.message());
+    }
+
+    ProgressRecord record;
+    try {
+        record.operation = tree.get<std::string>("operation");
+        record.operationProgress = tree.get<double>("operation_progress");
+        record.progress = tree.get<double>("progress");
+        record.estimate = ElapsedTime::fromMilliseconds(tree.get<int64_t>("estimate_ms"));
+        record.elapsed = ElapsedTime::fromMilliseconds(tree.get<int64_t>("elapsed_ms"));
+        record.rssMB = tree.get<size_t>("rss_mb");
+        record.output = tree.get<std::string>("output", "");
+        record.outputElapsed =
+                ElapsedTime::fromMilliseconds(tree.get<int64_t>("output_elapsed_ms", 0));
+        for (const auto &stage : tree.get_child("stages")) {
+            Stage &recordStage = record.stages[stage.first];
+            recordStage.elapsed = ElapsedTime::fromMilliseconds(
+                    stage.second.get<int64_t>("elapsed_ms"));
+            recordStage.peakRssMB = stage.second.get<size_t>("peak_rss_mb");
+            recordStage.peakAllocatedMB = stage.second.get<size_t>("peak_allocated_mb", 0);
+        }
+    } catch (const boost::property_tree::ptree_error &e) {
+        throw std::invalid_argument(std::string("Invalid progress record: ") + e.what());
+    }
+    return record;
+}
+
+std::string ProgressRecord::str() const
+{
+    // Enough digits for the parsed record to equal the written one.
+    std::stringstream line;
+    line.precision(std::numeric_limits<double>::max_digits10);
+    line << "{\"operation\":" << quoted(operation)
+         << ",\"operation_progress\":" << operationProgress
+         << ",\"progress\":" << progress
+         << ",\"estimate_ms\":" << estimate.milliseconds(false)
+         << ",\"elapsed_ms\":" << elapsed.milliseconds(false)
+         << ",\"rss_mb\":" << rssMB;
+    if (!output.empty()) {
+        line << ",\"output\":" << quoted(output)
+             << ",\"output_elapsed_ms\":" << outputElapsed.milliseconds(false);
+    }
+    line << ",\"stages\":{";
+    for (auto it = stages.begin(); it != stages.end(); ++it) {
+        line << (it == stages.begin() ? "" : ",") << quoted(it->first)
+             << ":{\"elapsed_ms\":" << it->second.elapsed.milliseconds(false)
+             << ",\"peak_rss_mb\":" << it->second.peakRssMB
+             << ",\"peak_allocated_mb\":" << it->second.peakAllocatedMB << "}";
+    }
+    line << "}}";
+    return line.str();
+}
+
+//
+//
+// ProgressWriter
+//
+//
+ProgressWriter::ProgressWriter(int fd, double maxRate)
+    : _fd(fd)
+    , _minInterval(std::chrono::duration_cast<Clock::duration>(
+              std::chrono::duration<double>(maxRate > 0. ? 1. / maxRate : 0.)))
+    , _lastWritten()
+{
+}
+
+bool ProgressWriter::due() const
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    return Clock::now() - _lastWritten >= _minInterval;
+}
+
+void ProgressWriter::write(const ProgressRecord &record, bool force)
+{
+    std::lock_guard<std::mutex> guard(_mutex);
+    const Clock::time_point now = Clock::now();
+    if (!force && now - _lastWritten < _minInterval) {
+        return;
+    }
+    _lastWritten = now;
+
+    const std::string line = record.str() + "\n";
+    size_t written = 0;
+    while (written < line.size()) {
+        ssize_t result = ::write(_fd, line.data() + written, line.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            // The parent went away, the stitch goes on.
+            return;
+        }
+        written += static_cast<size_t>(result);
+    }
+}
+
+//
+//
+// ProgressParser
+//
+//
+ProgressParser::ProgressParser(RecordCb recordCb)
+    : _recordCb(recordCb)
+{
+}
+
+void ProgressParser::apply(const ProgressRecord &record, Estimator &estimator)
+{
+    estimator.setCurrent(record.estimate, record.progress);
+    if (!record.output.empty()
+        && (record.output != estimator.currentOutput()
+            || record.outputElapsed != estimator.currentOutputElapsed())) {
+        estimator.setCurrentOutput(record.output, record.outputElapsed);
+    }
+}
+
+void ProgressParser::feed(const char *data, size_t size)
+{
+    _buffer.append(data, size);
+    size_t newline;
+    while ((newline = _buffer.find('\n')) != std::string::npos) {
+        const std::string line = _buffer.substr(0, newline);
+        _buffer.erase(0, newline + 1);
+        if (!line.empty()) {
+            _recordCb(ProgressRecord::parse(line));
+        }
+    }
+}
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,149 @@
+#include "airmap/monitor/resources.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+namespace {
+
+ElapsedTime elapsedTime(const timeval &time)
+{
+    return ElapsedTime::fromMilliseconds(static_cast<int64_t>(time.tv_sec) * 1000
+                                         + time.tv_usec / 1000);
+}
+
+} // namespace
+
+size_t residentMemoryMB()
+{
+    // The second field of statm is the number of resident pages.
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t residentPages = 0;
+    if (!(statm >> pages >> residentPages)) {
+        return 0;
+    }
+    return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE)) / (1024 * 1024);
+}
+
+ElapsedTime processUptime()
+{
+    // The 22nd field of stat is when the process started, in clock ticks
+    // since boot, and the first of uptime the seconds since boot.
+    std::ifstream stat("/proc/self/stat");
+    std::ifstream uptime("/proc/uptime");
+    std::string line;
+    double secondsSinceBoot = 0.;
+    if (!std::getline(stat, line) || !(uptime >> secondsSinceBoot)) {
+        return ElapsedTime::fromSeconds(0);
+    }
+
+    // The second field, the command, may contain spaces and ends at the
+    // last parenthesis.
+    const size_t command = line.rfind(')');
+    if (command == std::string::npos) {
+        return ElapsedTime::fromSeconds(0);
+    }
+    std::stringstream fields(line.substr(command + 1));
+    std::string field;
+    for (int i = 3; i < 22; ++i) {
+        fields >> field;
+    }
+    unsigned long long startTicks = 0;
+    if (!(fields >> startTicks)) {
+        return ElapsedTime::fromSeconds(0);
+    }
+
+    const double started =
+            static_cast<double>(startTicks) / static_cast<double>(sysconf(_SC_CLK_TCK));
+    return ElapsedTime::fromMilliseconds(
+            static_cast<int64_t>(std::max(0., secondsSinceBoot - started) * 1000.));
+}
+
+//
+//
+// ResourceUsage
+//
+//
+ResourceUsage ResourceUsage::now()
+{
+    ResourceUsage usage;
+
+    rusage self;
+    if (getrusage(RUSAGE_SELF, &self) == 0) {
+        usage.userCpu = elapsedTime(self.ru_utime);
+        usage.systemCpu = elapsedTime(self.ru_stime);
+        // In KB on Linux, never reset.
+        usage.peakRssMB = static_cast<size_t>(self.ru_maxrss) / 1024;
+    }
+
+    // The peak of status can be reset, unlike that of getrusage.
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            usage.peakRssMB = std::stoul(line.substr(6)) / 1024;
+            break;
+        }
+    }
+
+    usage.rssMB = residentMemoryMB();
+    return usage;
+}
+
+bool ResourceUsage::resetPeak()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+    clearRefs.flush();
+    return static_cast<bool>(clearRefs);
+}
+
+//
+//
+// OperationResources
+//
+//
+constexpr const char *OperationResources::Features;
+constexpr const char *OperationResources::MatchedPairs;
+constexpr const char *OperationResources::WarpedPixels;
+constexpr const char *OperationResources::GraphVertices;
+
+double OperationResources::cpuUtilization() const
+{
+    const double wallMs = static_cast<double>(wall.milliseconds(false));
+    if (wallMs <= 0.) {
+        return 0.;
+    }
+    return static_cast<double>(userCpu.milliseconds(false) + systemCpu.milliseconds(false))
+            / wallMs;
+}
+
+std::string OperationResources::str() const
+{
+    std::stringstream resources;
+    resources.precision(2);
+    resources << std::fixed << "cpu user " << userCpu << " system " << systemCpu
+              << " (" << cpuUtilization() << " cores), peak rss " << peakRssMB
+              << " MB (" << (deltaRssMB >= 0 ? "+" : "") << deltaRssMB << " MB)";
+    if (allocations > 0) {
+        resources << ", matrices peak " << peakAllocatedMB << " MB, " << allocations
+                  << " allocated (" << allocatedMB << " MB, " << liveAllocatedMB
+                  << " MB live)";
+    }
+    for (const auto &counter : work) {
+        resources << ", " << counter.second << " " << counter.first;
+    }
+    return resources.str();
+}
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
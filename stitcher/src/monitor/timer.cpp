@@ -1,5 +1,7 @@
 #include "airmap/monitor/timer.h"
 
+#include <cmath>
+
 namespace airmap {
 namespace stitcher {
 namespace monitor {
@@ -76,8 +78,10 @@ const ElapsedTime ElapsedTime::operator-(const ElapsedTime &other) const
 
 const ElapsedTime ElapsedTime::operator*(const double &multiplier) const
 {
-    return { static_cast<int64_t>(static_cast<double>(milliseconds(false))
-                                  * multiplier) };
+    // Rounded, so that a multiplier off by a rounding error, e.g. an average
+    // of ratios, doesn't lose a millisecond.
+    return { static_cast<int64_t>(std::llround(
+            static_cast<double>(milliseconds(false)) * multiplier)) };
 }
 
 double ElapsedTime::operator/(const ElapsedTime &other) const
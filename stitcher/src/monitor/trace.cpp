@@ -0,0 +1,83 @@
+#include "airmap/monitor/trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+namespace {
+
+/**
+ * @brief threadId
+ * The id of the calling thread, as shown by the system.
+ */
+long threadId()
+{
+    return syscall(SYS_gettid);
+}
+
+} // namespace
+
+Tracer::Tracer(const std::string &path)
+    : _start(Clock::now())
+    , _pid(static_cast<int>(getpid()))
+    , _trace(path)
+    , _empty(true)
+{
+    if (!_trace) {
+        throw std::invalid_argument("Can't write trace to " + path);
+    }
+    _trace << "[\n";
+    write("\"name\":\"process_name\",\"ph\":\"M\",\"args\":{\"name\":\"airmap_stitcher\"}");
+}
+
+Tracer::~Tracer()
+{
+    _trace << "\n]\n";
+}
+
+void Tracer::begin(const std::string &name, const std::string &category,
+                   int64_t index)
+{
+    std::stringstream event;
+    event << "\"name\":\"" << name << "\",\"cat\":\"" << category << "\",\"ph\":\"B\"";
+    if (index >= 0) {
+        event << ",\"args\":{\"index\":" << index << "}";
+    }
+    write(event.str());
+}
+
+void Tracer::counter(const std::string &name, double value)
+{
+    std::stringstream event;
+    event << "\"name\":\"" << name << "\",\"ph\":\"C\",\"args\":{\"" << name
+          << "\":" << value << "}";
+    write(event.str());
+}
+
+void Tracer::end(const std::string &name, const std::string &category)
+{
+    write("\"name\":\"" + name + "\",\"cat\":\"" + category + "\",\"ph\":\"E\"");
+}
+
+void Tracer::write(const std::string &event)
+{
+    const auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(
+                                   Clock::now() - _start)
+                                   .count();
+    const long tid = threadId();
+
+    std::lock_guard<std::mutex> guard(_mutex);
+    _trace << (_empty ? "" : ",\n") << "{" << event << ",\"ts\":" << timestamp
+           << ",\"pid\":" << _pid << ",\"tid\":" << tid << "}";
+    _empty = false;
+}
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,738 @@
+#include "airmap/opencv/bundle_adjusters.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/utility.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+namespace {
+
+constexpr int params_per_camera = 4;
+constexpr int errors_per_match = 3;
+
+//! Numerical differentiation step, a tenth of BundleAdjusterRay's 1e-3.
+constexpr double jacobian_step = 1e-4;
+
+//! Levenberg-Marquardt damping, as CvLevMarq.
+constexpr double initial_lambda = 1e-3;
+constexpr double min_lambda = 1e-12;
+constexpr double max_lambda = 1e16;
+
+constexpr double default_huber_threshold = 3.;
+
+/**
+ * @brief rayMatrix
+ * R * K^-1 of a camera given its focal length and rotation vector, with the
+ * principal point at the center of the image.
+ */
+cv::Matx33d rayMatrix(const double *params, cv::Size img_size)
+{
+    cv::Matx33d R;
+    cv::Rodrigues(cv::Matx31d(params[1], params[2], params[3]), R);
+
+    const double f = params[0];
+    const cv::Matx33d K_inv(1. / f, 0., -0.5 * img_size.width / f, 0., 1. / f,
+                            -0.5 * img_size.height / f, 0., 0., 1.);
+    return R * K_inv;
+}
+
+inline cv::Vec3d ray(const cv::Matx33d &H, cv::Point2f p)
+{
+    cv::Vec3d r = H * cv::Vec3d(p.x, p.y, 1.);
+    return r / std::sqrt(r.dot(r));
+}
+
+/**
+ * @brief pairErrors
+ * Errors of the inlier matches of a pair of images, as
+ * BundleAdjusterRay::calcError.
+ */
+void pairErrors(const cv::detail::ImageFeatures &features1,
+                const cv::detail::ImageFeatures &features2,
+                const cv::detail::MatchesInfo &matches_info,
+                const double *params1, const double *params2, double *errors)
+{
+    const cv::Matx33d H1 = rayMatrix(params1, features1.img_size);
+    const cv::Matx33d H2 = rayMatrix(params2, features2.img_size);
+    const double mult = std::sqrt(params1[0] * params2[0]);
+
+    for (size_t k = 0; k < matches_info.matches.size(); ++k) {
+        if (!matches_info.inliers_mask[k]) {
+            continue;
+        }
+
+        const cv::DMatch &m = matches_info.matches[k];
+        const cv::Vec3d diff = ray(H1, features1.keypoints[m.queryIdx].pt) -
+                               ray(H2, features2.keypoints[m.trainIdx].pt);
+        errors[0] = mult * diff[0];
+        errors[1] = mult * diff[1];
+        errors[2] = mult * diff[2];
+        errors += errors_per_match;
+    }
+}
+
+/**
+ * @brief cameraPositions
+ * Position of each camera in a reverse Cuthill-McKee ordering of the graph
+ * of pairs, which keeps the cameras of each pair close to each other and so
+ * the envelope of the normal equations narrow.
+ */
+std::vector<int> cameraPositions(int count,
+                                 const std::vector<std::pair<int, int>> &edges)
+{
+    std::vector<std::vector<int>> adjacency(count);
+    for (const auto &edge : edges) {
+        adjacency[edge.first].push_back(edge.second);
+        adjacency[edge.second].push_back(edge.first);
+    }
+
+    auto by_degree = [&adjacency](int a, int b) {
+        return adjacency[a].size() < adjacency[b].size() ||
+               (adjacency[a].size() == adjacency[b].size() && a < b);
+    };
+    for (auto &neighbours : adjacency) {
+        std::sort(neighbours.begin(), neighbours.end(), by_degree);
+    }
+
+    std::vector<int> cameras(count);
+    std::iota(cameras.begin(), cameras.end(), 0);
+    std::sort(cameras.begin(), cameras.end(), by_degree);
+
+    // Breadth first from the lowest degree camera of each component
+    std::vector<int> order;
+    order.reserve(count);
+    std::vector<bool> visited(count, false);
+    for (int start : cameras) {
+        if (visited[start]) {
+            continue;
+        }
+        visited[start] = true;
+        order.push_back(start);
+        for (size_t k = order.size() - 1; k < order.size(); ++k) {
+            for (int neighbour : adjacency[order[k]]) {
+                if (!visited[neighbour]) {
+                    visited[neighbour] = true;
+                    order.push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    std::vector<int> positions(count);
+    for (int k = 0; k < count; ++k) {
+        positions[order[k]] = count - 1 - k;
+    }
+    return positions;
+}
+
+/**
+ * @brief EnvelopeMatrix
+ * Lower triangle of a symmetric matrix, storing each row from its first
+ * nonzero column.  The Cholesky factor of such a matrix has the same
+ * envelope, so it can be factorized in place.
+ */
+class EnvelopeMatrix {
+public:
+    explicit EnvelopeMatrix(const std::vector<int> &first)
+        : _first(first)
+        , _offsets(first.size() + 1, 0)
+    {
+        for (size_t r = 0; r < first.size(); ++r) {
+            _offsets[r + 1] = _offsets[r] + static_cast<int>(r) - first[r] + 1;
+        }
+        _values.assign(_offsets.back(), 0.);
+    }
+
+    double &at(int r, int c) { return _values[_offsets[r] + c - _first[r]]; }
+    double at(int r, int c) const
+    {
+        return _values[_offsets[r] + c - _first[r]];
+    }
+
+    bool factorize()
+    {
+        const int n = static_cast<int>(_first.size());
+        for (int r = 0; r < n; ++r) {
+            for (int c = _first[r]; c <= r; ++c) {
+                double sum = at(r, c);
+                for (int k = std::max(_first[r], _first[c]); k < c; ++k) {
+                    sum -= at(r, k) * at(c, k);
+                }
+                if (c < r) {
+                    at(r, c) = sum / at(c, c);
+                } else if (sum > 0.) {
+                    at(r, r) = std::sqrt(sum);
+                } else {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void solve(std::vector<double> &b) const
+    {
+        const int n = static_cast<int>(_first.size());
+        for (int r = 0; r < n; ++r) {
+            double sum = b[r];
+            for (int k = _first[r]; k < r; ++k) {
+                sum -= at(r, k) * b[k];
+            }
+            b[r] = sum / at(r, r);
+        }
+        for (int r = n - 1; r >= 0; --r) {
+            b[r] /= at(r, r);
+            for (int k = _first[r]; k < r; ++k) {
+                b[k] -= at(r, k) * b[r];
+            }
+        }
+    }
+
+private:
+    std::vector<int> _first;
+    std::vector<int> _offsets;
+    std::vector<double> _values;
+};
+
+} // namespace
+
+/**
+ * @brief NormalEquations
+ * J^T J and J^T r of the weighted errors, as a 4x4 block per camera and per
+ * edge, and the structure used to solve them.
+ */
+struct SparseBundleAdjusterRay::NormalEquations {
+    std::vector<std::pair<int, int>> edges;
+    //! Position of each camera in the elimination order.
+    std::vector<int> positions;
+    //! First column of the envelope of each row, in elimination order.
+    std::vector<int> first;
+    //! Whether each parameter is held constant.
+    std::vector<uchar> fixed;
+
+    std::vector<cv::Matx44d> diagonal;
+    //! Rows of the first camera of the edge, columns of the second.
+    std::vector<cv::Matx44d> off_diagonal;
+    std::vector<cv::Vec4d> gradient;
+
+    /**
+     * @brief solve
+     * Solve (J^T J + lambda diag(J^T J)) step = -J^T r.
+     * @return false if the damped matrix is not positive definite.
+     */
+    bool solve(double lambda, std::vector<double> &step) const
+    {
+        const int n = static_cast<int>(first.size());
+        std::vector<uchar> fixed_rows(n);
+        for (size_t c = 0; c < positions.size(); ++c) {
+            for (int a = 0; a < params_per_camera; ++a) {
+                fixed_rows[positions[c] * params_per_camera + a] =
+                    fixed[c * params_per_camera + a];
+            }
+        }
+
+        EnvelopeMatrix A(first);
+        std::vector<double> b(n, 0.);
+        auto set = [&](int r, int c, double value) {
+            if (!fixed_rows[r] && !fixed_rows[c]) {
+                A.at(r, c) = value;
+            }
+        };
+
+        for (size_t c = 0; c < positions.size(); ++c) {
+            const int p = positions[c] * params_per_camera;
+            for (int a = 0; a < params_per_camera; ++a) {
+                b[p + a] = fixed_rows[p + a] ? 0. : -gradient[c](a);
+                for (int k = 0; k < a; ++k) {
+                    set(p + a, p + k, diagonal[c](a, k));
+                }
+                const double d = diagonal[c](a, a);
+                A.at(p + a, p + a) =
+                    (fixed_rows[p + a] || d <= 0.) ? 1. : d * (1. + lambda);
+            }
+        }
+
+        for (size_t e = 0; e < edges.size(); ++e) {
+            const int pi = positions[edges[e].first] * params_per_camera;
+            const int pj = positions[edges[e].second] * params_per_camera;
+            for (int a = 0; a < params_per_camera; ++a) {
+                for (int k = 0; k < params_per_camera; ++k) {
+                    if (pi > pj) {
+                        set(pi + a, pj + k, off_diagonal[e](a, k));
+                    } else {
+                        set(pj + k, pi + a, off_diagonal[e](a, k));
+                    }
+                }
+            }
+        }
+
+        if (!A.factorize()) {
+            return false;
+        }
+        A.solve(b);
+
+        step.resize(n);
+        for (size_t c = 0; c < positions.size(); ++c) {
+            for (int a = 0; a < params_per_camera; ++a) {
+                step[c * params_per_camera + a] =
+                    b[positions[c] * params_per_camera + a];
+            }
+        }
+        return true;
+    }
+};
+
+SparseBundleAdjusterRay::SparseBundleAdjusterRay()
+    : BundleAdjusterBase(params_per_camera, errors_per_match)
+    , huber_threshold_(default_huber_threshold)
+    , min_relative_improvement_(0.)
+    , time_budget_(0.)
+    , iterations_(0)
+    , rms_error_(0.)
+    , progress_(0.)
+    , exceeded_time_budget_(false)
+{
+}
+
+bool SparseBundleAdjusterRay::estimate(
+    const std::vector<cv::detail::ImageFeatures> &features,
+    const std::vector<cv::detail::MatchesInfo> &pairwise_matches,
+    std::vector<cv::detail::CameraParams> &cameras)
+{
+    num_images_ = static_cast<int>(features.size());
+    features_ = &features[0];
+    pairwise_matches_ = &pairwise_matches[0];
+    iterations_ = 0;
+    rms_error_ = 0.;
+    progress_ = 0.;
+    exceeded_time_budget_ = false;
+    const auto start = std::chrono::steady_clock::now();
+
+    setUpInitialCameraParams(cameras);
+    setUpEdges(pairwise_matches);
+
+    NormalEquations equations;
+    equations.edges = edges_;
+    equations.positions = cameraPositions(num_images_, edges_);
+
+    std::vector<int> first_position(num_images_);
+    std::iota(first_position.begin(), first_position.end(), 0);
+    for (const auto &edge : edges_) {
+        const int pi = equations.positions[edge.first];
+        const int pj = equations.positions[edge.second];
+        first_position[std::max(pi, pj)] =
+            std::min(first_position[std::max(pi, pj)], std::min(pi, pj));
+    }
+    equations.first.resize(num_images_ * params_per_camera);
+    for (int p = 0; p < num_images_; ++p) {
+        for (int a = 0; a < params_per_camera; ++a) {
+            equations.first[p * params_per_camera + a] =
+                first_position[p] * params_per_camera;
+        }
+    }
+
+    // Hold the focal lengths if they are not refined, and the rotation of
+    // one camera, as the error does not change under a global rotation.
+    equations.fixed.assign(cam_params_.rows, 0);
+    if (!refinement_mask_.at<uchar>(0, 0)) {
+        for (int i = 0; i < num_images_; ++i) {
+            equations.fixed[i * params_per_camera] = 1;
+        }
+    }
+    if (!edges_.empty()) {
+        for (int a = 1; a < params_per_camera; ++a) {
+            equations.fixed[edges_[0].first * params_per_camera + a] = 1;
+        }
+    }
+
+    const int max_iterations = (term_criteria_.type & cv::TermCriteria::COUNT)
+                                   ? term_criteria_.maxCount
+                                   : std::numeric_limits<int>::max();
+    const double epsilon = (term_criteria_.type & cv::TermCriteria::EPS)
+                               ? term_criteria_.epsilon
+                               : 0.;
+
+    double squared_error = 0.;
+    double cost = evaluate(cam_params_, &equations, squared_error);
+    double lambda = initial_lambda;
+    std::vector<double> step;
+    cv::Mat candidate;
+    // Relative improvement of the cost below which the estimation converges
+    const double min_improvement = std::max(epsilon, min_relative_improvement_);
+    double first_improvement = 0.;
+
+    while (total_num_matches_ > 0 && iterations_ < max_iterations) {
+        ++iterations_;
+
+        bool improved = false;
+        bool converged = false;
+        double improvement = 0.;
+        while (!improved && lambda <= max_lambda) {
+            if (!equations.solve(lambda, step)) {
+                lambda *= 10.;
+                continue;
+            }
+
+            candidate = cam_params_.clone();
+            for (int r = 0; r < candidate.rows; ++r) {
+                candidate.at<double>(r, 0) += step[r];
+            }
+
+            double candidate_squared_error = 0.;
+            const double candidate_cost =
+                evaluate(candidate, nullptr, candidate_squared_error);
+            if (candidate_cost < cost) {
+                improvement = (cost - candidate_cost) / cost;
+                converged =
+                    cost - candidate_cost <= epsilon * cost ||
+                    cost - candidate_cost < min_relative_improvement_ * cost ||
+                    cv::norm(step) <= epsilon * cv::norm(cam_params_);
+                std::swap(cam_params_, candidate);
+                cost = candidate_cost;
+                squared_error = candidate_squared_error;
+                lambda = std::max(lambda / 10., min_lambda);
+                improved = true;
+            } else {
+                lambda *= 10.;
+            }
+        }
+
+        if (!improved) {
+            break;
+        }
+
+        const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+        if (!converged && time_budget_ > 0. &&
+            elapsed.count() >= time_budget_) {
+            exceeded_time_budget_ = true;
+        }
+
+        if (converged || exceeded_time_budget_ ||
+            iterations_ >= max_iterations) {
+            progress_ = 1.;
+        } else {
+            double progress =
+                static_cast<double>(iterations_) / max_iterations;
+            if (time_budget_ > 0.) {
+                progress = std::max(progress, elapsed.count() / time_budget_);
+            }
+            if (iterations_ == 1) {
+                first_improvement = improvement;
+            }
+            if (min_improvement > 0. && first_improvement > min_improvement &&
+                improvement < first_improvement) {
+                progress = std::max(
+                    progress, std::log(first_improvement / improvement) /
+                                  std::log(first_improvement / min_improvement));
+            }
+            progress_ = std::max(progress_, std::min(progress, 1.));
+        }
+
+        if (iteration_cb_) {
+            iteration_cb_(iterations_,
+                          std::sqrt(squared_error / total_num_matches_));
+        }
+
+        if (converged || exceeded_time_budget_) {
+            break;
+        }
+
+        cost = evaluate(cam_params_, &equations, squared_error);
+    }
+    progress_ = 1.;
+
+    if (total_num_matches_ > 0) {
+        rms_error_ = std::sqrt(squared_error / total_num_matches_);
+    }
+
+    // Check if all camera parameters are valid
+    for (int i = 0; i < cam_params_.rows; ++i) {
+        if (cvIsNaN(cam_params_.at<double>(i, 0))) {
+            return false;
+        }
+    }
+
+    obtainRefinedCameraParams(cameras);
+
+    // Normalize motion to center image, as BundleAdjusterBase
+    cv::detail::Graph span_tree;
+    std::vector<int> span_tree_centers;
+    cv::detail::findMaxSpanningTree(num_images_, pairwise_matches, span_tree,
+                                    span_tree_centers);
+    cv::Mat R_inv = cameras[span_tree_centers[0]].R.inv();
+    for (int i = 0; i < num_images_; ++i) {
+        cameras[i].R = R_inv * cameras[i].R;
+    }
+
+    return true;
+}
+
+void SparseBundleAdjusterRay::setUpInitialCameraParams(
+    const std::vector<cv::detail::CameraParams> &cameras)
+{
+    cam_params_.create(num_images_ * params_per_camera, 1, CV_64F);
+    cv::SVD svd;
+    for (int i = 0; i < num_images_; ++i) {
+        cam_params_.at<double>(i * params_per_camera, 0) = cameras[i].focal;
+
+        cv::Mat R_camera;
+        cameras[i].R.convertTo(R_camera, CV_64F);
+        svd(R_camera, cv::SVD::FULL_UV);
+        cv::Mat R = svd.u * svd.vt;
+        if (cv::determinant(R) < 0) {
+            R *= -1;
+        }
+
+        cv::Mat rvec;
+        cv::Rodrigues(R, rvec);
+        for (int a = 1; a < params_per_camera; ++a) {
+            cam_params_.at<double>(i * params_per_camera + a, 0) =
+                rvec.at<double>(a - 1, 0);
+        }
+    }
+}
+
+void SparseBundleAdjusterRay::obtainRefinedCameraParams(
+    std::vector<cv::detail::CameraParams> &cameras) const
+{
+    for (int i = 0; i < num_images_; ++i) {
+        cameras[i].focal = cam_params_.at<double>(i * params_per_camera, 0);
+
+        cv::Mat rvec(3, 1, CV_64F);
+        for (int a = 1; a < params_per_camera; ++a) {
+            rvec.at<double>(a - 1, 0) =
+                cam_params_.at<double>(i * params_per_camera + a, 0);
+        }
+        cv::Rodrigues(rvec, cameras[i].R);
+
+        cv::Mat tmp;
+        cameras[i].R.convertTo(tmp, CV_32F);
+        cameras[i].R = tmp;
+    }
+}
+
+void SparseBundleAdjusterRay::calcError(cv::Mat &err)
+{
+    err.create(total_num_matches_ * errors_per_match, 1, CV_64F);
+
+    std::vector<double> errors;
+    for (size_t edge = 0; edge < edges_.size(); ++edge) {
+        edgeErrors(edge, cam_params_, errors);
+        std::copy(errors.begin(), errors.end(),
+                  err.ptr<double>(edge_offsets_[edge] * errors_per_match));
+    }
+}
+
+void SparseBundleAdjusterRay::calcJacobian(cv::Mat &jac)
+{
+    jac.create(total_num_matches_ * errors_per_match,
+               num_images_ * params_per_camera, CV_64F);
+    jac.setTo(0);
+
+    std::vector<double> errors, jacobian;
+    for (size_t edge = 0; edge < edges_.size(); ++edge) {
+        edgeJacobian(edge, cam_params_, errors, jacobian);
+
+        const int rows = static_cast<int>(errors.size());
+        const int first_row = edge_offsets_[edge] * errors_per_match;
+        const int cameras[] = {edges_[edge].first, edges_[edge].second};
+        for (int c = 0; c < 2 * params_per_camera; ++c) {
+            const int col = cameras[c / params_per_camera] * params_per_camera +
+                            c % params_per_camera;
+            for (int r = 0; r < rows; ++r) {
+                jac.at<double>(first_row + r, col) = jacobian[c * rows + r];
+            }
+        }
+    }
+}
+
+void SparseBundleAdjusterRay::setUpEdges(
+    const std::vector<cv::detail::MatchesInfo> &pairwise_matches)
+{
+    // Leave only consistent image pairs, as BundleAdjusterBase
+    edges_.clear();
+    edge_offsets_.assign(1, 0);
+    for (int i = 0; i < num_images_ - 1; ++i) {
+        for (int j = i + 1; j < num_images_; ++j) {
+            const cv::detail::MatchesInfo &matches_info =
+                pairwise_matches[i * num_images_ + j];
+            if (matches_info.confidence > conf_thresh_) {
+                edges_.push_back(std::make_pair(i, j));
+                edge_offsets_.push_back(
+                    edge_offsets_.back() +
+                    static_cast<int>(std::count_if(
+                        matches_info.inliers_mask.begin(),
+                        matches_info.inliers_mask.end(),
+                        [](uchar inlier) { return inlier != 0; })));
+            }
+        }
+    }
+    total_num_matches_ = edge_offsets_.back();
+}
+
+void SparseBundleAdjusterRay::edgeErrors(size_t edge, const cv::Mat &params,
+                                         std::vector<double> &errors) const
+{
+    const int i = edges_[edge].first;
+    const int j = edges_[edge].second;
+    errors.resize((edge_offsets_[edge + 1] - edge_offsets_[edge]) *
+                  errors_per_match);
+    pairErrors(features_[i], features_[j],
+               pairwise_matches_[i * num_images_ + j],
+               params.ptr<double>(i * params_per_camera),
+               params.ptr<double>(j * params_per_camera), errors.data());
+}
+
+void SparseBundleAdjusterRay::edgeJacobian(size_t edge, const cv::Mat &params,
+                                           std::vector<double> &errors,
+                                           std::vector<double> &jacobian) const
+{
+    const int i = edges_[edge].first;
+    const int j = edges_[edge].second;
+    const cv::detail::MatchesInfo &matches_info =
+        pairwise_matches_[i * num_images_ + j];
+
+    edgeErrors(edge, params, errors);
+    const size_t rows = errors.size();
+    jacobian.resize(2 * params_per_camera * rows);
+
+    // Parameters of both cameras, perturbed one at a time
+    double cameras[2 * params_per_camera];
+    std::copy_n(params.ptr<double>(i * params_per_camera), params_per_camera,
+                cameras);
+    std::copy_n(params.ptr<double>(j * params_per_camera), params_per_camera,
+                cameras + params_per_camera);
+
+    std::vector<double> errors_plus(rows), errors_minus(rows);
+    for (int c = 0; c < 2 * params_per_camera; ++c) {
+        const double value = cameras[c];
+        cameras[c] = value + jacobian_step;
+        pairErrors(features_[i], features_[j], matches_info, cameras,
+                   cameras + params_per_camera, errors_plus.data());
+        cameras[c] = value - jacobian_step;
+        pairErrors(features_[i], features_[j], matches_info, cameras,
+                   cameras + params_per_camera, errors_minus.data());
+        cameras[c] = value;
+
+        double *column = &jacobian[c * rows];
+        for (size_t r = 0; r < rows; ++r) {
+            column[r] = (errors_plus[r] - errors_minus[r]) / (2. * jacobian_step);
+        }
+    }
+}
+
+double SparseBundleAdjusterRay::evaluate(const cv::Mat &params,
+                                         NormalEquations *equations,
+                                         double &squared_error) const
+{
+    constexpr int edge_params = 2 * params_per_camera;
+    struct EdgeSystem {
+        cv::Matx<double, edge_params, edge_params> JtJ;
+        cv::Vec<double, edge_params> Jtr;
+        double cost = 0.;
+        double squared_error = 0.;
+    };
+
+    std::vector<EdgeSystem> systems(edges_.size());
+    cv::parallel_for_(
+        cv::Range(0, static_cast<int>(edges_.size())),
+        [&](const cv::Range &range) {
+            std::vector<double> errors, jacobian;
+            for (int edge = range.start; edge < range.end; ++edge) {
+                if (equations) {
+                    edgeJacobian(edge, params, errors, jacobian);
+                } else {
+                    edgeErrors(edge, params, errors);
+                }
+
+                EdgeSystem &system = systems[edge];
+                const size_t rows = errors.size();
+                for (size_t m = 0; m < rows; m += errors_per_match) {
+                    const double *e = &errors[m];
+                    const double s = e[0] * e[0] + e[1] * e[1] + e[2] * e[2];
+                    double weight;
+                    system.cost += loss(s, weight);
+                    system.squared_error += s;
+                    if (!equations) {
+                        continue;
+                    }
+
+                    for (int a = 0; a < edge_params; ++a) {
+                        const double *ja = &jacobian[a * rows + m];
+                        system.Jtr(a) +=
+                            weight * (ja[0] * e[0] + ja[1] * e[1] + ja[2] * e[2]);
+                        for (int b = a; b < edge_params; ++b) {
+                            const double *jb = &jacobian[b * rows + m];
+                            system.JtJ(a, b) += weight * (ja[0] * jb[0] +
+                                                          ja[1] * jb[1] +
+                                                          ja[2] * jb[2]);
+                        }
+                    }
+                }
+            }
+        });
+
+    if (equations) {
+        equations->diagonal.assign(num_images_, cv::Matx44d());
+        equations->off_diagonal.assign(edges_.size(), cv::Matx44d());
+        equations->gradient.assign(num_images_, cv::Vec4d());
+    }
+
+    double cost = 0.;
+    squared_error = 0.;
+    for (size_t edge = 0; edge < edges_.size(); ++edge) {
+        const EdgeSystem &system = systems[edge];
+        cost += system.cost;
+        squared_error += system.squared_error;
+        if (!equations) {
+            continue;
+        }
+
+        const int i = edges_[edge].first;
+        const int j = edges_[edge].second;
+        for (int a = 0; a < params_per_camera; ++a) {
+            const int a2 = a + params_per_camera;
+            equations->gradient[i](a) += system.Jtr(a);
+            equations->gradient[j](a) += system.Jtr(a2);
+            for (int b = 0; b < params_per_camera; ++b) {
+                const int b2 = b + params_per_camera;
+                // Only the upper triangle of JtJ was accumulated
+                equations->diagonal[i](a, b) +=
+                    a <= b ? system.JtJ(a, b) : system.JtJ(b, a);
+                equations->diagonal[j](a, b) +=
+                    a <= b ? system.JtJ(a2, b2) : system.JtJ(b2, a2);
+                equations->off_diagonal[edge](a, b) = system.JtJ(a, b2);
+            }
+        }
+    }
+
+    return cost;
+}
+
+double SparseBundleAdjusterRay::loss(double squared_error, double &weight) const
+{
+    const double threshold = huber_threshold_;
+    if (threshold <= 0. || squared_error <= threshold * threshold) {
+        weight = 1.;
+        return squared_error;
+    }
+
+    const double error = std::sqrt(squared_error);
+    weight = threshold / error;
+    return 2. * threshold * error - threshold * threshold;
+}
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,72 @@
+#include "airmap/opencv/estimators.h"
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+GimbalBasedEstimator::GimbalBasedEstimator(
+    std::shared_ptr<Camera> camera,
+    std::vector<GimbalOrientation> gimbal_orientations)
+    : _camera(std::move(camera))
+    , _gimbal_orientations(std::move(gimbal_orientations))
+{
+}
+
+bool GimbalBasedEstimator::available(
+    const std::shared_ptr<Camera> &camera,
+    const std::vector<GimbalOrientation> &gimbal_orientations)
+{
+    if (!camera || camera->sensorDimensionsPixels().x <= 0) {
+        return false;
+    }
+
+    if (!camera->calibration_intrinsics &&
+        (camera->focal_length_meters <= 0 ||
+         camera->sensorDimensionsMeters().x <= 0 ||
+         camera->sensorDimensionsMeters().y <= 0)) {
+        return false;
+    }
+
+    for (const auto &gimbal_orientation : gimbal_orientations) {
+        if (!gimbal_orientation.hasOrientation()) {
+            return false;
+        }
+    }
+
+    return !gimbal_orientations.empty();
+}
+
+bool GimbalBasedEstimator::estimate(
+    const std::vector<cv::detail::ImageFeatures> &features,
+    const std::vector<cv::detail::MatchesInfo> &pairwise_matches,
+    std::vector<cv::detail::CameraParams> &cameras)
+{
+    CV_UNUSED(pairwise_matches);
+
+    if (features.size() != _gimbal_orientations.size() ||
+        !available(_camera, _gimbal_orientations)) {
+        return false;
+    }
+
+    cameras.assign(features.size(), cv::detail::CameraParams());
+    for (size_t i = 0; i < features.size(); ++i) {
+        const double scale =
+            features[i].img_size.width / _camera->sensorDimensionsPixels().x;
+        const cv::Mat K = _camera->K(scale);
+
+        cameras[i].focal = K.at<double>(0, 0);
+        cameras[i].aspect = K.at<double>(1, 1) / K.at<double>(0, 0);
+        cameras[i].ppx = K.at<double>(0, 2);
+        cameras[i].ppy = K.at<double>(1, 2);
+        _gimbal_orientations[i].cameraRotation().convertTo(cameras[i].R,
+                                                           CV_32F);
+    }
+
+    return true;
+}
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
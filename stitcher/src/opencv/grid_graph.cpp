@@ -0,0 +1,356 @@
+#include "airmap/opencv/grid_graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+constexpr uint8_t GridGraph::NoParent;
+constexpr uint8_t GridGraph::Terminal;
+constexpr uint8_t GridGraph::Orphan;
+constexpr int GridGraph::NotInQueue;
+constexpr int GridGraph::QueueEnd;
+
+GridGraph::GridGraph(int width, int height)
+    : _width(width)
+    , _height(height)
+    , _vertex_total(width * height)
+    , _vertex_count(0)
+    , _offset { width, 1, -1, -width }
+    , _flow(0.f)
+    , _first(QueueEnd)
+    , _last(QueueEnd)
+{
+    assert(width > 0 && height > 0);
+    size_t vertex_total = static_cast<size_t>(_vertex_total);
+    for (auto &capacity : _capacity) {
+        capacity.assign(vertex_total, 0.f);
+    }
+    _weight.assign(vertex_total, 0.f);
+    _ts.resize(vertex_total);
+    _dist.resize(vertex_total);
+    _next.resize(vertex_total);
+    _parent.resize(vertex_total);
+    _sink.assign(vertex_total, 0);
+}
+
+int GridGraph::addVtx()
+{
+    assert(_vertex_count < _vertex_total);
+    return _vertex_count++;
+}
+
+void GridGraph::addEdges(int i, int j, float w, float revw)
+{
+    assert(w >= 0 && revw >= 0);
+    assert(i >= 0 && j < _vertex_total);
+
+    // Check for a vertical edge first, so that single column grids work.
+    if (j - i == _width) {
+        _capacity[Down][i] += w;
+        _capacity[Up][j] += revw;
+    } else {
+        assert(j - i == 1 && j % _width != 0);
+        _capacity[Right][i] += w;
+        _capacity[Left][j] += revw;
+    }
+}
+
+void GridGraph::addHorizontalEdges(int y, const float *weights)
+{
+    assert(y >= 0 && y < _height);
+
+    float *right = _capacity[Right].data() + y * _width;
+    float *left = _capacity[Left].data() + y * _width + 1;
+    for (int x = 0; x < _width - 1; ++x) {
+        right[x] += weights[x];
+        left[x] += weights[x];
+    }
+}
+
+void GridGraph::addVerticalEdges(int y, const float *weights)
+{
+    assert(y >= 0 && y < _height - 1);
+
+    float *down = _capacity[Down].data() + y * _width;
+    float *up = _capacity[Up].data() + (y + 1) * _width;
+    for (int x = 0; x < _width; ++x) {
+        down[x] += weights[x];
+        up[x] += weights[x];
+    }
+}
+
+void GridGraph::addTermWeights(int i, float source_weight, float sink_weight)
+{
+    assert(i >= 0 && i < _vertex_total);
+
+    // Cancel out flow that could go straight from the source to the sink,
+    // as GCGraph does.
+    float dw = _weight[i];
+    if (dw > 0) {
+        source_weight += dw;
+    } else {
+        sink_weight -= dw;
+    }
+    _flow += std::min(source_weight, sink_weight);
+    _weight[i] = source_weight - sink_weight;
+}
+
+inline void GridGraph::enqueue(int v)
+{
+    _next[v] = QueueEnd;
+    if (_first == QueueEnd) {
+        _first = v;
+    } else {
+        _next[_last] = v;
+    }
+    _last = v;
+}
+
+float GridGraph::maxFlow()
+{
+    int curr_ts = 0;
+    _first = QueueEnd;
+    _last = QueueEnd;
+    _orphans.clear();
+
+    // Initialize the active queue and the search trees.
+    for (int v = 0; v < _vertex_total; ++v) {
+        _ts[v] = 0;
+        _next[v] = NotInQueue;
+        if (_weight[v] != 0) {
+            enqueue(v);
+            _dist[v] = 1;
+            _parent[v] = Terminal;
+            _sink[v] = _weight[v] < 0;
+        } else {
+            _parent[v] = NoParent;
+        }
+    }
+
+    for (;;) {
+        // The edge joining the search trees, from the source tree side.
+        int joint = -1;
+        int joint_direction = 0;
+
+        // Grow the search trees from the active vertices.
+        while (_first != QueueEnd) {
+            const int v = _first;
+            if (_parent[v] != NoParent) {
+                const uint8_t vt = _sink[v];
+                const int x = v % _width;
+                for (int d = 0; d < 4; ++d) {
+                    if (!hasNeighbour(v, x, d)) {
+                        continue;
+                    }
+                    const int u = v + _offset[d];
+                    const float capacity =
+                            vt ? _capacity[opposite(d)][u] : _capacity[d][v];
+                    if (capacity == 0) {
+                        continue;
+                    }
+                    if (_parent[u] == NoParent) {
+                        _sink[u] = vt;
+                        _parent[u] = static_cast<uint8_t>(opposite(d) + 1);
+                        _ts[u] = _ts[v];
+                        _dist[u] = _dist[v] + 1;
+                        if (_next[u] == NotInQueue) {
+                            enqueue(u);
+                        }
+                        continue;
+                    }
+                    if (_sink[u] != vt) {
+                        if (vt) {
+                            joint = u;
+                            joint_direction = opposite(d);
+                        } else {
+                            joint = v;
+                            joint_direction = d;
+                        }
+                        break;
+                    }
+                    if (_dist[u] > _dist[v] + 1 && _ts[u] <= _ts[v]) {
+                        _parent[u] = static_cast<uint8_t>(opposite(d) + 1);
+                        _ts[u] = _ts[v];
+                        _dist[u] = _dist[v] + 1;
+                    }
+                }
+                if (joint >= 0) {
+                    break;
+                }
+            }
+            // Exclude the vertex from the active queue.
+            _first = _next[v];
+            _next[v] = NotInQueue;
+            if (_first == QueueEnd) {
+                _last = QueueEnd;
+            }
+        }
+
+        if (joint < 0) {
+            break;
+        }
+
+        const int joint_sink = joint + _offset[joint_direction];
+
+        // Find the bottleneck capacity along the path.
+        float min_weight = _capacity[joint_direction][joint];
+        int v = joint;
+        while (isDirection(_parent[v])) {
+            const int d = _parent[v] - 1;
+            const int p = v + _offset[d];
+            min_weight = std::min(min_weight, _capacity[opposite(d)][p]);
+            v = p;
+        }
+        min_weight = std::min(min_weight, std::fabs(_weight[v]));
+        v = joint_sink;
+        while (isDirection(_parent[v])) {
+            const int d = _parent[v] - 1;
+            min_weight = std::min(min_weight, _capacity[d][v]);
+            v += _offset[d];
+        }
+        min_weight = std::min(min_weight, std::fabs(_weight[v]));
+
+        // Augment along the path and collect orphans.
+        _capacity[joint_direction][joint] -= min_weight;
+        _capacity[opposite(joint_direction)][joint_sink] += min_weight;
+        _flow += min_weight;
+
+        v = joint;
+        while (isDirection(_parent[v])) {
+            const int d = _parent[v] - 1;
+            const int p = v + _offset[d];
+            _capacity[d][v] += min_weight;
+            if ((_capacity[opposite(d)][p] -= min_weight) == 0) {
+                _orphans.push_back(v);
+                _parent[v] = Orphan;
+            }
+            v = p;
+        }
+        _weight[v] -= min_weight;
+        if (_weight[v] == 0) {
+            _orphans.push_back(v);
+            _parent[v] = Orphan;
+        }
+
+        v = joint_sink;
+        while (isDirection(_parent[v])) {
+            const int d = _parent[v] - 1;
+            const int p = v + _offset[d];
+            _capacity[opposite(d)][p] += min_weight;
+            if ((_capacity[d][v] -= min_weight) == 0) {
+                _orphans.push_back(v);
+                _parent[v] = Orphan;
+            }
+            v = p;
+        }
+        _weight[v] += min_weight;
+        if (_weight[v] == 0) {
+            _orphans.push_back(v);
+            _parent[v] = Orphan;
+        }
+
+        // Restore the search trees by finding new parents for the orphans.
+        curr_ts++;
+        while (!_orphans.empty()) {
+            const int orphan = _orphans.back();
+            _orphans.pop_back();
+
+            const uint8_t vt = _sink[orphan];
+            const int x = orphan % _width;
+            int min_dist = INT_MAX;
+            int parent_direction = -1;
+
+            for (int d = 0; d < 4; ++d) {
+                if (!hasNeighbour(orphan, x, d)) {
+                    continue;
+                }
+                const int u = orphan + _offset[d];
+                const float capacity =
+                        vt ? _capacity[d][orphan] : _capacity[opposite(d)][u];
+                if (capacity == 0) {
+                    continue;
+                }
+                if (_sink[u] != vt || _parent[u] == NoParent) {
+                    continue;
+                }
+
+                // Compute the distance to the tree root.
+                int dist = 0;
+                int w = u;
+                for (;;) {
+                    if (_ts[w] == curr_ts) {
+                        dist += _dist[w];
+                        break;
+                    }
+                    const uint8_t parent = _parent[w];
+                    dist++;
+                    if (!isDirection(parent)) {
+                        if (parent == Orphan) {
+                            dist = INT_MAX - 1;
+                        } else {
+                            _ts[w] = curr_ts;
+                            _dist[w] = 1;
+                        }
+                        break;
+                    }
+                    w += _offset[parent - 1];
+                }
+
+                // Update the distance.
+                if (++dist < INT_MAX) {
+                    if (dist < min_dist) {
+                        min_dist = dist;
+                        parent_direction = d;
+                    }
+                    for (w = u; _ts[w] != curr_ts; w += _offset[_parent[w] - 1]) {
+                        _ts[w] = curr_ts;
+                        _dist[w] = --dist;
+                    }
+                }
+            }
+
+            if (parent_direction >= 0) {
+                _parent[orphan] = static_cast<uint8_t>(parent_direction + 1);
+                _ts[orphan] = curr_ts;
+                _dist[orphan] = min_dist;
+                continue;
+            }
+
+            // No parent was found; free the orphan.
+            _parent[orphan] = NoParent;
+            _ts[orphan] = 0;
+            for (int d = 0; d < 4; ++d) {
+                if (!hasNeighbour(orphan, x, d)) {
+                    continue;
+                }
+                const int u = orphan + _offset[d];
+                const uint8_t parent = _parent[u];
+                if (_sink[u] != vt || parent == NoParent) {
+                    continue;
+                }
+                const float capacity =
+                        vt ? _capacity[d][orphan] : _capacity[opposite(d)][u];
+                if (capacity != 0 && _next[u] == NotInQueue) {
+                    enqueue(u);
+                }
+                if (isDirection(parent) && u + _offset[parent - 1] == orphan) {
+                    _orphans.push_back(u);
+                    _parent[u] = Orphan;
+                }
+            }
+        }
+    }
+
+    return _flow;
+}
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
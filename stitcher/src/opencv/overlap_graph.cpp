@@ -0,0 +1,79 @@
+#include "airmap/opencv/overlap_graph.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+OverlapGraph::OverlapGraph(const std::vector<cv::Point> &corners,
+                           const std::vector<cv::Size> &sizes,
+                           const std::vector<cv::UMat> &masks,
+                           int min_overlap_pixels)
+    : _corners(corners)
+    , _sizes(sizes)
+    , _adjacency(corners.size())
+{
+    CV_Assert(corners.size() == sizes.size());
+    CV_Assert(masks.empty() || masks.size() == corners.size());
+
+    if (corners.empty()) {
+        return;
+    }
+
+    cv::Point tl(std::numeric_limits<int>::max(),
+                 std::numeric_limits<int>::max());
+    cv::Point br(std::numeric_limits<int>::min(),
+                 std::numeric_limits<int>::min());
+    for (size_t i = 0; i < corners.size(); ++i) {
+        tl.x = std::min(tl.x, corners[i].x);
+        tl.y = std::min(tl.y, corners[i].y);
+        br.x = std::max(br.x, corners[i].x + sizes[i].width);
+        br.y = std::max(br.y, corners[i].y + sizes[i].height);
+    }
+    _result_roi = cv::Rect(tl, br);
+
+    cv::Mat overlap;
+    for (size_t i = 0; i + 1 < corners.size(); ++i) {
+        const cv::Rect rect1(corners[i], sizes[i]);
+        for (size_t j = i + 1; j < corners.size(); ++j) {
+            const cv::Rect roi = rect1 & cv::Rect(corners[j], sizes[j]);
+            if (roi.empty()) {
+                continue;
+            }
+
+            // Counting the pixels within both masks is only needed to compare
+            // them with the threshold.
+            int overlap_pixels = roi.area();
+            if (!masks.empty() && min_overlap_pixels > 0) {
+                cv::Mat mask1 = masks[i].getMat(cv::ACCESS_READ);
+                cv::Mat mask2 = masks[j].getMat(cv::ACCESS_READ);
+                cv::bitwise_and(mask1(roi - corners[i]),
+                                mask2(roi - corners[j]), overlap);
+                overlap_pixels = cv::countNonZero(overlap);
+            }
+
+            if (overlap_pixels < min_overlap_pixels) {
+                ++_skipped_pairs;
+                continue;
+            }
+
+            _adjacency[i].push_back(_pairs.size());
+            _adjacency[j].push_back(_pairs.size());
+            _pairs.push_back({i, j, roi, overlap_pixels});
+        }
+    }
+}
+
+bool OverlapGraph::matches(const std::vector<cv::Point> &corners,
+                           const std::vector<cv::Size> &sizes) const
+{
+    return corners == _corners && sizes == _sizes;
+}
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
@@ -1,5 +1,8 @@
 #include "airmap/opencv/seam_finders.h"
+#include "airmap/opencv/grid_graph.h"
+#include "airmap/opencv/seam_graph.h"
 
+#include <opencv2/core/utility.hpp>
 #include <opencv2/imgproc/detail/gcgraph.hpp>
 #include <opencv2/stitching.hpp>
 
@@ -11,14 +14,22 @@ namespace stitcher {
 namespace opencv {
 namespace detail {
 
+namespace {
+
+// Margin around the overlap of a pair of images included in their graph
+constexpr int gap = 10;
+
+} // namespace
+
 class MonitoredGraphCutSeamFinder::Impl
     : public cv::detail::PairwiseSeamFinder {
 public:
     Impl(Monitor::SharedPtr monitor, int cost_type, float terminal_cost,
-         float bad_region_penalty)
+         float bad_region_penalty, MaxFlowType max_flow_type)
         : cost_type_(cost_type)
         , terminal_cost_(terminal_cost)
         , bad_region_penalty_(bad_region_penalty)
+        , max_flow_type_(max_flow_type)
         , _monitor(monitor)
     {
     }
@@ -30,21 +41,26 @@ public:
 
     void findInPair(size_t first, size_t second, Rect roi) CV_OVERRIDE;
 
+    void setOverlapGraph(const OverlapGraph &overlaps) { overlaps_ = overlaps; }
+
 private:
-    void setGraphWeightsColor(const Mat &img1, const Mat &img2,
-                              const Mat &mask1, const Mat &mask2,
-                              GCGraph<float> &graph);
+    template <class Graph>
+    void cut(size_t first, size_t second, Rect roi, const Mat &submask1,
+             const Mat &submask2, const Mat &horizontal, const Mat &vertical,
+             Graph &graph);
 
-    void setGraphWeightsColorGrad(const Mat &img1, const Mat &img2,
-                                  const Mat &dx1, const Mat &dx2,
-                                  const Mat &dy1, const Mat &dy2,
-                                  const Mat &mask1, const Mat &mask2,
-                                  GCGraph<float> &graph);
+    void computeGradients(size_t index);
 
+    // Gradients are only computed for the part of each image that is
+    // within gap of an overlap, gradient_rois_ is that part of the image.
     std::vector<Mat> dx_, dy_;
+    std::vector<Rect> gradient_rois_;
+    OverlapGraph overlaps_;
+    TLSData<SeamGraphWorkspace> workspace_;
     int cost_type_;
     float terminal_cost_;
     float bad_region_penalty_;
+    MaxFlowType max_flow_type_;
     Monitor::SharedPtr _monitor;
 };
 
@@ -52,128 +68,91 @@ void MonitoredGraphCutSeamFinder::Impl::find(const std::vector<UMat> &src,
                                              const std::vector<Point> &corners,
                                              std::vector<UMat> &masks)
 {
-    // Compute gradients
-    dx_.resize(src.size());
-    dy_.resize(src.size());
-    Mat dx, dy;
+    CV_Assert(src.size() == corners.size());
+    if (src.empty()) {
+        return;
+    }
+
+    images_ = src;
+    sizes_.resize(src.size());
     for (size_t i = 0; i < src.size(); ++i) {
-        CV_Assert(src[i].channels() == 3);
-        Sobel(src[i], dx, CV_32F, 1, 0);
-        Sobel(src[i], dy, CV_32F, 0, 1);
-        dx_[i].create(src[i].size(), CV_32F);
-        dy_[i].create(src[i].size(), CV_32F);
-        for (int y = 0; y < src[i].rows; ++y) {
-            const Point3f *dx_row = dx.ptr<Point3f>(y);
-            const Point3f *dy_row = dy.ptr<Point3f>(y);
-            float *dx_row_ = dx_[i].ptr<float>(y);
-            float *dy_row_ = dy_[i].ptr<float>(y);
-            for (int x = 0; x < src[i].cols; ++x) {
-                dx_row_[x] = normL2(dx_row[x]);
-                dy_row_[x] = normL2(dy_row[x]);
-            }
-        }
+        sizes_[i] = src[i].size();
     }
-    PairwiseSeamFinder::find(src, corners, masks);
-}
+    corners_ = corners;
+    masks_ = masks;
 
-void MonitoredGraphCutSeamFinder::Impl::setGraphWeightsColor(
-    const Mat &img1, const Mat &img2, const Mat &mask1, const Mat &mask2,
-    GCGraph<float> &graph)
-{
-    const Size img_size = img1.size();
-
-    // Set terminal weights
-    for (int y = 0; y < img_size.height; ++y) {
-        for (int x = 0; x < img_size.width; ++x) {
-            int v = graph.addVtx();
-            graph.addTermWeights(v,
-                                 mask1.at<uchar>(y, x) ? terminal_cost_ : 0.f,
-                                 mask2.at<uchar>(y, x) ? terminal_cost_ : 0.f);
-        }
+    if (!overlaps_.matches(corners_, sizes_)) {
+        overlaps_ = OverlapGraph(corners_, sizes_);
     }
 
-    // Set regular edge weights
-    const float weight_eps = 1.f;
-    for (int y = 0; y < img_size.height; ++y) {
-        for (int x = 0; x < img_size.width; ++x) {
-            int v = y * img_size.width + x;
-            if (x < img_size.width - 1) {
-                float weight =
-                    normL2(img1.at<Point3f>(y, x), img2.at<Point3f>(y, x)) +
-                    normL2(img1.at<Point3f>(y, x + 1),
-                           img2.at<Point3f>(y, x + 1)) +
-                    weight_eps;
-                if (!mask1.at<uchar>(y, x) || !mask1.at<uchar>(y, x + 1) ||
-                    !mask2.at<uchar>(y, x) || !mask2.at<uchar>(y, x + 1))
-                    weight += bad_region_penalty_;
-                graph.addEdges(v, v + 1, weight, weight);
-            }
-            if (y < img_size.height - 1) {
-                float weight =
-                    normL2(img1.at<Point3f>(y, x), img2.at<Point3f>(y, x)) +
-                    normL2(img1.at<Point3f>(y + 1, x),
-                           img2.at<Point3f>(y + 1, x)) +
-                    weight_eps;
-                if (!mask1.at<uchar>(y, x) || !mask1.at<uchar>(y + 1, x) ||
-                    !mask2.at<uchar>(y, x) || !mask2.at<uchar>(y + 1, x))
-                    weight += bad_region_penalty_;
-                graph.addEdges(v, v + img_size.width, weight, weight);
-            }
+    // Find the parts of the images read by findInPair, gradients are
+    // computed lazily for those parts only.
+    dx_.assign(src.size(), Mat());
+    dy_.assign(src.size(), Mat());
+    gradient_rois_.assign(src.size(), Rect());
+    if (cost_type_ == GraphCutSeamFinder::COST_COLOR_GRAD) {
+        for (const OverlapGraph::Pair &pair : overlaps_.pairs()) {
+            const Rect &roi = pair.roi;
+            Rect expanded(roi.x - gap, roi.y - gap, roi.width + 2 * gap,
+                          roi.height + 2 * gap);
+            gradient_rois_[pair.first] |=
+                (expanded - corners_[pair.first]) &
+                Rect(Point(), sizes_[pair.first]);
+            gradient_rois_[pair.second] |=
+                (expanded - corners_[pair.second]) &
+                Rect(Point(), sizes_[pair.second]);
         }
     }
+
+    _monitor->setOperationWork(overlaps_.pairs().size());
+    for (const OverlapGraph::Pair &pair : overlaps_.pairs()) {
+        findInPair(pair.first, pair.second, pair.roi);
+    }
+
+    dx_.clear();
+    dy_.clear();
 }
 
-void MonitoredGraphCutSeamFinder::Impl::setGraphWeightsColorGrad(
-    const Mat &img1, const Mat &img2, const Mat &dx1, const Mat &dx2,
-    const Mat &dy1, const Mat &dy2, const Mat &mask1, const Mat &mask2,
-    GCGraph<float> &graph)
+void MonitoredGraphCutSeamFinder::Impl::computeGradients(size_t index)
 {
-    const Size img_size = img1.size();
-
-    // Set terminal weights
-    for (int y = 0; y < img_size.height; ++y) {
-        for (int x = 0; x < img_size.width; ++x) {
-            int v = graph.addVtx();
-            graph.addTermWeights(v,
-                                 mask1.at<uchar>(y, x) ? terminal_cost_ : 0.f,
-                                 mask2.at<uchar>(y, x) ? terminal_cost_ : 0.f);
-        }
+    if (!dx_[index].empty() || gradient_rois_[index].empty()) {
+        return;
     }
 
-    // Set regular edge weights
-    const float weight_eps = 1.f;
-    for (int y = 0; y < img_size.height; ++y) {
-        for (int x = 0; x < img_size.width; ++x) {
-            int v = y * img_size.width + x;
-            if (x < img_size.width - 1) {
-                float grad = dx1.at<float>(y, x) + dx1.at<float>(y, x + 1) +
-                             dx2.at<float>(y, x) + dx2.at<float>(y, x + 1) +
-                             weight_eps;
-                float weight =
-                    (normL2(img1.at<Point3f>(y, x), img2.at<Point3f>(y, x)) +
-                     normL2(img1.at<Point3f>(y, x + 1),
-                            img2.at<Point3f>(y, x + 1))) /
-                        grad +
-                    weight_eps;
-                if (!mask1.at<uchar>(y, x) || !mask1.at<uchar>(y, x + 1) ||
-                    !mask2.at<uchar>(y, x) || !mask2.at<uchar>(y, x + 1))
-                    weight += bad_region_penalty_;
-                graph.addEdges(v, v + 1, weight, weight);
-            }
-            if (y < img_size.height - 1) {
-                float grad = dy1.at<float>(y, x) + dy1.at<float>(y + 1, x) +
-                             dy2.at<float>(y, x) + dy2.at<float>(y + 1, x) +
-                             weight_eps;
-                float weight =
-                    (normL2(img1.at<Point3f>(y, x), img2.at<Point3f>(y, x)) +
-                     normL2(img1.at<Point3f>(y + 1, x),
-                            img2.at<Point3f>(y + 1, x))) /
-                        grad +
-                    weight_eps;
-                if (!mask1.at<uchar>(y, x) || !mask1.at<uchar>(y + 1, x) ||
-                    !mask2.at<uchar>(y, x) || !mask2.at<uchar>(y + 1, x))
-                    weight += bad_region_penalty_;
-                graph.addEdges(v, v + img_size.width, weight, weight);
+    Mat img = images_[index].getMat(ACCESS_READ);
+    CV_Assert(img.channels() == 3);
+    seamGraphGradients(img, gradient_rois_[index], dx_[index], dy_[index]);
+}
+
+template <class Graph>
+void MonitoredGraphCutSeamFinder::Impl::cut(size_t first, size_t second,
+                                            Rect roi, const Mat &submask1,
+                                            const Mat &submask2,
+                                            const Mat &horizontal,
+                                            const Mat &vertical, Graph &graph)
+{
+    buildSeamGraph(submask1, submask2, terminal_cost_, horizontal, vertical,
+                   graph);
+    graph.maxFlow();
+
+    Mat mask1 = masks_[first].getMat(ACCESS_RW),
+        mask2 = masks_[second].getMat(ACCESS_RW);
+    Point tl1 = corners_[first], tl2 = corners_[second];
+    const int sub_width = roi.width + 2 * gap;
+
+    for (int y = 0; y < roi.height; ++y) {
+        uchar *mask1_row =
+            mask1.ptr<uchar>(roi.y - tl1.y + y) + (roi.x - tl1.x);
+        uchar *mask2_row =
+            mask2.ptr<uchar>(roi.y - tl2.y + y) + (roi.x - tl2.x);
+        const int v = (y + gap) * sub_width + gap;
+        for (int x = 0; x < roi.width; ++x) {
+            if (graph.inSourceSegment(v + x)) {
+                if (mask1_row[x])
+                    mask2_row[x] = 0;
+            } else {
+                if (mask2_row[x])
+                    mask1_row[x] = 0;
             }
         }
     }
@@ -182,98 +161,87 @@ void MonitoredGraphCutSeamFinder::Impl::setGraphWeightsColorGrad(
 void MonitoredGraphCutSeamFinder::Impl::findInPair(size_t first, size_t second,
                                                    Rect roi)
 {
-    _monitor->updateCurrentOperation(static_cast<double>(first) /
-                                     static_cast<double>(dx_.size()));
+    auto span = _monitor->span("FindInPair", static_cast<int64_t>(first));
     Mat img1 = images_[first].getMat(ACCESS_READ),
         img2 = images_[second].getMat(ACCESS_READ);
-    Mat dx1 = dx_[first], dx2 = dx_[second];
-    Mat dy1 = dy_[first], dy2 = dy_[second];
-    Mat mask1 = masks_[first].getMat(ACCESS_RW),
-        mask2 = masks_[second].getMat(ACCESS_RW);
+    Mat mask1 = masks_[first].getMat(ACCESS_READ),
+        mask2 = masks_[second].getMat(ACCESS_READ);
     Point tl1 = corners_[first], tl2 = corners_[second];
 
-    const int gap = 10;
-    Mat subimg1(roi.height + 2 * gap, roi.width + 2 * gap, CV_32FC3);
-    Mat subimg2(roi.height + 2 * gap, roi.width + 2 * gap, CV_32FC3);
-    Mat submask1(roi.height + 2 * gap, roi.width + 2 * gap, CV_8U);
-    Mat submask2(roi.height + 2 * gap, roi.width + 2 * gap, CV_8U);
-    Mat subdx1(roi.height + 2 * gap, roi.width + 2 * gap, CV_32F);
-    Mat subdy1(roi.height + 2 * gap, roi.width + 2 * gap, CV_32F);
-    Mat subdx2(roi.height + 2 * gap, roi.width + 2 * gap, CV_32F);
-    Mat subdy2(roi.height + 2 * gap, roi.width + 2 * gap, CV_32F);
-
-    // Cut subimages and submasks with some gap
-    for (int y = -gap; y < roi.height + gap; ++y) {
-        for (int x = -gap; x < roi.width + gap; ++x) {
-            int y1 = roi.y - tl1.y + y;
-            int x1 = roi.x - tl1.x + x;
-            if (y1 >= 0 && x1 >= 0 && y1 < img1.rows && x1 < img1.cols) {
-                subimg1.at<Point3f>(y + gap, x + gap) =
-                    img1.at<Point3f>(y1, x1);
-                submask1.at<uchar>(y + gap, x + gap) = mask1.at<uchar>(y1, x1);
-                subdx1.at<float>(y + gap, x + gap) = dx1.at<float>(y1, x1);
-                subdy1.at<float>(y + gap, x + gap) = dy1.at<float>(y1, x1);
-            } else {
-                subimg1.at<Point3f>(y + gap, x + gap) = Point3f(0, 0, 0);
-                submask1.at<uchar>(y + gap, x + gap) = 0;
-                subdx1.at<float>(y + gap, x + gap) = 0.f;
-                subdy1.at<float>(y + gap, x + gap) = 0.f;
-            }
+    const Size sub_size(roi.width + 2 * gap, roi.height + 2 * gap);
+    SeamGraphWorkspace &workspace = *workspace_.get();
 
-            int y2 = roi.y - tl2.y + y;
-            int x2 = roi.x - tl2.x + x;
-            if (y2 >= 0 && x2 >= 0 && y2 < img2.rows && x2 < img2.cols) {
-                subimg2.at<Point3f>(y + gap, x + gap) =
-                    img2.at<Point3f>(y2, x2);
-                submask2.at<uchar>(y + gap, x + gap) = mask2.at<uchar>(y2, x2);
-                subdx2.at<float>(y + gap, x + gap) = dx2.at<float>(y2, x2);
-                subdy2.at<float>(y + gap, x + gap) = dy2.at<float>(y2, x2);
-            } else {
-                subimg2.at<Point3f>(y + gap, x + gap) = Point3f(0, 0, 0);
-                submask2.at<uchar>(y + gap, x + gap) = 0;
-                subdx2.at<float>(y + gap, x + gap) = 0.f;
-                subdy2.at<float>(y + gap, x + gap) = 0.f;
-            }
-        }
-    }
-
-    const int vertex_count = (roi.height + 2 * gap) * (roi.width + 2 * gap);
-    const int edge_count = (roi.height - 1 + 2 * gap) * (roi.width + 2 * gap) +
-                           (roi.width - 1 + 2 * gap) * (roi.height + 2 * gap);
-    GCGraph<float> graph(vertex_count, edge_count);
+    // Cut subimages and submasks with some gap, pixels outside of the
+    // images are zero
+    Mat subimg1 =
+        workspace.zeros(SeamGraphWorkspace::Image1, sub_size, CV_32FC3);
+    Mat subimg2 =
+        workspace.zeros(SeamGraphWorkspace::Image2, sub_size, CV_32FC3);
+    Mat submask1 = workspace.zeros(SeamGraphWorkspace::Mask1, sub_size, CV_8U);
+    Mat submask2 = workspace.zeros(SeamGraphWorkspace::Mask2, sub_size, CV_8U);
+    extractSubimage(img1, tl1, roi, gap, subimg1);
+    extractSubimage(img2, tl2, roi, gap, subimg2);
+    extractSubimage(mask1, tl1, roi, gap, submask1);
+    extractSubimage(mask2, tl2, roi, gap, submask2);
 
+    Mat horizontal, vertical;
     switch (cost_type_) {
     case GraphCutSeamFinder::COST_COLOR:
-        setGraphWeightsColor(subimg1, subimg2, submask1, submask2, graph);
+        seamGraphWeightsColor(subimg1, subimg2, submask1, submask2,
+                              bad_region_penalty_, workspace, horizontal,
+                              vertical);
         break;
-    case GraphCutSeamFinder::COST_COLOR_GRAD:
-        setGraphWeightsColorGrad(subimg1, subimg2, subdx1, subdx2, subdy1,
-                                 subdy2, submask1, submask2, graph);
+    case GraphCutSeamFinder::COST_COLOR_GRAD: {
+        Mat subdx1 = workspace.zeros(SeamGraphWorkspace::Dx1, sub_size, CV_32F);
+        Mat subdx2 = workspace.zeros(SeamGraphWorkspace::Dx2, sub_size, CV_32F);
+        Mat subdy1 = workspace.zeros(SeamGraphWorkspace::Dy1, sub_size, CV_32F);
+        Mat subdy2 = workspace.zeros(SeamGraphWorkspace::Dy2, sub_size, CV_32F);
+        computeGradients(first);
+        computeGradients(second);
+        const Point grad_tl1 = tl1 + gradient_rois_[first].tl();
+        const Point grad_tl2 = tl2 + gradient_rois_[second].tl();
+        extractSubimage(dx_[first], grad_tl1, roi, gap, subdx1);
+        extractSubimage(dx_[second], grad_tl2, roi, gap, subdx2);
+        extractSubimage(dy_[first], grad_tl1, roi, gap, subdy1);
+        extractSubimage(dy_[second], grad_tl2, roi, gap, subdy2);
+        seamGraphWeightsColorGrad(subimg1, subimg2, subdx1, subdx2, subdy1,
+                                  subdy2, submask1, submask2,
+                                  bad_region_penalty_, workspace, horizontal,
+                                  vertical);
         break;
+    }
     default:
         CV_Error(Error::StsBadArg, "unsupported pixel similarity measure");
     }
 
-    graph.maxFlow();
+    const int vertex_count = sub_size.area();
+    _monitor->addWork(monitor::OperationResources::GraphVertices, vertex_count);
+    const int edge_count = (roi.height - 1 + 2 * gap) * (roi.width + 2 * gap) +
+                           (roi.width - 1 + 2 * gap) * (roi.height + 2 * gap);
 
-    for (int y = 0; y < roi.height; ++y) {
-        for (int x = 0; x < roi.width; ++x) {
-            if (graph.inSourceSegment((y + gap) * (roi.width + 2 * gap) + x +
-                                      gap)) {
-                if (mask1.at<uchar>(roi.y - tl1.y + y, roi.x - tl1.x + x))
-                    mask2.at<uchar>(roi.y - tl2.y + y, roi.x - tl2.x + x) = 0;
-            } else {
-                if (mask2.at<uchar>(roi.y - tl2.y + y, roi.x - tl2.x + x))
-                    mask1.at<uchar>(roi.y - tl1.y + y, roi.x - tl1.x + x) = 0;
-            }
-        }
+    switch (max_flow_type_) {
+    case MaxFlowType::Generic: {
+        GCGraph<float> graph(vertex_count, edge_count);
+        cut(first, second, roi, submask1, submask2, horizontal, vertical,
+            graph);
+        break;
     }
+    case MaxFlowType::Grid: {
+        GridGraph graph(sub_size.width, sub_size.height);
+        cut(first, second, roi, submask1, submask2, horizontal, vertical,
+            graph);
+        break;
+    }
+    }
+
+    _monitor->completeWork();
 }
 
 MonitoredGraphCutSeamFinder::MonitoredGraphCutSeamFinder(
     Monitor::SharedPtr monitor, int cost_type, float terminal_cost,
-    float bad_region_penalty)
-    : _impl(new Impl(monitor, cost_type, terminal_cost, bad_region_penalty))
+    float bad_region_penalty, MaxFlowType max_flow_type)
+    : _impl(new Impl(monitor, cost_type, terminal_cost, bad_region_penalty,
+                     max_flow_type))
 {
 }
 
@@ -286,6 +254,11 @@ void MonitoredGraphCutSeamFinder::find(const std::vector<cv::UMat> &src,
     _impl->find(src, corners, masks);
 }
 
+void MonitoredGraphCutSeamFinder::setOverlapGraph(const OverlapGraph &overlaps)
+{
+    _impl->setOverlapGraph(overlaps);
+}
+
 } // namespace detail
 } // namespace opencv
 } // namespace stitcher
@@ -0,0 +1,301 @@
+#include "airmap/opencv/seam_graph.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/core/utility.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace opencv {
+namespace detail {
+
+namespace {
+
+constexpr float weight_eps = 1.f;
+
+/**
+ * @brief pixelCosts
+ * Compute the squared color difference of each pixel, and whether each
+ * pixel is inside both masks.
+ */
+void pixelCosts(const cv::Mat &img1, const cv::Mat &img2,
+                const cv::Mat &mask1, const cv::Mat &mask2, cv::Mat &cost,
+                cv::Mat &valid)
+{
+    CV_Assert(img1.type() == CV_32FC3 && img2.type() == CV_32FC3);
+
+    for (int y = 0; y < img1.rows; ++y) {
+        const float *img1_row = img1.ptr<float>(y);
+        const float *img2_row = img2.ptr<float>(y);
+        const uchar *mask1_row = mask1.ptr<uchar>(y);
+        const uchar *mask2_row = mask2.ptr<uchar>(y);
+        float *cost_row = cost.ptr<float>(y);
+        uchar *valid_row = valid.ptr<uchar>(y);
+        for (int x = 0; x < img1.cols; ++x) {
+            float d0 = img1_row[3 * x] - img2_row[3 * x];
+            float d1 = img1_row[3 * x + 1] - img2_row[3 * x + 1];
+            float d2 = img1_row[3 * x + 2] - img2_row[3 * x + 2];
+            cost_row[x] = d0 * d0 + d1 * d1 + d2 * d2;
+            valid_row[x] = (mask1_row[x] != 0) & (mask2_row[x] != 0);
+        }
+    }
+}
+
+/**
+ * @brief reflect101
+ * Index of a pixel outside of [0, n) as per cv::BORDER_REFLECT_101, the
+ * border Sobel uses by default.
+ */
+inline int reflect101(int i, int n)
+{
+    if (n == 1) {
+        return 0;
+    }
+    if (i < 0) {
+        return -i;
+    }
+    if (i >= n) {
+        return 2 * n - 2 - i;
+    }
+    return i;
+}
+
+/**
+ * @brief sobelPixel
+ * Squared magnitudes of the 3x3 Sobel derivatives of a 3 channel pixel,
+ * given the offsets of its left, center and right neighbours in the rows
+ * above, at and below it.
+ */
+inline void sobelPixel(const float *above, const float *row,
+                       const float *below, int l, int c, int r, float &dx,
+                       float &dy)
+{
+    float dx_sum = 0.f, dy_sum = 0.f;
+    for (int k = 0; k < 3; ++k) {
+        float gx = (above[r + k] - above[l + k]) +
+                   2.f * (row[r + k] - row[l + k]) +
+                   (below[r + k] - below[l + k]);
+        float gy = (below[l + k] + 2.f * below[c + k] + below[r + k]) -
+                   (above[l + k] + 2.f * above[c + k] + above[r + k]);
+        dx_sum += gx * gx;
+        dy_sum += gy * gy;
+    }
+    dx = dx_sum;
+    dy = dy_sum;
+}
+
+} // namespace
+
+cv::Mat SeamGraphWorkspace::get(Buffer buffer, cv::Size size, int type)
+{
+    std::vector<uchar> &storage = _buffers[buffer];
+    size_t bytes = static_cast<size_t>(size.area()) * CV_ELEM_SIZE(type);
+    if (storage.size() < bytes) {
+        storage.resize(bytes);
+    }
+    return cv::Mat(size, type, storage.data());
+}
+
+cv::Mat SeamGraphWorkspace::zeros(Buffer buffer, cv::Size size, int type)
+{
+    cv::Mat mat = get(buffer, size, type);
+    mat.setTo(cv::Scalar::all(0));
+    return mat;
+}
+
+void extractSubimage(const cv::Mat &src, cv::Point tl, cv::Rect roi, int gap,
+                     cv::Mat &dst)
+{
+    // The expanded roi, relative to src
+    cv::Rect sub(roi.x - tl.x - gap, roi.y - tl.y - gap, roi.width + 2 * gap,
+                 roi.height + 2 * gap);
+    cv::Rect intersection = sub & cv::Rect(0, 0, src.cols, src.rows);
+    if (intersection.empty()) {
+        return;
+    }
+
+    src(intersection).copyTo(dst(intersection - sub.tl()));
+}
+
+void seamGraphGradients(const cv::Mat &img, cv::Rect roi, cv::Mat &dx,
+                        cv::Mat &dy)
+{
+    CV_Assert(img.type() == CV_32FC3);
+    CV_Assert((roi & cv::Rect(0, 0, img.cols, img.rows)) == roi);
+
+    dx.create(roi.size(), CV_32F);
+    dy.create(roi.size(), CV_32F);
+    if (roi.empty()) {
+        return;
+    }
+
+    // Columns whose neighbours are both inside the image
+    const int interior_begin = std::max(roi.x, 1) - roi.x;
+    const int interior_end =
+        std::max(interior_begin, std::min(roi.x + roi.width, img.cols - 1) -
+                                     roi.x);
+
+    cv::parallel_for_(cv::Range(0, roi.height), [&](const cv::Range &range) {
+        for (int y = range.start; y < range.end; ++y) {
+            const int img_y = roi.y + y;
+            const float *above =
+                img.ptr<float>(reflect101(img_y - 1, img.rows));
+            const float *row = img.ptr<float>(img_y);
+            const float *below =
+                img.ptr<float>(reflect101(img_y + 1, img.rows));
+            float *dx_row = dx.ptr<float>(y);
+            float *dy_row = dy.ptr<float>(y);
+
+            auto border = [&](int x) {
+                const int img_x = roi.x + x;
+                sobelPixel(above, row, below,
+                           3 * reflect101(img_x - 1, img.cols), 3 * img_x,
+                           3 * reflect101(img_x + 1, img.cols), dx_row[x],
+                           dy_row[x]);
+            };
+
+            for (int x = 0; x < interior_begin; ++x) {
+                border(x);
+            }
+            for (int x = interior_begin; x < interior_end; ++x) {
+                const int c = 3 * (roi.x + x);
+                sobelPixel(above, row, below, c - 3, c, c + 3, dx_row[x],
+                           dy_row[x]);
+            }
+            for (int x = interior_end; x < roi.width; ++x) {
+                border(x);
+            }
+        }
+    });
+}
+
+void seamGraphWeightsColor(const cv::Mat &img1, const cv::Mat &img2,
+                           const cv::Mat &mask1, const cv::Mat &mask2,
+                           float bad_region_penalty,
+                           SeamGraphWorkspace &workspace, cv::Mat &horizontal,
+                           cv::Mat &vertical)
+{
+    const cv::Size img_size = img1.size();
+    cv::Mat cost = workspace.get(SeamGraphWorkspace::Cost, img_size, CV_32F);
+    cv::Mat valid = workspace.get(SeamGraphWorkspace::Valid, img_size, CV_8U);
+    pixelCosts(img1, img2, mask1, mask2, cost, valid);
+
+    horizontal = workspace.get(SeamGraphWorkspace::Horizontal,
+                               {img_size.width - 1, img_size.height}, CV_32F);
+    vertical = workspace.get(SeamGraphWorkspace::Vertical,
+                             {img_size.width, img_size.height - 1}, CV_32F);
+
+    for (int y = 0; y < img_size.height; ++y) {
+        const float *cost_row = cost.ptr<float>(y);
+        const uchar *valid_row = valid.ptr<uchar>(y);
+        float *weights = horizontal.ptr<float>(y);
+        for (int x = 0; x < img_size.width - 1; ++x) {
+            float weight = cost_row[x] + cost_row[x + 1] + weight_eps;
+            weights[x] = weight + ((valid_row[x] & valid_row[x + 1])
+                                       ? 0.f
+                                       : bad_region_penalty);
+        }
+    }
+
+    for (int y = 0; y < img_size.height - 1; ++y) {
+        const float *cost_row = cost.ptr<float>(y);
+        const float *cost_next_row = cost.ptr<float>(y + 1);
+        const uchar *valid_row = valid.ptr<uchar>(y);
+        const uchar *valid_next_row = valid.ptr<uchar>(y + 1);
+        float *weights = vertical.ptr<float>(y);
+        for (int x = 0; x < img_size.width; ++x) {
+            float weight = cost_row[x] + cost_next_row[x] + weight_eps;
+            weights[x] = weight + ((valid_row[x] & valid_next_row[x])
+                                       ? 0.f
+                                       : bad_region_penalty);
+        }
+    }
+}
+
+void seamGraphWeightsColorGrad(const cv::Mat &img1, const cv::Mat &img2,
+                               const cv::Mat &dx1, const cv::Mat &dx2,
+                               const cv::Mat &dy1, const cv::Mat &dy2,
+                               const cv::Mat &mask1, const cv::Mat &mask2,
+                               float bad_region_penalty,
+                               SeamGraphWorkspace &workspace,
+                               cv::Mat &horizontal, cv::Mat &vertical)
+{
+    const cv::Size img_size = img1.size();
+    cv::Mat cost = workspace.get(SeamGraphWorkspace::Cost, img_size, CV_32F);
+    cv::Mat valid = workspace.get(SeamGraphWorkspace::Valid, img_size, CV_8U);
+    pixelCosts(img1, img2, mask1, mask2, cost, valid);
+
+    horizontal = workspace.get(SeamGraphWorkspace::Horizontal,
+                               {img_size.width - 1, img_size.height}, CV_32F);
+    vertical = workspace.get(SeamGraphWorkspace::Vertical,
+                             {img_size.width, img_size.height - 1}, CV_32F);
+
+    for (int y = 0; y < img_size.height; ++y) {
+        const float *cost_row = cost.ptr<float>(y);
+        const float *dx1_row = dx1.ptr<float>(y);
+        const float *dx2_row = dx2.ptr<float>(y);
+        const uchar *valid_row = valid.ptr<uchar>(y);
+        float *weights = horizontal.ptr<float>(y);
+        for (int x = 0; x < img_size.width - 1; ++x) {
+            float grad = dx1_row[x] + dx1_row[x + 1] + dx2_row[x] +
+                         dx2_row[x + 1] + weight_eps;
+            float weight = (cost_row[x] + cost_row[x + 1]) / grad + weight_eps;
+            weights[x] = weight + ((valid_row[x] & valid_row[x + 1])
+                                       ? 0.f
+                                       : bad_region_penalty);
+        }
+    }
+
+    for (int y = 0; y < img_size.height - 1; ++y) {
+        const float *cost_row = cost.ptr<float>(y);
+        const float *cost_next_row = cost.ptr<float>(y + 1);
+        const float *dy1_row = dy1.ptr<float>(y);
+        const float *dy1_next_row = dy1.ptr<float>(y + 1);
+        const float *dy2_row = dy2.ptr<float>(y);
+        const float *dy2_next_row = dy2.ptr<float>(y + 1);
+        const uchar *valid_row = valid.ptr<uchar>(y);
+        const uchar *valid_next_row = valid.ptr<uchar>(y + 1);
+        float *weights = vertical.ptr<float>(y);
+        for (int x = 0; x < img_size.width; ++x) {
+            float grad = dy1_row[x] + dy1_next_row[x] + dy2_row[x] +
+                         dy2_next_row[x] + weight_eps;
+            float weight =
+                (cost_row[x] + cost_next_row[x]) / grad + weight_eps;
+            weights[x] = weight + ((valid_row[x] & valid_next_row[x])
+                                       ? 0.f
+                                       : bad_region_penalty);
+        }
+    }
+}
+
+void buildSeamGraph(const cv::Mat &mask1, const cv::Mat &mask2,
+                    float terminal_cost, const cv::Mat &horizontal,
+                    const cv::Mat &vertical, GridGraph &graph)
+{
+    const cv::Size img_size = mask1.size();
+    CV_Assert(graph.width() == img_size.width &&
+              graph.height() == img_size.height);
+
+    for (int y = 0; y < img_size.height; ++y) {
+        const uchar *mask1_row = mask1.ptr<uchar>(y);
+        const uchar *mask2_row = mask2.ptr<uchar>(y);
+        for (int x = 0; x < img_size.width; ++x) {
+            graph.addTermWeights(y * img_size.width + x,
+                                 mask1_row[x] ? terminal_cost : 0.f,
+                                 mask2_row[x] ? terminal_cost : 0.f);
+        }
+    }
+
+    for (int y = 0; y < img_size.height; ++y) {
+        graph.addHorizontalEdges(y, horizontal.ptr<float>(y));
+        if (y < img_size.height - 1) {
+            graph.addVerticalEdges(y, vertical.ptr<float>(y));
+        }
+    }
+}
+
+} // namespace detail
+} // namespace opencv
+} // namespace stitcher
+} // namespace airmap
@@ -158,7 +158,9 @@ GeoImage GeoImage::fromExif(const std::string &imagePath)
                       imageEXIF.GeoLocation.RollDegree,
                       imageEXIF.GeoLocation.YawDegree,
                       std::max(static_cast<time_t>(0), std::mktime(&image_created)),
-                      file_created };
+                      file_created,
+                      imageEXIF.ImageWidth,
+                      imageEXIF.ImageHeight };
 }
 
 constexpr char Panorama::PanoramaFileExtension[];
@@ -0,0 +1,259 @@
+#include "airmap/recipe.h"
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+
+namespace {
+
+/**
+ * @brief recipe_version
+ * Version of the recipe file format, bumped when the format changes.
+ */
+constexpr int recipe_version = 2;
+
+} // namespace
+
+StitchRecipe StitchRecipe::load(const std::string &path)
+{
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        throw std::invalid_argument("Can't read stitch recipe " + path);
+    }
+    if (static_cast<int>(fs["version"]) != recipe_version) {
+        throw std::invalid_argument("Unsupported version of stitch recipe "
+                                    + path);
+    }
+
+    StitchRecipe recipe;
+    fs["image_count"] >> recipe.image_count;
+    fs["image_indices"] >> recipe.image_indices;
+    fs["work_size"] >> recipe.work_size;
+    fs["warped_image_scale"] >> recipe.warped_image_scale;
+    recipe.rotate_result = static_cast<int>(fs["rotate_result"]) != 0;
+
+    for (cv::FileNode node : fs["cameras"]) {
+        cv::detail::CameraParams camera;
+        node["focal"] >> camera.focal;
+        node["aspect"] >> camera.aspect;
+        node["ppx"] >> camera.ppx;
+        node["ppy"] >> camera.ppy;
+        node["R"] >> camera.R;
+        node["t"] >> camera.t;
+        recipe.cameras.push_back(camera);
+    }
+
+    for (cv::FileNode node : fs["gimbal_orientations"]) {
+        recipe.gimbal_orientations.emplace_back(
+                static_cast<double>(node["pitch"]),
+                static_cast<double>(node["roll"]),
+                static_cast<double>(node["yaw"]));
+    }
+
+    const int exposure_compensator_type =
+            static_cast<int>(fs["exposure_compensator_type"]);
+    recipe.exposure_compensator_type =
+            static_cast<ExposureCompensatorType>(exposure_compensator_type);
+    fs["exposure_gains"] >> recipe.exposure_gains;
+    fs["corners"] >> recipe.corners;
+
+    // Seam masks are binary, and so are kept much smaller as PNG.
+    for (cv::FileNode node : fs["seam_masks"]) {
+        std::vector<uchar> png;
+        node >> png;
+        recipe.seam_masks.push_back(cv::imdecode(png, cv::IMREAD_GRAYSCALE));
+    }
+
+    const size_t count = recipe.cameras.size();
+    bool consistent = count > 0 && recipe.image_indices.size() == count
+            && recipe.gimbal_orientations.size() == count
+            && recipe.corners.size() == count
+            && recipe.seam_masks.size() == count
+            && exposure_compensator_type >= 0
+            && exposure_compensator_type
+                    <= static_cast<int>(ExposureCompensatorType::No);
+    // A compensator has one gain, or gain map, per image, except for no
+    // compensation, which has none.
+    if (recipe.exposure_compensator_type == ExposureCompensatorType::No) {
+        consistent = consistent && recipe.exposure_gains.empty();
+    } else {
+        consistent = consistent && recipe.exposure_gains.size() == count;
+    }
+    for (const auto &gain : recipe.exposure_gains) {
+        consistent = consistent && !gain.empty();
+    }
+    for (int index : recipe.image_indices) {
+        consistent = consistent && index >= 0 && index < recipe.image_count;
+    }
+    for (const auto &seam_mask : recipe.seam_masks) {
+        consistent = consistent && !seam_mask.empty();
+    }
+    if (!consistent) {
+        throw std::invalid_argument("Inconsistent stitch recipe " + path);
+    }
+
+    return recipe;
+}
+
+void StitchRecipe::save(const std::string &path) const
+{
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        throw std::invalid_argument("Can't write stitch recipe " + path);
+    }
+
+    fs << "version" << recipe_version;
+    fs << "image_count" << image_count;
+    fs << "image_indices" << image_indices;
+    fs << "work_size" << work_size;
+    fs << "warped_image_scale" << warped_image_scale;
+    fs << "rotate_result" << static_cast<int>(rotate_result);
+
+    fs << "cameras" << "[";
+    for (const auto &camera : cameras) {
+        fs << "{"
+           << "focal" << camera.focal
+           << "aspect" << camera.aspect
+           << "ppx" << camera.ppx
+           << "ppy" << camera.ppy
+           << "R" << camera.R
+           << "t" << camera.t
+           << "}";
+    }
+    fs << "]";
+
+    fs << "gimbal_orientations" << "[";
+    for (GimbalOrientation gimbal_orientation : gimbal_orientations) {
+        gimbal_orientation =
+                gimbal_orientation.convertTo(GimbalOrientation::Units::Degrees);
+        fs << "{"
+           << "pitch" << gimbal_orientation.pitch
+           << "roll" << gimbal_orientation.roll
+           << "yaw" << gimbal_orientation.yaw
+           << "}";
+    }
+    fs << "]";
+
+    fs << "exposure_compensator_type"
+       << static_cast<int>(exposure_compensator_type);
+    fs << "exposure_gains" << exposure_gains;
+    fs << "corners" << corners;
+
+    fs << "seam_masks" << "[";
+    for (const auto &seam_mask : seam_masks) {
+        std::vector<uchar> png;
+        cv::imencode(".png", seam_mask, png);
+        fs << png;
+    }
+    fs << "]";
+}
+
+std::vector<cv::detail::CameraParams> StitchRecipe::alignedCameras(
+        const std::vector<GimbalOrientation> &gimbal_orientations,
+        const cv::Size &work_size) const
+{
+    CV_Assert(gimbal_orientations.size() == cameras.size());
+
+    const double scale = this->work_size.width > 0
+            ? static_cast<double>(work_size.width) / this->work_size.width
+            : 1.0;
+
+    std::vector<cv::detail::CameraParams> aligned = cameras;
+    for (size_t i = 0; i < aligned.size(); ++i) {
+        aligned[i].R = cameras[i].R.clone();
+        aligned[i].focal *= scale;
+        aligned[i].ppx *= scale;
+        aligned[i].ppy *= scale;
+
+        GimbalOrientation from = this->gimbal_orientations[i];
+        GimbalOrientation to = gimbal_orientations[i];
+        if (!from.hasOrientation() || !to.hasOrientation()) {
+            continue;
+        }
+
+        // The rotation from the gimbal's frame to the recipe's is kept, and
+        // applied to the new gimbal orientation.
+        cv::Mat R;
+        cameras[i].R.convertTo(R, CV_64F);
+        R = R * from.cameraRotation().t() * to.cameraRotation();
+        R.convertTo(aligned[i].R, CV_32F);
+    }
+
+    alignRotations(cameras, aligned);
+    return aligned;
+}
+
+void StitchRecipe::cutAlongSeams(const std::vector<cv::Point> &corners,
+                                 std::vector<cv::UMat> &masks_warped) const
+{
+    CV_Assert(corners.size() == seam_masks.size()
+              && masks_warped.size() == seam_masks.size());
+
+    for (size_t i = 0; i < seam_masks.size(); ++i) {
+        cv::Mat mask = masks_warped[i].getMat(cv::ACCESS_RW);
+        const cv::Rect roi(corners[i], mask.size());
+        const cv::Rect recipe_roi(this->corners[i], seam_masks[i].size());
+        const cv::Rect common = roi & recipe_roi;
+        if (common.empty()) {
+            continue;
+        }
+
+        cv::Mat mask_common = mask(common - corners[i]);
+        cv::bitwise_and(mask_common, seam_masks[i](common - this->corners[i]),
+                        mask_common);
+    }
+}
+
+std::vector<cv::Size> StitchRecipe::seamSizes() const
+{
+    std::vector<cv::Size> sizes;
+    sizes.reserve(seam_masks.size());
+    for (const auto &seam_mask : seam_masks) {
+        sizes.push_back(seam_mask.size());
+    }
+    return sizes;
+}
+
+void StitchRecipe::alignRotations(
+        const std::vector<cv::detail::CameraParams> &reference,
+        std::vector<cv::detail::CameraParams> &cameras)
+{
+    CV_Assert(reference.size() == cameras.size());
+
+    // Q, applied on the left of every camera rotation R_i, minimises the
+    // sum of the squared Frobenius norms |Q R_i - reference_i|^2, i.e.
+    // maximises trace(Q^T M) with M the sum of reference_i R_i^T.  With
+    // M = U S V^T, that is U V^T if it is a rotation, else a reflection,
+    // and the closest rotation negates the column of U of the smallest
+    // singular value, the last.
+    cv::Mat M = cv::Mat::zeros(3, 3, CV_64F);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        cv::Mat A, B;
+        reference[i].R.convertTo(A, CV_64F);
+        cameras[i].R.convertTo(B, CV_64F);
+        M += A * B.t();
+    }
+
+    cv::SVD svd(M, cv::SVD::FULL_UV);
+    cv::Mat Q = svd.u * svd.vt;
+    if (cv::determinant(Q) < 0) {
+        cv::Mat u = svd.u.clone();
+        u.col(2) *= -1;
+        Q = u * svd.vt;
+    }
+
+    // Cameras copied from one another share their rotation matrices, so
+    // each gets a new one.
+    for (auto &camera : cameras) {
+        cv::Mat R, R_aligned;
+        camera.R.convertTo(R, CV_64F);
+        cv::Mat(Q * R).convertTo(R_aligned, CV_32F);
+        camera.R = R_aligned;
+    }
+}
+
+} // namespace stitcher
+} // namespace airmap
@@ -21,12 +21,63 @@
 #include <opencv2/stitching/detail/warpers.hpp>
 #include <opencv2/stitching/warpers.hpp>
 
+using GimbalBasedEstimator =
+    airmap::stitcher::opencv::detail::GimbalBasedEstimator;
+using SparseBundleAdjusterRay =
+    airmap::stitcher::opencv::detail::SparseBundleAdjusterRay;
+using MaxFlowType = airmap::stitcher::opencv::detail::MaxFlowType;
 using MonitoredGraphCutSeamFinder =
     airmap::stitcher::opencv::detail::MonitoredGraphCutSeamFinder;
 
 namespace airmap {
 namespace stitcher {
 
+namespace {
+
+/**
+ * @brief cameraModels
+ * The canned camera models, built once per process and shared by every
+ * stitch, e.g. of a batch or a daemon.
+ */
+const CameraModels &cameraModels()
+{
+    static const CameraModels models;
+    return models;
+}
+
+/**
+ * @brief FailedOperationGuard
+ * Ends the monitor's current operation as failed, which stops its progress
+ * reporter, when a stitch leaves by any path but completing.
+ */
+class FailedOperationGuard
+{
+public:
+    explicit FailedOperationGuard(monitor::Monitor::SharedPtr monitor)
+        : _monitor(std::move(monitor))
+    {
+    }
+
+    ~FailedOperationGuard()
+    {
+        if (!_completed) {
+            _monitor->operationFailed();
+        }
+    }
+
+    FailedOperationGuard(const FailedOperationGuard &) = delete;
+    FailedOperationGuard &operator=(const FailedOperationGuard &) = delete;
+
+    //! The stitch completed, its operation did not fail.
+    void completed() { _completed = true; }
+
+private:
+    monitor::Monitor::SharedPtr _monitor;
+    bool _completed = false;
+};
+
+} // namespace
+
 //
 //
 // OpenCVStitcher
@@ -39,23 +90,52 @@ OpenCVStitcher::OpenCVStitcher(const Panorama &panorama,
                                monitor::Estimator::UpdatedCb updatedCb, bool debug,
                                path debugPath)
     : OperationsMonitoredStitcher(panorama, parameters, logger,
-                                  CameraModels().detect(panorama.front()), updatedCb)
+                                  cameraModels().detect(panorama.front()), updatedCb)
     , _debug(debug)
     , _debugPath(debugPath)
     , _logger(logger)
     , _panorama(panorama)
     , _parameters(parameters)
     , _outputPath(outputPath)
+    , _memoryBudgetFraction(1.)
 {
     setUseOpenCL(_parameters.enableOpenCL);
 }
 
+Panorama::Parameters OpenCVStitcher::plannedParameters() const
+{
+    Panorama::Parameters parameters = _parameters;
+    if (parameters.memoryBudgetMB > MemoryPlanner::baselineMB) {
+        parameters.memoryBudgetMB = static_cast<size_t>(
+                MemoryPlanner::baselineMB
+                + (parameters.memoryBudgetMB - MemoryPlanner::baselineMB)
+                        * _memoryBudgetFraction);
+    }
+    return parameters;
+}
+
 void OpenCVStitcher::setFallbackMode()
 {
     _parameters.enableOpenCL = false;
     setUseOpenCL(_parameters.enableOpenCL);
 }
 
+void OpenCVStitcher::setMemoryBudgetExceeded(const MemoryBudgetExceededError &error)
+{
+    // The stitch needed at least what its matrices had once refused: plan
+    // the next one for the share of it the budget allows, and a fifth less
+    // at the least.
+    const double share = static_cast<double>(error.budgetMB())
+            / std::max<size_t>(1, error.requiredMB());
+    _memoryBudgetFraction *= std::min(0.8, share);
+
+    std::stringstream message;
+    message << monitor::Operation(error.operation()).str() << " exceeded the memory budget"
+            << ", planning for " << plannedParameters().memoryBudgetMB << " of "
+            << _parameters.memoryBudgetMB << " MB.";
+    _logger->log(logging::Logger::Severity::info, message, "stitcher");
+}
+
 void OpenCVStitcher::setUseOpenCL(bool enabled)
 {
     cv::ocl::setUseOpenCL(enabled);
@@ -65,18 +145,41 @@ void OpenCVStitcher::setUseOpenCL(bool enabled)
     _logger->log(logging::Logger::Severity::info, message, "stitcher");
 }
 
+monitor::AllocationTracker::Binding OpenCVStitcher::trackAllocations()
+{
+    size_t budgetMB = 0;
+    if (_parameters.enforceMemoryBudget) {
+        budgetMB = _parameters.memoryBudgetMB > MemoryPlanner::baselineMB
+                ? static_cast<size_t>(_parameters.memoryBudgetMB - MemoryPlanner::baselineMB)
+                : 1;
+    }
+    _monitor->allocations()->setBudgetMB(budgetMB);
+    return _monitor->allocations()->bind();
+}
+
 Stitcher::Report OpenCVStitcher::stitch()
 {
+    auto allocations = trackAllocations();
+    FailedOperationGuard failedOperation(_monitor);
+    _monitor->changeOperation(monitor::Operation::Start());
     Stitcher::Report report;
 
+    _monitor->changeOperation(monitor::Operation::LoadImages());
     SourceImages source_images(_panorama, _logger);
-    source_images.scaleToAvailableMemory(_parameters.memoryBudgetMB,
-                                         _parameters.maxInputImageSize,
-                                         report.inputSizeMB,
-                                         report.inputScaled);
+    _monitor->changeOperation(monitor::Operation::ScaleImages());
+    // OpenCV's stitcher defaults are close to those of a 360.
+    MemoryPlan plan = source_images.scaleToAvailableMemory(
+            MemoryPlanner(Configuration(StitchType::ThreeSixty), plannedParameters()),
+            report.inputSizeMB, report.inputScaled);
 
+    // OpenCV's stitcher runs every operation up to the composition at once.
+    _monitor->changeOperation(monitor::Operation::Compose());
     cv::Mat result;
     cv::Ptr<cv::Stitcher> stitcher = cv::Stitcher::create(cv::Stitcher::PANORAMA);
+    if (plan.composeScale < 1.) {
+        stitcher->setCompositingResol(source_images.images[0].size().area()
+                                      * plan.composeScale * plan.composeScale / 1e6);
+    }
     cv::Stitcher::Status status;
     try {
         status = stitcher->stitch(source_images.images, result);
@@ -86,6 +189,7 @@ Stitcher::Report OpenCVStitcher::stitch()
         // failed) (size_t)knn <= index_->size() in function 'runKnnSearch_' but
         // that's
         // nothing we shouldn't want to retry on.
+        _monitor->allocations()->checkBudget();
         throw RetriableError(e.what());
     }
     if (status != cv::Stitcher::OK) {
@@ -103,13 +207,31 @@ Stitcher::Report OpenCVStitcher::stitch()
     }
 
     postprocess(std::move(result));
+
+    _monitor->changeOperation(monitor::Operation::Complete());
+    failedOperation.completed();
+    report.operationResources = _monitor->operationResources();
     return report;
 }
 
-void OpenCVStitcher::cancel() { }
+void OpenCVStitcher::cancel()
+{
+    _monitor->cancel();
+}
 
-void OpenCVStitcher::postprocess(cv::Mat &&result)
+void OpenCVStitcher::postprocess(cv::Mat &&result, bool preview)
 {
+    postprocess(std::move(result), _outputPath, preview);
+}
+
+void OpenCVStitcher::postprocess(cv::Mat &&result, const std::string &outputPath,
+                                 bool preview)
+{
+    // A preview is postprocessed as part of composing it.
+    if (!preview) {
+        _monitor->changeOperation(monitor::Operation::CropPanorama());
+    }
+
     // Crop any null regions from the sides or bottoms.
     // This will also crop null regions from the sky too, but that will be added back in
     // below.
@@ -132,13 +254,20 @@ void OpenCVStitcher::postprocess(cv::Mat &&result)
     }
     assert(result.rows == result.cols / 2);
 
-    cv::imwrite(_outputPath, result);
+    if (!preview) {
+        _monitor->changeOperation(monitor::Operation::WritePanorama());
+    }
+    cv::imwrite(outputPath, result);
     std::stringstream message;
-    message << "Written stitched image to " << _outputPath << std::endl;
+    message << "Written stitched image to " << outputPath << std::endl;
     _logger->log(logging::Logger::Severity::info, message, "stitcher");
+    _monitor->outputWritten(outputPath);
     if (_parameters.alsoCreateCubeMap) {
-        std::string base_path = (path(_outputPath).parent_path()
-                                 / path(_outputPath).stem())
+        if (!preview) {
+            _monitor->changeOperation(monitor::Operation::WriteCubemap());
+        }
+        std::string base_path = (path(outputPath).parent_path()
+                                 / path(outputPath).stem())
                                         .string();
         CubeMap::write(
                 result,
@@ -166,26 +295,209 @@ LowLevelOpenCVStitcher::LowLevelOpenCVStitcher(
                      debugPath)
     , _config(_camera ? _camera->configuration(config, config.stitch_type)
                       : config)
+    , _fullQualityConfig(_config)
+    , _preview(false)
 {
+    // Meeting a deadline relies on the estimates of the monitor, and
+    // recording a stitch to the history on its elapsed times.
+    if (!_parameters.historyPath.empty()) {
+        _monitor->estimator()->setHistory(
+                monitor::History::load(_parameters.historyPath, _logger));
+    }
+    if (_parameters.deadlineSeconds > 0 || !_parameters.historyPath.empty()) {
+        _monitor->enable();
+        _estimator->enable();
+    }
 }
 
 void LowLevelOpenCVStitcher::adjustCameraParameters(
         std::vector<cv::detail::ImageFeatures> &features,
         std::vector<cv::detail::MatchesInfo> &matches,
-        std::vector<cv::detail::CameraParams> &cameras)
+        std::vector<cv::detail::CameraParams> &cameras,
+        Stitcher::Report &report)
 {
     _monitor->changeOperation(monitor::Operation::AdjustCameraParameters());
 
     _logger->log(logging::Logger::Severity::info, "Adjusting camera parameters.", "stitcher");
     auto bundle_adjuster = getBundleAdjuster();
+    auto sparse_adjuster =
+            dynamic_cast<SparseBundleAdjusterRay *>(bundle_adjuster.get());
+    if (sparse_adjuster) {
+        sparse_adjuster->setIterationCallback(
+                [this, sparse_adjuster](int iteration, double rms_error) {
+                    _monitor->updateCurrentOperation(sparse_adjuster->progress());
+
+                    std::stringstream message;
+                    message << "Bundle adjustment iteration " << iteration
+                            << ", RMS error " << rms_error << ".";
+                    _logger->log(logging::Logger::Severity::debug, message,
+                                 "stitcher");
+                });
+    }
+
+    monitor::Timer timer;
+    timer.start();
     if (!(*bundle_adjuster)(features, matches, cameras)) {
         std::string message = "Failed to adjust camera parameters.";
         _logger->log(logging::Logger::Severity::error, message.c_str(), "stitcher");
         throw std::invalid_argument(message);
     }
+    timer.stop();
+
+    std::stringstream message;
+    message << "Bundle adjustment took " << timer;
+    if (sparse_adjuster) {
+        report.bundleAdjustmentIterations = sparse_adjuster->iterations();
+        report.bundleAdjustmentError = sparse_adjuster->rmsError();
+        message << ", " << sparse_adjuster->iterations()
+                << " iterations, final RMS error "
+                << sparse_adjuster->rmsError();
+        if (sparse_adjuster->exceededTimeBudget()) {
+            message << ", stopped by the time budget";
+        }
+    }
+    message << ".";
+    _logger->log(logging::Logger::Severity::info, message, "stitcher");
     _logger->log(logging::Logger::Severity::info, "Finished adjusting camera parameters.", "stitcher");
 }
 
+void LowLevelOpenCVStitcher::alignPreview(
+        std::vector<cv::detail::ImageFeatures> &features,
+        std::vector<cv::detail::MatchesInfo> &matches,
+        std::vector<cv::detail::CameraParams> &cameras)
+{
+    _logger->log(logging::Logger::Severity::info, "Aligning cameras for the preview.",
+                 "stitcher");
+
+    // The bundle adjuster writes the rotations of the cameras in place.
+    std::vector<cv::detail::CameraParams> estimated = cameras;
+    for (auto &camera : estimated) {
+        camera.R = camera.R.clone();
+    }
+
+    auto bundle_adjuster = getBundleAdjuster();
+    bundle_adjuster->setTermCriteria(
+            cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS,
+                             _config.preview_bundle_adjustment_iterations,
+                             DBL_EPSILON));
+    if (!(*bundle_adjuster)(features, matches, cameras)) {
+        _logger->log(logging::Logger::Severity::info,
+                     "Failed to align cameras for the preview, composing it from "
+                     "the estimated cameras.",
+                     "stitcher");
+        cameras = estimated;
+    }
+}
+
+bool LowLevelOpenCVStitcher::camerasFromRecipe(
+        const SourceImages &source_images, std::vector<int> &keep_indices,
+        std::vector<cv::detail::CameraParams> &cameras)
+{
+    if (_recipe.empty()) {
+        return false;
+    }
+
+    _monitor->changeOperation(monitor::Operation::EstimateCameraParameters());
+    _logger->log(logging::Logger::Severity::info,
+                 "Aligning camera parameters from the stitch recipe.", "stitcher");
+
+    const size_t image_count = source_images.images_scaled.size();
+    const cv::Size work_size = source_images.images_scaled[0].size();
+    std::stringstream message;
+    if (static_cast<size_t>(_recipe.image_count) != image_count) {
+        message << "Stitch recipe is for " << _recipe.image_count
+                << " images, not " << image_count << ", stitching from scratch.";
+        _logger->log(logging::Logger::Severity::info, message, "stitcher");
+        return false;
+    }
+    if (std::abs(work_size.width - _recipe.work_size.width)
+        > 0.01 * _recipe.work_size.width) {
+        message << "Stitch recipe is for images of width "
+                << _recipe.work_size.width << " at work scale, not "
+                << work_size.width << ", stitching from scratch.";
+        _logger->log(logging::Logger::Severity::info, message, "stitcher");
+        return false;
+    }
+
+    std::vector<cv::Mat> images;
+    std::vector<GimbalOrientation> gimbal_orientations;
+    for (int index : _recipe.image_indices) {
+        images.push_back(source_images.images_scaled[index]);
+        gimbal_orientations.push_back(source_images.gimbal_orientations[index]);
+    }
+    std::vector<cv::detail::CameraParams> aligned =
+            _recipe.alignedCameras(gimbal_orientations, work_size);
+
+    // Verify the alignment with a few features, matched only between the
+    // images that overlap in the recipe.
+    cv::Ptr<cv::Feature2D> finder =
+            cv::ORB::create(_config.recipe_features_maximum);
+    std::vector<cv::detail::ImageFeatures> features(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        cv::detail::computeImageFeatures(finder, images[i], features[i]);
+        features[i].img_idx = static_cast<int>(i);
+        _monitor->updateCurrentOperation(0.5 * static_cast<double>(i)
+                                         / static_cast<double>(images.size()));
+    }
+
+    OverlapGraph overlaps(_recipe.corners, _recipe.seamSizes());
+    cv::Mat_<uchar> match_mask =
+            cv::Mat::zeros(static_cast<int>(images.size()),
+                           static_cast<int>(images.size()), CV_8U);
+    for (const auto &pair : overlaps.pairs()) {
+        match_mask(static_cast<int>(pair.first), static_cast<int>(pair.second)) = 1;
+    }
+
+    std::vector<cv::detail::MatchesInfo> matches;
+    auto matcher = getFeaturesMatcher();
+    (*matcher)(features, matches, match_mask.getUMat(cv::ACCESS_READ));
+    matcher->collectGarbage();
+
+    size_t verified_pairs = 0;
+    for (const auto &match : matches) {
+        if (match.src_img_idx < match.dst_img_idx
+            && match.confidence > _config.match_conf_thresh) {
+            ++verified_pairs;
+        }
+    }
+    if (verified_pairs == 0) {
+        _logger->log(logging::Logger::Severity::info,
+                     "No matches to verify the stitch recipe with, stitching "
+                     "from scratch.",
+                     "stitcher");
+        return false;
+    }
+
+    // Refine the rotations only, as the camera and so the focal length is
+    // the recipe's.
+    SparseBundleAdjusterRay bundle_adjuster;
+    bundle_adjuster.setConfThresh(_config.match_conf_thresh);
+    bundle_adjuster.setRefinementMask(cv::Mat::zeros(3, 3, CV_8U));
+    bundle_adjuster.setTimeBudget(_config.bundle_adjustment_time_budget);
+    std::vector<cv::detail::CameraParams> refined = aligned;
+    if (!bundle_adjuster(features, matches, refined)
+        || bundle_adjuster.rmsError() > _config.recipe_max_error) {
+        message << "Stitch recipe verified with an RMS error of "
+                << bundle_adjuster.rmsError() << " over " << verified_pairs
+                << " pairs, more than " << _config.recipe_max_error
+                << ", stitching from scratch.";
+        _logger->log(logging::Logger::Severity::info, message, "stitcher");
+        return false;
+    }
+
+    // The bundle adjuster normalises the rotations to one of the cameras,
+    // rotate them back to the recipe's seams.
+    StitchRecipe::alignRotations(aligned, refined);
+    cameras = refined;
+    keep_indices = _recipe.image_indices;
+
+    message << "Stitch recipe verified with an RMS error of "
+            << bundle_adjuster.rmsError() << " over " << verified_pairs
+            << " pairs.";
+    _logger->log(logging::Logger::Severity::info, message, "stitcher");
+    return true;
+}
+
 void LowLevelOpenCVStitcher::compose(
         SourceImages &source_images, std::vector<cv::detail::CameraParams> &cameras,
         cv::Ptr<cv::detail::ExposureCompensator> &exposure_compensator,
@@ -221,6 +533,9 @@ void LowLevelOpenCVStitcher::compose(
         warp_results.corners[i] = roi.tl();
         warp_results.sizes[i] = roi.size();
     }
+    // The seam scale graph no longer matches the corners; compose doesn't
+    // need pairs, only the result ROI, which the blender computes itself.
+    warp_results.overlaps = OverlapGraph();
 
     auto blender = prepareBlender(warp_results);
     warp_results.masks.clear();
@@ -229,22 +544,30 @@ void LowLevelOpenCVStitcher::compose(
     cv::Mat image_warped, image_warped_s;
     cv::Mat dilated_mask, seam_mask, mask, mask_warped;
 
+    _monitor->setOperationWork(source_images.images_scaled.size());
     for (size_t i = 0; i < source_images.images_scaled.size(); ++i) {
+        auto image_span = _monitor->span("ComposeImage", static_cast<int64_t>(i));
         cv::Size image_size = source_images.images_scaled[i].size();
 
         cv::Mat K;
         cameras[i].K().convertTo(K, CV_32F);
 
-        // warp the current image
-        warper->warp(source_images.images_scaled[i], K, cameras[i].R, cv::INTER_LINEAR, cv::BORDER_REFLECT,
-                     image_warped);
-        source_images.images_scaled[i].release();
-
-        // warp the current image mask
-        mask.create(image_size, CV_8U);
-        mask.setTo(cv::Scalar::all(255));
-        warper->warp(mask, K, cameras[i].R, cv::INTER_NEAREST, cv::BORDER_CONSTANT,
-                     mask_warped);
+        {
+            auto warp_span = _monitor->span("Warp", static_cast<int64_t>(i));
+
+            // warp the current image
+            warper->warp(source_images.images_scaled[i], K, cameras[i].R, cv::INTER_LINEAR, cv::BORDER_REFLECT,
+                         image_warped);
+            source_images.images_scaled[i].release();
+            _monitor->addWork(monitor::OperationResources::WarpedPixels,
+                              image_warped.size().area());
+
+            // warp the current image mask
+            mask.create(image_size, CV_8U);
+            mask.setTo(cv::Scalar::all(255));
+            warper->warp(mask, K, cameras[i].R, cv::INTER_NEAREST, cv::BORDER_CONSTANT,
+                         mask_warped);
+        }
 
         // compensate exposure
         exposure_compensator->apply(static_cast<int>(i), warp_results.corners[i],
@@ -263,20 +586,165 @@ void LowLevelOpenCVStitcher::compose(
         seam_mask.release();
 
         // blend the current image
-        blender->feed(image_warped_s, mask_warped, warp_results.corners[i]);
+        {
+            auto feed_span = _monitor->span("Feed", static_cast<int64_t>(i));
+            blender->feed(image_warped_s, mask_warped, warp_results.corners[i]);
+        }
         image_warped_s.release();
         mask_warped.release();
 
-        _monitor->updateCurrentOperation(
-            static_cast<double>(i) /
-            static_cast<double>(source_images.images_scaled.size()));
+        _monitor->completeWork();
     }
 
     cv::Mat result_mask;
-    blender->blend(result, result_mask);
+    {
+        auto blend_span = _monitor->span("Blend");
+        blender->blend(result, result_mask);
+    }
     _logger->log(logging::Logger::Severity::info, "Finished composing stitched image.", "stitcher");
 }
 
+cv::Mat LowLevelOpenCVStitcher::composePreview(
+        SourceImages &source_images,
+        const std::vector<cv::detail::CameraParams> &cameras,
+        double work_scale)
+{
+    _monitor->changeOperation(monitor::Operation::ComposePreview());
+
+    _logger->log(logging::Logger::Severity::info, "Composing preview.", "stitcher");
+
+    // A full turn of the spherical panorama is 2 * pi * the warper's scale
+    // pixels wide.
+    const float warped_image_scale =
+            static_cast<float>(findMedianFocalLength(cameras));
+    double preview_work_aspect = _config.preview_width
+            / (2. * CV_PI * static_cast<double>(warped_image_scale));
+    double preview_scale = std::min(1., work_scale * preview_work_aspect);
+    preview_work_aspect = preview_scale / work_scale;
+
+    source_images.scale(preview_scale);
+
+    auto warper = getWarperCreator()->create(static_cast<float>(
+            static_cast<double>(warped_image_scale) * preview_work_aspect));
+
+    const size_t image_count = source_images.images_scaled.size();
+    std::vector<cv::Point> corners(image_count);
+    std::vector<cv::Size> sizes(image_count);
+    std::vector<cv::UMat> images_warped(image_count);
+    std::vector<cv::UMat> masks_warped(image_count);
+    cv::Mat mask;
+    for (size_t i = 0; i < image_count; ++i) {
+        cv::detail::CameraParams camera = cameras[i];
+        camera.focal *= preview_work_aspect;
+        camera.ppx *= preview_work_aspect;
+        camera.ppy *= preview_work_aspect;
+
+        cv::Mat K;
+        camera.K().convertTo(K, CV_32F);
+        corners[i] = warper->warp(source_images.images_scaled[i], K, camera.R,
+                                  cv::INTER_LINEAR, cv::BORDER_REFLECT,
+                                  images_warped[i]);
+        sizes[i] = images_warped[i].size();
+        _monitor->addWork(monitor::OperationResources::WarpedPixels, sizes[i].area());
+
+        mask.create(source_images.images_scaled[i].size(), CV_8U);
+        mask.setTo(cv::Scalar::all(255));
+        warper->warp(mask, K, camera.R, cv::INTER_NEAREST, cv::BORDER_CONSTANT,
+                     masks_warped[i]);
+    }
+
+    // Voronoi seams only depend on the masks, and no exposure compensation
+    // or blending is done, which keeps the preview quick.
+    cv::detail::VoronoiSeamFinder().find(sizes, corners, masks_warped);
+
+    auto blender = cv::detail::Blender::createDefault(cv::detail::Blender::NO,
+                                                      _config.try_cuda);
+    blender->prepare(corners, sizes);
+    cv::Mat image_warped_s;
+    for (size_t i = 0; i < image_count; ++i) {
+        images_warped[i].convertTo(image_warped_s, CV_16S);
+        images_warped[i].release();
+        blender->feed(image_warped_s, masks_warped[i], corners[i]);
+        masks_warped[i].release();
+    }
+
+    cv::Mat preview, preview_mask;
+    blender->blend(preview, preview_mask);
+    _logger->log(logging::Logger::Severity::info, "Finished composing preview.", "stitcher");
+    return preview;
+}
+
+bool LowLevelOpenCVStitcher::degradeForDeadline(Degradation first,
+                                                SourceImages &source_images,
+                                                Stitcher::Report &report)
+{
+    if (_parameters.deadlineSeconds == 0) {
+        return false;
+    }
+
+    const monitor::ElapsedTime projected =
+            _monitor->elapsed() + _monitor->currentEstimate();
+    const monitor::ElapsedTime deadline = monitor::ElapsedTime::fromSeconds(
+            static_cast<int64_t>(_parameters.deadlineSeconds));
+    if (projected.get() <= deadline.get()) {
+        return false;
+    }
+
+    // Megapixels the images are scaled to for a setting of megapix, where -1
+    // is full size.
+    const double image_megapix = source_images.images[0].size().area() / 1e6;
+    auto scaledMegapix = [image_megapix](double megapix) {
+        return megapix < 0 ? image_megapix : std::min(megapix, image_megapix);
+    };
+
+    std::vector<std::string> degradations;
+    std::stringstream degradation;
+    if (first <= Degradation::SeamMegapix
+        && _config.seam_megapix == _fullQualityConfig.seam_megapix) {
+        double seam_megapix = scaledMegapix(_config.seam_megapix) / 2.;
+        degradation << "seam_megapix " << _config.seam_megapix << " -> " << seam_megapix;
+        degradations.push_back(degradation.str());
+        _config.seam_megapix = seam_megapix;
+    }
+    if (first <= Degradation::SeamFinder
+        && _config.seam_finder_type != SeamFinderType::Voronoi
+        && _config.seam_finder_type != SeamFinderType::No) {
+        degradations.push_back("seam_finder_type Voronoi");
+        _config.seam_finder_type = SeamFinderType::Voronoi;
+    }
+    if (first <= Degradation::BlendBands
+        && _config.blender_type == cv::detail::Blender::MULTI_BAND
+        && _config.blend_strength == _fullQualityConfig.blend_strength) {
+        // Halving the blend width removes one band.
+        float blend_strength = _config.blend_strength / 2.f;
+        degradation.str("");
+        degradation << "blend_strength " << _config.blend_strength << " -> "
+                    << blend_strength;
+        degradations.push_back(degradation.str());
+        _config.blend_strength = blend_strength;
+    }
+    if (first <= Degradation::ComposeMegapix
+        && _config.compose_megapix == _fullQualityConfig.compose_megapix) {
+        double compose_megapix = scaledMegapix(_config.compose_megapix) / 2.;
+        degradation.str("");
+        degradation << "compose_megapix " << _config.compose_megapix << " -> "
+                    << compose_megapix;
+        degradations.push_back(degradation.str());
+        _config.compose_megapix = compose_megapix;
+    }
+
+    for (const auto &applied : degradations) {
+        std::stringstream message;
+        message << "Projected to finish in " << projected << ", past the deadline of "
+                << deadline << ", stepping down " << applied << ".";
+        _logger->log(logging::Logger::Severity::info, message, "stitcher");
+    }
+    report.degradations.insert(report.degradations.end(), degradations.begin(),
+                               degradations.end());
+
+    return !degradations.empty();
+}
+
 void LowLevelOpenCVStitcher::debugFeatures(SourceImages &source_images,
         std::vector<cv::detail::ImageFeatures> &features,
         cv::DrawMatchesFlags flags)
@@ -372,6 +840,7 @@ void LowLevelOpenCVStitcher::debugWarpResults(WarpResults &warp_results)
 }
 
 std::vector<cv::detail::CameraParams> LowLevelOpenCVStitcher::estimateCameraParameters(
+        const SourceImages &source_images,
         std::vector<cv::detail::ImageFeatures> &features,
         std::vector<cv::detail::MatchesInfo> &matches)
 {
@@ -380,7 +849,7 @@ std::vector<cv::detail::CameraParams> LowLevelOpenCVStitcher::estimateCameraPara
     _logger->log(logging::Logger::Severity::info, "Estimating camera parameters.", "stitcher");
     std::vector<cv::detail::CameraParams> cameras;
 
-    auto estimator = getEstimator();
+    auto estimator = getEstimator(source_images);
     if (!(*estimator)(features, matches, cameras)) {
         std::string message = "Failed to estimate camera parameters.";
         _logger->log(logging::Logger::Severity::info, message.c_str(), "stitcher");
@@ -400,16 +869,17 @@ std::vector<cv::detail::CameraParams> LowLevelOpenCVStitcher::estimateCameraPara
 std::vector<cv::detail::ImageFeatures> LowLevelOpenCVStitcher::findFeatures(
     const std::vector<cv::Mat> &source_images) const
 {
-    _monitor->changeOperation(monitor::Operation::FindFeatures());
-
     _logger->log(logging::Logger::Severity::info, "Finding features.", "stitcher");
     std::vector<cv::detail::ImageFeatures> features(source_images.size());
     cv::Ptr<cv::Feature2D> finder = getFeaturesFinder();
 
     for (size_t i = 0; i < source_images.size(); i++) {
+        auto span = _monitor->span("ComputeImageFeatures", static_cast<int64_t>(i));
         cv::detail::computeImageFeatures(finder, source_images[i], features[i]);
 
         features[i].img_idx = static_cast<int>(i);
+        _monitor->addWork(monitor::OperationResources::Features,
+                          features[i].keypoints.size());
     }
 
     _logger->log(logging::Logger::Severity::info, "Finished finding features.", "stitcher");
@@ -417,7 +887,7 @@ std::vector<cv::detail::ImageFeatures> LowLevelOpenCVStitcher::findFeatures(
 }
 
 double LowLevelOpenCVStitcher::findMedianFocalLength(
-        std::vector<cv::detail::CameraParams> &cameras)
+        const std::vector<cv::detail::CameraParams> &cameras)
 {
     std::vector<double> focal_lengths;
     for (size_t i = 0; i < cameras.size(); i++) {
@@ -439,6 +909,10 @@ void LowLevelOpenCVStitcher::findSeams(LowLevelOpenCVStitcher::WarpResults &warp
 
     _logger->log(logging::Logger::Severity::info, "Finding seams.", "stitcher");
     auto seam_finder = getSeamFinder();
+    if (dynamic_cast<MonitoredGraphCutSeamFinder *>(seam_finder.get())) {
+        dynamic_cast<MonitoredGraphCutSeamFinder *>(seam_finder.get())
+                ->setOverlapGraph(warp_results.overlaps);
+    }
     seam_finder->find(warp_results.images_warped_f, warp_results.corners,
                       warp_results.masks_warped);
     _logger->log(logging::Logger::Severity::info, "Finished finding seams.", "stitcher");
@@ -461,6 +935,14 @@ cv::Ptr<cv::detail::BundleAdjusterBase> LowLevelOpenCVStitcher::getBundleAdjuste
     case BundleAdjusterType::No:
         bundle_adjuster = cv::makePtr<cv::detail::NoBundleAdjuster>();
         break;
+    case BundleAdjusterType::SparseRay: {
+        auto sparse_adjuster = cv::makePtr<SparseBundleAdjusterRay>();
+        sparse_adjuster->setMinRelativeImprovement(
+                _config.bundle_adjustment_min_improvement);
+        sparse_adjuster->setTimeBudget(_config.bundle_adjustment_time_budget);
+        bundle_adjuster = sparse_adjuster;
+        break;
+    }
     }
 
     bundle_adjuster->setConfThresh(_config.match_conf_thresh);
@@ -474,16 +956,24 @@ cv::Ptr<cv::detail::BundleAdjusterBase> LowLevelOpenCVStitcher::getBundleAdjuste
 
 double LowLevelOpenCVStitcher::getComposeScale(SourceImages &source_images)
 {
-    if (_config.compose_megapix < 0) {
+    return std::min(getComposeScale(source_images, _config.compose_megapix),
+                    _memoryPlan.composeScale);
+}
+
+double LowLevelOpenCVStitcher::getComposeScale(SourceImages &source_images,
+                                               double compose_megapix)
+{
+    if (compose_megapix < 0) {
         return 1.0;
     }
 
     return cv::min(
             1.0,
-            sqrt(_config.compose_megapix * 1e6 / source_images.images[0].size().area()));
+            sqrt(compose_megapix * 1e6 / source_images.images[0].size().area()));
 }
 
-cv::Ptr<cv::detail::Estimator> LowLevelOpenCVStitcher::getEstimator()
+cv::Ptr<cv::detail::Estimator>
+LowLevelOpenCVStitcher::getEstimator(const SourceImages &source_images)
 {
     cv::Ptr<cv::detail::Estimator> estimator;
 
@@ -491,6 +981,19 @@ cv::Ptr<cv::detail::Estimator> LowLevelOpenCVStitcher::getEstimator()
     case EstimatorType::Affine:
         estimator = cv::makePtr<cv::detail::AffineBasedEstimator>();
         break;
+    case EstimatorType::Gimbal:
+        if (GimbalBasedEstimator::available(
+                    _camera, source_images.gimbal_orientations)) {
+            estimator = cv::makePtr<GimbalBasedEstimator>(
+                    _camera, source_images.gimbal_orientations);
+            break;
+        }
+        _logger->log(logging::Logger::Severity::info,
+                     "Gimbal orientations or camera intrinsics unknown, "
+                     "estimating camera parameters from homographies.",
+                     "stitcher");
+        estimator = cv::makePtr<cv::detail::HomographyBasedEstimator>();
+        break;
     case EstimatorType::Homography:
         estimator = cv::makePtr<cv::detail::HomographyBasedEstimator>();
         break;
@@ -500,10 +1003,16 @@ cv::Ptr<cv::detail::Estimator> LowLevelOpenCVStitcher::getEstimator()
 }
 
 cv::Ptr<cv::detail::ExposureCompensator> LowLevelOpenCVStitcher::getExposureCompensator()
+{
+    return getExposureCompensator(_config.exposure_compensator_type);
+}
+
+cv::Ptr<cv::detail::ExposureCompensator>
+LowLevelOpenCVStitcher::getExposureCompensator(ExposureCompensatorType type)
 {
     cv::Ptr<cv::detail::ExposureCompensator> compensator;
 
-    switch (_config.exposure_compensator_type) {
+    switch (type) {
     case ExposureCompensatorType::Channels:
         compensator = cv::detail::ExposureCompensator::createDefault(
                 cv::detail::ExposureCompensator::CHANNELS);
@@ -619,6 +1128,20 @@ cv::Ptr<cv::detail::SeamFinder> LowLevelOpenCVStitcher::getSeamFinder()
             _config.seam_finder_graph_cut_terminal_cost,
             _config.seam_finder_graph_cut_bad_region_penalty);
         break;
+    case SeamFinderType::GraphCutGridColor:
+        seam_finder = cv::makePtr<MonitoredGraphCutSeamFinder>(
+            _monitor, cv::detail::GraphCutSeamFinder::COST_COLOR,
+            _config.seam_finder_graph_cut_terminal_cost,
+            _config.seam_finder_graph_cut_bad_region_penalty,
+            MaxFlowType::Grid);
+        break;
+    case SeamFinderType::GraphCutGridColorGrad:
+        seam_finder = cv::makePtr<MonitoredGraphCutSeamFinder>(
+            _monitor, cv::detail::GraphCutSeamFinder::COST_COLOR_GRAD,
+            _config.seam_finder_graph_cut_terminal_cost,
+            _config.seam_finder_graph_cut_bad_region_penalty,
+            MaxFlowType::Grid);
+        break;
     case SeamFinderType::Voronoi:
         seam_finder = cv::makePtr<cv::detail::VoronoiSeamFinder>();
         break;
@@ -735,6 +1258,14 @@ LowLevelOpenCVStitcher::matchFeatures(std::vector<cv::detail::ImageFeatures> &fe
     cv::Ptr<cv::detail::FeaturesMatcher> matcher = getFeaturesMatcher();
     (*matcher)(features, matches);
     matcher->collectGarbage();
+
+    // Count each pair once, it is matched both ways.
+    const auto matched_pairs = std::count_if(
+            matches.begin(), matches.end(), [](const cv::detail::MatchesInfo &match) {
+                return match.src_img_idx < match.dst_img_idx && !match.matches.empty();
+            });
+    _monitor->addWork(monitor::OperationResources::MatchedPairs,
+                      static_cast<uint64_t>(matched_pairs));
     _logger->log(logging::Logger::Severity::info, "Finished matching features.", "stitcher");
     return matches;
 }
@@ -744,8 +1275,9 @@ LowLevelOpenCVStitcher::prepareBlender(WarpResults &warp_results)
 {
     cv::Ptr<cv::detail::Blender> blender =
             cv::detail::Blender::createDefault(_config.blender_type, _config.try_cuda);
-    cv::Size destination_size =
-            cv::detail::resultRoi(warp_results.corners, warp_results.sizes).size();
+    cv::Rect destination_roi =
+            cv::detail::resultRoi(warp_results.corners, warp_results.sizes);
+    cv::Size destination_size = destination_roi.size();
     float blend_width = cv::sqrt(static_cast<float>(destination_size.area()))
             * _config.blend_strength / 100.f;
 
@@ -770,7 +1302,7 @@ LowLevelOpenCVStitcher::prepareBlender(WarpResults &warp_results)
         _logger->log(logging::Logger::Severity::info, message, "stitcher");
     }
 
-    blender->prepare(warp_results.corners, warp_results.sizes);
+    blender->prepare(destination_roi);
     return blender;
 }
 
@@ -789,6 +1321,110 @@ LowLevelOpenCVStitcher::prepareExposureCompensation(
     return compensator;
 }
 
+Stitcher::Report LowLevelOpenCVStitcher::render(
+        const StitchRecipe &recipe, const std::vector<RenderTarget> &targets)
+{
+    auto allocations = trackAllocations();
+    _monitor->changeOperation(monitor::Operation::Start());
+
+    Stitcher::Report report;
+    if (targets.empty()) {
+        return report;
+    }
+
+    // Load images, as for stitching them.
+    _monitor->changeOperation(monitor::Operation::LoadImages());
+    SourceImages source_images(_panorama, _logger);
+    source_images.ensureImageCount();
+    if (static_cast<size_t>(recipe.image_count) != source_images.images.size()) {
+        std::stringstream message;
+        message << "Stitch recipe is for " << recipe.image_count
+                << " images, not " << source_images.images.size() << ".";
+        _logger->log(logging::Logger::Severity::error, message, "stitcher");
+        throw std::invalid_argument(message.str());
+    }
+    undistortImages(source_images);
+
+    // The images are composed once, at the largest of the target scales,
+    // which memory is planned for.  Every target is capped at the compose
+    // scale the plan allows.
+    double compose_megapix = targets.front().compose_megapix;
+    for (const auto &target : targets) {
+        compose_megapix = compose_megapix < 0 || target.compose_megapix < 0
+                ? -1.
+                : std::max(compose_megapix, target.compose_megapix);
+    }
+    _monitor->changeOperation(monitor::Operation::ScaleImages());
+    _memoryPlan = source_images.scaleToAvailableMemory(
+            memoryPlanner(source_images, compose_megapix), report.inputSizeMB,
+            report.inputScaled);
+
+    double work_scale = getWorkScale(source_images);
+    std::vector<double> compose_scales;
+    for (const auto &target : targets) {
+        compose_scales.push_back(
+                std::min(getComposeScale(source_images, target.compose_megapix),
+                         _memoryPlan.composeScale));
+    }
+    double compose_scale =
+            *std::max_element(compose_scales.begin(), compose_scales.end());
+
+    // The recipe's cameras, scaled to the size of these images at work scale.
+    cv::Size work_size(
+            static_cast<int>(std::round(source_images.images[0].cols * work_scale)),
+            static_cast<int>(std::round(source_images.images[0].rows * work_scale)));
+    auto cameras = recipe.alignedCameras(recipe.gimbal_orientations, work_size);
+    float warped_image_scale = static_cast<float>(findMedianFocalLength(cameras));
+
+    std::vector<int> keep_indices = recipe.image_indices;
+    source_images.filter(keep_indices);
+    undistortCropImages(source_images);
+
+    // Compose from the recipe's exposure gains and seams.
+    auto exposure_compensator =
+            getExposureCompensator(recipe.exposure_compensator_type);
+    std::vector<cv::Mat> exposure_gains = recipe.exposure_gains;
+    exposure_compensator->setMatGains(exposure_gains);
+
+    WarpResults warp_results(recipe.seam_masks.size());
+    for (size_t i = 0; i < recipe.seam_masks.size(); ++i) {
+        warp_results.corners[i] = recipe.corners[i];
+        recipe.seam_masks[i].copyTo(warp_results.masks_warped[i]);
+    }
+
+    source_images.scale(compose_scale);
+    source_images.images.clear();
+
+    cv::Mat result;
+    compose(source_images, cameras, exposure_compensator, warp_results,
+            work_scale, compose_scale, warped_image_scale, result);
+
+    if (recipe.rotate_result) {
+        _logger->log(airmap::logging::Logger::Severity::info,
+                     "Rotating panorama result.", "stitcher");
+        rotateImage(result, 180.);
+    }
+
+    // Scale the smaller panoramas down from the composed one, which
+    // postprocessing doesn't modify in place.
+    for (size_t i = 0; i < targets.size(); ++i) {
+        cv::Mat target_result;
+        if (compose_scales[i] < compose_scale) {
+            double scale = compose_scales[i] / compose_scale;
+            cv::resize(result, target_result, cv::Size(), scale, scale,
+                       cv::INTER_AREA);
+        } else {
+            target_result = result;
+        }
+        postprocess(std::move(target_result), targets[i].output_path);
+    }
+
+    _monitor->changeOperation(monitor::Operation::Complete());
+    report.operationResources = _monitor->operationResources();
+
+    return report;
+}
+
 void LowLevelOpenCVStitcher::rotateImage(cv::Mat &image, double angle)
 {
     cv::Size size = image.size();
@@ -804,6 +1440,8 @@ void LowLevelOpenCVStitcher::rotateImage(cv::Mat &image, double angle)
 bool LowLevelOpenCVStitcher::shouldRotateThreeSixty(
     const std::vector<cv::Mat> &original_images, cv::InputArray &warped_images)
 {
+    _monitor->changeOperation(monitor::Operation::ShouldRotate());
+
     _logger->log(airmap::logging::Logger::Severity::info,
                  "Determining if 360 should be rotated.", "stitcher");
 
@@ -949,10 +1587,16 @@ Stitcher::Report LowLevelOpenCVStitcher::stitch()
 {
     cv::Mat result;
     Stitcher::Report report;
-    
+    auto allocations = trackAllocations();
+    FailedOperationGuard failedOperation(_monitor);
+
     try {
         report = stitch(result);
     } catch (const std::exception &e) {
+        // An allocation refused for the memory budget is retried with less
+        // memory planned, whether OpenCV passed its exception on or threw
+        // another, e.g. from a parallel loop.
+        _monitor->allocations()->checkBudget();
         // can indeed throw, e.g.:
         //.../OpenCV/modules/flann/src/miniflann.cpp:487: error: (-215:Assertion
         // failed) (size_t)knn <= index_->size() in function 'runKnnSearch_' but
@@ -961,64 +1605,143 @@ Stitcher::Report LowLevelOpenCVStitcher::stitch()
         throw RetriableError(e.what());
     }
 
-    postprocess(std::move(result));
+    try {
+        postprocess(std::move(result));
+    } catch (const std::exception &) {
+        _monitor->allocations()->checkBudget();
+        throw;
+    }
+
+    _monitor->changeOperation(monitor::Operation::Complete());
+    failedOperation.completed();
+    report.operationResources = _monitor->operationResources();
     return report;
 }
 
-void LowLevelOpenCVStitcher::cancel() { }
+void LowLevelOpenCVStitcher::cancel()
+{
+    _monitor->cancel();
+}
+
+void LowLevelOpenCVStitcher::setRecipe(const StitchRecipe &recipe)
+{
+    _recipe = recipe;
+}
+
+void LowLevelOpenCVStitcher::setPreview(bool enabled)
+{
+    _preview = enabled;
+}
+
+void LowLevelOpenCVStitcher::setRecipeOutputPath(const std::string &path)
+{
+    _recipeOutputPath = path;
+}
 
 Stitcher::Report LowLevelOpenCVStitcher::stitch(cv::Mat &result)
 {
     _monitor->changeOperation(monitor::Operation::Start());
+    _config = _fullQualityConfig;
 
     Stitcher::Report report;
     std::list<std::string> sourceImagePaths = _panorama.inputPaths();
 
     // Load images.
+    _monitor->changeOperation(monitor::Operation::LoadImages());
     SourceImages source_images(_panorama, _logger);
     source_images.ensureImageCount();
+    double input_megapix = 0.;
+    for (const auto &image : source_images.images) {
+        input_megapix += image.size().area() / 1e6;
+    }
 
     // Optionally undistort images for detected cameras with a
     // known distortion model.
     undistortImages(source_images);
 
-    // Scale images based on available memory.
-    source_images.scaleToAvailableMemory(_parameters.memoryBudgetMB,
-                                         _parameters.maxInputImageSize,
-                                         report.inputSizeMB,
-                                         report.inputScaled);
+    // Scale images, and plan the compose scale, based on available memory.
+    _monitor->changeOperation(monitor::Operation::ScaleImages());
+    _memoryPlan = source_images.scaleToAvailableMemory(
+            memoryPlanner(source_images), report.inputSizeMB, report.inputScaled);
 
     // Determine scales for operations.
     double seam_scale = getSeamScale(source_images);
     double work_scale = getWorkScale(source_images);
     double compose_scale = getComposeScale(source_images);
 
+    // Estimate the remaining operations from similar past stitches.
+    _monitor->setJobFeatures(jobFeatures(
+            source_images, input_megapix, work_scale, seam_scale, compose_scale));
+
     // Scale images down for feature detection and matching.
     source_images.scale(work_scale);
 
-    // Find features and matches.
-    auto features = findFeatures(source_images.images_scaled);
-    debugFeatures(source_images, features);
-    auto matches = matchFeatures(features);
-    debugMatches(source_images.images_scaled, features, matches,
-                 _config.match_conf_thresh, _debugPath / "matches");
+    // Keep what is needed to stitch similar panoramas from a recipe.
+    const bool record_recipe = !_recipeOutputPath.empty();
+    StitchRecipe recipe;
+    recipe.image_count = static_cast<int>(source_images.images.size());
+    recipe.work_size = source_images.images_scaled[0].size();
 
-    // Filter images with poor matching.
-    auto keep_indices = cv::detail::leaveBiggestComponent(
-            features, matches, static_cast<float>(_config.match_conf_thresh));
-    source_images.filter(keep_indices);
+    // Align the cameras of a recipe, or else estimate them from scratch.
+    std::vector<int> keep_indices;
+    std::vector<cv::detail::CameraParams> cameras;
+    cv::Mat preview;
+    const bool from_recipe =
+            camerasFromRecipe(source_images, keep_indices, cameras);
+    if (from_recipe) {
+        source_images.filter(keep_indices);
+        if (_preview) {
+            writePreview(composePreview(source_images, cameras, work_scale),
+                         _recipe.rotate_result);
+        }
+    } else {
+        // Find features and matches.  Features are also found to decide
+        // whether to rotate a 360, as part of that operation.
+        _monitor->changeOperation(monitor::Operation::FindFeatures());
+        auto features = findFeatures(source_images.images_scaled);
+        debugFeatures(source_images, features);
+        auto matches = matchFeatures(features);
+        debugMatches(source_images.images_scaled, features, matches,
+                     _config.match_conf_thresh, _debugPath / "matches");
+
+        // Filter images with poor matching.
+        keep_indices = cv::detail::leaveBiggestComponent(
+                features, matches, static_cast<float>(_config.match_conf_thresh));
+        source_images.filter(keep_indices);
+
+        // Estimate camera parameters.
+        cameras = estimateCameraParameters(source_images, features, matches);
+
+        // Write a quick preview from a few iterations of bundle adjustment,
+        // before the full adjustment refines the same cameras.
+        if (_preview) {
+            alignPreview(features, matches, cameras);
+            std::vector<cv::detail::CameraParams> preview_cameras = cameras;
+            waveCorrect(preview_cameras);
+            preview = composePreview(source_images, preview_cameras, work_scale);
+            writePreview(preview, false);
+        }
 
-    // Estimate and refine camera parameters.
-    auto cameras = estimateCameraParameters(features, matches);
-    adjustCameraParameters(features, matches, cameras);
+        // Refine camera parameters.
+        adjustCameraParameters(features, matches, cameras, report);
 
-    // Perform wave correction.
-    waveCorrect(cameras);
+        // Perform wave correction.
+        waveCorrect(cameras);
+    }
 
-    // Crop images based on the distortion model.
-    undistortCropImages(source_images);
+    // Step down the remaining stages if the stitch is projected to miss
+    // its deadline.
+    if (degradeForDeadline(Degradation::SeamMegapix, source_images, report)) {
+        seam_scale = getSeamScale(source_images);
+        compose_scale = getComposeScale(source_images);
+        _monitor->setJobFeatures(jobFeatures(
+                source_images, input_megapix, work_scale, seam_scale, compose_scale));
+    }
 
-    // Scale images to seam scale.
+    // Crop images based on the distortion model, and scale them to seam
+    // scale, to warp them.
+    _monitor->changeOperation(monitor::Operation::WarpImages());
+    undistortCropImages(source_images);
     source_images.scale(seam_scale);
 
     // Warp images.
@@ -1029,11 +1752,20 @@ Stitcher::Report LowLevelOpenCVStitcher::stitch(cv::Mat &result)
             warpImages(source_images, cameras, warped_image_scale, seam_work_aspect);
     debugWarpResults(warp_results);
 
-    // Prepare exposure compensation.
-    auto exposure_compensator = prepareExposureCompensation(warp_results);
+    // Prepare exposure compensation, with the recipe's gains if there is one.
+    cv::Ptr<cv::detail::ExposureCompensator> exposure_compensator;
+    if (from_recipe) {
+        exposure_compensator =
+                getExposureCompensator(_recipe.exposure_compensator_type);
+        std::vector<cv::Mat> exposure_gains = _recipe.exposure_gains;
+        exposure_compensator->setMatGains(exposure_gains);
+    } else {
+        exposure_compensator = prepareExposureCompensation(warp_results);
+    }
 
-    bool should_rotate_result =
-        _config.stitch_type == StitchType::ThreeSixty
+    bool should_rotate_result = from_recipe
+        ? _recipe.rotate_result
+        : _config.stitch_type == StitchType::ThreeSixty
             ? shouldRotateThreeSixty(source_images.images_scaled,
                                      warp_results.images_warped)
             : false;
@@ -1042,12 +1774,51 @@ Stitcher::Report LowLevelOpenCVStitcher::stitch(cv::Mat &result)
     warp_results.images_warped.clear();
     warp_results.masks.clear();
 
-    // Find seams.
-    findSeams(warp_results);
+    // The preview of a stitch from scratch was written before whether to
+    // rotate it was known.
+    if (!preview.empty()) {
+        if (should_rotate_result) {
+            writePreview(preview, true);
+        }
+        preview.release();
+    }
+
+    if (degradeForDeadline(Degradation::SeamFinder, source_images, report)) {
+        compose_scale = getComposeScale(source_images);
+        _monitor->setJobFeatures(jobFeatures(
+                source_images, input_megapix, work_scale, seam_scale, compose_scale));
+    }
+
+    // Find seams, or cut the masks along the recipe's.
+    if (from_recipe) {
+        _recipe.cutAlongSeams(warp_results.corners, warp_results.masks_warped);
+    } else {
+        findSeams(warp_results);
+    }
+
+    if (record_recipe) {
+        recipe.image_indices = keep_indices;
+        recipe.warped_image_scale = warped_image_scale;
+        recipe.rotate_result = should_rotate_result;
+        recipe.cameras = cameras;
+        recipe.gimbal_orientations = source_images.gimbal_orientations;
+        recipe.exposure_compensator_type = _config.exposure_compensator_type;
+        exposure_compensator->getMatGains(recipe.exposure_gains);
+        recipe.corners = warp_results.corners;
+        for (const auto &mask_warped : warp_results.masks_warped) {
+            recipe.seam_masks.push_back(mask_warped.getMat(cv::ACCESS_READ).clone());
+        }
+    }
 
     // Release memory.
     warp_results.images_warped_f.clear();
 
+    if (degradeForDeadline(Degradation::BlendBands, source_images, report)) {
+        compose_scale = getComposeScale(source_images);
+        _monitor->setJobFeatures(jobFeatures(
+                source_images, input_megapix, work_scale, seam_scale, compose_scale));
+    }
+
     // Scale images to compose scale.
     source_images.scale(compose_scale);
 
@@ -1064,11 +1835,69 @@ Stitcher::Report LowLevelOpenCVStitcher::stitch(cv::Mat &result)
         rotateImage(result, 180.);
     }
 
-    _monitor->changeOperation(monitor::Operation::Complete());
+    if (record_recipe) {
+        recipe.save(_recipeOutputPath);
+        std::stringstream message;
+        message << "Written stitch recipe to " << _recipeOutputPath << ".";
+        _logger->log(logging::Logger::Severity::info, message, "stitcher");
+    }
 
     return report;
 }
 
+monitor::JobFeatures LowLevelOpenCVStitcher::jobFeatures(const SourceImages &source_images,
+                                                       double input_megapix,
+                                                       double work_scale, double seam_scale,
+                                                       double compose_scale) const
+{
+    double megapix = 0.;
+    for (const auto &image : source_images.images) {
+        megapix += image.size().area() / 1e6;
+    }
+
+    // The settings that change the cost of the stitch, besides its scales.
+    std::stringstream configuration;
+    configuration << static_cast<int>(_config.features_finder_type) << "-"
+                  << static_cast<int>(_config.features_matcher_type) << "-"
+                  << static_cast<int>(_config.bundle_adjuster_type) << "-"
+                  << static_cast<int>(_config.warper_type) << "-"
+                  << static_cast<int>(_config.exposure_compensator_type) << "-"
+                  << static_cast<int>(_config.seam_finder_type) << "-"
+                  << _config.blender_type << "-" << _config.blend_strength;
+
+    monitor::JobFeatures features;
+    features.imageCount = source_images.images.size();
+    features.inputMegapix = input_megapix;
+    features.workMegapix = megapix * work_scale * work_scale;
+    features.seamMegapix = megapix * seam_scale * seam_scale;
+    features.composeMegapix = megapix * compose_scale * compose_scale;
+    features.camera = _panorama.empty() ? "" : _panorama.front().cameraModel;
+    features.configuration = configuration.str();
+    features.threads = static_cast<size_t>(std::max(1, cv::getNumThreads()));
+    return features;
+}
+
+MemoryPlanner LowLevelOpenCVStitcher::memoryPlanner(const SourceImages &source_images) const
+{
+    return memoryPlanner(source_images, _config.compose_megapix);
+}
+
+MemoryPlanner LowLevelOpenCVStitcher::memoryPlanner(const SourceImages &source_images,
+                                                    double compose_megapix) const
+{
+    // The camera's focal length, in pixels of the images as loaded.
+    double focal_pixels = 0.;
+    bool undistort = false;
+    if (_camera && !source_images.images.empty()) {
+        focal_pixels = _camera->focalLengthPixels().x * source_images.images[0].cols
+                / _camera->sensorDimensionsPixels().x;
+        undistort = _camera->distortion_model && _camera->distortion_model->enabled();
+    }
+    Configuration config = _config;
+    config.compose_megapix = compose_megapix;
+    return MemoryPlanner(config, plannedParameters(), focal_pixels, undistort);
+}
+
 void LowLevelOpenCVStitcher::undistortImages(SourceImages &source_images)
 {
     _monitor->changeOperation(monitor::Operation::UndistortImages());
@@ -1088,11 +1917,10 @@ void LowLevelOpenCVStitcher::undistortImages(SourceImages &source_images)
         _logger->log(logging::Logger::Severity::info, "Undistorting images.", "stitcher");
 
         cv::Mat K = _camera->K();
+        _monitor->setOperationWork(source_images.images.size());
         for (size_t i = 0; i < source_images.images.size(); ++i) {
-            _monitor->updateCurrentOperation(
-                static_cast<double>(i) /
-                static_cast<double>(source_images.images.size()));
             _camera->distortion_model->undistort(source_images.images[i], K);
+            _monitor->completeWork();
         }
 
         if (_debug) {
@@ -1150,6 +1978,7 @@ LowLevelOpenCVStitcher::warpImages(SourceImages &source_images,
     }
 
     for (size_t i = 0; i < image_count; ++i) {
+        auto span = _monitor->span("Warp", static_cast<int64_t>(i));
         cv::Mat_<float> K;
         cameras[i].K().convertTo(K, CV_32F);
         K(0, 0) *= seam_work_aspect;
@@ -1161,11 +1990,24 @@ LowLevelOpenCVStitcher::warpImages(SourceImages &source_images,
                 warper->warp(source_images.images_scaled[i], K, cameras[i].R, cv::INTER_LINEAR,
                              cv::BORDER_REFLECT, warp_results.images_warped[i]);
         warp_results.sizes[i] = warp_results.images_warped[i].size();
+        _monitor->addWork(monitor::OperationResources::WarpedPixels,
+                          warp_results.sizes[i].area());
         warper->warp(warp_results.masks[i], K, cameras[i].R, cv::INTER_NEAREST,
                      cv::BORDER_CONSTANT, warp_results.masks_warped[i]);
         warp_results.images_warped[i].convertTo(warp_results.images_warped_f[i], CV_32F);
     }
 
+    warp_results.overlaps =
+            OverlapGraph(warp_results.corners, warp_results.sizes,
+                         warp_results.masks_warped, _config.min_overlap_pixels);
+    std::stringstream message;
+    message << "Found " << warp_results.overlaps.pairs().size()
+            << " overlapping pairs of images, skipped "
+            << warp_results.overlaps.skippedPairs()
+            << " with less than " << _config.min_overlap_pixels
+            << " overlapping pixels.";
+    _logger->log(logging::Logger::Severity::info, message, "stitcher");
+
     _logger->log(logging::Logger::Severity::info, "Finished warping images.", "stitcher");
     return warp_results;
 }
@@ -1185,5 +2027,14 @@ void LowLevelOpenCVStitcher::waveCorrect(std::vector<cv::detail::CameraParams> &
     }
 }
 
+void LowLevelOpenCVStitcher::writePreview(const cv::Mat &preview, bool rotate_result)
+{
+    cv::Mat result = preview.clone();
+    if (rotate_result) {
+        rotateImage(result, 180.);
+    }
+    postprocess(std::move(result), true);
+}
+
 } // namespace stitcher
 } // namespace airmap
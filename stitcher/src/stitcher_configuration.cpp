@@ -11,7 +11,9 @@ Configuration::Configuration(StitchType stitchType)
     case StitchType::ThreeSixty:
         blend_strength = 5;
         blender_type = cv::detail::Blender::MULTI_BAND;
-        bundle_adjuster_type = BundleAdjusterType::Ray;
+        bundle_adjuster_type = BundleAdjusterType::SparseRay;
+        bundle_adjustment_min_improvement = 0.0;
+        bundle_adjustment_time_budget = 0.0;
         compose_megapix = -1;
         estimator_type = EstimatorType::Homography;
         exposure_compensator_type = ExposureCompensatorType::GainBlocks;
@@ -23,9 +25,14 @@ Configuration::Configuration(StitchType stitchType)
         features_maximum = 1000;
         match_conf = 0.3f;
         match_conf_thresh = 1.0;
+        min_overlap_pixels = 0;
+        preview_bundle_adjustment_iterations = 10;
+        preview_width = 2048;
         range_width = -1;
+        recipe_features_maximum = 200;
+        recipe_max_error = 2.0;
         seam_megapix = 0.1;
-        seam_finder_type = SeamFinderType::GraphCutColorGrad;
+        seam_finder_type = SeamFinderType::GraphCutGridColorGrad;
         seam_finder_graph_cut_terminal_cost = 10000.f;
         seam_finder_graph_cut_bad_region_penalty = 10000000.f;
         try_cuda = false;
@@ -59,6 +66,8 @@ Configuration::Configuration(
     : blend_strength(blend_strength)
     , blender_type(blender_type)
     , bundle_adjuster_type(bundle_adjuster_type)
+    , bundle_adjustment_min_improvement(0.0)
+    , bundle_adjustment_time_budget(0.0)
     , compose_megapix(compose_megapix)
     , estimator_type(estimator_type)
     , exposure_compensator_type(exposure_compensator_type)
@@ -70,7 +79,12 @@ Configuration::Configuration(
     , features_maximum(features_maximum)
     , match_conf(match_conf)
     , match_conf_thresh(match_conf_thresh)
+    , min_overlap_pixels(0)
+    , preview_bundle_adjustment_iterations(10)
+    , preview_width(2048)
     , range_width(range_width)
+    , recipe_features_maximum(200)
+    , recipe_max_error(2.0)
     , seam_megapix(seam_megapix)
     , seam_finder_type(seam_finder_type)
     , seam_finder_graph_cut_terminal_cost(seam_finder_graph_cut_terminal_cost)
@@ -0,0 +1,403 @@
+#include "airmap/synthetic.h"
+#include "airmap/distortion.h"
+
+#include <boost/filesystem.hpp>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+
+namespace {
+
+/**
+ * @brief IfdEntry
+ * A TIFF image file directory entry, with its value in little endian.
+ */
+struct IfdEntry
+{
+    enum Type : uint16_t { Byte = 1, Ascii = 2, Long = 4, Rational = 5 };
+
+    uint16_t tag;
+    Type type;
+    uint32_t count;
+    std::vector<uint8_t> value;
+};
+
+using Ifd = std::vector<IfdEntry>;
+
+void put16(std::vector<uint8_t> &out, uint16_t value)
+{
+    out.push_back(static_cast<uint8_t>(value & 0xff));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    put16(out, static_cast<uint16_t>(value & 0xffff));
+    put16(out, static_cast<uint16_t>(value >> 16));
+}
+
+IfdEntry asciiEntry(uint16_t tag, const std::string &value)
+{
+    IfdEntry entry { tag, IfdEntry::Ascii, static_cast<uint32_t>(value.size() + 1),
+                     std::vector<uint8_t>(value.begin(), value.end()) };
+    entry.value.push_back('\0');
+    return entry;
+}
+
+IfdEntry longEntry(uint16_t tag, uint32_t value)
+{
+    IfdEntry entry { tag, IfdEntry::Long, 1, {} };
+    put32(entry.value, value);
+    return entry;
+}
+
+IfdEntry rationalEntry(uint16_t tag, const std::vector<double> &values,
+                       uint32_t denominator)
+{
+    IfdEntry entry { tag, IfdEntry::Rational, static_cast<uint32_t>(values.size()), {} };
+    for (double value : values) {
+        put32(entry.value, static_cast<uint32_t>(std::llround(value * denominator)));
+        put32(entry.value, denominator);
+    }
+    return entry;
+}
+
+/**
+ * @brief ifdSize
+ * Bytes of a directory, with the values that don't fit in their entries.
+ */
+uint32_t ifdSize(const Ifd &ifd)
+{
+    uint32_t size = 2 + 12 * static_cast<uint32_t>(ifd.size()) + 4;
+    for (const auto &entry : ifd) {
+        if (entry.value.size() > 4) {
+            size += static_cast<uint32_t>(entry.value.size() + entry.value.size() % 2);
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief writeIfd
+ * Append a directory to a TIFF, whose offsets start at its header.
+ */
+void writeIfd(std::vector<uint8_t> &tiff, const Ifd &ifd)
+{
+    uint32_t value_offset = static_cast<uint32_t>(tiff.size() + 2 + 12 * ifd.size() + 4);
+    std::vector<uint8_t> values;
+    put16(tiff, static_cast<uint16_t>(ifd.size()));
+    for (const auto &entry : ifd) {
+        put16(tiff, entry.tag);
+        put16(tiff, entry.type);
+        put32(tiff, entry.count);
+        if (entry.value.size() <= 4) {
+            std::vector<uint8_t> value = entry.value;
+            value.resize(4, 0);
+            tiff.insert(tiff.end(), value.begin(), value.end());
+        } else {
+            put32(tiff, value_offset + static_cast<uint32_t>(values.size()));
+            values.insert(values.end(), entry.value.begin(), entry.value.end());
+            if (values.size() % 2) {
+                values.push_back(0);
+            }
+        }
+    }
+    // No next directory.
+    put32(tiff, 0);
+    tiff.insert(tiff.end(), values.begin(), values.end());
+}
+
+/**
+ * @brief degreesMinutesSeconds
+ * An angle as EXIF GPS rationals.
+ */
+std::vector<double> degreesMinutesSeconds(double angle)
+{
+    angle = std::abs(angle);
+    double degrees = std::floor(angle);
+    double minutes = std::floor((angle - degrees) * 60.);
+    double seconds = (angle - degrees - minutes / 60.) * 3600.;
+    return { degrees, minutes, seconds };
+}
+
+/**
+ * @brief exifSegment
+ * The APP1 payload of the EXIF of an image: make, model and time in the
+ * image directory, size in the EXIF directory, and location in the GPS
+ * directory.
+ */
+std::vector<uint8_t> exifSegment(const GeoImage &image, double altitude_meters)
+{
+    std::tm created = {};
+    localtime_r(&image.createdTimestampSec, &created);
+    std::stringstream time;
+    time << std::put_time(&created, "%Y:%m:%d %H:%M:%S");
+
+    const double longitude = image.geoCoordinate.first;
+    const double latitude = image.geoCoordinate.second;
+    Ifd gps_ifd = {
+        { 0x0000, IfdEntry::Byte, 4, { 2, 3, 0, 0 } },
+        asciiEntry(0x0001, latitude < 0 ? "S" : "N"),
+        rationalEntry(0x0002, degreesMinutesSeconds(latitude), 10000),
+        asciiEntry(0x0003, longitude < 0 ? "W" : "E"),
+        rationalEntry(0x0004, degreesMinutesSeconds(longitude), 10000),
+        { 0x0005, IfdEntry::Byte, 1, { static_cast<uint8_t>(altitude_meters < 0) } },
+        rationalEntry(0x0006, { std::abs(altitude_meters) }, 100),
+    };
+    Ifd exif_ifd = {
+        asciiEntry(0x9003, time.str()),
+        longEntry(0xa002, image.widthPixels),
+        longEntry(0xa003, image.heightPixels),
+    };
+    Ifd image_ifd = {
+        asciiEntry(0x010f, image.cameraMake),
+        asciiEntry(0x0110, image.cameraModel),
+        asciiEntry(0x0132, time.str()),
+        longEntry(0x8769, 0),
+        longEntry(0x8825, 0),
+    };
+
+    // The directories follow the 8 bytes of the header, in order.
+    const uint32_t exif_offset = 8 + ifdSize(image_ifd);
+    const uint32_t gps_offset = exif_offset + ifdSize(exif_ifd);
+    image_ifd[3] = longEntry(0x8769, exif_offset);
+    image_ifd[4] = longEntry(0x8825, gps_offset);
+
+    std::vector<uint8_t> segment = { 'E', 'x', 'i', 'f', 0, 0 };
+    std::vector<uint8_t> tiff = { 'I', 'I' };
+    put16(tiff, 42);
+    put32(tiff, 8);
+    writeIfd(tiff, image_ifd);
+    writeIfd(tiff, exif_ifd);
+    writeIfd(tiff, gps_ifd);
+    segment.insert(segment.end(), tiff.begin(), tiff.end());
+    return segment;
+}
+
+/**
+ * @brief xmpSegment
+ * The APP1 payload of the XMP of an image, with its gimbal orientation as
+ * written by DJI drones, which TinyEXIF reads whatever the make.
+ */
+std::vector<uint8_t> xmpSegment(const GeoImage &image)
+{
+    std::stringstream xmp;
+    xmp << "http://ns.adobe.com/xap/1.0/" << '\0'
+        << "<?xpacket begin=\"\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>"
+        << "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">"
+        << "<rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">"
+        << "<rdf:Description rdf:about=\"DJI Meta Data\""
+        << " xmlns:drone-dji=\"http://www.dji.com/drone-dji/1.0/\""
+        << std::setprecision(10)
+        << " drone-dji:GimbalRollDegree=\"" << image.cameraRollDeg << "\""
+        << " drone-dji:GimbalPitchDegree=\"" << image.cameraPitchDeg << "\""
+        << " drone-dji:GimbalYawDegree=\"" << image.cameraYawDeg << "\"/>"
+        << "</rdf:RDF></x:xmpmeta>"
+        << "<?xpacket end=\"w\"?>";
+    const std::string payload = xmp.str();
+    return std::vector<uint8_t>(payload.begin(), payload.end());
+}
+
+/**
+ * @brief insertApp1
+ * Insert APP1 segments right after the start of image marker of a JPEG.
+ * @throws std::invalid_argument If a segment is too large for a marker.
+ */
+void insertApp1(std::vector<uint8_t> &jpeg,
+                const std::vector<std::vector<uint8_t>> &payloads)
+{
+    std::vector<uint8_t> segments;
+    for (const auto &payload : payloads) {
+        if (payload.size() + 2 > 0xffff) {
+            throw std::invalid_argument("APP1 segment too large");
+        }
+        const uint16_t length = static_cast<uint16_t>(payload.size() + 2);
+        segments.push_back(0xff);
+        segments.push_back(0xe1);
+        segments.push_back(static_cast<uint8_t>(length >> 8));
+        segments.push_back(static_cast<uint8_t>(length & 0xff));
+        segments.insert(segments.end(), payload.begin(), payload.end());
+    }
+    jpeg.insert(jpeg.begin() + 2, segments.begin(), segments.end());
+}
+
+} // namespace
+
+SyntheticPanorama::SyntheticPanorama(const cv::Mat &equirectangular,
+                                     const Camera &camera,
+                                     const Parameters &parameters)
+    : _equirectangular(equirectangular)
+    , _camera(camera)
+    , _parameters(parameters)
+{
+    if (_equirectangular.empty()) {
+        throw std::invalid_argument("Synthetic panorama without a scene");
+    }
+    cv::Point2d sensor_pixels = _camera.sensorDimensionsPixels();
+    _width = static_cast<int>(std::round(sensor_pixels.x * _parameters.scale));
+    _height = static_cast<int>(std::round(sensor_pixels.y * _parameters.scale));
+}
+
+cv::Mat SyntheticPanorama::K() const
+{
+    cv::Mat K = _camera.K(_parameters.scale);
+    if (_parameters.distort && _camera.distortion_model) {
+        return _camera.distortion_model->undistortedK(_width, _height, K);
+    }
+    return K;
+}
+
+cv::Mat SyntheticPanorama::render(const GimbalOrientation &orientation) const
+{
+    const cv::Matx33d K_inv = cv::Matx33d(K()).inv();
+    const cv::Matx33d R = GimbalOrientation(orientation).cameraRotation();
+    const cv::Matx33d world_from_pixel = R * K_inv;
+
+    // Where the ray of each pixel of the frame hits the panorama.
+    const double panorama_width = _equirectangular.cols;
+    const double panorama_height = _equirectangular.rows;
+    cv::Mat map_x(_height, _width, CV_32FC1);
+    cv::Mat map_y(_height, _width, CV_32FC1);
+    for (int y = 0; y < _height; ++y) {
+        for (int x = 0; x < _width; ++x) {
+            cv::Vec3d ray = world_from_pixel * cv::Vec3d(x, y, 1.);
+            double longitude = std::atan2(ray[0], ray[2]);
+            double latitude = std::atan2(-ray[1], std::hypot(ray[0], ray[2]));
+            map_x.at<float>(y, x) = static_cast<float>(
+                    (longitude / (2. * M_PI) + 0.5) * panorama_width - 0.5);
+            map_y.at<float>(y, x) = static_cast<float>(
+                    (0.5 - latitude / M_PI) * panorama_height - 0.5);
+        }
+    }
+
+    cv::Mat frame;
+    cv::remap(_equirectangular, frame, map_x, map_y, cv::INTER_LINEAR,
+              cv::BORDER_WRAP);
+    if (_parameters.distort && _camera.distortion_model) {
+        _camera.distortion_model->distort(frame, _camera.K(_parameters.scale));
+    }
+    return frame;
+}
+
+std::vector<SyntheticFrame>
+SyntheticPanorama::write(const std::vector<GimbalOrientation> &orientations,
+                         const std::string &directory) const
+{
+    boost::filesystem::create_directories(directory);
+
+    std::vector<SyntheticFrame> frames;
+    for (size_t i = 0; i < orientations.size(); ++i) {
+        GimbalOrientation orientation = GimbalOrientation(orientations[i])
+                .convertTo(GimbalOrientation::Units::Degrees);
+
+        std::stringstream name;
+        name << "frame_" << std::setw(4) << std::setfill('0') << i << ".jpg";
+        SyntheticFrame frame;
+        frame.path = (boost::filesystem::path(directory) / name.str()).string();
+        frame.orientation = orientation;
+        frame.R = orientation.cameraRotation();
+
+        GeoImage metadata { frame.path,
+                            _parameters.location,
+                            _parameters.make,
+                            _parameters.model,
+                            orientation.pitch,
+                            orientation.roll,
+                            orientation.yaw,
+                            _parameters.startTime
+                                    + static_cast<std::time_t>(
+                                            i * _parameters.secondsBetweenFrames),
+                            0,
+                            static_cast<uint32_t>(_width),
+                            static_cast<uint32_t>(_height) };
+
+        std::vector<uint8_t> jpeg;
+        cv::imencode(".jpg", render(orientation), jpeg,
+                     { cv::IMWRITE_JPEG_QUALITY, _parameters.jpegQuality });
+        insertApp1(jpeg, { exifSegment(metadata, _parameters.altitudeMeters),
+                           xmpSegment(metadata) });
+
+        std::ofstream file(frame.path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(jpeg.data()),
+                   static_cast<std::streamsize>(jpeg.size()));
+        if (!file) {
+            throw std::invalid_argument("Can't write synthetic frame " + frame.path);
+        }
+        frames.push_back(frame);
+    }
+
+    const std::string ground_truth_path =
+            (boost::filesystem::path(directory) / "ground_truth.yml").string();
+    cv::FileStorage fs(ground_truth_path, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        throw std::invalid_argument("Can't write ground truth " + ground_truth_path);
+    }
+    fs << "model" << _parameters.model;
+    fs << "K" << K();
+    fs << "frames" << "[";
+    for (const auto &frame : frames) {
+        fs << "{"
+           << "path" << boost::filesystem::path(frame.path).filename().string()
+           << "pitch" << frame.orientation.pitch
+           << "roll" << frame.orientation.roll
+           << "yaw" << frame.orientation.yaw
+           << "R" << frame.R
+           << "}";
+    }
+    fs << "]";
+    return frames;
+}
+
+std::vector<SyntheticFrame> SyntheticPanorama::loadGroundTruth(const std::string &path)
+{
+    cv::FileStorage fs(path, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        throw std::invalid_argument("Can't read ground truth " + path);
+    }
+
+    const boost::filesystem::path directory = boost::filesystem::path(path).parent_path();
+    std::vector<SyntheticFrame> frames;
+    for (cv::FileNode node : fs["frames"]) {
+        SyntheticFrame frame;
+        frame.path = (directory / static_cast<std::string>(node["path"])).string();
+        frame.orientation = GimbalOrientation(static_cast<double>(node["pitch"]),
+                                              static_cast<double>(node["roll"]),
+                                              static_cast<double>(node["yaw"]));
+        node["R"] >> frame.R;
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+std::vector<GimbalOrientation> SyntheticPanorama::spiral(size_t count, double min_pitch,
+                                                         double max_pitch)
+{
+    // Evenly spaced heights are evenly spaced areas of the sphere, and the
+    // golden angle between consecutive frames spreads them around it.
+    const double golden_angle = 180. * (3. - std::sqrt(5.));
+    const double min_height = std::sin(min_pitch * M_PI / 180.);
+    const double max_height = std::sin(max_pitch * M_PI / 180.);
+
+    std::vector<GimbalOrientation> orientations;
+    for (size_t i = 0; i < count; ++i) {
+        double height = min_height
+                + (max_height - min_height) * (static_cast<double>(i) + 0.5)
+                        / static_cast<double>(count);
+        double yaw = std::fmod(static_cast<double>(i) * golden_angle, 360.);
+        orientations.emplace_back(std::asin(height) * 180. / M_PI, 0.,
+                                  yaw > 180. ? yaw - 360. : yaw);
+    }
+    return orientations;
+}
+
+} // namespace stitcher
+} // namespace airmap
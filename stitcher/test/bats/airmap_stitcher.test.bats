@@ -7,3 +7,63 @@
   panorama_size=$(stat -c %s panorama.jpg | numfmt --to=iec)
   [ "$panorama_size" = "3.0M" ]
 }
+
+@test "render panorama from recipe at several resolutions" {
+  input_images=$(find ../test/fixtures/panorama_aus_1 -name *.JPG | xargs)
+  ./airmap_stitcher --recipe_output recipe.yml.gz --output recipe.jpg $input_images
+  [ -f recipe.yml.gz ]
+  ./airmap_stitcher --recipe recipe.yml.gz --render=-1:render_full.jpg --render 0.5:render_small.jpg $input_images
+  [ -f render_full.jpg ]
+  [ -f render_small.jpg ]
+  [ $(stat -c %s render_small.jpg) -lt $(stat -c %s render_full.jpg) ]
+}
+
+@test "write preview before full quality panorama" {
+  input_images=$(find ../test/fixtures/panorama_aus_1 -name *.JPG | xargs)
+  output=$(./airmap_stitcher --preview --estimate_log --output preview.jpg $input_images)
+  # The preview is written again, rotated, if the 360 turns out upside down.
+  [ $(echo "$output" | grep -c "Output written: .* preview.jpg") -ge 2 ]
+  [ -f preview.jpg ]
+}
+
+@test "step down stitch settings to meet deadline" {
+  input_images=$(find ../test/fixtures/panorama_aus_1 -name *.JPG | xargs)
+  output=$(./airmap_stitcher --deadline 1 --output deadline.jpg $input_images)
+  echo "$output" | grep -q "stepping down seam_finder_type Voronoi"
+  [ -f deadline.jpg ]
+}
+
+@test "stitch batch of panoramas from a directory" {
+  mkdir -p batch
+  output=$(./airmap_stitcher --batch ../test/fixtures/panorama_aus_1 --batch_output batch)
+  echo "$output" | grep -q "Stitched 1 of 1 panoramas"
+  [ -f batch/P5050970.panorama.jpg ]
+}
+
+@test "stitch panorama submitted to daemon" {
+  input_images=$(find ../test/fixtures/panorama_aus_1 -name *.JPG | xargs)
+  ./airmap_stitcher --daemon daemon.sock > daemon.log &
+  daemon=$!
+  while [ ! -S daemon.sock ]; do sleep 1; done
+  output=$(./airmap_stitcher --submit daemon.sock --output daemon.jpg $input_images)
+  kill $daemon
+  echo "$output" | grep -q "progress"
+  echo "$output" | grep -q "done"
+  [ -f daemon.jpg ]
+}
+
+@test "daemon sets up each stitch faster than the command line" {
+  input_images=$(find ../test/fixtures/panorama_aus_1 -name *.JPG | xargs)
+  milliseconds() { echo "$1" | awk -F '[:.]' '{ print (($1 * 60 + $2) * 60 + $3) * 1000 + $4 }'; }
+  output=$(./airmap_stitcher --elapsed_time_log --output cold.jpg $input_images)
+  cold=$(echo "$output" | sed -n 's/^\[setup\]>Set up in \([0-9:.]*\) .*/\1/p')
+  ./airmap_stitcher --daemon setup.sock > setup.log &
+  daemon=$!
+  while [ ! -S setup.sock ]; do sleep 1; done
+  output=$(./airmap_stitcher --submit setup.sock --output warm.jpg $input_images)
+  kill $daemon
+  warm=$(echo "$output" | sed -n 's/^\[daemon\]>done \([0-9:.]*\) .*/\1/p')
+  [ -n "$cold" ]
+  [ -n "$warm" ]
+  [ $(milliseconds $warm) -lt $(milliseconds $cold) ]
+}
@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+
+#include "airmap/opencv/bundle_adjusters.h"
+#include "util/bundle_adjustment.h"
+
+#include <chrono>
+
+using airmap::stitcher::opencv::detail::SparseBundleAdjusterRay;
+using util::bundle_adjustment::Scene;
+using util::bundle_adjustment::makeScene;
+using util::bundle_adjustment::perturbed;
+
+/**
+ * Bundle adjustment of synthetic scenes of a growing number of cameras, to
+ * show how the cost of an iteration scales with it.
+ */
+static void BM_SparseBundleAdjusterRay(benchmark::State &state)
+{
+    const Scene scene = makeScene(static_cast<size_t>(state.range(0)));
+    SparseBundleAdjusterRay adjuster;
+
+    double seconds = 0.;
+    int iterations = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+        state.ResumeTiming();
+
+        const auto start = std::chrono::steady_clock::now();
+        adjuster(scene.features, scene.matches, cameras);
+        seconds += std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+        iterations += adjuster.iterations();
+    }
+
+    state.counters["cameras"] = static_cast<double>(state.range(0));
+    state.counters["iterations"] = benchmark::Counter(
+        iterations, benchmark::Counter::kAvgIterations);
+    state.counters["ms_per_iteration"] =
+        iterations > 0 ? seconds * 1000. / iterations : 0.;
+}
+BENCHMARK(BM_SparseBundleAdjusterRay)
+    ->Arg(25)
+    ->Arg(50)
+    ->Arg(100)
+    ->Arg(200)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,77 @@
+#include "pipeline.h"
+
+#include "airmap/camera.h"
+#include "airmap/camera_models.h"
+#include "airmap/distortion.h"
+
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::benchmarks::setThreads;
+using airmap::stitcher::benchmarks::stageArgs;
+using util::images::Images;
+
+namespace {
+
+/**
+ * @brief PinholeCamera
+ * The Parrot Anafi Thermal, whose images are undistorted with OpenCV's
+ * pinhole model.
+ */
+struct PinholeCamera {
+    static Camera get() { return CameraModels::ParrotAnafiThermal(true); }
+};
+
+/**
+ * @brief ScaramuzzaCamera
+ * The Vantage Vesper EO navigation camera, whose images are undistorted
+ * with the Scaramuzza fisheye model.
+ */
+struct ScaramuzzaCamera {
+    static Camera get() { return CameraModels::VantageVesperEONavigation(); }
+};
+
+/**
+ * @brief sensorImage
+ * A fixture image resized to the sensor of a camera, scaled.
+ */
+cv::Mat sensorImage(const Camera &camera, double scale)
+{
+    static const cv::Mat original =
+        cv::imread(Images::original().front().path);
+    const cv::Point2d pixels = camera.sensorDimensionsPixels();
+    cv::Mat image;
+    cv::resize(original, image,
+               cv::Size(static_cast<int>(pixels.x * scale),
+                        static_cast<int>(pixels.y * scale)),
+               0, 0, cv::INTER_AREA);
+    return image;
+}
+
+} // namespace
+
+/**
+ * Undistortion of an image, as loaded, by the distortion model of a camera.
+ */
+template <class CameraModel>
+static void BM_UndistortImage(benchmark::State &state)
+{
+    setThreads(state);
+    const double scale = static_cast<double>(state.range(0)) / 100.;
+    Camera camera = CameraModel::get();
+    const cv::Mat K = camera.K(scale);
+    const cv::Mat distorted = sensorImage(camera, scale);
+    for (auto _ : state) {
+        state.PauseTiming();
+        cv::Mat image = distorted.clone();
+        state.ResumeTiming();
+        camera.distortion_model->undistort(image, K);
+        benchmark::DoNotOptimize(image.data);
+    }
+    state.counters["megapixels"] = static_cast<double>(distorted.total()) / 1e6;
+}
+BENCHMARK_TEMPLATE(BM_UndistortImage, PinholeCamera)
+    ->Apply(stageArgs)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_UndistortImage, ScaramuzzaCamera)
+    ->Apply(stageArgs)
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "airmap/logging.h"
+#include "airmap/opencv_stitcher.h"
+#include "airmap/panorama.h"
+#include "airmap/stitcher_configuration.h"
+#include "util/images.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/stitching/detail/motion_estimators.hpp>
+
+namespace airmap {
+namespace stitcher {
+namespace benchmarks {
+
+/**
+ * @brief NullLogger
+ * Keeps the logs of the stages out of the benchmark output.
+ */
+class NullLogger : public logging::Logger {
+public:
+    void log(Severity, const char *, const char *) override {}
+    bool should_log(Severity, const char *, const char *) override { return false; }
+};
+
+/**
+ * @brief BenchmarkStitcher
+ * Exposes the stages of a stitch, to run them on their own.  The monitor
+ * is disabled, as it is by default.
+ */
+class BenchmarkStitcher : public LowLevelOpenCVStitcher {
+public:
+    explicit BenchmarkStitcher(const Panorama &panorama)
+        : LowLevelOpenCVStitcher(
+              Configuration(StitchType::ThreeSixty), panorama,
+              Panorama::Parameters{Panorama::Parameters::defaultMemoryBudgetMB()},
+              "", std::make_shared<NullLogger>())
+    {
+    }
+
+    const Panorama &panorama() const { return _panorama; }
+    EstimatorType estimatorType() const { return _config.estimator_type; }
+    void setEstimatorType(EstimatorType type)
+    {
+        _config.estimator_type = type;
+    }
+    float matchConfThresh() const
+    {
+        return static_cast<float>(_config.match_conf_thresh);
+    }
+
+    using LowLevelOpenCVStitcher::adjustCameraParameters;
+    using LowLevelOpenCVStitcher::compose;
+    using LowLevelOpenCVStitcher::estimateCameraParameters;
+    using LowLevelOpenCVStitcher::findFeatures;
+    using LowLevelOpenCVStitcher::findMedianFocalLength;
+    using LowLevelOpenCVStitcher::findSeams;
+    using LowLevelOpenCVStitcher::getComposeScale;
+    using LowLevelOpenCVStitcher::getSeamScale;
+    using LowLevelOpenCVStitcher::getWorkScale;
+    using LowLevelOpenCVStitcher::matchFeatures;
+    using LowLevelOpenCVStitcher::prepareExposureCompensation;
+    using LowLevelOpenCVStitcher::warpImages;
+    using LowLevelOpenCVStitcher::waveCorrect;
+};
+
+/**
+ * @brief Pipeline
+ * The inputs and outputs of each stage of a stitch of the panorama_aus_1
+ * fixtures, with the images scaled by a percentage, computed once per
+ * scale by running the stages in order, as LowLevelOpenCVStitcher::stitch
+ * does.  Each stage benchmark runs its stage on copies of its inputs.
+ */
+struct Pipeline {
+    using WarpResults = LowLevelOpenCVStitcher::WarpResults;
+
+    const double scale;
+    std::unique_ptr<BenchmarkStitcher> stitcher;
+    std::unique_ptr<SourceImages> source_images;
+
+    double work_scale, seam_scale, compose_scale;
+    std::vector<cv::Mat> input_images, work_images, seam_images,
+        compose_images;
+
+    std::vector<cv::detail::ImageFeatures> features;
+    std::vector<cv::detail::MatchesInfo> matches;
+    std::vector<cv::detail::CameraParams> cameras;
+    float warped_image_scale;
+
+    //! Warp results, before and after their seams are found.
+    std::unique_ptr<WarpResults> warped, seamed;
+    cv::Ptr<cv::detail::ExposureCompensator> exposure_compensator;
+
+    //! The composed panorama, and forced to 2x1 for its cubemap.
+    cv::Mat panorama, equirectangular;
+
+    /**
+     * @brief get
+     * The pipeline of the images scaled by scale_percent.
+     */
+    static Pipeline &get(int scale_percent)
+    {
+        static std::map<int, std::unique_ptr<Pipeline>> pipelines;
+        auto it = pipelines.find(scale_percent);
+        if (it == pipelines.end()) {
+            it = pipelines
+                     .emplace(scale_percent,
+                              std::unique_ptr<Pipeline>(new Pipeline(
+                                  static_cast<double>(scale_percent) / 100.)))
+                     .first;
+        }
+        return *it->second;
+    }
+
+    /**
+     * @brief images
+     * The source images, with their scaled images set to those given, as
+     * a stage reads them.
+     */
+    SourceImages &images(const std::vector<cv::Mat> &scaled)
+    {
+        source_images->images = input_images;
+        source_images->images_scaled = scaled;
+        return *source_images;
+    }
+
+    /**
+     * @brief clone
+     * A deep copy of warp results, which the stages change in place.
+     */
+    static WarpResults clone(const WarpResults &results)
+    {
+        WarpResults copy(results.corners.size());
+        copy.corners = results.corners;
+        copy.sizes = results.sizes;
+        copy.overlaps = results.overlaps;
+        for (size_t i = 0; i < results.corners.size(); ++i) {
+            results.masks_warped[i].copyTo(copy.masks_warped[i]);
+            results.images_warped[i].copyTo(copy.images_warped[i]);
+            results.images_warped_f[i].copyTo(copy.images_warped_f[i]);
+            results.masks[i].copyTo(copy.masks[i]);
+        }
+        return copy;
+    }
+
+private:
+    explicit Pipeline(double _scale)
+        : scale(_scale)
+        , stitcher(new BenchmarkStitcher(
+              Panorama{util::images::Images::original()}))
+        , source_images(new SourceImages(stitcher->panorama(),
+                                         std::make_shared<NullLogger>()))
+    {
+        for (auto &image : source_images->images) {
+            cv::resize(image, image, cv::Size(), scale, scale, cv::INTER_AREA);
+        }
+        input_images = source_images->images;
+
+        work_scale = stitcher->getWorkScale(*source_images);
+        seam_scale = stitcher->getSeamScale(*source_images);
+        compose_scale = stitcher->getComposeScale(*source_images);
+        source_images->scale(work_scale);
+        work_images = source_images->images_scaled;
+
+        features = stitcher->findFeatures(work_images);
+        matches = stitcher->matchFeatures(features);
+        std::vector<int> keep_indices =
+            cv::detail::leaveBiggestComponent(features, matches,
+                                              stitcher->matchConfThresh());
+        source_images->filter(keep_indices);
+        input_images = source_images->images;
+        work_images = source_images->images_scaled;
+
+        Stitcher::Report report;
+        cameras = stitcher->estimateCameraParameters(*source_images, features,
+                                                     matches);
+        stitcher->adjustCameraParameters(features, matches, cameras, report);
+        stitcher->waveCorrect(cameras);
+        warped_image_scale =
+            static_cast<float>(stitcher->findMedianFocalLength(cameras));
+
+        source_images->scale(seam_scale);
+        seam_images = source_images->images_scaled;
+        warped.reset(new WarpResults(stitcher->warpImages(
+            *source_images, cameras, warped_image_scale,
+            static_cast<float>(seam_scale / work_scale))));
+        exposure_compensator =
+            stitcher->prepareExposureCompensation(*warped);
+        seamed.reset(new WarpResults(clone(*warped)));
+        stitcher->findSeams(*seamed);
+
+        source_images->scale(compose_scale);
+        compose_images = source_images->images_scaled;
+        WarpResults composed = clone(*seamed);
+        std::vector<cv::detail::CameraParams> compose_cameras = cameras;
+        stitcher->compose(*source_images, compose_cameras, exposure_compensator,
+                          composed, work_scale, compose_scale,
+                          warped_image_scale, panorama);
+
+        // Forced to 2x1 as the postprocessing of a stitch does, padded with
+        // sky or cropped.
+        const int left_padding = panorama.cols % 2;
+        const int top_padding = (panorama.cols + left_padding) / 2 - panorama.rows;
+        if (top_padding >= 0) {
+            cv::copyMakeBorder(panorama, equirectangular, top_padding, 0,
+                               left_padding, 0, cv::BORDER_REPLICATE);
+        } else {
+            const int cols = panorama.cols - left_padding;
+            equirectangular = panorama(
+                cv::Rect{0, panorama.rows - cols / 2, cols, cols / 2});
+        }
+    }
+};
+
+/**
+ * @brief threadCounts
+ * The numbers of OpenCV threads a stage is benchmarked with: one, and one
+ * per hardware thread.
+ */
+inline std::vector<int> threadCounts()
+{
+    const int hardware_threads =
+        static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    if (hardware_threads == 1) {
+        return {1};
+    }
+    return {1, hardware_threads};
+}
+
+/**
+ * @brief stageArgs
+ * The arguments of a stage benchmark: the percentage the fixtures are
+ * scaled by, and the number of OpenCV threads.
+ */
+inline void stageArgs(benchmark::internal::Benchmark *benchmark)
+{
+    benchmark->ArgNames({"scale", "threads"});
+    for (int scale : {25, 50}) {
+        for (int threads : threadCounts()) {
+            benchmark->Args({scale, threads});
+        }
+    }
+}
+
+/**
+ * @brief setThreads
+ * Set the number of OpenCV threads of a stage benchmark, and report it
+ * and the scale as counters of its JSON output.
+ */
+inline void setThreads(benchmark::State &state)
+{
+    cv::setNumThreads(static_cast<int>(state.range(1)));
+    state.counters["scale"] = static_cast<double>(state.range(0)) / 100.;
+    state.counters["threads"] = static_cast<double>(state.range(1));
+}
+
+} // namespace benchmarks
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,47 @@
+#include "pipeline.h"
+
+#include "cropper.h"
+#include "cubemap.h"
+
+using airmap::stitcher::benchmarks::Pipeline;
+using airmap::stitcher::benchmarks::setThreads;
+using airmap::stitcher::benchmarks::stageArgs;
+
+/**
+ * Cropping of the null edges of the composed panorama.
+ */
+static void BM_Cropper(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(Cropper{}.cropNullEdges(pipeline.panorama));
+    }
+    state.counters["megapixels"] =
+        static_cast<double>(pipeline.panorama.total()) / 1e6;
+}
+BENCHMARK(BM_Cropper)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
+
+/**
+ * Projection of the six faces of the cubemap of the panorama, without
+ * writing them.
+ */
+static void BM_CubeMap(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    const int face_dimension = pipeline.equirectangular.cols / 4;
+    for (auto _ : state) {
+        for (int face = 0; face < static_cast<int>(CubeMap::Face::NumFaces);
+             ++face) {
+            cv::Mat out;
+            CubeMap::createFace(pipeline.equirectangular, out,
+                                static_cast<CubeMap::Face>(face),
+                                face_dimension, face_dimension);
+            benchmark::DoNotOptimize(out.data);
+        }
+    }
+    state.counters["megapixels"] =
+        static_cast<double>(pipeline.equirectangular.total()) / 1e6;
+}
+BENCHMARK(BM_CubeMap)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
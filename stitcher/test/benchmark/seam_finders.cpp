@@ -0,0 +1,233 @@
+#include <benchmark/benchmark.h>
+
+#include "airmap/camera_models.h"
+#include "airmap/logging.h"
+#include "airmap/monitor/estimator.h"
+#include "airmap/monitor/monitor.h"
+#include "airmap/opencv/grid_graph.h"
+#include "airmap/opencv/seam_finders.h"
+#include "airmap/opencv/seam_graph.h"
+#include "util/images.h"
+
+#include <algorithm>
+#include <map>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgproc/detail/gcgraph.hpp>
+
+using airmap::logging::stdoe_logger;
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::monitor::Monitor;
+using airmap::stitcher::monitor::OperationsEstimator;
+using airmap::stitcher::opencv::detail::GridGraph;
+using airmap::stitcher::opencv::detail::MaxFlowType;
+using airmap::stitcher::opencv::detail::MonitoredGraphCutSeamFinder;
+using airmap::stitcher::opencv::detail::SeamGraphWorkspace;
+using airmap::stitcher::opencv::detail::buildSeamGraph;
+using airmap::stitcher::opencv::detail::seamGraphWeightsColorGrad;
+using cv::detail::GCGraph;
+using util::images::Images;
+
+namespace {
+
+/**
+ * @brief Overlap
+ * The overlap ROI of two warped fixture images, each offset by half of its
+ * width from the previous one, as the seam finder would see it.  The first
+ * image covers the left two thirds, the second image the right two thirds.
+ */
+struct Overlap {
+    cv::Mat img1, img2, dx1, dx2, dy1, dy2, mask1, mask2;
+
+    static const Overlap &get(double scale)
+    {
+        static std::map<double, Overlap> overlaps;
+        auto it = overlaps.find(scale);
+        if (it != overlaps.end()) {
+            return it->second;
+        }
+
+        std::vector<cv::Mat> warped = Images::warped();
+        cv::Mat resized1, resized2;
+        cv::resize(warped[0], resized1, cv::Size(), scale, scale);
+        cv::resize(warped[1], resized2, cv::Size(), scale, scale);
+
+        Overlap overlap;
+        const int offset = resized1.cols / 2;
+        const int width = std::min(resized1.cols - offset, resized2.cols);
+        const int height = std::min(resized1.rows, resized2.rows);
+        resized1(cv::Rect(offset, 0, width, height))
+            .convertTo(overlap.img1, CV_32F);
+        resized2(cv::Rect(0, 0, width, height))
+            .convertTo(overlap.img2, CV_32F);
+        gradients(overlap.img1, overlap.dx1, overlap.dy1);
+        gradients(overlap.img2, overlap.dx2, overlap.dy2);
+
+        overlap.mask1 = cv::Mat::zeros(height, width, CV_8U);
+        overlap.mask2 = cv::Mat::zeros(height, width, CV_8U);
+        overlap.mask1.colRange(0, (width * 2) / 3).setTo(255);
+        overlap.mask2.colRange(width / 3, width).setTo(255);
+        return overlaps.emplace(scale, overlap).first->second;
+    }
+
+private:
+    static void gradients(const cv::Mat &img, cv::Mat &dx, cv::Mat &dy)
+    {
+        cv::Mat sobel_dx, sobel_dy;
+        cv::Sobel(img, sobel_dx, CV_32F, 1, 0);
+        cv::Sobel(img, sobel_dy, CV_32F, 0, 1);
+        cv::multiply(sobel_dx, sobel_dx, sobel_dx);
+        cv::multiply(sobel_dy, sobel_dy, sobel_dy);
+        cv::transform(sobel_dx, dx, cv::Matx13f(1.f, 1.f, 1.f));
+        cv::transform(sobel_dy, dy, cv::Matx13f(1.f, 1.f, 1.f));
+    }
+};
+
+struct Weights {
+    SeamGraphWorkspace workspace;
+    cv::Mat horizontal, vertical;
+
+    explicit Weights(const Overlap &overlap) { compute(overlap); }
+
+    void compute(const Overlap &overlap)
+    {
+        seamGraphWeightsColorGrad(overlap.img1, overlap.img2, overlap.dx1,
+                                  overlap.dx2, overlap.dy1, overlap.dy2,
+                                  overlap.mask1, overlap.mask2, 1000.f,
+                                  workspace, horizontal, vertical);
+    }
+};
+
+double scaleArg(const benchmark::State &state)
+{
+    return static_cast<double>(state.range(0)) / 100.;
+}
+
+template <class Graph>
+Graph createGraph(const Overlap &overlap);
+
+template <>
+GCGraph<float> createGraph<GCGraph<float>>(const Overlap &overlap)
+{
+    const int vertex_count = overlap.img1.rows * overlap.img1.cols;
+    return GCGraph<float>(vertex_count, 4 * vertex_count);
+}
+
+template <>
+GridGraph createGraph<GridGraph>(const Overlap &overlap)
+{
+    return GridGraph(overlap.img1.cols, overlap.img1.rows);
+}
+
+} // namespace
+
+/**
+ * Edge weight computation, shared by both graph types.
+ */
+static void BM_SeamGraphWeights(benchmark::State &state)
+{
+    const Overlap &overlap = Overlap::get(scaleArg(state));
+    Weights weights(overlap);
+    for (auto _ : state) {
+        weights.compute(overlap);
+        benchmark::ClobberMemory();
+    }
+    state.counters["vertices"] = overlap.img1.rows * overlap.img1.cols;
+}
+BENCHMARK(BM_SeamGraphWeights)->Arg(25)->Arg(50)->Unit(benchmark::kMillisecond);
+
+/**
+ * Graph construction from precomputed weights, excluding max-flow.
+ */
+template <class Graph>
+static void BM_SeamGraphBuild(benchmark::State &state)
+{
+    const Overlap &overlap = Overlap::get(scaleArg(state));
+    Weights weights(overlap);
+    for (auto _ : state) {
+        Graph graph = createGraph<Graph>(overlap);
+        buildSeamGraph(overlap.mask1, overlap.mask2, 10000.f,
+                       weights.horizontal, weights.vertical, graph);
+        benchmark::ClobberMemory();
+    }
+    state.counters["vertices"] = overlap.img1.rows * overlap.img1.cols;
+}
+BENCHMARK_TEMPLATE(BM_SeamGraphBuild, GCGraph<float>)
+    ->Arg(25)
+    ->Arg(50)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SeamGraphBuild, GridGraph)
+    ->Arg(25)
+    ->Arg(50)
+    ->Unit(benchmark::kMillisecond);
+
+/**
+ * Max-flow only, the graph is built outside of the timed region.
+ */
+template <class Graph>
+static void BM_SeamGraphMaxFlow(benchmark::State &state)
+{
+    const Overlap &overlap = Overlap::get(scaleArg(state));
+    Weights weights(overlap);
+    for (auto _ : state) {
+        state.PauseTiming();
+        Graph graph = createGraph<Graph>(overlap);
+        buildSeamGraph(overlap.mask1, overlap.mask2, 10000.f,
+                       weights.horizontal, weights.vertical, graph);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(graph.maxFlow());
+    }
+    state.counters["vertices"] = overlap.img1.rows * overlap.img1.cols;
+}
+BENCHMARK_TEMPLATE(BM_SeamGraphMaxFlow, GCGraph<float>)
+    ->Arg(25)
+    ->Arg(50)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_SeamGraphMaxFlow, GridGraph)
+    ->Arg(25)
+    ->Arg(50)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_GraphCutSeamFinder(benchmark::State &state)
+{
+    const size_t image_count = 4;
+    const double scale = 0.25;
+    const MaxFlowType max_flow_type = static_cast<MaxFlowType>(state.range(0));
+
+    std::vector<cv::Mat> warped = Images::warped();
+    std::vector<cv::UMat> images(image_count);
+    std::vector<cv::Point> corners(image_count);
+    int x = 0;
+    for (size_t i = 0; i < image_count; ++i) {
+        cv::Mat resized;
+        cv::resize(warped[i], resized, cv::Size(), scale, scale);
+        resized.convertTo(images[i], CV_32F);
+        corners[i] = cv::Point(x, 0);
+        x += resized.cols / 2;
+    }
+
+    auto logger = std::make_shared<stdoe_logger>();
+    auto camera =
+        std::make_shared<Camera>(CameraModels::ParrotAnafiThermal());
+    auto monitor =
+        Monitor::create(OperationsEstimator::create(camera, logger), logger);
+    MonitoredGraphCutSeamFinder seam_finder(
+        monitor, cv::detail::GraphCutSeamFinder::COST_COLOR_GRAD, 10000.f,
+        1000.f, max_flow_type);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::vector<cv::UMat> masks(image_count);
+        for (size_t i = 0; i < image_count; ++i) {
+            masks[i].create(images[i].size(), CV_8U);
+            masks[i].setTo(cv::Scalar::all(255));
+        }
+        state.ResumeTiming();
+        seam_finder.find(images, corners, masks);
+    }
+}
+BENCHMARK(BM_GraphCutSeamFinder)
+    ->Arg(static_cast<int>(MaxFlowType::Generic))
+    ->Arg(static_cast<int>(MaxFlowType::Grid))
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,204 @@
+#include "pipeline.h"
+
+using airmap::stitcher::EstimatorType;
+using airmap::stitcher::Panorama;
+using airmap::stitcher::SourceImages;
+using airmap::stitcher::Stitcher;
+using airmap::stitcher::benchmarks::NullLogger;
+using airmap::stitcher::benchmarks::Pipeline;
+using airmap::stitcher::benchmarks::setThreads;
+using airmap::stitcher::benchmarks::stageArgs;
+using airmap::stitcher::benchmarks::threadCounts;
+using util::images::Images;
+
+namespace {
+
+/**
+ * @brief loadArgs
+ * Images are loaded at full size, i.e. a scale of 100%.
+ */
+void loadArgs(benchmark::internal::Benchmark *benchmark)
+{
+    benchmark->ArgNames({"scale", "threads"});
+    for (int threads : threadCounts()) {
+        benchmark->Args({100, threads});
+    }
+}
+
+/**
+ * @brief estimatorArgs
+ * The stage arguments, with each estimator of the initial cameras.
+ */
+void estimatorArgs(benchmark::internal::Benchmark *benchmark)
+{
+    benchmark->ArgNames({"scale", "threads", "estimator"});
+    for (int scale : {25, 50}) {
+        for (int threads : threadCounts()) {
+            for (EstimatorType estimator :
+                 {EstimatorType::Homography, EstimatorType::Gimbal}) {
+                benchmark->Args({scale, threads, static_cast<int>(estimator)});
+            }
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * Decoding of the fixtures and their metadata.
+ */
+static void BM_LoadImages(benchmark::State &state)
+{
+    setThreads(state);
+    static const Panorama panorama{Images::original()};
+    for (auto _ : state) {
+        SourceImages source_images(panorama, std::make_shared<NullLogger>());
+        benchmark::DoNotOptimize(source_images.images.data());
+    }
+    state.counters["images"] = static_cast<double>(panorama.size());
+}
+BENCHMARK(BM_LoadImages)->Apply(loadArgs)->Unit(benchmark::kMillisecond);
+
+static void BM_FindFeatures(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            pipeline.stitcher->findFeatures(pipeline.work_images));
+    }
+    state.counters["images"] = static_cast<double>(pipeline.work_images.size());
+}
+BENCHMARK(BM_FindFeatures)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
+
+static void BM_MatchFeatures(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto features = pipeline.features;
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(pipeline.stitcher->matchFeatures(features));
+    }
+    state.counters["images"] = static_cast<double>(pipeline.features.size());
+}
+BENCHMARK(BM_MatchFeatures)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
+
+/**
+ * Estimation of the cameras, and their bundle adjustment, which starts from
+ * cameras as good as the estimator's.
+ */
+static void BM_EstimateCameraParameters(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    SourceImages &source_images = pipeline.images(pipeline.work_images);
+    const EstimatorType estimator_type = pipeline.stitcher->estimatorType();
+    pipeline.stitcher->setEstimatorType(
+        static_cast<EstimatorType>(state.range(2)));
+    double iterations = 0.;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto features = pipeline.features;
+        auto matches = pipeline.matches;
+        Stitcher::Report report;
+        state.ResumeTiming();
+        auto cameras = pipeline.stitcher->estimateCameraParameters(
+            source_images, features, matches);
+        pipeline.stitcher->adjustCameraParameters(features, matches, cameras,
+                                                  report);
+        benchmark::DoNotOptimize(cameras.data());
+        iterations += report.bundleAdjustmentIterations;
+    }
+    pipeline.stitcher->setEstimatorType(estimator_type);
+    state.counters["images"] = static_cast<double>(pipeline.features.size());
+    state.counters["ba_iterations"] =
+        benchmark::Counter(iterations, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_EstimateCameraParameters)
+    ->Apply(estimatorArgs)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_WarpImages(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    const float seam_work_aspect =
+        static_cast<float>(pipeline.seam_scale / pipeline.work_scale);
+    for (auto _ : state) {
+        state.PauseTiming();
+        SourceImages &source_images = pipeline.images(pipeline.seam_images);
+        auto cameras = pipeline.cameras;
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(pipeline.stitcher->warpImages(
+            source_images, cameras, pipeline.warped_image_scale,
+            seam_work_aspect));
+    }
+    state.counters["images"] = static_cast<double>(pipeline.seam_images.size());
+}
+BENCHMARK(BM_WarpImages)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
+
+/**
+ * Feeding the warped images to the exposure compensator.
+ */
+static void BM_PrepareExposureCompensation(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        Pipeline::WarpResults warp_results = Pipeline::clone(*pipeline.warped);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(
+            pipeline.stitcher->prepareExposureCompensation(warp_results));
+    }
+    state.counters["images"] =
+        static_cast<double>(pipeline.warped->corners.size());
+}
+BENCHMARK(BM_PrepareExposureCompensation)
+    ->Apply(stageArgs)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_FindSeams(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        Pipeline::WarpResults warp_results = Pipeline::clone(*pipeline.warped);
+        state.ResumeTiming();
+        pipeline.stitcher->findSeams(warp_results);
+        benchmark::ClobberMemory();
+    }
+    state.counters["images"] =
+        static_cast<double>(pipeline.warped->corners.size());
+}
+BENCHMARK(BM_FindSeams)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
+
+/**
+ * Composition of the panorama from the seams, with exposure compensation
+ * and blending.
+ */
+static void BM_Compose(benchmark::State &state)
+{
+    setThreads(state);
+    Pipeline &pipeline = Pipeline::get(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        state.PauseTiming();
+        SourceImages &source_images = pipeline.images(pipeline.compose_images);
+        source_images.images.clear();
+        auto cameras = pipeline.cameras;
+        Pipeline::WarpResults warp_results = Pipeline::clone(*pipeline.seamed);
+        cv::Mat result;
+        state.ResumeTiming();
+        pipeline.stitcher->compose(source_images, cameras,
+                                   pipeline.exposure_compensator, warp_results,
+                                   pipeline.work_scale, pipeline.compose_scale,
+                                   pipeline.warped_image_scale, result);
+        benchmark::DoNotOptimize(result.data);
+    }
+    state.counters["megapixels"] =
+        static_cast<double>(pipeline.panorama.total()) / 1e6;
+}
+BENCHMARK(BM_Compose)->Apply(stageArgs)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,184 @@
+#include "gtest/gtest.h"
+#include "airmap/admission.h"
+#include "airmap/memory_planner.h"
+
+#include <algorithm>
+#include <list>
+#include <random>
+
+using airmap::stitcher::AdmissionController;
+using airmap::stitcher::Configuration;
+using airmap::stitcher::GeoImage;
+using airmap::stitcher::MemoryPlan;
+using airmap::stitcher::MemoryPlanner;
+using airmap::stitcher::Panorama;
+using airmap::stitcher::StitchType;
+using airmap::stitcher::monitor::Operation;
+
+namespace {
+
+/**
+ * @brief SimulatedJob
+ * A stitch whose duration is proportional to its predicted peak memory.
+ */
+struct SimulatedJob
+{
+    size_t peakMB;
+    double duration;
+};
+
+/**
+ * @brief jobMix
+ * Synthetic panoramas of 20 to 80 images of 2 to 20 megapixels.
+ */
+std::vector<SimulatedJob> jobMix(size_t count, unsigned int seed,
+                                 const Panorama::Parameters &parameters)
+{
+    std::mt19937 generator(seed);
+    std::uniform_int_distribution<size_t> images(20, 80);
+    std::uniform_int_distribution<size_t> megapixels(2, 20);
+
+    std::vector<SimulatedJob> jobs;
+    for (size_t i = 0; i < count; ++i) {
+        size_t peakMB = AdmissionController::predictPeakMB(
+                images(generator), megapixels(generator) * 1000000, parameters);
+        jobs.push_back({ peakMB, peakMB / 1000. });
+    }
+    return jobs;
+}
+
+/**
+ * @brief simulate
+ * Run the jobs, the largest first, admitting the first pending jobs that
+ * fit whenever one ends, and check the budgets at every admission.
+ * @return The time the last job ended.
+ */
+double simulate(std::vector<SimulatedJob> jobs, size_t memoryBudgetMB,
+                size_t maxJobs, size_t &maxRunning)
+{
+    std::sort(jobs.begin(), jobs.end(), [](const SimulatedJob &a, const SimulatedJob &b) {
+        return a.peakMB > b.peakMB;
+    });
+    std::list<SimulatedJob> pending(jobs.begin(), jobs.end());
+    std::vector<std::pair<double, AdmissionController::Admission>> running;
+
+    AdmissionController admissions(memoryBudgetMB, maxJobs);
+    double now = 0;
+    maxRunning = 0;
+    while (!pending.empty() || !running.empty()) {
+        for (auto it = pending.begin(); it != pending.end();) {
+            AdmissionController::Admission admission;
+            if (!admissions.admit(it->peakMB, admission)) {
+                ++it;
+                continue;
+            }
+            EXPECT_EQ(admission.memoryBudgetMB,
+                      std::min(it->peakMB, memoryBudgetMB));
+            running.emplace_back(now + it->duration, admission);
+            it = pending.erase(it);
+
+            size_t usedMemoryMB = 0;
+            for (const auto &job : running) {
+                usedMemoryMB += job.second.memoryBudgetMB;
+            }
+            EXPECT_LE(usedMemoryMB, memoryBudgetMB);
+            EXPECT_LE(running.size(), maxJobs);
+            maxRunning = std::max(maxRunning, running.size());
+        }
+
+        // The next job to end.
+        auto next = std::min_element(
+                running.begin(), running.end(),
+                [](const std::pair<double, AdmissionController::Admission> &a,
+                   const std::pair<double, AdmissionController::Admission> &b) {
+                    return a.first < b.first;
+                });
+        EXPECT_NE(next, running.end());
+        now = next->first;
+        admissions.release(next->second);
+        running.erase(next);
+    }
+
+    EXPECT_EQ(admissions.running(), 0);
+    EXPECT_EQ(admissions.availableMemoryMB(), memoryBudgetMB);
+    return now;
+}
+
+} // namespace
+
+TEST(admission, predictPeakMB)
+{
+    Panorama::Parameters parameters(16000);
+    parameters.maxInputImageSize = 10000000;
+
+    // 20 images of 1024x1024 pixels, which aren't scaled, peak when the
+    // panorama is composed.
+    const MemoryPlan plan = MemoryPlanner(Configuration(StitchType::ThreeSixty), parameters)
+                                    .predict(20, 1024 * 1024, 1., 1.);
+    EXPECT_EQ(AdmissionController::predictPeakMB(20, 1024 * 1024, parameters),
+              plan.peakMB());
+    EXPECT_EQ(plan.peakMB(), plan.peaksMB.at(Operation::Enum::Compose));
+
+    // Images are scaled down to maxInputImageSize, which is assumed when
+    // their size is unknown.
+    EXPECT_EQ(AdmissionController::predictPeakMB(20, 20000000, parameters),
+              AdmissionController::predictPeakMB(20, 10000000, parameters));
+    EXPECT_EQ(AdmissionController::predictPeakMB(20, 0, parameters),
+              AdmissionController::predictPeakMB(20, 10000000, parameters));
+
+    Panorama panorama;
+    for (time_t i = 0; i < 20; ++i) {
+        panorama.add(GeoImage { "a/" + std::to_string(i) + ".jpg", { 8., 47. },
+                                "Parrot", "ANAFI", 0., 0., 0., i, i, 1024, 1024 });
+    }
+    EXPECT_EQ(AdmissionController::predictPeakMB(panorama, parameters),
+              AdmissionController::predictPeakMB(20, 1024 * 1024, parameters));
+}
+
+TEST(admission, admit)
+{
+    AdmissionController admissions(1000, 2);
+    AdmissionController::Admission a, b, c;
+
+    EXPECT_TRUE(admissions.admit(500, a));
+    EXPECT_EQ(a.memoryBudgetMB, 500);
+    EXPECT_TRUE(admissions.admit(400, b));
+    EXPECT_EQ(b.memoryBudgetMB, 400);
+
+    // No job is left, then not enough memory.
+    EXPECT_FALSE(admissions.admit(100, c));
+    admissions.release(a);
+    EXPECT_FALSE(admissions.admit(700, c));
+    EXPECT_TRUE(admissions.admit(100, c));
+    EXPECT_EQ(c.memoryBudgetMB, 100);
+    admissions.release(b);
+    admissions.release(c);
+
+    // A stitch larger than the whole budget runs alone with all of it.
+    EXPECT_TRUE(admissions.admit(5000, a));
+    EXPECT_EQ(a.memoryBudgetMB, 1000);
+    EXPECT_FALSE(admissions.admit(1, b));
+}
+
+TEST(admission, simulatedJobMixes)
+{
+    Panorama::Parameters parameters(0);
+    parameters.maxInputImageSize = 12740198;
+
+    for (unsigned int seed = 0; seed < 20; ++seed) {
+        std::vector<SimulatedJob> jobs = jobMix(30, seed, parameters);
+
+        size_t serialRunning = 0, packedRunning = 0;
+        double serial = simulate(jobs, 64000, 1, serialRunning);
+        double packed = simulate(jobs, 64000, 8, packedRunning);
+
+        EXPECT_EQ(serialRunning, 1);
+        EXPECT_GT(packedRunning, 1);
+        EXPECT_LT(packed, serial);
+    }
+
+    // A host too small for any of the jobs runs them one at a time.
+    size_t maxRunning = 0;
+    simulate(jobMix(10, 1, parameters), 500, 8, maxRunning);
+    EXPECT_EQ(maxRunning, 1);
+}
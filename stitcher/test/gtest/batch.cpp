@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "airmap/batch.h"
+
+using airmap::stitcher::BatchStitcher;
+using airmap::stitcher::GeoImage;
+using airmap::stitcher::Panorama;
+
+namespace {
+
+GeoImage image(const std::string &path, double lng, double lat, time_t created)
+{
+    return GeoImage { path, { lng, lat }, "Parrot", "ANAFI", 0., 0., 0., created, created };
+}
+
+/**
+ * @brief flight
+ * Images of two panoramas, taken a few seconds apart at two spots 100
+ * metres apart, and a stray image, out of time order.
+ */
+std::vector<GeoImage> flight()
+{
+    std::vector<GeoImage> images;
+    for (int i = 0; i < 4; ++i) {
+        images.push_back(image("flight/b" + std::to_string(i) + ".jpg", 8.0009, 47.0, 1000 + 2 * i));
+        images.push_back(image("flight/a" + std::to_string(i) + ".jpg", 8.0, 47.0, 100 + 2 * i));
+    }
+    images.push_back(image("flight/c0.jpg", 8.0, 47.0, 5000));
+    return images;
+}
+
+} // namespace
+
+TEST(batch, group)
+{
+    std::vector<Panorama> panoramas = BatchStitcher::group(flight(), 2);
+    ASSERT_EQ(panoramas.size(), 2);
+    EXPECT_EQ(panoramas[0].size(), 4);
+    EXPECT_EQ(panoramas[0].front().path, "flight/a0.jpg");
+    EXPECT_EQ(panoramas[1].size(), 4);
+    EXPECT_EQ(panoramas[1].front().path, "flight/b0.jpg");
+
+    EXPECT_EQ(BatchStitcher::group(flight(), 1).size(), 3);
+    EXPECT_EQ(BatchStitcher::group(flight(), 5).size(), 0);
+    EXPECT_EQ(BatchStitcher::group({}, 1).size(), 0);
+}
+
+TEST(batch, jobs)
+{
+    std::vector<Panorama> panoramas = BatchStitcher::group(flight(), 2);
+
+    auto jobs = BatchStitcher::jobs(panoramas);
+    ASSERT_EQ(jobs.size(), 2);
+    EXPECT_EQ(jobs[0].outputPath, "flight/a0.panorama.jpg");
+    EXPECT_EQ(jobs[1].outputPath, "flight/b0.panorama.jpg");
+
+    jobs = BatchStitcher::jobs(panoramas, "out");
+    EXPECT_EQ(jobs[0].outputPath, "out/a0.panorama.jpg");
+}
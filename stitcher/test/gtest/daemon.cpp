@@ -0,0 +1,165 @@
+#include "gtest/gtest.h"
+#include "airmap/daemon.h"
+
+#include <boost/filesystem.hpp>
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <thread>
+
+using airmap::logging::stdoe_logger;
+using airmap::stitcher::Configuration;
+using airmap::stitcher::Panorama;
+using airmap::stitcher::StitchDaemon;
+using airmap::stitcher::StitchType;
+using boost::filesystem::path;
+
+class DaemonTest : public ::testing::Test
+{
+protected:
+    DaemonTest()
+        : directory(boost::filesystem::temp_directory_path()
+                    / boost::filesystem::unique_path("daemon-%%%%-%%%%"))
+        , socketPath((directory / "daemon.sock").string())
+        , daemon(socketPath, Configuration(StitchType::ThreeSixty),
+                 Panorama::Parameters { 2000 }, 2, std::make_shared<stdoe_logger>())
+    {
+        boost::filesystem::create_directories(directory);
+    }
+
+    ~DaemonTest() { boost::filesystem::remove_all(directory); }
+
+    void SetUp() override
+    {
+        running = std::thread([this]() { daemon.run(); });
+        // The daemon warms up before it listens.
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+        while (std::chrono::steady_clock::now() < deadline) {
+            try {
+                StitchDaemon::Client probe(socketPath);
+                return;
+            } catch (const std::runtime_error &) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+        FAIL() << "The daemon isn't listening on " << socketPath;
+    }
+
+    void TearDown() override
+    {
+        daemon.stop();
+        running.join();
+    }
+
+    /**
+     * @brief request
+     * A request to stitch the images of panorama_aus_1 to output.
+     */
+    StitchDaemon::Request request(const std::string &output)
+    {
+        path imageDirectory =
+                path(__FILE__).parent_path() / ".." / "fixtures" / "panorama_aus_1";
+        StitchDaemon::Request request { {}, (directory / output).string(),
+                                        Panorama::Parameters { 2000 }, false };
+        for (const auto &entry : boost::filesystem::directory_iterator(imageDirectory)) {
+            if (entry.path().extension() == ".JPG") {
+                request.inputPaths.push_back(entry.path().string());
+            }
+        }
+        return request;
+    }
+
+    path directory;
+    std::string socketPath;
+    StitchDaemon daemon;
+    std::thread running;
+};
+
+TEST(daemon, parseRequest)
+{
+    Panorama::Parameters defaults { 1000 };
+    StitchDaemon::Request request = StitchDaemon::Request::parse(
+            "stitch\tinput=/a.jpg\tinput=/b.jpg\toutput=/p.jpg\tdeadline=60\tpreview=1",
+            defaults);
+    EXPECT_EQ(request.inputPaths, std::vector<std::string>({ "/a.jpg", "/b.jpg" }));
+    EXPECT_EQ(request.outputPath, "/p.jpg");
+    EXPECT_EQ(request.parameters.memoryBudgetMB, 1000);
+    EXPECT_EQ(request.parameters.deadlineSeconds, 60);
+    EXPECT_EQ(request.parameters.retries, defaults.retries);
+    EXPECT_TRUE(request.preview);
+
+    StitchDaemon::Request parsed = StitchDaemon::Request::parse(request.str(), defaults);
+    EXPECT_EQ(parsed.str(), request.str());
+}
+
+TEST(daemon, parseInvalidRequest)
+{
+    Panorama::Parameters defaults { 1000 };
+    EXPECT_THROW(StitchDaemon::Request::parse("cancel", defaults), std::invalid_argument);
+    EXPECT_THROW(StitchDaemon::Request::parse("stitch\toutput=/p.jpg", defaults),
+                 std::invalid_argument);
+    EXPECT_THROW(StitchDaemon::Request::parse("stitch\tinput=/a.jpg", defaults),
+                 std::invalid_argument);
+    EXPECT_THROW(StitchDaemon::Request::parse("stitch\tinput=/a.jpg\toutput=/p.jpg\tcolor=1",
+                                              defaults),
+                 std::invalid_argument);
+}
+
+TEST_F(DaemonTest, restrictSocketToOwner)
+{
+    struct stat status;
+    ASSERT_EQ(::stat(socketPath.c_str(), &status), 0);
+    EXPECT_TRUE(S_ISSOCK(status.st_mode));
+    EXPECT_EQ(status.st_mode & 0777, 0600);
+}
+
+TEST_F(DaemonTest, refuseSocketOfAnotherDaemon)
+{
+    StitchDaemon other(socketPath, Configuration(StitchType::ThreeSixty),
+                       Panorama::Parameters { 2000 }, 1, std::make_shared<stdoe_logger>());
+    EXPECT_THROW(other.run(), std::runtime_error);
+    // The socket is still the first daemon's.
+    EXPECT_NO_THROW(StitchDaemon::Client client(socketPath));
+}
+
+TEST_F(DaemonTest, submit)
+{
+    StitchDaemon::Request request = this->request("panorama.jpg");
+    size_t progress = 0;
+    StitchDaemon::Client client(socketPath);
+    StitchDaemon::Response response =
+            client.submit(request, [&progress](const StitchDaemon::Response &response) {
+                if (response.front() == "progress") {
+                    ++progress;
+                }
+            });
+    ASSERT_EQ(response.front(), "done");
+    ASSERT_EQ(response.size(), 3u);
+    EXPECT_GT(progress, 0u);
+    EXPECT_TRUE(boost::filesystem::exists(request.outputPath));
+
+    // The daemon serves the next client.
+    StitchDaemon::Client next(socketPath);
+    EXPECT_EQ(next.submit(this->request("next.jpg")).front(), "done");
+}
+
+TEST_F(DaemonTest, cancel)
+{
+    StitchDaemon::Client client(socketPath);
+    StitchDaemon::Response response = client.submit(
+            request("cancelled.jpg"), [&client](const StitchDaemon::Response &response) {
+                if (response.front() == "progress") {
+                    client.cancel();
+                }
+            });
+    EXPECT_EQ(response.front(), "cancelled");
+}
+
+TEST_F(DaemonTest, submitInvalid)
+{
+    StitchDaemon::Request request = this->request("invalid.jpg");
+    request.inputPaths = { (directory / "missing.jpg").string() };
+    StitchDaemon::Client client(socketPath);
+    EXPECT_EQ(client.submit(request).front(), "error");
+}
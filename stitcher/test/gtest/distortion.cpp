@@ -134,6 +134,28 @@ TEST_F(PinholeDistortionModelTest, pinholeUndistortImage)
     EXPECT_PRED_FORMAT2(CvMatEq, actual_image, expected_image);
 }
 
+TEST_F(PinholeDistortionModelTest, pinholeDistortImage)
+{
+    Camera camera = createCamera(true);
+    cv::Mat K = camera.K(0.25);
+    EXPECT_PRED_FORMAT2(CvMatEq, camera.distortion_model->undistortedK(1336, 1004, K), K);
+
+    cv::Mat expected_image;
+    cv::resize(createUndistortedImage(), expected_image, cv::Size(1336, 1004), 0, 0,
+               cv::INTER_AREA);
+    cv::GaussianBlur(expected_image, expected_image, cv::Size(5, 5), 0);
+
+    // Undistorting the distorted image gives the image back, but for the
+    // edges the distortion moves out of the image.
+    cv::Mat actual_image = expected_image.clone();
+    camera.distortion_model->distort(actual_image, K);
+    EXPECT_PRED_FORMAT2(CvMatNe, actual_image, expected_image);
+    camera.distortion_model->undistort(actual_image, K);
+    cv::Rect centre(134, 100, 1068, 804);
+    cv::Scalar error = cv::mean(cv::abs(actual_image(centre) - expected_image(centre)));
+    EXPECT_LT(error[0] + error[1] + error[2], 6.);
+}
+
 //
 // 
 // ScaramuzzaDistortionModel Tests
@@ -201,5 +223,36 @@ TEST_F(ScaramuzzaDistortionModelTest, scaramuzzaUndistortImage)
     EXPECT_PRED_FORMAT2(CvMatEq, actual_image, expected_image);
 }
 
+TEST_F(ScaramuzzaDistortionModelTest, scaramuzzaDistortImage)
+{
+    ScaramuzzaDistortionModel::Parameters parameters = createParameters();
+    ScaramuzzaDistortionModel distortion_model(parameters);
+
+    cv::Mat expected_image = createUndistortedImage();
+    cv::Mat K = distortion_model.undistortedK(expected_image.cols, expected_image.rows);
+    EXPECT_DOUBLE_EQ(K.at<double>(0, 0), expected_image.cols / 2.);
+    EXPECT_DOUBLE_EQ(K.at<double>(0, 2), expected_image.cols / 2.);
+    EXPECT_DOUBLE_EQ(K.at<double>(1, 2), expected_image.rows / 2.);
+
+    // A point back-projected by cameraToWorld projects back to itself.
+    cv::Point2d camera_point(300., 200.);
+    cv::Point3d world_point;
+    distortion_model.cameraToWorld(camera_point, world_point);
+    cv::Point2d projected_point;
+    distortion_model.worldToCamera(world_point, projected_point);
+    EXPECT_NEAR(projected_point.x, camera_point.x, 0.5);
+    EXPECT_NEAR(projected_point.y, camera_point.y, 0.5);
+
+    cv::GaussianBlur(expected_image, expected_image, cv::Size(5, 5), 0);
+    cv::Mat actual_image = expected_image.clone();
+    distortion_model.distort(actual_image);
+    EXPECT_PRED_FORMAT2(CvMatNe, actual_image, expected_image);
+    distortion_model.undistort(actual_image);
+    cv::Rect centre(expected_image.cols / 4, expected_image.rows / 4,
+                    expected_image.cols / 2, expected_image.rows / 2);
+    cv::Scalar error = cv::mean(cv::abs(actual_image(centre) - expected_image(centre)));
+    EXPECT_LT(error[0] + error[1] + error[2], 6.);
+}
+
 } // namespace stitcher
 } // namespace airmap
@@ -3,6 +3,9 @@
 
 #include <opencv2/core.hpp>
 
+#include <cfloat>
+#include <cmath>
+
 using airmap::stitcher::GimbalOrientation;
 
 TEST(gimbal, gimbalStruct)
@@ -126,3 +129,58 @@ TEST(gimbal, gimbalRotationMatrix)
     EXPECT_DOUBLE_EQ(R.at<double>(2, 1), 0);
     EXPECT_DOUBLE_EQ(R.at<double>(2, 2), cos_negative_angle);
 }
+
+TEST(gimbal, gimbalCameraRotation)
+{
+    cv::Mat R, optical_axis, right;
+    const cv::Mat z = (cv::Mat_<double>(3, 1) << 0, 0, 1);
+    const cv::Mat x = (cv::Mat_<double>(3, 1) << 1, 0, 0);
+
+    /**
+     * No rotation for a level camera facing forward.
+     */
+    R = GimbalOrientation(0, 0, 0).cameraRotation();
+    EXPECT_LT(cv::norm(R, cv::Mat::eye(3, 3, CV_64F)), 1e-12);
+
+    /**
+     * Yawing right turns the optical axis towards x.
+     */
+    R = GimbalOrientation(0, 0, 90).cameraRotation();
+    optical_axis = R * z;
+    EXPECT_NEAR(optical_axis.at<double>(0), 1, 1e-12);
+    EXPECT_NEAR(optical_axis.at<double>(1), 0, 1e-12);
+    EXPECT_NEAR(optical_axis.at<double>(2), 0, 1e-12);
+
+    /**
+     * Pitching down turns the optical axis towards y, which points down.
+     */
+    R = GimbalOrientation(-90, 0, 0).cameraRotation();
+    optical_axis = R * z;
+    EXPECT_NEAR(optical_axis.at<double>(0), 0, 1e-12);
+    EXPECT_NEAR(optical_axis.at<double>(1), 1, 1e-12);
+    EXPECT_NEAR(optical_axis.at<double>(2), 0, 1e-12);
+
+    /**
+     * Rolling clockwise turns the x axis of the image down.
+     */
+    R = GimbalOrientation(0, 90, 0).cameraRotation();
+    right = R * x;
+    EXPECT_NEAR(right.at<double>(0), 0, 1e-12);
+    EXPECT_NEAR(right.at<double>(1), 1, 1e-12);
+    EXPECT_NEAR(right.at<double>(2), 0, 1e-12);
+
+    /**
+     * Any orientation is a proper rotation.
+     */
+    R = GimbalOrientation(-35, 3, 141).cameraRotation();
+    EXPECT_LT(cv::norm(R * R.t(), cv::Mat::eye(3, 3, CV_64F)), 1e-12);
+    EXPECT_NEAR(cv::determinant(R), 1, 1e-12);
+}
+
+TEST(gimbal, gimbalHasOrientation)
+{
+    EXPECT_TRUE(GimbalOrientation(-35, 0, 141).hasOrientation());
+    EXPECT_FALSE(GimbalOrientation(DBL_MAX, 0, 141).hasOrientation());
+    EXPECT_FALSE(GimbalOrientation(-35, DBL_MAX, 141).hasOrientation());
+    EXPECT_FALSE(GimbalOrientation(-35, 0, NAN).hasOrientation());
+}
@@ -0,0 +1,163 @@
+#include "gtest/gtest.h"
+
+#include "airmap/logging.h"
+#include "airmap/memory_planner.h"
+#include "airmap/opencv_stitcher.h"
+#include "util/images.h"
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using airmap::logging::stdoe_logger;
+using util::images::Images;
+
+namespace airmap {
+namespace stitcher {
+
+namespace {
+
+//! 25 images of a Parrot Anafi, with its focal length in pixels.
+constexpr size_t imageCount = 25;
+constexpr size_t imagePixels = 5344 * 4016;
+constexpr double focalPixels = 2990;
+
+MemoryPlanner createPlanner(size_t memoryBudgetMB,
+                            const Configuration &config = Configuration(StitchType::ThreeSixty))
+{
+    return MemoryPlanner(config, Panorama::Parameters(memoryBudgetMB), focalPixels);
+}
+
+} // namespace
+
+TEST(memoryPlanner, predict)
+{
+    MemoryPlanner planner = createPlanner(16000);
+    MemoryPlan full = planner.predict(imageCount, imagePixels, 1., 1.);
+    MemoryPlan smallerInput = planner.predict(imageCount, imagePixels, 0.5, 1.);
+    MemoryPlan smallerCompose = planner.predict(imageCount, imagePixels, 1., 0.5);
+
+    // Loading happens at full size, the stages after it shrink with the
+    // scales, those before composing only with the input scale.
+    EXPECT_EQ(full.peaksMB.at(monitor::Operation::Enum::LoadImages),
+              smallerInput.peaksMB.at(monitor::Operation::Enum::LoadImages));
+    EXPECT_LT(smallerInput.peakMB(), full.peakMB());
+    EXPECT_LT(smallerCompose.peakMB(), full.peakMB());
+    EXPECT_EQ(full.peaksMB.at(monitor::Operation::Enum::WarpImages),
+              smallerCompose.peaksMB.at(monitor::Operation::Enum::WarpImages));
+    EXPECT_LT(smallerCompose.peaksMB.at(monitor::Operation::Enum::Compose),
+              full.peaksMB.at(monitor::Operation::Enum::Compose));
+    EXPECT_LT(smallerCompose.panoramaPixels, full.panoramaPixels);
+
+    // The panorama is at most a full sphere.
+    EXPECT_LE(full.panoramaPixels, 2 * M_PI * M_PI * focalPixels * focalPixels);
+    for (const auto &stage : full.peaksMB) {
+        EXPECT_GE(stage.second, MemoryPlanner::baselineMB);
+    }
+}
+
+TEST(memoryPlanner, predictConfiguration)
+{
+    // Seams found at a megapixel, of images composed small enough for the
+    // seam finder to matter to the peak of finding seams.
+    Configuration config(StitchType::ThreeSixty);
+    config.seam_megapix = 1.;
+    MemoryPlan graphCut =
+            createPlanner(16000, config).predict(imageCount, imagePixels, 1., 0.25);
+
+    config.seam_finder_type = SeamFinderType::Voronoi;
+    config.blender_type = cv::detail::Blender::NO;
+    MemoryPlan voronoi =
+            createPlanner(16000, config).predict(imageCount, imagePixels, 1., 0.25);
+    EXPECT_LT(voronoi.peaksMB.at(monitor::Operation::Enum::FindSeams),
+              graphCut.peaksMB.at(monitor::Operation::Enum::FindSeams));
+    EXPECT_LT(voronoi.peaksMB.at(monitor::Operation::Enum::Compose),
+              graphCut.peaksMB.at(monitor::Operation::Enum::Compose));
+}
+
+TEST(memoryPlanner, plan)
+{
+    // A big budget scales the images down to the maximum input image size
+    // only, and composes them at full size.
+    MemoryPlanner planner = createPlanner(64000);
+    MemoryPlan plan = planner.plan(imageCount, imagePixels);
+    Panorama::Parameters parameters(64000);
+    EXPECT_DOUBLE_EQ(plan.inputScale,
+                     std::sqrt(static_cast<double>(parameters.maxInputImageSize)
+                               / imagePixels));
+    EXPECT_DOUBLE_EQ(plan.composeScale, 1.);
+
+    // A budget just below its peak scales the input down, as composing
+    // at a smaller scale would give the same panorama.
+    const size_t peakMB = plan.peakMB();
+    MemoryPlan smaller = createPlanner(peakMB - 1).plan(imageCount, imagePixels);
+    EXPECT_LT(smaller.inputScale, plan.inputScale);
+    EXPECT_DOUBLE_EQ(smaller.composeScale, 1.);
+    EXPECT_LE(smaller.peakMB(), peakMB - 1);
+
+    // Past the least input scale, the composition is scaled down.
+    const size_t tightMB =
+            planner.predict(imageCount, imagePixels, MemoryPlanner::minimumScale, 1.)
+                    .peakMB()
+            - 1;
+    MemoryPlan tight = createPlanner(tightMB).plan(imageCount, imagePixels);
+    EXPECT_DOUBLE_EQ(tight.inputScale, MemoryPlanner::minimumScale);
+    EXPECT_LT(tight.composeScale, 1.);
+    EXPECT_LE(tight.peakMB(), tightMB);
+
+    // Every budget is kept to, and the more budget the larger the panorama.
+    size_t panoramaPixels = 0;
+    for (size_t budgetMB = 1000; budgetMB <= 4000; budgetMB += 500) {
+        MemoryPlan budgetPlan = createPlanner(budgetMB).plan(imageCount, imagePixels);
+        EXPECT_LE(budgetPlan.peakMB(), budgetMB);
+        EXPECT_GE(budgetPlan.panoramaPixels, panoramaPixels);
+        panoramaPixels = budgetPlan.panoramaPixels;
+    }
+
+    // Less than the process needs before loading any image.
+    EXPECT_THROW(createPlanner(100).plan(imageCount, imagePixels), std::invalid_argument);
+}
+
+class MemoryPlannerTestStitcher : public LowLevelOpenCVStitcher
+{
+public:
+    using LowLevelOpenCVStitcher::LowLevelOpenCVStitcher;
+
+    const MemoryPlan &memoryPlan() const { return _memoryPlan; }
+};
+
+TEST(memoryPlanner, predictMeasuredPeak)
+{
+    const std::string outputPath =
+            (boost::filesystem::temp_directory_path()
+             / boost::filesystem::unique_path("memory-planner-%%%%-%%%%.jpg"))
+                    .string();
+    Panorama::Parameters parameters(Panorama::Parameters::defaultMemoryBudgetMB(),
+                                    false, true, true);
+    MemoryPlannerTestStitcher stitcher(Configuration(StitchType::ThreeSixty),
+                                       Panorama(Images::original()), parameters,
+                                       outputPath, std::make_shared<stdoe_logger>());
+    Stitcher::Report report = stitcher.stitch();
+    boost::filesystem::remove(outputPath);
+
+    size_t measuredMB = 0;
+    for (const auto &operation : report.operationResources) {
+        measuredMB = std::max(measuredMB, operation.second.peakRssMB);
+    }
+    const MemoryPlan &plan = stitcher.memoryPlan();
+    const size_t predictedMB = std::max(plan.peakMB(), plan.loadPeakMB());
+    ASSERT_GT(measuredMB, 0);
+
+    // The prediction bounds the measured peak, but for what the model
+    // leaves out, e.g. the allocator's fragmentation and OpenCV's buffers
+    // of a few rows.
+    const size_t slackMB = 32;
+    EXPECT_LE(measuredMB, predictedMB + slackMB);
+    // And isn't a multiple of it, which would scale the input more than
+    // needed.
+    EXPECT_LE(predictedMB, measuredMB * 2);
+}
+
+} // namespace stitcher
+} // namespace airmap
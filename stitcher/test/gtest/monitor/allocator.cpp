@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+
+#include "airmap/monitor/allocator.h"
+#include "airmap/stitcher.h"
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using airmap::stitcher::Stitcher;
+using airmap::stitcher::monitor::AllocationStats;
+using airmap::stitcher::monitor::AllocationTracker;
+using airmap::stitcher::monitor::Operation;
+
+namespace {
+
+//! A matrix of 3 MB.
+constexpr int rows = 1024;
+constexpr int cols = 1024;
+constexpr size_t bytes = rows * cols * 3;
+
+} // namespace
+
+TEST(allocationTracker, track)
+{
+    AllocationTracker tracker;
+    auto binding = tracker.bind();
+    tracker.changeOperation(Operation::Enum::FindFeatures);
+    const size_t before = tracker.liveBytes();
+
+    cv::Mat image(rows, cols, CV_8UC3);
+    AllocationStats findFeatures = tracker.stats(Operation::Enum::FindFeatures);
+    EXPECT_EQ(findFeatures.allocations, 1);
+    EXPECT_EQ(findFeatures.allocatedBytes, bytes);
+    EXPECT_EQ(findFeatures.liveBytes, bytes);
+    EXPECT_EQ(findFeatures.peakBytes, before + bytes);
+
+    // Matrices of user data, and copies of headers, allocate nothing.
+    std::vector<uchar> data(bytes);
+    cv::Mat header(rows, cols, CV_8UC3, data.data());
+    cv::Mat copy = image;
+    EXPECT_EQ(tracker.stats(Operation::Enum::FindFeatures).allocations, 1);
+
+    // Matrices are credited to the operation that allocated them, and the
+    // peak of an operation counts those of the operations before it.
+    tracker.changeOperation(Operation::Enum::Compose);
+    cv::Mat panorama(2 * rows, cols, CV_8UC3);
+    image.release();
+    copy.release();
+    findFeatures = tracker.stats(Operation::Enum::FindFeatures);
+    const AllocationStats compose = tracker.stats(Operation::Enum::Compose);
+    EXPECT_EQ(findFeatures.liveBytes, 0);
+    EXPECT_EQ(findFeatures.allocatedBytes, bytes);
+    EXPECT_EQ(compose.liveBytes, 2 * bytes);
+    EXPECT_EQ(compose.peakBytes, before + 3 * bytes);
+    EXPECT_EQ(tracker.liveBytes(), before + 2 * bytes);
+
+    // Stats are cleared for another stitch, live matrices stay charged.
+    tracker.reset();
+    EXPECT_EQ(tracker.stats(Operation::Enum::Compose).allocations, 0);
+    EXPECT_EQ(tracker.stats(Operation::Enum::Compose).liveBytes, 2 * bytes);
+    panorama.release();
+    EXPECT_EQ(tracker.liveBytes(), before);
+}
+
+TEST(allocationTracker, budget)
+{
+    AllocationTracker tracker;
+    auto binding = tracker.bind();
+    tracker.setBudgetMB(8);
+    EXPECT_EQ(tracker.budgetMB(), 8);
+    tracker.changeOperation(Operation::Enum::WarpImages);
+
+    cv::Mat first(rows, cols, CV_8UC3);
+    cv::Mat second;
+    try {
+        second.create(2 * rows, cols, CV_8UC3);
+        FAIL() << "Allocated over the budget";
+    } catch (const Stitcher::MemoryBudgetExceededError &e) {
+        EXPECT_EQ(e.operation(), Operation::Enum::WarpImages);
+        EXPECT_EQ(e.budgetMB(), 8);
+        EXPECT_EQ(e.requiredMB(), 9);
+    }
+    EXPECT_TRUE(second.empty());
+    EXPECT_EQ(tracker.stats(Operation::Enum::WarpImages).allocations, 1);
+
+    // The refusal is kept, for the stitcher to retry on whatever OpenCV
+    // threw instead, and cleared with the stats.
+    EXPECT_THROW(tracker.checkBudget(), Stitcher::RetriableError);
+    tracker.reset();
+    EXPECT_NO_THROW(tracker.checkBudget());
+
+    // Within the budget once the first is released.
+    first.release();
+    EXPECT_NO_THROW(second.create(2 * rows, cols, CV_8UC3));
+    tracker.setBudgetMB(0);
+    EXPECT_NO_THROW(first.create(2 * rows, cols, CV_8UC3));
+}
+
+TEST(allocationTracker, threads)
+{
+    cv::Mat outliving;
+    {
+        AllocationTracker tracker;
+        auto binding = tracker.bind();
+        tracker.changeOperation(Operation::Enum::FindSeams);
+
+        // A thread bound to no tracker charges the only one bound.
+        cv::Mat worker;
+        std::thread([&worker]() { worker.create(rows, cols, CV_8UC3); }).join();
+        EXPECT_EQ(tracker.stats(Operation::Enum::FindSeams).liveBytes, bytes);
+
+        // But no tracker while two are.
+        AllocationTracker other;
+        std::thread otherThread([&other, &worker]() {
+            auto otherBinding = other.bind();
+            std::thread([&worker]() { worker.create(2 * rows, cols, CV_8UC3); }).join();
+        });
+        otherThread.join();
+        EXPECT_EQ(tracker.stats(Operation::Enum::FindSeams).liveBytes, 0);
+        EXPECT_EQ(other.liveBytes(), 0);
+
+        outliving.create(rows, cols, CV_8UC3);
+    }
+    // Credited to the tracker destroyed.
+    outliving.release();
+}
+
+TEST(allocationTracker, bindWhileAllocating)
+{
+    // Unbound threads charge the only tracker bound, lock-free, while
+    // trackers are bound and destroyed.
+    std::atomic<bool> done { false };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&done]() {
+            while (!done) {
+                cv::Mat worker(rows / 16, cols / 16, CV_8UC3);
+            }
+        });
+    }
+    for (int i = 0; i < 1000; i++) {
+        AllocationTracker tracker;
+        auto binding = tracker.bind();
+        cv::Mat image(rows / 16, cols / 16, CV_8UC3);
+    }
+    done = true;
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
@@ -194,7 +194,7 @@ TEST_F(EstimatorTest, changesOperationsAdjusted)
     });
     estimator.changeOperation(operation);
     EXPECT_EQ(estimator.currentEstimate(),
-              estimator.estimatedTimeRemaining() * 2.666666);
+              estimator.estimatedTimeRemaining() * 4.6);
 
     operation = Operation::FindSeams();
     estimator.setOperationTimesCb([this, operationEstimates, operation]() {
@@ -214,7 +214,7 @@ TEST_F(EstimatorTest, changesOperationsAdjusted)
     });
     estimator.changeOperation(operation);
     EXPECT_EQ(estimator.currentEstimate(),
-              estimator.estimatedTimeRemaining() * 0.495048);
+              estimator.estimatedTimeRemaining() * 0.336);
 }
 
 TEST_F(EstimatorTest, estimatedTimeRemaining)
@@ -232,7 +232,7 @@ TEST_F(EstimatorTest, estimatedTimeRemaining)
     EXPECT_EQ(estimator.estimatedTimeRemaining(),
               estimator.estimatedTimeTotal());
 
-    estimator.changeOperation(Operation::UndistortImages());
+    estimator.changeOperation(Operation::LoadImages());
     EXPECT_EQ(estimator.currentEstimate(), estimator.estimatedTimeRemaining());
     EXPECT_NE(estimator.estimatedTimeRemaining(),
               estimator.estimatedTimeTotal());
@@ -361,6 +361,31 @@ TEST_F(EstimatorTest, setCurrentProgress)
     }
 }
 
+TEST_F(EstimatorTest, outputWritten)
+{
+    OperationsEstimator estimator = estimatorVesper();
+
+    estimator.outputWritten("preview.jpg", ElapsedTime::fromSeconds(4));
+    EXPECT_EQ(estimator.currentOutput(), "");
+
+    estimator.enable();
+    estimator.outputWritten("preview.jpg", ElapsedTime::fromSeconds(4));
+    EXPECT_EQ(estimator.currentOutput(), "preview.jpg");
+    EXPECT_EQ(estimator.currentOutputElapsed(), ElapsedTime::fromSeconds(4));
+}
+
+TEST_F(EstimatorTest, setCurrentOutput)
+{
+    OperationsEstimator estimator = estimatorVesper();
+    estimator.enable();
+
+    estimator.setCurrentOutput("00:01:02.003 path with spaces/panorama.jpg");
+    EXPECT_EQ(estimator.currentOutput(), "path with spaces/panorama.jpg");
+    EXPECT_EQ(estimator.currentOutputElapsed(), ElapsedTime("00:01:02.003"));
+
+    EXPECT_THROW(estimator.setCurrentOutput("panorama.jpg"), std::invalid_argument);
+}
+
 TEST_F(EstimatorTest, updatedCallback)
 {
     int calledCount = 0;
@@ -375,4 +400,7 @@ TEST_F(EstimatorTest, updatedCallback)
 
     estimator.setCurrentProgress("45.32");
     EXPECT_EQ(calledCount, 3);
+
+    estimator.setCurrentOutput("00:00:04.000 panorama.jpg");
+    EXPECT_EQ(calledCount, 4);
 }
@@ -0,0 +1,215 @@
+#include "gtest/gtest.h"
+
+#include "airmap/camera.h"
+#include "airmap/camera_models.h"
+#include "airmap/logging.h"
+#include "airmap/monitor/estimator.h"
+#include "airmap/monitor/history.h"
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+#include <fstream>
+
+using airmap::logging::stdoe_logger;
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::monitor::ElapsedTime;
+using airmap::stitcher::monitor::History;
+using airmap::stitcher::monitor::JobFeatures;
+using airmap::stitcher::monitor::JobRecord;
+using airmap::stitcher::monitor::Operation;
+using airmap::stitcher::monitor::OperationElapsedTimesMap;
+using airmap::stitcher::monitor::OperationsEstimator;
+using airmap::stitcher::monitor::PredictionErrors;
+
+class HistoryTest : public ::testing::Test {
+protected:
+    HistoryTest()
+        : path((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("history-%%%%-%%%%.tsv"))
+                       .string())
+    {
+    }
+
+    ~HistoryTest() { boost::filesystem::remove(path); }
+
+    /**
+     * @brief features
+     * The features of a job of megapix megapixels at every scale.
+     */
+    JobFeatures features(double megapix, const std::string &camera = "ANAFI-Thermal")
+    {
+        JobFeatures features;
+        features.imageCount = 10;
+        features.inputMegapix = megapix;
+        features.workMegapix = megapix;
+        features.seamMegapix = megapix;
+        features.composeMegapix = megapix;
+        features.camera = camera;
+        features.configuration = "0-0-0";
+        features.threads = 8;
+        return features;
+    }
+
+    /**
+     * @brief record
+     * A job whose seams take 100ms plus 50ms a megapixel, and whose
+     * composition takes slope ms a megapixel.
+     */
+    JobRecord record(double megapix, const std::string &camera = "ANAFI-Thermal",
+                     double slope = 20.)
+    {
+        JobRecord record;
+        record.features = features(megapix, camera);
+        record.times.insert(std::make_pair(
+                Operation::FindSeams().value(),
+                ElapsedTime::fromMilliseconds(std::llround(100. + 50. * megapix))));
+        record.times.insert(std::make_pair(
+                Operation::Compose().value(),
+                ElapsedTime::fromMilliseconds(std::llround(slope * megapix))));
+        return record;
+    }
+
+    const std::string path;
+};
+
+TEST_F(HistoryTest, recordRoundTrip)
+{
+    JobRecord original = record(12.5);
+    JobRecord parsed = JobRecord::parse(original.str());
+    EXPECT_EQ(parsed.str(), original.str());
+    EXPECT_EQ(parsed.features.imageCount, 10);
+    EXPECT_DOUBLE_EQ(parsed.features.seamMegapix, 12.5);
+    EXPECT_EQ(parsed.features.camera, "ANAFI-Thermal");
+    EXPECT_EQ(parsed.features.threads, 8);
+    EXPECT_EQ(parsed.times.at(Operation::FindSeams().value()).milliseconds(false), 725);
+
+    // Fields of operations since renamed are ignored.
+    parsed = JobRecord::parse("job\timages=2\tRenamed=5\tCompose=7");
+    EXPECT_EQ(parsed.times.size(), 1);
+    EXPECT_EQ(parsed.times.at(Operation::Compose().value()).milliseconds(false), 7);
+
+    EXPECT_THROW(JobRecord::parse("stitch\timages=2"), std::invalid_argument);
+    EXPECT_THROW(JobRecord::parse("job\timages=two"), std::invalid_argument);
+    EXPECT_THROW(JobRecord::parse("job\tCompose=7"), std::invalid_argument);
+}
+
+TEST_F(HistoryTest, predictsLinearCosts)
+{
+    History history;
+    EXPECT_TRUE(history.predict(features(8.)).empty());
+
+    for (double megapix : { 1., 2., 4., 5. }) {
+        history.add(record(megapix));
+    }
+    OperationElapsedTimesMap predicted = history.predict(features(8.));
+    EXPECT_EQ(predicted.size(), 2);
+    EXPECT_EQ(predicted.at(Operation::FindSeams().value()).milliseconds(false), 500);
+    EXPECT_EQ(predicted.at(Operation::Compose().value()).milliseconds(false), 160);
+}
+
+TEST_F(HistoryTest, prefersSimilarJobs)
+{
+    History history;
+    for (double megapix : { 1., 2., 3. }) {
+        history.add(record(megapix, "ANAFI-Thermal", 20.));
+        history.add(record(megapix, "Vesper", 60.));
+    }
+    EXPECT_EQ(history.predict(features(10., "ANAFI-Thermal"))
+                      .at(Operation::Compose().value())
+                      .milliseconds(false),
+              200);
+    EXPECT_EQ(history.predict(features(10., "Vesper"))
+                      .at(Operation::Compose().value())
+                      .milliseconds(false),
+              600);
+}
+
+TEST_F(HistoryTest, evaluate)
+{
+    History history;
+    EXPECT_EQ(history.evaluate().jobs, 0);
+
+    for (double megapix : { 1., 2., 3., 4., 5., 6. }) {
+        history.add(record(megapix));
+    }
+    PredictionErrors errors = history.evaluate();
+    // Each job is predicted from the others, within rounding.
+    EXPECT_EQ(errors.jobs, 6);
+    EXPECT_LT(errors.total, 0.01);
+    EXPECT_LT(errors.operations.at(Operation::FindSeams().value()), 0.01);
+    EXPECT_LT(errors.operations.at(Operation::Compose().value()), 0.01);
+}
+
+TEST_F(HistoryTest, loadAndAdd)
+{
+    History::SharedPtr history = History::load(path, std::make_shared<stdoe_logger>());
+    EXPECT_TRUE(history->records().empty());
+
+    history->add(record(1.));
+    history->add(record(2.));
+
+    History::SharedPtr loaded = History::load(path, std::make_shared<stdoe_logger>());
+    ASSERT_EQ(loaded->records().size(), 2);
+    EXPECT_EQ(loaded->records()[1].str(), record(2.).str());
+}
+
+TEST_F(HistoryTest, loadSkipsInvalidLines)
+{
+    History::SharedPtr history = History::load(path, std::make_shared<stdoe_logger>());
+    history->add(record(1.));
+    {
+        std::ofstream file(path, std::ios::app);
+        file << "job\timages=ten\n";
+    }
+    history->add(record(2.));
+
+    // A stitch killed while appending its record leaves the last line cut,
+    // here after a field that still parses.
+    const std::string last = record(3.).str();
+    {
+        std::ofstream file(path, std::ios::app);
+        file << last.substr(0, last.find("\tcamera="));
+    }
+
+    History::SharedPtr loaded = History::load(path, std::make_shared<stdoe_logger>());
+    ASSERT_EQ(loaded->records().size(), 2);
+    EXPECT_EQ(loaded->records()[1].str(), record(2.).str());
+}
+
+TEST_F(HistoryTest, estimator)
+{
+    OperationsEstimator estimator { std::make_shared<Camera>(
+                                            CameraModels::ParrotAnafiThermal()),
+                                    std::make_shared<stdoe_logger>() };
+    estimator.enable();
+    const OperationElapsedTimesMap constants = estimator.estimateOperations();
+
+    // Without history, the estimates are those of the camera.
+    auto history = std::make_shared<History>();
+    estimator.setHistory(history);
+    estimator.setJobFeatures(features(8.));
+    EXPECT_EQ(estimator.estimateOperations().size(), constants.size());
+    EXPECT_EQ(estimator.estimateOperations()
+                      .at(Operation::FindSeams().value())
+                      .milliseconds(false),
+              constants.at(Operation::FindSeams().value()).milliseconds(false));
+
+    for (double megapix : { 1., 2., 4., 5. }) {
+        history->add(record(megapix));
+    }
+    estimator.changeOperation(Operation::Start());
+    estimator.setJobFeatures(features(8.));
+    OperationElapsedTimesMap estimates = estimator.operationEstimateTimes();
+    EXPECT_EQ(estimates.at(Operation::FindSeams().value()).milliseconds(false), 500);
+    EXPECT_EQ(estimates.at(Operation::Compose().value()).milliseconds(false), 160);
+    EXPECT_EQ(estimates.at(Operation::AdjustCameraParameters().value()).milliseconds(false),
+              constants.at(Operation::AdjustCameraParameters().value()).milliseconds(false));
+
+    // A complete stitch is added to the history.
+    estimator.setOperationTimesCb([this]() { return record(8.).times; });
+    estimator.changeOperation(Operation::Complete());
+    ASSERT_EQ(history->records().size(), 5);
+    EXPECT_EQ(history->records().back().str(), record(8.).str());
+}
@@ -6,6 +6,13 @@
 #include "airmap/monitor/monitor.h"
 #include "airmap/monitor/operation.h"
 
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+
 using airmap::logging::Logger;
 using airmap::logging::stdoe_logger;
 using airmap::stitcher::Camera;
@@ -15,7 +22,10 @@ using airmap::stitcher::monitor::Estimator;
 using airmap::stitcher::monitor::Monitor;
 using airmap::stitcher::monitor::Operation;
 using airmap::stitcher::monitor::OperationElapsedTimesMap;
+using airmap::stitcher::monitor::OperationResources;
+using airmap::stitcher::monitor::OperationResourcesMap;
 using airmap::stitcher::monitor::OperationsEstimator;
+using airmap::stitcher::monitor::ResourceUsage;
 
 class MonitorTest : public ::testing::Test {
 protected:
@@ -48,7 +58,7 @@ TEST_F(MonitorTest, changeOperation)
     EXPECT_EQ(estimator->currentEstimate(), estimator->estimatedTimeRemaining());
     EXPECT_EQ(estimator->currentEstimate(), estimator->estimatedTimeTotal());
 
-    monitor.changeOperation(Operation::UndistortImages());
+    monitor.changeOperation(Operation::LoadImages());
     EXPECT_EQ(estimator->currentEstimate(), estimator->estimatedTimeRemaining());
     EXPECT_EQ(estimator->estimatedTimeRemaining(),
               estimator->estimatedTimeTotal()
@@ -90,3 +100,270 @@ TEST_F(MonitorTest, operationProgress)
                   startingEstimatedTimeRemaining - undistortEstimate * operationProgress);
     }
 }
+
+TEST_F(MonitorTest, outputWritten)
+{
+    Monitor monitor = createMonitor();
+    monitor.enable();
+
+    monitor.changeOperation(Operation::Start());
+    monitor.outputWritten("preview.jpg");
+    EXPECT_EQ(estimator->currentOutput(), "preview.jpg");
+    const ElapsedTime previewElapsed = estimator->currentOutputElapsed();
+
+    monitor.changeOperation(Operation::UndistortImages());
+    monitor.outputWritten("panorama.jpg");
+    EXPECT_EQ(estimator->currentOutput(), "panorama.jpg");
+    EXPECT_GE(estimator->currentOutputElapsed().get(), previewElapsed.get());
+}
+
+TEST_F(MonitorTest, elapsed)
+{
+    Monitor monitor = createMonitor();
+    monitor.enable();
+
+    monitor.changeOperation(Operation::Start());
+    const ElapsedTime started = monitor.elapsed();
+    monitor.changeOperation(Operation::UndistortImages());
+    EXPECT_GE(monitor.elapsed().get(), started.get());
+}
+
+TEST_F(MonitorTest, cancel)
+{
+    Monitor monitor = createMonitor();
+
+    monitor.changeOperation(Operation::Start());
+    EXPECT_FALSE(monitor.cancelled());
+
+    // Copies share the cancellation, whether enabled or not.
+    Monitor copy = monitor;
+    copy.cancel();
+    EXPECT_TRUE(monitor.cancelled());
+    EXPECT_THROW(monitor.changeOperation(Operation::UndistortImages()),
+                 airmap::stitcher::monitor::Cancelled);
+    EXPECT_THROW(monitor.updateCurrentOperation(0.5),
+                 airmap::stitcher::monitor::Cancelled);
+}
+
+TEST_F(MonitorTest, operationResources)
+{
+    Monitor monitor = createMonitor();
+    monitor.enable();
+
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::UndistortImages());
+    monitor.changeOperation(Operation::FindFeatures());
+    monitor.addWork(OperationResources::Features, 100);
+    monitor.addWork(OperationResources::Features, 20);
+
+    // Keep a core busy and hold some memory.
+    std::vector<char> memory(64 * 1024 * 1024, 1);
+    volatile double sum = 0.;
+    for (size_t i = 0; i < memory.size(); ++i) {
+        sum += memory[i] * 0.5;
+    }
+    monitor.changeOperation(Operation::MatchFeatures());
+
+    const OperationResourcesMap resources = monitor.operationResources();
+    ASSERT_EQ(resources.count(Operation::FindFeatures().value()), 1);
+    const OperationResources &findFeatures =
+            resources.at(Operation::FindFeatures().value());
+    EXPECT_EQ(findFeatures.wall,
+              monitor.operationTimes().at(Operation::FindFeatures().value()));
+    EXPECT_EQ(findFeatures.work.at(OperationResources::Features), 120);
+    EXPECT_GE(findFeatures.peakRssMB, 64);
+    EXPECT_GE(findFeatures.deltaRssMB, 60);
+    EXPECT_GE(findFeatures.cpuUtilization(), 0.);
+    EXPECT_TRUE(resources.at(Operation::UndistortImages().value()).work.empty());
+}
+
+TEST_F(MonitorTest, operationAllocations)
+{
+    Monitor monitor = createMonitor();
+    monitor.enable();
+    auto binding = monitor.allocations()->bind();
+
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::WarpImages());
+    cv::Mat warped(4096, 1024, CV_8UC3);
+    monitor.changeOperation(Operation::FindSeams());
+
+    const OperationResources warpImages =
+            monitor.operationResources().at(Operation::WarpImages().value());
+    EXPECT_EQ(warpImages.allocations, 1);
+    EXPECT_EQ(warpImages.allocatedMB, 12);
+    EXPECT_EQ(warpImages.peakAllocatedMB, 12);
+    EXPECT_EQ(warpImages.liveAllocatedMB, 12);
+    EXPECT_NE(warpImages.str().find("matrices peak 12 MB"), std::string::npos);
+}
+
+TEST_F(MonitorTest, skippedAndRepeatedOperations)
+{
+    Monitor monitor = createMonitor();
+    monitor.enable();
+
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::LoadImages());
+    // UndistortImages is skipped.
+    monitor.changeOperation(Operation::ScaleImages());
+    monitor.changeOperation(Operation::Compose());
+    for (int i = 0; i < 2; i++) {
+        monitor.changeOperation(Operation::CropPanorama());
+        monitor.changeOperation(Operation::WritePanorama());
+        monitor.addWork(OperationResources::WarpedPixels, 10);
+    }
+    EXPECT_EQ(monitor.currentOperation(), Operation::WritePanorama());
+    monitor.changeOperation(Operation::Complete());
+
+    // Each operation is attributed its own time, however many ran between.
+    const OperationElapsedTimesMap times = monitor.operationTimes();
+    EXPECT_EQ(times.count(Operation::UndistortImages().value()), 0);
+    EXPECT_EQ(times.count(Operation::ScaleImages().value()), 1);
+    EXPECT_EQ(times.count(Operation::Compose().value()), 1);
+    EXPECT_EQ(times.count(Operation::Complete().value()), 0);
+
+    // Repeated operations add up.
+    const OperationResourcesMap resources = monitor.operationResources();
+    EXPECT_EQ(resources.at(Operation::WritePanorama().value())
+                      .work.at(OperationResources::WarpedPixels),
+              20);
+    EXPECT_EQ(resources.at(Operation::WritePanorama().value()).wall,
+              times.at(Operation::WritePanorama().value()));
+
+    // A retry starts afresh.
+    monitor.changeOperation(Operation::Start());
+    EXPECT_TRUE(monitor.operationTimes().empty());
+}
+
+TEST_F(MonitorTest, parallelWork)
+{
+    // Workers never report, only the stitching thread and the reporter.  The
+    // estimator is read as it reports, not to race the reporter.
+    std::mutex reportsMutex;
+    std::set<std::thread::id> reportingThreads;
+    ElapsedTime reportedTimeRemaining;
+    OperationsEstimator::SharedPtr estimator;
+    estimator = OperationsEstimator::create(
+            camera, logger,
+            [&]() {
+                std::lock_guard<std::mutex> lock(reportsMutex);
+                reportingThreads.insert(std::this_thread::get_id());
+                reportedTimeRemaining = estimator->estimatedTimeRemaining();
+            },
+            true);
+    auto timeRemaining = [&]() {
+        std::lock_guard<std::mutex> lock(reportsMutex);
+        return reportedTimeRemaining;
+    };
+    Monitor monitor { estimator, logger, true };
+    monitor.setReportInterval(std::chrono::milliseconds(0));
+
+    const OperationElapsedTimesMap operationEstimates = estimator->estimateOperations();
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::FindSeams());
+    const ElapsedTime startingEstimatedTimeRemaining = timeRemaining();
+
+    monitor.setOperationWork(4001);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&monitor]() {
+            for (int i = 0; i < 1000; i++) {
+                monitor.completeWork();
+                monitor.addWork(OperationResources::GraphVertices, 2);
+            }
+        });
+    }
+    std::vector<std::thread::id> workerIds;
+    for (auto &worker : workers) {
+        workerIds.push_back(worker.get_id());
+        worker.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(reportsMutex);
+        for (const auto &workerId : workerIds) {
+            EXPECT_EQ(reportingThreads.count(workerId), 0);
+        }
+    }
+    EXPECT_DOUBLE_EQ(monitor.currentOperationProgress(), 4000. / 4001.);
+
+    monitor.completeWork();
+    EXPECT_DOUBLE_EQ(monitor.currentOperationProgress(), 1.);
+    EXPECT_EQ(timeRemaining(),
+              startingEstimatedTimeRemaining
+                      - operationEstimates.at(Operation::FindSeams().value()));
+
+    EXPECT_THROW(monitor.addWork("unknown", 1), std::invalid_argument);
+    monitor.changeOperation(Operation::Compose());
+    EXPECT_EQ(monitor.operationResources()
+                      .at(Operation::FindSeams().value())
+                      .work.at(OperationResources::GraphVertices),
+              8000);
+    EXPECT_DOUBLE_EQ(monitor.currentOperationProgress(), 0.);
+}
+
+TEST_F(MonitorTest, rateLimitedReports)
+{
+    int reports = 0;
+    auto estimator = OperationsEstimator::create(
+            camera, logger, [&reports]() { reports++; }, true);
+    Monitor monitor { estimator, logger, true };
+    monitor.setReportInterval(std::chrono::milliseconds(60000));
+
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::FindSeams());
+    reports = 0;
+    for (int i = 0; i < 1000; i++) {
+        monitor.updateCurrentOperation(i / 1000.);
+    }
+    EXPECT_EQ(reports, 0);
+    EXPECT_DOUBLE_EQ(monitor.currentOperationProgress(), 0.999);
+
+    // Changes of operation are always reported.
+    monitor.changeOperation(Operation::Compose());
+    EXPECT_EQ(reports, 1);
+}
+
+TEST_F(MonitorTest, reportWhileBlocked)
+{
+    std::atomic<int> reports { 0 };
+    auto estimator = OperationsEstimator::create(
+            camera, logger, [&reports]() { reports++; }, true);
+    Monitor monitor { estimator, logger, true };
+    monitor.setReportInterval(std::chrono::milliseconds(10));
+
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::FindSeams());
+    monitor.setOperationWork(10);
+    reports = 0;
+
+    // The stitching thread waits for a worker, as for a parallel loop.
+    std::thread([&monitor]() {
+        for (int i = 0; i < 10; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            monitor.completeWork();
+        }
+    }).join();
+    EXPECT_GT(reports, 0);
+    EXPECT_DOUBLE_EQ(monitor.currentOperationProgress(), 1.);
+
+    // Not once the stitch is complete.
+    monitor.changeOperation(Operation::Complete());
+    reports = 0;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(reports, 0);
+}
+
+TEST(ResourceUsage, now)
+{
+    const ResourceUsage before = ResourceUsage::now();
+    EXPECT_GT(before.rssMB, 0);
+    EXPECT_GE(before.peakRssMB, before.rssMB);
+
+    volatile double sum = 0.;
+    for (int i = 0; i < 50000000; ++i) {
+        sum += i * 0.5;
+    }
+    const ResourceUsage after = ResourceUsage::now();
+    EXPECT_GT((after.userCpu + after.systemCpu).get(),
+              (before.userCpu + before.systemCpu).get());
+}
@@ -0,0 +1,165 @@
+#include "gtest/gtest.h"
+
+#include "airmap/camera.h"
+#include "airmap/camera_models.h"
+#include "airmap/logging.h"
+#include "airmap/monitor/monitor.h"
+#include "airmap/monitor/progress.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using airmap::logging::stdoe_logger;
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::monitor::ElapsedTime;
+using airmap::stitcher::monitor::Estimator;
+using airmap::stitcher::monitor::Monitor;
+using airmap::stitcher::monitor::Operation;
+using airmap::stitcher::monitor::OperationsEstimator;
+using airmap::stitcher::monitor::ProgressParser;
+using airmap::stitcher::monitor::ProgressRecord;
+using airmap::stitcher::monitor::ProgressWriter;
+
+class ProgressTest : public ::testing::Test {
+protected:
+    ProgressTest()
+    {
+        EXPECT_EQ(pipe(fds), 0);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    }
+
+    ~ProgressTest()
+    {
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    /**
+     * @brief read
+     * The records written to the pipe so far.
+     */
+    std::vector<ProgressRecord> read()
+    {
+        std::vector<ProgressRecord> records;
+        ProgressParser parser(
+                [&records](const ProgressRecord &record) { records.push_back(record); });
+        char chunk[256];
+        ssize_t size;
+        while ((size = ::read(fds[0], chunk, sizeof(chunk))) > 0) {
+            parser.feed(chunk, static_cast<size_t>(size));
+        }
+        return records;
+    }
+
+    static ProgressRecord record()
+    {
+        ProgressRecord record;
+        record.operation = "FindSeams";
+        record.operationProgress = 0.1;
+        record.progress = 62.5;
+        record.estimate = ElapsedTime::fromMilliseconds(12345);
+        record.elapsed = ElapsedTime::fromMilliseconds(6789);
+        record.rssMB = 1234;
+        record.output = "path with \"quotes\"/preview.jpg";
+        record.outputElapsed = ElapsedTime::fromMilliseconds(3000);
+        record.stages["Start"].elapsed = ElapsedTime::fromMilliseconds(1);
+        record.stages["Start"].peakRssMB = 100;
+        record.stages["Start"].peakAllocatedMB = 10;
+        return record;
+    }
+
+    int fds[2];
+};
+
+TEST_F(ProgressTest, parse)
+{
+    const ProgressRecord expected = record();
+    const ProgressRecord parsed = ProgressRecord::parse(expected.str());
+    EXPECT_EQ(parsed.operation, expected.operation);
+    EXPECT_EQ(parsed.operationProgress, expected.operationProgress);
+    EXPECT_EQ(parsed.progress, expected.progress);
+    EXPECT_EQ(parsed.estimate, expected.estimate);
+    EXPECT_EQ(parsed.elapsed, expected.elapsed);
+    EXPECT_EQ(parsed.rssMB, expected.rssMB);
+    EXPECT_EQ(parsed.output, expected.output);
+    EXPECT_EQ(parsed.outputElapsed, expected.outputElapsed);
+    ASSERT_EQ(parsed.stages.size(), 1);
+    EXPECT_EQ(parsed.stages.at("Start").elapsed, ElapsedTime::fromMilliseconds(1));
+    EXPECT_EQ(parsed.stages.at("Start").peakRssMB, 100);
+    EXPECT_EQ(parsed.stages.at("Start").peakAllocatedMB, 10);
+    EXPECT_EQ(parsed.str(), expected.str());
+
+    EXPECT_THROW(ProgressRecord::parse("Progress: 62.5"), std::invalid_argument);
+    EXPECT_THROW(ProgressRecord::parse("{\"operation\":\"Start\"}"),
+                 std::invalid_argument);
+}
+
+TEST_F(ProgressTest, feed)
+{
+    std::vector<ProgressRecord> records;
+    ProgressParser parser(
+            [&records](const ProgressRecord &record) { records.push_back(record); });
+
+    const std::string lines = record().str() + "\n" + record().str() + "\n";
+    const size_t split = lines.size() / 3;
+    parser.feed(lines.data(), split);
+    EXPECT_EQ(records.size(), 0);
+    parser.feed(lines.data() + split, lines.size() - split);
+    ASSERT_EQ(records.size(), 2);
+    EXPECT_EQ(records[1].str(), record().str());
+}
+
+TEST_F(ProgressTest, apply)
+{
+    std::shared_ptr<airmap::logging::Logger> logger = std::make_shared<stdoe_logger>();
+    size_t updates = 0;
+    Estimator estimator(logger, [&updates]() { updates++; }, true);
+
+    ProgressParser::apply(record(), estimator);
+    EXPECT_EQ(estimator.currentEstimate(), record().estimate);
+    EXPECT_EQ(estimator.currentProgress(), record().progress);
+    EXPECT_EQ(estimator.currentOutput(), record().output);
+    EXPECT_EQ(estimator.currentOutputElapsed(), record().outputElapsed);
+    EXPECT_EQ(updates, 2);
+
+    // An output is set only when it changes.
+    ProgressParser::apply(record(), estimator);
+    EXPECT_EQ(updates, 3);
+}
+
+TEST_F(ProgressTest, rateLimit)
+{
+    ProgressWriter writer(fds[1], 1.);
+    EXPECT_TRUE(writer.due());
+    writer.write(record());
+    EXPECT_FALSE(writer.due());
+    writer.write(record());
+    writer.write(record(), true);
+    EXPECT_EQ(read().size(), 2);
+}
+
+TEST_F(ProgressTest, monitor)
+{
+    std::shared_ptr<airmap::logging::Logger> logger = std::make_shared<stdoe_logger>();
+    OperationsEstimator::SharedPtr estimator = OperationsEstimator::create(
+            std::make_shared<Camera>(CameraModels::ParrotAnafiThermal()), logger);
+    Monitor monitor { estimator, logger };
+    monitor.setProgressWriter(std::make_shared<ProgressWriter>(fds[1], 1.));
+
+    monitor.changeOperation(Operation::Start());
+    monitor.changeOperation(Operation::UndistortImages());
+    monitor.updateCurrentOperation(0.25);
+    monitor.updateCurrentOperation(0.5);
+    monitor.outputWritten("preview.jpg");
+
+    // Every change of operation and output, no rate limited update.
+    std::vector<ProgressRecord> records = read();
+    ASSERT_EQ(records.size(), 3);
+    EXPECT_EQ(records[0].operation, "Start");
+    EXPECT_EQ(records[1].operation, "UndistortImages");
+    EXPECT_EQ(records[1].stages.count("Start"), 1);
+    EXPECT_EQ(records[2].output, "preview.jpg");
+    EXPECT_EQ(records[2].operationProgress, 0.5);
+    EXPECT_GT(records[2].rssMB, 0);
+}
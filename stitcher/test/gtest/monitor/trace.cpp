@@ -0,0 +1,119 @@
+#include "gtest/gtest.h"
+
+#include "airmap/camera.h"
+#include "airmap/camera_models.h"
+#include "airmap/logging.h"
+#include "airmap/monitor/monitor.h"
+#include "airmap/monitor/trace.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <thread>
+
+using airmap::logging::stdoe_logger;
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::monitor::Monitor;
+using airmap::stitcher::monitor::Operation;
+using airmap::stitcher::monitor::OperationsEstimator;
+using airmap::stitcher::monitor::Tracer;
+
+class TraceTest : public ::testing::Test {
+protected:
+    TraceTest()
+        : path((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("trace-%%%%-%%%%.json"))
+                       .string())
+    {
+    }
+
+    ~TraceTest() { boost::filesystem::remove(path); }
+
+    /**
+     * @brief events
+     * The events of the closed trace, in order.
+     */
+    std::vector<boost::property_tree::ptree> events()
+    {
+        boost::property_tree::ptree trace;
+        boost::property_tree::read_json(path, trace);
+        std::vector<boost::property_tree::ptree> events;
+        for (const auto &event : trace) {
+            events.push_back(event.second);
+        }
+        return events;
+    }
+
+    const std::string path;
+};
+
+TEST_F(TraceTest, spans)
+{
+    {
+        auto tracer = std::make_shared<Tracer>(path);
+        {
+            auto span = Tracer::span(tracer, "Attempt", "retry", 0);
+            std::thread([&tracer]() {
+                auto span = Tracer::span(tracer, "Warp", "step", 1);
+            }).join();
+        }
+        tracer->counter("rss_mb", 1234.);
+    }
+
+    std::vector<boost::property_tree::ptree> trace = events();
+    ASSERT_EQ(trace.size(), 6);
+    EXPECT_EQ(trace[0].get<std::string>("ph"), "M");
+    EXPECT_EQ(trace[1].get<std::string>("name"), "Attempt");
+    EXPECT_EQ(trace[1].get<std::string>("ph"), "B");
+    EXPECT_EQ(trace[1].get<int>("args.index"), 0);
+    EXPECT_EQ(trace[2].get<std::string>("name"), "Warp");
+    EXPECT_EQ(trace[2].get<std::string>("cat"), "step");
+    EXPECT_NE(trace[2].get<long>("tid"), trace[1].get<long>("tid"));
+    EXPECT_EQ(trace[3].get<std::string>("ph"), "E");
+    EXPECT_EQ(trace[3].get<long>("tid"), trace[2].get<long>("tid"));
+    EXPECT_EQ(trace[4].get<std::string>("name"), "Attempt");
+    EXPECT_EQ(trace[4].get<std::string>("ph"), "E");
+    EXPECT_GE(trace[4].get<int64_t>("ts"), trace[1].get<int64_t>("ts"));
+    EXPECT_EQ(trace[5].get<std::string>("ph"), "C");
+    EXPECT_EQ(trace[5].get<double>("args.rss_mb"), 1234.);
+}
+
+TEST_F(TraceTest, disabled)
+{
+    // Without a tracer, spans do nothing.
+    auto span = Tracer::span(nullptr, "Attempt", "retry");
+    EXPECT_FALSE(boost::filesystem::exists(path));
+}
+
+TEST_F(TraceTest, monitor)
+{
+    {
+        std::shared_ptr<airmap::logging::Logger> logger =
+                std::make_shared<stdoe_logger>();
+        OperationsEstimator::SharedPtr estimator = OperationsEstimator::create(
+                std::make_shared<Camera>(CameraModels::ParrotAnafiThermal()), logger);
+        Monitor monitor { estimator, logger };
+        monitor.setTracer(std::make_shared<Tracer>(path));
+
+        monitor.changeOperation(Operation::Start());
+        monitor.changeOperation(Operation::FindSeams());
+        {
+            auto span = monitor.span("FindInPair", 3);
+        }
+        monitor.changeOperation(Operation::Complete());
+    }
+
+    std::vector<std::string> spans;
+    for (const auto &event : events()) {
+        const std::string phase = event.get<std::string>("ph");
+        if (phase == "B" || phase == "E") {
+            spans.push_back(phase + " " + event.get<std::string>("name"));
+        }
+    }
+    const std::vector<std::string> expected = { "B Start",      "E Start",
+                                                "B FindSeams",  "B FindInPair",
+                                                "E FindInPair", "E FindSeams" };
+    EXPECT_EQ(spans, expected);
+}
@@ -0,0 +1,238 @@
+#include "gtest/gtest.h"
+
+#include "airmap/opencv/bundle_adjusters.h"
+#include "util/bundle_adjustment.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/filesystem.hpp>
+#include <opencv2/features2d.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/stitching/detail/matchers.hpp>
+#include <opencv2/stitching/detail/motion_estimators.hpp>
+
+using airmap::stitcher::opencv::detail::SparseBundleAdjusterRay;
+using boost::filesystem::path;
+using util::bundle_adjustment::Scene;
+using util::bundle_adjustment::makeScene;
+using util::bundle_adjustment::perturbed;
+using util::bundle_adjustment::relativeRotationError;
+
+namespace {
+
+/**
+ * @brief fixtureScene
+ * Features, matches and homography based initial cameras of the
+ * panorama_aus_1 images, as the stitcher has them before bundle adjustment.
+ * @param cameras The initial cameras.
+ */
+Scene fixtureScene(std::vector<cv::detail::CameraParams> &cameras)
+{
+    const path image_directory = path(__FILE__).parent_path() / ".." / ".." /
+                                 "fixtures" / "panorama_aus_1";
+    const double work_megapix = 0.3;
+
+    std::vector<path> image_paths;
+    for (auto &entry : boost::filesystem::directory_iterator(image_directory)) {
+        if (entry.path().extension() == ".JPG") {
+            image_paths.push_back(entry.path());
+        }
+    }
+    std::sort(image_paths.begin(), image_paths.end());
+
+    Scene scene;
+    scene.features.resize(image_paths.size());
+    cv::Ptr<cv::Feature2D> finder = cv::ORB::create(1500);
+    for (size_t i = 0; i < image_paths.size(); ++i) {
+        cv::Mat image = cv::imread(image_paths[i].string());
+        const double scale =
+            std::min(1., std::sqrt(work_megapix * 1e6 / image.size().area()));
+        cv::resize(image, image, cv::Size(), scale, scale, cv::INTER_AREA);
+        cv::detail::computeImageFeatures(finder, image, scene.features[i]);
+        scene.features[i].img_idx = static_cast<int>(i);
+    }
+
+    cv::detail::BestOf2NearestMatcher matcher(false, 0.3f);
+    matcher(scene.features, scene.matches);
+    matcher.collectGarbage();
+    cv::detail::leaveBiggestComponent(scene.features, scene.matches, 1.f);
+
+    cv::detail::HomographyBasedEstimator estimator;
+    if (!estimator(scene.features, scene.matches, cameras)) {
+        ADD_FAILURE() << "Homography based estimation failed";
+    }
+    for (auto &camera : cameras) {
+        camera.R.convertTo(camera.R, CV_32F);
+    }
+    return scene;
+}
+
+} // namespace
+
+TEST(sparseBundleAdjusterRay, recoversCameras)
+{
+    Scene scene = makeScene(8);
+    std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+
+    SparseBundleAdjusterRay adjuster;
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, cameras));
+
+    EXPECT_GT(adjuster.iterations(), 0);
+    EXPECT_LT(adjuster.rmsError(), 1.);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_NEAR(cameras[i].focal, scene.truth[i].focal, 2.);
+        EXPECT_EQ(cameras[i].R.type(), CV_32F);
+    }
+    EXPECT_LT(relativeRotationError(cameras, scene.truth), 1e-3);
+}
+
+TEST(sparseBundleAdjusterRay, matchesBundleAdjusterRay)
+{
+    Scene scene = makeScene(8);
+    std::vector<cv::detail::CameraParams> sparse_cameras = perturbed(scene);
+    std::vector<cv::detail::CameraParams> dense_cameras = sparse_cameras;
+
+    SparseBundleAdjusterRay sparse;
+    cv::detail::BundleAdjusterRay dense;
+    ASSERT_TRUE(sparse(scene.features, scene.matches, sparse_cameras));
+    ASSERT_TRUE(dense(scene.features, scene.matches, dense_cameras));
+
+    for (size_t i = 0; i < sparse_cameras.size(); ++i) {
+        EXPECT_NEAR(sparse_cameras[i].focal, dense_cameras[i].focal, 0.5);
+    }
+    EXPECT_LT(relativeRotationError(sparse_cameras, dense_cameras), 1e-4);
+}
+
+TEST(sparseBundleAdjusterRay, matchesBundleAdjusterRayOnFixture)
+{
+    std::vector<cv::detail::CameraParams> sparse_cameras;
+    Scene scene = fixtureScene(sparse_cameras);
+    ASSERT_FALSE(sparse_cameras.empty());
+    std::vector<cv::detail::CameraParams> dense_cameras = sparse_cameras;
+
+    // Both minimize the squared ray distance, as the stitcher configures
+    // them, apart from the robust loss which BundleAdjusterRay lacks.
+    SparseBundleAdjusterRay sparse;
+    cv::detail::BundleAdjusterRay dense;
+    sparse.setHuberThreshold(0.);
+    sparse.setConfThresh(1.);
+    dense.setConfThresh(1.);
+    ASSERT_TRUE(sparse(scene.features, scene.matches, sparse_cameras));
+    ASSERT_TRUE(dense(scene.features, scene.matches, dense_cameras));
+
+    for (size_t i = 0; i < sparse_cameras.size(); ++i) {
+        EXPECT_NEAR(sparse_cameras[i].focal / dense_cameras[i].focal, 1.,
+                    0.01);
+    }
+    EXPECT_LT(relativeRotationError(sparse_cameras, dense_cameras), 5e-3);
+}
+
+TEST(sparseBundleAdjusterRay, holdsFocalOutsideRefinementMask)
+{
+    Scene scene = makeScene(5);
+    std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+    const double focal = cameras[0].focal;
+
+    SparseBundleAdjusterRay adjuster;
+    cv::Mat_<uchar> refine_mask = cv::Mat::ones(3, 3, CV_8U);
+    refine_mask(0, 0) = 0;
+    adjuster.setRefinementMask(refine_mask);
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, cameras));
+
+    for (const auto &camera : cameras) {
+        EXPECT_DOUBLE_EQ(camera.focal, focal);
+    }
+}
+
+TEST(sparseBundleAdjusterRay, ignoresPairsBelowConfidence)
+{
+    Scene scene = makeScene(5);
+    std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+    const std::vector<cv::detail::CameraParams> initial = cameras;
+
+    SparseBundleAdjusterRay adjuster;
+    adjuster.setConfThresh(5.);
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, cameras));
+
+    EXPECT_EQ(adjuster.iterations(), 0);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_DOUBLE_EQ(cameras[i].focal, initial[i].focal);
+    }
+}
+
+TEST(sparseBundleAdjusterRay, reportsIterations)
+{
+    Scene scene = makeScene(6);
+    std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+
+    std::vector<double> errors;
+    SparseBundleAdjusterRay adjuster;
+    // Without the robust loss the cost is the squared error, which then
+    // decreases with every iteration
+    adjuster.setHuberThreshold(0.);
+    adjuster.setIterationCallback([&errors](int iteration, double rms_error) {
+        EXPECT_EQ(iteration, static_cast<int>(errors.size()) + 1);
+        errors.push_back(rms_error);
+    });
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, cameras));
+
+    ASSERT_FALSE(errors.empty());
+    EXPECT_LE(static_cast<int>(errors.size()), adjuster.iterations());
+    for (size_t i = 1; i < errors.size(); ++i) {
+        EXPECT_LE(errors[i], errors[i - 1]);
+    }
+    EXPECT_DOUBLE_EQ(errors.back(), adjuster.rmsError());
+}
+
+TEST(sparseBundleAdjusterRay, reportsProgress)
+{
+    Scene scene = makeScene(6);
+    std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+
+    std::vector<double> progress;
+    SparseBundleAdjusterRay adjuster;
+    adjuster.setIterationCallback([&](int, double) {
+        progress.push_back(adjuster.progress());
+    });
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, cameras));
+
+    // The default iteration limit is far above the iterations it takes to
+    // converge, which progress still reaches 1 at.
+    ASSERT_FALSE(progress.empty());
+    EXPECT_LT(adjuster.iterations(), adjuster.termCriteria().maxCount);
+    EXPECT_GT(progress.back(), 0.1);
+    for (size_t i = 1; i < progress.size(); ++i) {
+        EXPECT_GE(progress[i], progress[i - 1]);
+    }
+    EXPECT_DOUBLE_EQ(adjuster.progress(), 1.);
+}
+
+TEST(sparseBundleAdjusterRay, stopsOnSmallImprovement)
+{
+    Scene scene = makeScene(6);
+    std::vector<cv::detail::CameraParams> converged = perturbed(scene);
+    std::vector<cv::detail::CameraParams> stopped = converged;
+
+    SparseBundleAdjusterRay adjuster;
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, converged));
+    const int iterations = adjuster.iterations();
+
+    adjuster.setMinRelativeImprovement(0.1);
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, stopped));
+    EXPECT_LT(adjuster.iterations(), iterations);
+    EXPECT_FALSE(adjuster.exceededTimeBudget());
+}
+
+TEST(sparseBundleAdjusterRay, stopsOnTimeBudget)
+{
+    Scene scene = makeScene(6);
+    std::vector<cv::detail::CameraParams> cameras = perturbed(scene);
+
+    SparseBundleAdjusterRay adjuster;
+    adjuster.setTimeBudget(1e-9);
+    ASSERT_TRUE(adjuster(scene.features, scene.matches, cameras));
+    EXPECT_EQ(adjuster.iterations(), 1);
+    EXPECT_TRUE(adjuster.exceededTimeBudget());
+}
@@ -0,0 +1,77 @@
+#include "gtest/gtest.h"
+
+#include "airmap/camera_models.h"
+#include "airmap/opencv/estimators.h"
+
+#include <cfloat>
+
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::GimbalOrientation;
+using airmap::stitcher::opencv::detail::GimbalBasedEstimator;
+
+namespace {
+
+std::vector<cv::detail::ImageFeatures> features(size_t count, cv::Size size)
+{
+    std::vector<cv::detail::ImageFeatures> result(count);
+    for (size_t i = 0; i < count; ++i) {
+        result[i].img_idx = static_cast<int>(i);
+        result[i].img_size = size;
+    }
+    return result;
+}
+
+} // namespace
+
+TEST(gimbalBasedEstimator, estimatesFromMetadata)
+{
+    auto camera = std::make_shared<Camera>(CameraModels::ParrotAnafiThermal());
+    std::vector<GimbalOrientation> gimbal_orientations{
+        GimbalOrientation(-30, 0, 0), GimbalOrientation(-30, 0, 40)};
+    const double scale = 0.25;
+    const cv::Size size(cvRound(camera->sensorDimensionsPixels().x * scale),
+                        cvRound(camera->sensorDimensionsPixels().y * scale));
+    std::vector<cv::detail::MatchesInfo> matches(4);
+    std::vector<cv::detail::CameraParams> cameras;
+
+    GimbalBasedEstimator estimator(camera, gimbal_orientations);
+    ASSERT_TRUE(estimator(features(2, size), matches, cameras));
+    ASSERT_EQ(cameras.size(), 2u);
+
+    const cv::Mat K = camera->K(scale);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_NEAR(cameras[i].focal, K.at<double>(0, 0), 1e-9);
+        EXPECT_NEAR(cameras[i].aspect,
+                    K.at<double>(1, 1) / K.at<double>(0, 0), 1e-9);
+        EXPECT_NEAR(cameras[i].ppx, K.at<double>(0, 2), 1e-9);
+        EXPECT_NEAR(cameras[i].ppy, K.at<double>(1, 2), 1e-9);
+        EXPECT_EQ(cameras[i].R.type(), CV_32F);
+
+        cv::Mat expected;
+        gimbal_orientations[i].cameraRotation().convertTo(expected, CV_32F);
+        EXPECT_LT(cv::norm(cameras[i].R, expected), 1e-6);
+    }
+}
+
+TEST(gimbalBasedEstimator, requiresMetadata)
+{
+    auto camera = std::make_shared<Camera>(CameraModels::ParrotAnafiThermal());
+    std::vector<GimbalOrientation> gimbal_orientations{
+        GimbalOrientation(-30, 0, 0), GimbalOrientation(-30, 0, DBL_MAX)};
+
+    EXPECT_TRUE(GimbalBasedEstimator::available(
+        camera, {gimbal_orientations[0]}));
+    EXPECT_FALSE(
+        GimbalBasedEstimator::available(camera, gimbal_orientations));
+    EXPECT_FALSE(GimbalBasedEstimator::available(nullptr,
+                                                 {gimbal_orientations[0]}));
+    EXPECT_FALSE(GimbalBasedEstimator::available(std::make_shared<Camera>(),
+                                                 {gimbal_orientations[0]}));
+
+    std::vector<cv::detail::MatchesInfo> matches(4);
+    std::vector<cv::detail::CameraParams> cameras;
+    GimbalBasedEstimator estimator(camera, gimbal_orientations);
+    EXPECT_FALSE(estimator(features(2, cv::Size(1336, 1004)), matches,
+                           cameras));
+}
@@ -0,0 +1,143 @@
+#include "gtest/gtest.h"
+
+#include "airmap/opencv/grid_graph.h"
+
+#include <random>
+
+#include <opencv2/imgproc/detail/gcgraph.hpp>
+
+using airmap::stitcher::opencv::detail::GridGraph;
+using cv::detail::GCGraph;
+
+namespace {
+
+/**
+ * @brief buildGraph
+ * Builds a random grid graph resembling those created by the graph cut seam
+ * finder: vertices on the left are tied to the source, vertices on the right
+ * to the sink, and edges are added right then down for each vertex.
+ */
+template <class Graph>
+void buildGraph(Graph &graph, int width, int height, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> weight(1.f, 10.f);
+    std::uniform_int_distribution<int> coin(0, 3);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int v = graph.addVtx();
+            graph.addTermWeights(v, x < (width * 2) / 3 ? 10000.f : 0.f,
+                                 x >= width / 3 ? 10000.f : 0.f);
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int v = y * width + x;
+            if (x < width - 1) {
+                float w = weight(rng) + (coin(rng) == 0 ? 1000.f : 0.f);
+                graph.addEdges(v, v + 1, w, w);
+            }
+            if (y < height - 1) {
+                float w = weight(rng) + (coin(rng) == 0 ? 1000.f : 0.f);
+                graph.addEdges(v, v + width, w, w);
+            }
+        }
+    }
+}
+
+} // namespace
+
+TEST(gridGraph, matchesGCGraph)
+{
+    for (unsigned int seed = 0; seed < 50; ++seed) {
+        const int width = 5 + static_cast<int>(seed % 7) * 13;
+        const int height = 3 + static_cast<int>(seed % 5) * 17;
+
+        GCGraph<float> generic(width * height, 4 * width * height);
+        GridGraph grid(width, height);
+        buildGraph(generic, width, height, seed);
+        buildGraph(grid, width, height, seed);
+
+        EXPECT_FLOAT_EQ(generic.maxFlow(), grid.maxFlow());
+        for (int v = 0; v < width * height; ++v) {
+            ASSERT_EQ(generic.inSourceSegment(v), grid.inSourceSegment(v))
+                    << "seed " << seed << ", vertex " << v;
+        }
+    }
+}
+
+TEST(gridGraph, singleRowAndColumn)
+{
+    GridGraph row(4, 1);
+    for (int v = 0; v < 4; ++v) {
+        row.addVtx();
+    }
+    row.addTermWeights(0, 10.f, 0.f);
+    row.addTermWeights(3, 0.f, 10.f);
+    row.addEdges(0, 1, 5.f, 5.f);
+    row.addEdges(1, 2, 2.f, 2.f);
+    row.addEdges(2, 3, 5.f, 5.f);
+    EXPECT_FLOAT_EQ(row.maxFlow(), 2.f);
+    EXPECT_TRUE(row.inSourceSegment(1));
+    EXPECT_FALSE(row.inSourceSegment(2));
+
+    GridGraph column(1, 3);
+    for (int v = 0; v < 3; ++v) {
+        column.addVtx();
+    }
+    column.addTermWeights(0, 10.f, 0.f);
+    column.addTermWeights(2, 0.f, 10.f);
+    column.addEdges(0, 1, 1.f, 1.f);
+    column.addEdges(1, 2, 3.f, 3.f);
+    EXPECT_FLOAT_EQ(column.maxFlow(), 1.f);
+    EXPECT_TRUE(column.inSourceSegment(0));
+    EXPECT_FALSE(column.inSourceSegment(1));
+}
+
+TEST(gridGraph, bulkEdges)
+{
+    const int width = 31;
+    const int height = 17;
+
+    GCGraph<float> generic(width * height, 4 * width * height);
+    GridGraph grid(width, height);
+    buildGraph(generic, width, height, 7);
+
+    // Rebuild the same graph row by row
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> weight(1.f, 10.f);
+    std::uniform_int_distribution<int> coin(0, 3);
+    std::vector<float> horizontal(static_cast<size_t>(width * height));
+    std::vector<float> vertical(static_cast<size_t>(width * height));
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int v = grid.addVtx();
+            grid.addTermWeights(v, x < (width * 2) / 3 ? 10000.f : 0.f,
+                                x >= width / 3 ? 10000.f : 0.f);
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t v = static_cast<size_t>(y * width + x);
+            if (x < width - 1) {
+                horizontal[v] = weight(rng) + (coin(rng) == 0 ? 1000.f : 0.f);
+            }
+            if (y < height - 1) {
+                vertical[v] = weight(rng) + (coin(rng) == 0 ? 1000.f : 0.f);
+            }
+        }
+    }
+    for (int y = 0; y < height; ++y) {
+        grid.addHorizontalEdges(y, &horizontal[static_cast<size_t>(y * width)]);
+        if (y < height - 1) {
+            grid.addVerticalEdges(y, &vertical[static_cast<size_t>(y * width)]);
+        }
+    }
+
+    EXPECT_FLOAT_EQ(generic.maxFlow(), grid.maxFlow());
+    for (int v = 0; v < width * height; ++v) {
+        ASSERT_EQ(generic.inSourceSegment(v), grid.inSourceSegment(v));
+    }
+}
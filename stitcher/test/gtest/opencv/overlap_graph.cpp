@@ -0,0 +1,84 @@
+#include "gtest/gtest.h"
+
+#include "airmap/opencv/overlap_graph.h"
+
+#include <opencv2/stitching/detail/util.hpp>
+
+using airmap::stitcher::opencv::detail::OverlapGraph;
+
+namespace {
+
+// Four images in a row, each overlapping the next by 10 columns, and one
+// image overlapping none of them.
+const std::vector<cv::Point> corners = {
+    {0, 0}, {90, 5}, {180, 0}, {270, -5}, {1000, 1000}};
+const std::vector<cv::Size> sizes = {
+    {100, 50}, {100, 50}, {100, 50}, {100, 50}, {10, 10}};
+
+} // namespace
+
+TEST(overlapGraph, pairs)
+{
+    OverlapGraph graph(corners, sizes);
+
+    ASSERT_EQ(graph.imageCount(), corners.size());
+    ASSERT_EQ(graph.pairs().size(), 3u);
+    EXPECT_EQ(graph.skippedPairs(), 0u);
+
+    for (size_t p = 0; p < graph.pairs().size(); ++p) {
+        const OverlapGraph::Pair &pair = graph.pairs()[p];
+        EXPECT_EQ(pair.first, p);
+        EXPECT_EQ(pair.second, p + 1);
+
+        cv::Rect roi;
+        ASSERT_TRUE(cv::detail::overlapRoi(corners[p], corners[p + 1],
+                                           sizes[p], sizes[p + 1], roi));
+        EXPECT_EQ(pair.roi, roi);
+        EXPECT_EQ(pair.overlap_pixels, roi.area());
+    }
+
+    EXPECT_EQ(graph.neighbours(0), std::vector<size_t>({0}));
+    EXPECT_EQ(graph.neighbours(1), std::vector<size_t>({0, 1}));
+    EXPECT_EQ(graph.neighbours(3), std::vector<size_t>({2}));
+    EXPECT_TRUE(graph.neighbours(4).empty());
+
+    EXPECT_EQ(graph.resultRoi(), cv::detail::resultRoi(corners, sizes));
+    EXPECT_TRUE(graph.matches(corners, sizes));
+    EXPECT_FALSE(graph.matches(corners, std::vector<cv::Size>(5)));
+}
+
+TEST(overlapGraph, minOverlapPixels)
+{
+    // Masks only cover the left half of each image, so only the overlap
+    // between images 0 and 1 has overlapping pixels.
+    std::vector<cv::UMat> masks(corners.size());
+    for (size_t i = 0; i < corners.size(); ++i) {
+        masks[i].create(sizes[i], CV_8U);
+        masks[i].setTo(cv::Scalar::all(0));
+        cv::Mat mask = masks[i].getMat(cv::ACCESS_WRITE);
+        mask.colRange(0, sizes[i].width / 2).setTo(255);
+    }
+    cv::Mat(masks[0].getMat(cv::ACCESS_WRITE)).setTo(255);
+
+    // Without a threshold, the masks aren't counted.
+    OverlapGraph all(corners, sizes, masks);
+    ASSERT_EQ(all.pairs().size(), 3u);
+    for (const auto &pair : all.pairs()) {
+        EXPECT_EQ(pair.overlap_pixels, pair.roi.area());
+    }
+
+    OverlapGraph thresholded(corners, sizes, masks, 1);
+    ASSERT_EQ(thresholded.pairs().size(), 1u);
+    EXPECT_EQ(thresholded.skippedPairs(), 2u);
+    EXPECT_EQ(thresholded.pairs()[0].first, 0u);
+    EXPECT_EQ(thresholded.pairs()[0].overlap_pixels, 10 * 45);
+    EXPECT_TRUE(thresholded.neighbours(2).empty());
+}
+
+TEST(overlapGraph, empty)
+{
+    OverlapGraph graph;
+    EXPECT_TRUE(graph.empty());
+    EXPECT_TRUE(graph.pairs().empty());
+    EXPECT_TRUE(graph.matches({}, {}));
+}
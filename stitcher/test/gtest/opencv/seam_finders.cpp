@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+
+#include "airmap/camera_models.h"
+#include "airmap/logging.h"
+#include "airmap/monitor/estimator.h"
+#include "airmap/monitor/monitor.h"
+#include "airmap/opencv/seam_finders.h"
+#include "util/images.h"
+
+#include <opencv2/imgproc.hpp>
+
+using airmap::logging::stdoe_logger;
+using airmap::stitcher::Camera;
+using airmap::stitcher::CameraModels;
+using airmap::stitcher::monitor::Monitor;
+using airmap::stitcher::monitor::OperationsEstimator;
+using airmap::stitcher::opencv::detail::MaxFlowType;
+using airmap::stitcher::opencv::detail::MonitoredGraphCutSeamFinder;
+using util::images::Images;
+
+namespace {
+
+/**
+ * @brief findSeams
+ * Find seams between the first few warped fixture images, laid out so that
+ * each image overlaps half of the previous one.
+ */
+std::vector<cv::Mat> findSeams(int cost_type, MaxFlowType max_flow_type)
+{
+    const size_t image_count = 4;
+    const double scale = 0.25;
+
+    std::vector<cv::Mat> warped = Images::warped();
+    std::vector<cv::UMat> images(image_count);
+    std::vector<cv::Point> corners(image_count);
+    std::vector<cv::UMat> masks(image_count);
+    int x = 0;
+    for (size_t i = 0; i < image_count; ++i) {
+        cv::Mat resized;
+        cv::resize(warped[i], resized, cv::Size(), scale, scale);
+        resized.convertTo(images[i], CV_32F);
+        masks[i].create(resized.size(), CV_8U);
+        masks[i].setTo(cv::Scalar::all(255));
+        corners[i] = cv::Point(x, 0);
+        x += resized.cols / 2;
+    }
+
+    auto logger = std::make_shared<stdoe_logger>();
+    auto camera =
+        std::make_shared<Camera>(CameraModels::ParrotAnafiThermal());
+    auto monitor =
+        Monitor::create(OperationsEstimator::create(camera, logger), logger);
+    MonitoredGraphCutSeamFinder seam_finder(monitor, cost_type, 10000.f,
+                                            1000.f, max_flow_type);
+    seam_finder.find(images, corners, masks);
+
+    std::vector<cv::Mat> result;
+    for (auto &mask : masks) {
+        result.push_back(mask.getMat(cv::ACCESS_READ).clone());
+    }
+    return result;
+}
+
+void expectSameSeams(int cost_type)
+{
+    std::vector<cv::Mat> generic = findSeams(cost_type, MaxFlowType::Generic);
+    std::vector<cv::Mat> grid = findSeams(cost_type, MaxFlowType::Grid);
+    ASSERT_EQ(generic.size(), grid.size());
+
+    for (size_t i = 0; i < generic.size(); ++i) {
+        ASSERT_EQ(generic[i].size(), grid[i].size());
+        cv::Mat difference;
+        cv::compare(generic[i], grid[i], difference, cv::CMP_NE);
+        // The solvers are expected to agree exactly, the tolerance keeps the
+        // test from depending on how ties between equal cuts are broken.
+        EXPECT_LE(cv::countNonZero(difference),
+                  static_cast<int>(generic[i].total() / 1000));
+    }
+}
+
+} // namespace
+
+TEST(seamFinders, gridMatchesGenericColor)
+{
+    expectSameSeams(cv::detail::GraphCutSeamFinder::COST_COLOR);
+}
+
+TEST(seamFinders, gridMatchesGenericColorGrad)
+{
+    expectSameSeams(cv::detail::GraphCutSeamFinder::COST_COLOR_GRAD);
+}
@@ -0,0 +1,188 @@
+#include "gtest/gtest.h"
+
+#include "airmap/opencv/seam_graph.h"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/stitching/detail/util.hpp>
+
+using airmap::stitcher::opencv::detail::extractSubimage;
+using airmap::stitcher::opencv::detail::SeamGraphWorkspace;
+using airmap::stitcher::opencv::detail::seamGraphGradients;
+using airmap::stitcher::opencv::detail::seamGraphWeightsColor;
+using airmap::stitcher::opencv::detail::seamGraphWeightsColorGrad;
+using cv::detail::normL2;
+
+namespace {
+
+const float bad_region_penalty = 1000.f;
+
+struct Subimages {
+    cv::Mat img1, img2, dx1, dx2, dy1, dy2, mask1, mask2;
+
+    Subimages(cv::Size size)
+    {
+        cv::RNG rng(42);
+        for (cv::Mat *img : {&img1, &img2}) {
+            img->create(size, CV_32FC3);
+            rng.fill(*img, cv::RNG::UNIFORM, 0.f, 255.f);
+        }
+        for (cv::Mat *grad : {&dx1, &dx2, &dy1, &dy2}) {
+            grad->create(size, CV_32F);
+            rng.fill(*grad, cv::RNG::UNIFORM, 0.f, 1000.f);
+        }
+        for (cv::Mat *mask : {&mask1, &mask2}) {
+            mask->create(size, CV_8U);
+            rng.fill(*mask, cv::RNG::UNIFORM, 0, 2);
+            *mask *= 255;
+        }
+    }
+
+    bool bad(int y1, int x1, int y2, int x2) const
+    {
+        return !mask1.at<uchar>(y1, x1) || !mask1.at<uchar>(y2, x2) ||
+               !mask2.at<uchar>(y1, x1) || !mask2.at<uchar>(y2, x2);
+    }
+
+    float cost(int y, int x) const
+    {
+        return normL2(img1.at<cv::Point3f>(y, x), img2.at<cv::Point3f>(y, x));
+    }
+};
+
+} // namespace
+
+TEST(seamGraph, extractSubimage)
+{
+    cv::Mat src(20, 30, CV_8U);
+    cv::RNG(1).fill(src, cv::RNG::UNIFORM, 1, 255);
+    const cv::Point tl(100, 50);
+    const cv::Rect roi(95, 60, 20, 5);
+    const int gap = 3;
+
+    cv::Mat dst = cv::Mat::zeros(roi.height + 2 * gap, roi.width + 2 * gap,
+                                 CV_8U);
+    extractSubimage(src, tl, roi, gap, dst);
+
+    for (int y = -gap; y < roi.height + gap; ++y) {
+        for (int x = -gap; x < roi.width + gap; ++x) {
+            int y1 = roi.y - tl.y + y;
+            int x1 = roi.x - tl.x + x;
+            uchar expected = 0;
+            if (y1 >= 0 && x1 >= 0 && y1 < src.rows && x1 < src.cols) {
+                expected = src.at<uchar>(y1, x1);
+            }
+            ASSERT_EQ(dst.at<uchar>(y + gap, x + gap), expected)
+                << "at " << x << ", " << y;
+        }
+    }
+}
+
+TEST(seamGraph, gradients)
+{
+    // Warped images are converted from 8 bit, so gradients are exact
+    cv::Mat img8u(41, 53, CV_8UC3), img;
+    cv::RNG(3).fill(img8u, cv::RNG::UNIFORM, 0, 256);
+    img8u.convertTo(img, CV_32F);
+
+    cv::Mat sobel_dx, sobel_dy;
+    cv::Sobel(img, sobel_dx, CV_32F, 1, 0);
+    cv::Sobel(img, sobel_dy, CV_32F, 0, 1);
+
+    // Whole image, touching every border, and an interior roi
+    for (cv::Rect roi : {cv::Rect(0, 0, img.cols, img.rows),
+                         cv::Rect(0, 5, 10, 20), cv::Rect(40, 30, 13, 11),
+                         cv::Rect(7, 9, 21, 17)}) {
+        cv::Mat dx, dy;
+        seamGraphGradients(img, roi, dx, dy);
+        ASSERT_EQ(dx.size(), roi.size());
+        ASSERT_EQ(dy.size(), roi.size());
+
+        for (int y = 0; y < roi.height; ++y) {
+            for (int x = 0; x < roi.width; ++x) {
+                cv::Point p(roi.x + x, roi.y + y);
+                ASSERT_EQ(dx.at<float>(y, x),
+                          normL2(sobel_dx.at<cv::Point3f>(p)))
+                    << "at " << p;
+                ASSERT_EQ(dy.at<float>(y, x),
+                          normL2(sobel_dy.at<cv::Point3f>(p)))
+                    << "at " << p;
+            }
+        }
+    }
+}
+
+TEST(seamGraph, weightsColor)
+{
+    Subimages sub({37, 23});
+    SeamGraphWorkspace workspace;
+    cv::Mat horizontal, vertical;
+    seamGraphWeightsColor(sub.img1, sub.img2, sub.mask1, sub.mask2,
+                          bad_region_penalty, workspace, horizontal, vertical);
+
+    for (int y = 0; y < sub.img1.rows; ++y) {
+        for (int x = 0; x < sub.img1.cols; ++x) {
+            if (x < sub.img1.cols - 1) {
+                float weight = sub.cost(y, x) + sub.cost(y, x + 1) + 1.f;
+                if (sub.bad(y, x, y, x + 1))
+                    weight += bad_region_penalty;
+                ASSERT_EQ(horizontal.at<float>(y, x), weight);
+            }
+            if (y < sub.img1.rows - 1) {
+                float weight = sub.cost(y, x) + sub.cost(y + 1, x) + 1.f;
+                if (sub.bad(y, x, y + 1, x))
+                    weight += bad_region_penalty;
+                ASSERT_EQ(vertical.at<float>(y, x), weight);
+            }
+        }
+    }
+}
+
+TEST(seamGraph, weightsColorGrad)
+{
+    Subimages sub({37, 23});
+    SeamGraphWorkspace workspace;
+    cv::Mat horizontal, vertical;
+    seamGraphWeightsColorGrad(sub.img1, sub.img2, sub.dx1, sub.dx2, sub.dy1,
+                              sub.dy2, sub.mask1, sub.mask2,
+                              bad_region_penalty, workspace, horizontal,
+                              vertical);
+
+    for (int y = 0; y < sub.img1.rows; ++y) {
+        for (int x = 0; x < sub.img1.cols; ++x) {
+            if (x < sub.img1.cols - 1) {
+                float grad = sub.dx1.at<float>(y, x) +
+                             sub.dx1.at<float>(y, x + 1) +
+                             sub.dx2.at<float>(y, x) +
+                             sub.dx2.at<float>(y, x + 1) + 1.f;
+                float weight =
+                    (sub.cost(y, x) + sub.cost(y, x + 1)) / grad + 1.f;
+                if (sub.bad(y, x, y, x + 1))
+                    weight += bad_region_penalty;
+                ASSERT_EQ(horizontal.at<float>(y, x), weight);
+            }
+            if (y < sub.img1.rows - 1) {
+                float grad = sub.dy1.at<float>(y, x) +
+                             sub.dy1.at<float>(y + 1, x) +
+                             sub.dy2.at<float>(y, x) +
+                             sub.dy2.at<float>(y + 1, x) + 1.f;
+                float weight =
+                    (sub.cost(y, x) + sub.cost(y + 1, x)) / grad + 1.f;
+                if (sub.bad(y, x, y + 1, x))
+                    weight += bad_region_penalty;
+                ASSERT_EQ(vertical.at<float>(y, x), weight);
+            }
+        }
+    }
+}
+
+TEST(seamGraph, workspaceReuse)
+{
+    SeamGraphWorkspace workspace;
+    cv::Mat large = workspace.zeros(SeamGraphWorkspace::Image1, {40, 30},
+                                    CV_32FC3);
+    cv::Mat small = workspace.zeros(SeamGraphWorkspace::Image1, {20, 10},
+                                    CV_32FC3);
+    EXPECT_EQ(large.data, small.data);
+    EXPECT_TRUE(small.isContinuous());
+    EXPECT_EQ(cv::countNonZero(small.reshape(1)), 0);
+}
@@ -0,0 +1,223 @@
+#include "gtest/gtest.h"
+#include "airmap/recipe.h"
+
+#include <boost/filesystem.hpp>
+
+#include <opencv2/calib3d.hpp>
+
+#include <cfloat>
+#include <cmath>
+#include <stdexcept>
+
+using airmap::stitcher::ExposureCompensatorType;
+using airmap::stitcher::GimbalOrientation;
+using airmap::stitcher::StitchRecipe;
+
+namespace {
+
+/**
+ * @brief makeRecipe
+ * A recipe of a ring of cameras, yawing right, whose rotations are their
+ * gimbal orientations.
+ */
+StitchRecipe makeRecipe(size_t count)
+{
+    StitchRecipe recipe;
+    recipe.image_count = static_cast<int>(count) + 1;
+    recipe.work_size = cv::Size(800, 600);
+    recipe.warped_image_scale = 700.f;
+    recipe.rotate_result = true;
+    recipe.exposure_compensator_type = ExposureCompensatorType::GainBlocks;
+
+    for (size_t i = 0; i < count; ++i) {
+        GimbalOrientation gimbal_orientation(-10.0, 0.0, 40.0 * i);
+
+        cv::detail::CameraParams camera;
+        camera.focal = 700.0;
+        camera.ppx = 400.0;
+        camera.ppy = 300.0;
+        gimbal_orientation.cameraRotation().convertTo(camera.R, CV_32F);
+
+        cv::Mat seam_mask(60, 80, CV_8U, cv::Scalar::all(255));
+        seam_mask(cv::Rect(60, 0, 20, 60)).setTo(0);
+
+        recipe.image_indices.push_back(static_cast<int>(i) + 1);
+        recipe.cameras.push_back(camera);
+        recipe.gimbal_orientations.push_back(gimbal_orientation);
+        recipe.exposure_gains.push_back(cv::Mat(4, 4, CV_32F, cv::Scalar(1.0 + 0.1 * i)));
+        recipe.corners.emplace_back(60 * static_cast<int>(i), 10);
+        recipe.seam_masks.push_back(seam_mask);
+    }
+
+    return recipe;
+}
+
+double rotationDistance(const cv::Mat &a, const cv::Mat &b)
+{
+    cv::Mat a_, b_;
+    a.convertTo(a_, CV_64F);
+    b.convertTo(b_, CV_64F);
+    cv::Mat rvec;
+    cv::Rodrigues(cv::Mat(a_.t() * b_), rvec);
+    return cv::norm(rvec);
+}
+
+} // namespace
+
+TEST(recipe, savesAndLoads)
+{
+    StitchRecipe recipe = makeRecipe(3);
+    boost::filesystem::path path = boost::filesystem::temp_directory_path()
+            / boost::filesystem::unique_path("recipe-%%%%-%%%%.yml.gz");
+
+    recipe.save(path.string());
+    StitchRecipe loaded = StitchRecipe::load(path.string());
+    boost::filesystem::remove(path);
+
+    EXPECT_EQ(loaded.image_count, recipe.image_count);
+    EXPECT_EQ(loaded.image_indices, recipe.image_indices);
+    EXPECT_EQ(loaded.work_size, recipe.work_size);
+    EXPECT_FLOAT_EQ(loaded.warped_image_scale, recipe.warped_image_scale);
+    EXPECT_EQ(loaded.rotate_result, recipe.rotate_result);
+    EXPECT_EQ(loaded.exposure_compensator_type,
+              recipe.exposure_compensator_type);
+    EXPECT_EQ(loaded.corners, recipe.corners);
+    ASSERT_EQ(loaded.cameras.size(), recipe.cameras.size());
+    for (size_t i = 0; i < recipe.cameras.size(); ++i) {
+        EXPECT_DOUBLE_EQ(loaded.cameras[i].focal, recipe.cameras[i].focal);
+        EXPECT_DOUBLE_EQ(loaded.cameras[i].ppx, recipe.cameras[i].ppx);
+        EXPECT_DOUBLE_EQ(loaded.cameras[i].ppy, recipe.cameras[i].ppy);
+        EXPECT_EQ(cv::norm(loaded.cameras[i].R, recipe.cameras[i].R), 0.);
+        EXPECT_DOUBLE_EQ(loaded.gimbal_orientations[i].yaw,
+                         recipe.gimbal_orientations[i].yaw);
+        EXPECT_EQ(cv::norm(loaded.exposure_gains[i], recipe.exposure_gains[i]), 0.);
+        EXPECT_EQ(cv::norm(loaded.seam_masks[i], recipe.seam_masks[i], cv::NORM_L1), 0.);
+    }
+}
+
+TEST(recipe, loadRejectsInconsistentRecipes)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path()
+            / boost::filesystem::unique_path("recipe-%%%%-%%%%.yml");
+    EXPECT_THROW(StitchRecipe::load(path.string()), std::invalid_argument);
+
+    StitchRecipe recipe = makeRecipe(3);
+    recipe.corners.pop_back();
+    recipe.save(path.string());
+    EXPECT_THROW(StitchRecipe::load(path.string()), std::invalid_argument);
+
+    recipe = makeRecipe(3);
+    recipe.image_indices.back() = recipe.image_count;
+    recipe.save(path.string());
+    EXPECT_THROW(StitchRecipe::load(path.string()), std::invalid_argument);
+
+    // Gain maps without the compensator that applies them, and a gain
+    // compensator without gains.
+    recipe = makeRecipe(3);
+    recipe.exposure_compensator_type = ExposureCompensatorType::No;
+    recipe.save(path.string());
+    EXPECT_THROW(StitchRecipe::load(path.string()), std::invalid_argument);
+
+    recipe = makeRecipe(3);
+    recipe.exposure_gains.clear();
+    recipe.save(path.string());
+    EXPECT_THROW(StitchRecipe::load(path.string()), std::invalid_argument);
+
+    recipe.exposure_compensator_type = ExposureCompensatorType::No;
+    recipe.save(path.string());
+    EXPECT_NO_THROW(StitchRecipe::load(path.string()));
+    boost::filesystem::remove(path);
+}
+
+TEST(recipe, alignedCamerasFollowGimbal)
+{
+    StitchRecipe recipe = makeRecipe(4);
+
+    // The same pattern flown at another heading lines up with the recipe.
+    std::vector<GimbalOrientation> gimbal_orientations;
+    for (const auto &gimbal_orientation : recipe.gimbal_orientations) {
+        gimbal_orientations.emplace_back(gimbal_orientation.pitch,
+                                         gimbal_orientation.roll,
+                                         gimbal_orientation.yaw + 25.0);
+    }
+    auto cameras = recipe.alignedCameras(gimbal_orientations, recipe.work_size);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_EQ(cameras[i].R.type(), CV_32F);
+        EXPECT_LT(rotationDistance(cameras[i].R, recipe.cameras[i].R), 1e-5);
+    }
+
+    // A change of one image's gimbal orientation changes its rotation
+    // relative to the others.
+    gimbal_orientations[2].yaw += 3.0;
+    cameras = recipe.alignedCameras(gimbal_orientations, recipe.work_size);
+    cv::Mat recipe_relative, relative;
+    recipe_relative = recipe.cameras[1].R.t() * recipe.cameras[2].R;
+    relative = cameras[1].R.t() * cameras[2].R;
+    EXPECT_NEAR(rotationDistance(relative, recipe_relative), 3.0 * M_PI / 180.0, 1e-4);
+
+    // Missing orientations keep the recipe's rotations.
+    gimbal_orientations.assign(recipe.cameras.size(), GimbalOrientation(DBL_MAX, 0, 0));
+    cameras = recipe.alignedCameras(gimbal_orientations, recipe.work_size);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_LT(rotationDistance(cameras[i].R, recipe.cameras[i].R), 1e-5);
+    }
+}
+
+TEST(recipe, alignedCamerasScaleIntrinsics)
+{
+    StitchRecipe recipe = makeRecipe(2);
+    auto cameras = recipe.alignedCameras(
+            recipe.gimbal_orientations,
+            cv::Size(recipe.work_size.width / 2, recipe.work_size.height / 2));
+
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_DOUBLE_EQ(cameras[i].focal, recipe.cameras[i].focal / 2);
+        EXPECT_DOUBLE_EQ(cameras[i].ppx, recipe.cameras[i].ppx / 2);
+        EXPECT_DOUBLE_EQ(cameras[i].ppy, recipe.cameras[i].ppy / 2);
+    }
+}
+
+TEST(recipe, cutAlongSeams)
+{
+    StitchRecipe recipe = makeRecipe(2);
+
+    // Warped masks shifted left of the recipe's by 10 pixels, and 10
+    // pixels wider.
+    std::vector<cv::Point> corners;
+    std::vector<cv::UMat> masks_warped(2);
+    for (size_t i = 0; i < 2; ++i) {
+        corners.push_back(recipe.corners[i] - cv::Point(10, 0));
+        masks_warped[i].create(60, 100, CV_8U);
+        masks_warped[i].setTo(cv::Scalar::all(255));
+    }
+
+    recipe.cutAlongSeams(corners, masks_warped);
+
+    cv::Mat mask = masks_warped[0].getMat(cv::ACCESS_READ);
+    // Outside of the recipe's mask, kept.
+    EXPECT_EQ(mask.at<uchar>(30, 5), 255);
+    EXPECT_EQ(mask.at<uchar>(30, 95), 255);
+    // Within the recipe's mask, cut along its seam.
+    EXPECT_EQ(mask.at<uchar>(30, 60), 255);
+    EXPECT_EQ(mask.at<uchar>(30, 75), 0);
+}
+
+TEST(recipe, alignRotations)
+{
+    StitchRecipe recipe = makeRecipe(4);
+
+    cv::Mat Q;
+    cv::Rodrigues(cv::Vec3d(0.2, -0.4, 0.1), Q);
+    std::vector<cv::detail::CameraParams> cameras = recipe.cameras;
+    for (auto &camera : cameras) {
+        cv::Mat R, R_rotated;
+        camera.R.convertTo(R, CV_64F);
+        cv::Mat(Q * R).convertTo(R_rotated, CV_32F);
+        camera.R = R_rotated;
+    }
+
+    StitchRecipe::alignRotations(recipe.cameras, cameras);
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        EXPECT_LT(rotationDistance(cameras[i].R, recipe.cameras[i].R), 1e-5);
+    }
+}
@@ -31,8 +31,7 @@ public:
         Stitcher::Report report;
         SourceImages source_images(_panorama, _logger);
         source_images.scaleToAvailableMemory(
-            _parameters.memoryBudgetMB, _parameters.maxInputImageSize,
-            report.inputSizeMB, report.inputScaled);
+            memoryPlanner(source_images), report.inputSizeMB, report.inputScaled);
         source_images.scale(getSeamScale(source_images));
         return LowLevelOpenCVStitcher::shouldRotateThreeSixty(
             source_images.images_scaled, warped_images);
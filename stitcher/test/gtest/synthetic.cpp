@@ -0,0 +1,138 @@
+#include "gtest/gtest.h"
+
+#include "airmap/camera.h"
+#include "airmap/panorama.h"
+#include "airmap/synthetic.h"
+#include "util/mat_compare.h"
+
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core.hpp>
+
+namespace airmap {
+namespace stitcher {
+
+class SyntheticPanoramaTest : public ::testing::Test
+{
+protected:
+    SyntheticPanoramaTest()
+        : directory((boost::filesystem::temp_directory_path()
+                     / boost::filesystem::unique_path("synthetic-%%%%-%%%%"))
+                            .string())
+    {
+    }
+
+    ~SyntheticPanoramaTest() { boost::filesystem::remove_all(directory); }
+
+    /**
+     * @brief createCamera
+     * A 64x48 pinhole camera with a 90 degree horizontal field of view.
+     */
+    Camera createCamera()
+    {
+        return Camera(0.0032, cv::Point2d(0.0064, 0.0048), cv::Point2d(64, 48),
+                      cv::Point2d(31.5, 23.5));
+    }
+
+    /**
+     * @brief createEquirectangular
+     * A scene whose blue channel is its column, and green channel its row,
+     * scaled to 0..255.
+     */
+    cv::Mat createEquirectangular()
+    {
+        cv::Mat equirectangular(256, 512, CV_8UC3);
+        for (int y = 0; y < equirectangular.rows; ++y) {
+            for (int x = 0; x < equirectangular.cols; ++x) {
+                equirectangular.at<cv::Vec3b>(y, x) =
+                        cv::Vec3b(static_cast<uchar>(x / 2), static_cast<uchar>(y), 0);
+            }
+        }
+        return equirectangular;
+    }
+
+    SyntheticPanorama::Parameters createParameters()
+    {
+        SyntheticPanorama::Parameters parameters;
+        parameters.model = "Test";
+        return parameters;
+    }
+
+    const std::string directory;
+};
+
+TEST_F(SyntheticPanoramaTest, spiral)
+{
+    std::vector<GimbalOrientation> orientations = SyntheticPanorama::spiral(25);
+    ASSERT_EQ(orientations.size(), 25);
+    for (const GimbalOrientation &orientation : orientations) {
+        EXPECT_GE(orientation.pitch, -90.);
+        EXPECT_LE(orientation.pitch, 30.);
+        EXPECT_GT(orientation.yaw, -180.);
+        EXPECT_LE(orientation.yaw, 180.);
+        EXPECT_DOUBLE_EQ(orientation.roll, 0.);
+    }
+    EXPECT_LT(orientations.front().pitch, orientations.back().pitch);
+}
+
+TEST_F(SyntheticPanoramaTest, render)
+{
+    EXPECT_THROW(SyntheticPanorama(cv::Mat(), createCamera(), createParameters()),
+                 std::invalid_argument);
+
+    SyntheticPanorama synthetic(createEquirectangular(), createCamera(),
+                                createParameters());
+    cv::Mat frame = synthetic.render(GimbalOrientation(0., 0., 0.));
+    EXPECT_EQ(frame.size(), cv::Size(64, 48));
+    // Yaw 0 looks at the centre of the panorama, on the horizon.
+    EXPECT_NEAR(frame.at<cv::Vec3b>(24, 32)[0], 128, 2);
+    EXPECT_NEAR(frame.at<cv::Vec3b>(24, 32)[1], 128, 2);
+
+    // Yaw 90 looks at three quarters of its width.
+    frame = synthetic.render(GimbalOrientation(0., 0., 90.));
+    EXPECT_NEAR(frame.at<cv::Vec3b>(24, 32)[0], 192, 2);
+
+    // Pitch -90 looks at its bottom row.
+    frame = synthetic.render(GimbalOrientation(-90., 0., 0.));
+    EXPECT_GT(frame.at<cv::Vec3b>(24, 32)[1], 250);
+}
+
+TEST_F(SyntheticPanoramaTest, writeAndLoadGroundTruth)
+{
+    SyntheticPanorama synthetic(createEquirectangular(), createCamera(),
+                                createParameters());
+    std::vector<GimbalOrientation> orientations { GimbalOrientation(-90., 0., 0.),
+                                                  GimbalOrientation(-30., 5., 120.) };
+    std::vector<SyntheticFrame> frames = synthetic.write(orientations, directory);
+    ASSERT_EQ(frames.size(), 2);
+
+    // The frames have the metadata of a capture of the camera.
+    GeoImage first = GeoImage::fromExif(frames[0].path);
+    GeoImage second = GeoImage::fromExif(frames[1].path);
+    EXPECT_EQ(second.cameraMake, "Synthetic");
+    EXPECT_EQ(second.cameraModel, "Test");
+    EXPECT_EQ(second.widthPixels, 64);
+    EXPECT_EQ(second.heightPixels, 48);
+    EXPECT_NEAR(second.cameraPitchDeg, -30., 1e-6);
+    EXPECT_NEAR(second.cameraRollDeg, 5., 1e-6);
+    EXPECT_NEAR(second.cameraYawDeg, 120., 1e-6);
+    EXPECT_NEAR(second.geoCoordinate.lat(), -33.8688, 1e-5);
+    EXPECT_NEAR(second.geoCoordinate.lng(), 151.2093, 1e-5);
+    EXPECT_EQ(second.createdTimestampSec - first.createdTimestampSec, 2);
+
+    std::vector<SyntheticFrame> ground_truth = SyntheticPanorama::loadGroundTruth(
+            (boost::filesystem::path(directory) / "ground_truth.yml").string());
+    ASSERT_EQ(ground_truth.size(), 2);
+    for (size_t i = 0; i < frames.size(); ++i) {
+        EXPECT_EQ(ground_truth[i].path, frames[i].path);
+        EXPECT_DOUBLE_EQ(ground_truth[i].orientation.pitch, orientations[i].pitch);
+        EXPECT_DOUBLE_EQ(ground_truth[i].orientation.yaw, orientations[i].yaw);
+        EXPECT_PRED_FORMAT2(CvMatEq, ground_truth[i].R, frames[i].R);
+    }
+
+    EXPECT_THROW(SyntheticPanorama::loadGroundTruth(directory + "/missing.yml"),
+                 std::invalid_argument);
+}
+
+} // namespace stitcher
+} // namespace airmap
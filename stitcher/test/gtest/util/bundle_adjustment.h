@@ -0,0 +1,169 @@
+#pragma once
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/stitching/detail/camera.hpp>
+#include <opencv2/stitching/detail/matchers.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace util {
+namespace bundle_adjustment {
+
+/**
+ * @brief Scene
+ * Features and matches of cameras rotating about the vertical axis, as seen
+ * by a panorama shot from a single point.
+ */
+struct Scene {
+    std::vector<cv::detail::CameraParams> truth;
+    std::vector<cv::detail::ImageFeatures> features;
+    std::vector<cv::detail::MatchesInfo> matches;
+};
+
+static inline cv::Mat rotation(double x, double y, double z)
+{
+    cv::Mat R;
+    cv::Rodrigues(cv::Vec3d(x, y, z), R);
+    R.convertTo(R, CV_32F);
+    return R;
+}
+
+static inline cv::Matx33d
+intrinsics(const cv::detail::CameraParams &camera)
+{
+    cv::Matx33d K;
+    camera.K().convertTo(K, CV_64F);
+    return K;
+}
+
+static inline Scene makeScene(size_t count)
+{
+    const cv::Size img_size(1000, 750);
+    const double focal = 800.;
+    const double yaw_step = 0.35;
+    const int samples = 200;
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> x_distribution(0., img_size.width);
+    std::uniform_real_distribution<double> y_distribution(0., img_size.height);
+    std::normal_distribution<float> noise(0.f, 0.3f);
+
+    Scene scene;
+    scene.truth.resize(count);
+    scene.features.resize(count);
+    scene.matches.resize(count * count);
+    for (size_t i = 0; i < count; ++i) {
+        scene.truth[i].focal = focal;
+        scene.truth[i].ppx = img_size.width * 0.5;
+        scene.truth[i].ppy = img_size.height * 0.5;
+        scene.truth[i].R = rotation(0.02 * i, yaw_step * i, 0.);
+        scene.features[i].img_idx = static_cast<int>(i);
+        scene.features[i].img_size = img_size;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const cv::Matx33d K1 = intrinsics(scene.truth[i]);
+        const cv::Matx33d R1 = scene.truth[i].R;
+        for (size_t j = i + 1; j < count; ++j) {
+            const cv::Matx33d K2 = intrinsics(scene.truth[j]);
+            const cv::Matx33d R2 = scene.truth[j].R;
+            const cv::Matx33d H = K2 * R2.t() * R1 * K1.inv();
+
+            cv::detail::MatchesInfo &matches_info =
+                scene.matches[i * count + j];
+            for (int k = 0; k < samples; ++k) {
+                const cv::Vec3d p1(x_distribution(rng), y_distribution(rng),
+                                   1.);
+                const cv::Vec3d p2 = H * p1;
+                if (p2[2] <= 0. || p2[0] < 0. || p2[1] < 0. ||
+                    p2[0] >= p2[2] * img_size.width ||
+                    p2[1] >= p2[2] * img_size.height) {
+                    continue;
+                }
+
+                auto &keypoints1 = scene.features[i].keypoints;
+                auto &keypoints2 = scene.features[j].keypoints;
+                keypoints1.emplace_back(
+                    cv::Point2f(static_cast<float>(p1[0]) + noise(rng),
+                                static_cast<float>(p1[1]) + noise(rng)),
+                    1.f);
+                keypoints2.emplace_back(
+                    cv::Point2f(static_cast<float>(p2[0] / p2[2]) + noise(rng),
+                                static_cast<float>(p2[1] / p2[2]) + noise(rng)),
+                    1.f);
+                matches_info.matches.emplace_back(
+                    static_cast<int>(keypoints1.size()) - 1,
+                    static_cast<int>(keypoints2.size()) - 1, 0.f);
+            }
+
+            if (matches_info.matches.size() < 20) {
+                matches_info.matches.clear();
+                continue;
+            }
+
+            matches_info.src_img_idx = static_cast<int>(i);
+            matches_info.dst_img_idx = static_cast<int>(j);
+            matches_info.inliers_mask.assign(matches_info.matches.size(), 1);
+            matches_info.num_inliers =
+                static_cast<int>(matches_info.matches.size());
+            matches_info.confidence = 3.;
+            matches_info.H = cv::Mat(H);
+
+            cv::detail::MatchesInfo &reverse = scene.matches[j * count + i];
+            reverse = matches_info;
+            reverse.src_img_idx = static_cast<int>(j);
+            reverse.dst_img_idx = static_cast<int>(i);
+            reverse.H = cv::Mat(H.inv());
+            for (auto &match : reverse.matches) {
+                std::swap(match.queryIdx, match.trainIdx);
+            }
+        }
+    }
+
+    return scene;
+}
+
+/**
+ * @brief perturbed
+ * The true cameras, with errors in focal length and rotation as an initial
+ * estimation would have.
+ */
+static inline std::vector<cv::detail::CameraParams>
+perturbed(const Scene &scene)
+{
+    std::vector<cv::detail::CameraParams> cameras = scene.truth;
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        cameras[i].focal *= 1.05;
+        cameras[i].R = cameras[i].R * rotation(0.01, -0.02, 0.015 * i);
+    }
+    return cameras;
+}
+
+/**
+ * @brief relativeRotationError
+ * Largest angle between the estimated and the true rotation between two
+ * cameras, which does not depend on the global rotation of the estimation.
+ */
+static inline double
+relativeRotationError(const std::vector<cv::detail::CameraParams> &a,
+                      const std::vector<cv::detail::CameraParams> &b)
+{
+    double error = 0.;
+    for (size_t i = 0; i < a.size(); ++i) {
+        for (size_t j = i + 1; j < a.size(); ++j) {
+            const cv::Matx33d a_i = a[i].R, a_j = a[j].R;
+            const cv::Matx33d b_i = b[i].R, b_j = b[j].R;
+            const cv::Matx33d difference =
+                (a_i.t() * a_j) * (b_i.t() * b_j).t();
+            cv::Vec3d rvec;
+            cv::Rodrigues(difference, rvec);
+            error = std::max(error, cv::norm(rvec));
+        }
+    }
+    return error;
+}
+
+} // namespace bundle_adjustment
+} // namespace util
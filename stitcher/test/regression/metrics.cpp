@@ -0,0 +1,413 @@
+#include "metrics.h"
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+namespace {
+
+std::string kindStr(RegressionResults::Kind kind)
+{
+    switch (kind) {
+    case RegressionResults::Kind::Time:
+        return "time";
+    case RegressionResults::Kind::Memory:
+        return "memory";
+    case RegressionResults::Kind::Quality:
+        return "quality";
+    }
+    return "";
+}
+
+RegressionResults::Kind kindFromStr(const std::string &name)
+{
+    if (name == "time") {
+        return RegressionResults::Kind::Time;
+    } else if (name == "memory") {
+        return RegressionResults::Kind::Memory;
+    } else if (name == "quality") {
+        return RegressionResults::Kind::Quality;
+    }
+    throw std::invalid_argument("Unknown kind of metric " + name);
+}
+
+std::string statusStr(RegressionComparison::Status status)
+{
+    switch (status) {
+    case RegressionComparison::Status::Unchanged:
+        return "";
+    case RegressionComparison::Status::Improved:
+        return "improved";
+    case RegressionComparison::Status::Regressed:
+        return "REGRESSED";
+    case RegressionComparison::Status::Added:
+        return "added";
+    case RegressionComparison::Status::Missing:
+        return "missing";
+    }
+    return "";
+}
+
+/**
+ * @brief milliseconds
+ * Milliseconds per Google Benchmark time unit.
+ */
+double milliseconds(const std::string &time_unit)
+{
+    if (time_unit == "ns") {
+        return 1e-6;
+    } else if (time_unit == "us") {
+        return 1e-3;
+    } else if (time_unit == "s") {
+        return 1e3;
+    }
+    return 1.;
+}
+
+/**
+ * @brief value
+ * A metric value as shown in a comparison, to the precision it's
+ * meaningful to.
+ */
+std::string value(RegressionResults::Kind kind, double value)
+{
+    std::stringstream stream;
+    stream << std::fixed
+           << std::setprecision(kind == RegressionResults::Kind::Quality ? 4 : 1)
+           << value;
+    return stream.str();
+}
+
+/**
+ * @brief comparable
+ * An image and a reference as CV_8U of the same size and channels.
+ */
+void comparable(const cv::Mat &reference, const cv::Mat &image,
+                cv::Mat &reference_8u, cv::Mat &image_8u)
+{
+    if (reference.empty() || image.empty()) {
+        throw std::invalid_argument("Can't compare an empty image");
+    }
+    reference.convertTo(reference_8u, CV_8U);
+    image.convertTo(image_8u, CV_8U);
+    if (image_8u.channels() != reference_8u.channels()) {
+        cv::cvtColor(image_8u, image_8u,
+                     image_8u.channels() == 1 ? cv::COLOR_GRAY2BGR : cv::COLOR_BGR2GRAY);
+    }
+    if (image_8u.size() != reference_8u.size()) {
+        cv::resize(image_8u, image_8u, reference_8u.size(), 0, 0, cv::INTER_AREA);
+    }
+}
+
+} // namespace
+
+//
+//
+// RegressionResults
+//
+//
+void RegressionResults::addStitch(const OperationResourcesMap &resources,
+                                  const ElapsedTime &elapsed)
+{
+    size_t peakRssMB = 0;
+    for (const auto &operation : resources) {
+        const std::string prefix = "stitch/" + Operation(operation.first).str();
+        metrics[prefix + "/elapsed_ms"] = {
+            Kind::Time, static_cast<double>(operation.second.wall.milliseconds(false))
+        };
+        metrics[prefix + "/peak_rss_mb"] = {
+            Kind::Memory, static_cast<double>(operation.second.peakRssMB)
+        };
+        peakRssMB = std::max(peakRssMB, operation.second.peakRssMB);
+    }
+    metrics["stitch/elapsed_ms"] = { Kind::Time,
+                                     static_cast<double>(elapsed.milliseconds(false)) };
+    metrics["stitch/peak_rss_mb"] = { Kind::Memory, static_cast<double>(peakRssMB) };
+}
+
+void RegressionResults::addBenchmarks(const std::string &path)
+{
+    boost::property_tree::ptree tree;
+    try {
+        boost::property_tree::read_json(path, tree);
+    } catch (const boost::property_tree::json_parser_error &e) {
+        throw std::invalid_argument("Can't read benchmarks " + path + ": " + e.message());
+    }
+
+    auto benchmarks = tree.get_child_optional("benchmarks");
+    if (!benchmarks) {
+        throw std::invalid_argument("No benchmarks in " + path);
+    }
+    for (const auto &benchmark : *benchmarks) {
+        // Aggregates of repetitions are left out for the repetitions
+        // themselves, as are benchmarks which failed.
+        if (benchmark.second.get<std::string>("run_type", "iteration") != "iteration"
+            || benchmark.second.get<std::string>("error_occurred", "false") == "true") {
+            continue;
+        }
+        const std::string name = "benchmark/" + benchmark.second.get<std::string>("name");
+        const double time = benchmark.second.get<double>("real_time")
+                * milliseconds(benchmark.second.get<std::string>("time_unit", "ns"));
+        auto it = metrics.find(name);
+        if (it == metrics.end()) {
+            metrics[name] = { Kind::Time, time };
+        } else {
+            it->second.value = std::min(it->second.value, time);
+        }
+    }
+}
+
+void RegressionResults::addQuality(const cv::Mat &reference, const cv::Mat &panorama)
+{
+    metrics["quality/psnr_db"] = { Kind::Quality, psnr(reference, panorama) };
+    metrics["quality/ssim"] = { Kind::Quality, ssim(reference, panorama) };
+}
+
+RegressionResults RegressionResults::median(const std::vector<RegressionResults> &runs)
+{
+    RegressionResults result;
+    std::map<std::string, std::vector<double>> values;
+    for (const RegressionResults &run : runs) {
+        for (const auto &metric : run.metrics) {
+            result.metrics[metric.first].kind = metric.second.kind;
+            values[metric.first].push_back(metric.second.value);
+        }
+    }
+    for (auto &metric : values) {
+        std::vector<double> &sorted = metric.second;
+        std::sort(sorted.begin(), sorted.end());
+        const size_t middle = sorted.size() / 2;
+        result.metrics[metric.first].value = sorted.size() % 2
+                ? sorted[middle]
+                : (sorted[middle - 1] + sorted[middle]) / 2.;
+    }
+    return result;
+}
+
+RegressionResults RegressionResults::load(const std::string &path)
+{
+    boost::property_tree::ptree tree;
+    try {
+        boost::property_tree::read_json(path, tree);
+    } catch (const boost::property_tree::json_parser_error &e) {
+        throw std::invalid_argument("Can't read baseline " + path + ": " + e.message());
+    }
+
+    RegressionResults results;
+    try {
+        // The names contain dots, which a path of the tree would split at.
+        for (const auto &metric : tree.get_child("metrics")) {
+            results.metrics[metric.first] = {
+                kindFromStr(metric.second.get<std::string>("kind")),
+                metric.second.get<double>("value")
+            };
+        }
+    } catch (const boost::property_tree::ptree_error &e) {
+        throw std::invalid_argument("Invalid baseline " + path + ": " + e.what());
+    }
+    return results;
+}
+
+void RegressionResults::save(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file) {
+        throw std::invalid_argument("Can't write " + path);
+    }
+
+    // Enough digits for the loaded results to equal the saved ones.
+    file.precision(std::numeric_limits<double>::max_digits10);
+    file << "{\n  \"metrics\": {";
+    for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+        // Names are of operations and benchmarks, without quotes or
+        // backslashes to escape.
+        file << (it == metrics.begin() ? "\n" : ",\n") << "    \"" << it->first
+             << "\": {\"kind\": \"" << kindStr(it->second.kind)
+             << "\", \"value\": " << it->second.value << "}";
+    }
+    file << "\n  }\n}\n";
+}
+
+//
+//
+// RegressionComparison
+//
+//
+double RegressionComparison::Row::change() const
+{
+    if (status == Status::Added || status == Status::Missing || baseline == 0.) {
+        return 0.;
+    }
+    return (current - baseline) / std::abs(baseline);
+}
+
+RegressionComparison RegressionComparison::compare(const RegressionResults &baseline,
+                                                   const RegressionResults &current,
+                                                   const RegressionTolerances &tolerances)
+{
+    RegressionComparison comparison;
+    for (const auto &metric : baseline.metrics) {
+        Row row;
+        row.name = metric.first;
+        row.kind = metric.second.kind;
+        row.baseline = metric.second.value;
+
+        auto it = current.metrics.find(metric.first);
+        if (it == current.metrics.end()) {
+            row.status = Status::Missing;
+            comparison.rows.push_back(row);
+            continue;
+        }
+        row.current = it->second.value;
+
+        const double difference = row.current - row.baseline;
+        const double change = row.baseline == 0.
+                ? (difference == 0. ? 0. : std::copysign(1., difference)
+                           * std::numeric_limits<double>::infinity())
+                : difference / std::abs(row.baseline);
+        switch (row.kind) {
+        case RegressionResults::Kind::Time:
+        case RegressionResults::Kind::Memory: {
+            const bool time = row.kind == RegressionResults::Kind::Time;
+            const double tolerance = time ? tolerances.time : tolerances.memory;
+            const double minimum =
+                    time ? tolerances.minimumTimeMs : tolerances.minimumMemoryMB;
+            if (std::abs(difference) >= minimum) {
+                row.status = change > tolerance
+                        ? Status::Regressed
+                        : change < -tolerance ? Status::Improved : Status::Unchanged;
+            }
+            break;
+        }
+        case RegressionResults::Kind::Quality:
+            row.status = change < -tolerances.quality
+                    ? Status::Regressed
+                    : change > tolerances.quality ? Status::Improved : Status::Unchanged;
+            break;
+        }
+        comparison.rows.push_back(row);
+    }
+
+    for (const auto &metric : current.metrics) {
+        if (baseline.metrics.count(metric.first) == 0) {
+            Row row;
+            row.name = metric.first;
+            row.kind = metric.second.kind;
+            row.current = metric.second.value;
+            row.status = Status::Added;
+            comparison.rows.push_back(row);
+        }
+    }
+
+    std::sort(comparison.rows.begin(), comparison.rows.end(),
+              [](const Row &a, const Row &b) { return a.name < b.name; });
+    return comparison;
+}
+
+bool RegressionComparison::regressed() const
+{
+    return std::any_of(rows.begin(), rows.end(),
+                       [](const Row &row) { return row.status == Status::Regressed; });
+}
+
+std::string RegressionComparison::str() const
+{
+    size_t width = std::string("metric").size();
+    for (const Row &row : rows) {
+        width = std::max(width, row.name.size());
+    }
+
+    std::map<Status, size_t> counts;
+    std::stringstream table;
+    table << std::left << std::setw(static_cast<int>(width)) << "metric" << std::right
+          << std::setw(14) << "baseline" << std::setw(14) << "current"
+          << std::setw(10) << "change" << "\n";
+    for (const Row &row : rows) {
+        std::stringstream change;
+        if (row.status != Status::Added && row.status != Status::Missing) {
+            change << std::showpos << std::fixed << std::setprecision(1)
+                   << row.change() * 100. << "%";
+        }
+        table << std::left << std::setw(static_cast<int>(width)) << row.name << std::right
+              << std::setw(14)
+              << (row.status == Status::Added ? "-" : value(row.kind, row.baseline))
+              << std::setw(14)
+              << (row.status == Status::Missing ? "-" : value(row.kind, row.current))
+              << std::setw(10) << change.str();
+        if (row.status != Status::Unchanged) {
+            table << "  " << statusStr(row.status);
+        }
+        table << "\n";
+        ++counts[row.status];
+    }
+    table << counts[Status::Regressed] << " of " << rows.size() << " metrics regressed, "
+          << counts[Status::Improved] << " improved, " << counts[Status::Added]
+          << " added, " << counts[Status::Missing] << " missing.";
+    return table.str();
+}
+
+double psnr(const cv::Mat &reference, const cv::Mat &image)
+{
+    cv::Mat reference_8u, image_8u;
+    comparable(reference, image, reference_8u, image_8u);
+    return std::min(100., cv::PSNR(reference_8u, image_8u));
+}
+
+double ssim(const cv::Mat &reference, const cv::Mat &image)
+{
+    cv::Mat reference_8u, image_8u;
+    comparable(reference, image, reference_8u, image_8u);
+    if (reference_8u.channels() > 1) {
+        cv::cvtColor(reference_8u, reference_8u, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(image_8u, image_8u, cv::COLOR_BGR2GRAY);
+    }
+
+    // As Wang et al. define it, with an 11x11 gaussian window of sigma 1.5.
+    const double C1 = (0.01 * 255) * (0.01 * 255);
+    const double C2 = (0.03 * 255) * (0.03 * 255);
+    const cv::Size window(11, 11);
+    const double sigma = 1.5;
+
+    cv::Mat x, y;
+    reference_8u.convertTo(x, CV_32F);
+    image_8u.convertTo(y, CV_32F);
+
+    cv::Mat mu_x, mu_y;
+    cv::GaussianBlur(x, mu_x, window, sigma);
+    cv::GaussianBlur(y, mu_y, window, sigma);
+    cv::Mat mu_x_mu_y = mu_x.mul(mu_y);
+    cv::Mat mu_x_2 = mu_x.mul(mu_x);
+    cv::Mat mu_y_2 = mu_y.mul(mu_y);
+
+    cv::Mat sigma_x_2, sigma_y_2, sigma_xy;
+    cv::GaussianBlur(x.mul(x), sigma_x_2, window, sigma);
+    cv::GaussianBlur(y.mul(y), sigma_y_2, window, sigma);
+    cv::GaussianBlur(x.mul(y), sigma_xy, window, sigma);
+    sigma_x_2 -= mu_x_2;
+    sigma_y_2 -= mu_y_2;
+    sigma_xy -= mu_x_mu_y;
+
+    cv::Mat numerator = (2 * mu_x_mu_y + C1).mul(2 * sigma_xy + C2);
+    cv::Mat denominator = (mu_x_2 + mu_y_2 + C1).mul(sigma_x_2 + sigma_y_2 + C2);
+    cv::Mat ssim_map;
+    cv::divide(numerator, denominator, ssim_map);
+    return cv::mean(ssim_map)[0];
+}
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
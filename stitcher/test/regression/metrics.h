@@ -0,0 +1,168 @@
+#pragma once
+
+#include "airmap/monitor/resources.h"
+#include "airmap/opencv/forward.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace airmap {
+namespace stitcher {
+namespace monitor {
+
+/**
+ * @brief RegressionTolerances
+ * How much worse than its baseline a metric may get before it is a
+ * regression, as a fraction of the baseline.  Changes of times and memory
+ * below a floor are noise, whatever their fraction.
+ */
+struct RegressionTolerances
+{
+    double time = 0.1;
+    double memory = 0.1;
+    double quality = 0.01;
+    double minimumTimeMs = 10.;
+    double minimumMemoryMB = 16.;
+};
+
+/**
+ * @brief RegressionResults
+ * The metrics of a run of the performance regression harness, by name,
+ * e.g. "stitch/FindSeams/elapsed_ms".  Stored as a baseline in JSON:
+ *
+ *   {"metrics":{"stitch/elapsed_ms":{"kind":"time","value":41234},...}}
+ */
+struct RegressionResults
+{
+    //! What a metric measures, which tells which way is better: less time
+    //! and memory, more quality.
+    enum class Kind { Time, Memory, Quality };
+
+    struct Metric
+    {
+        Kind kind = Kind::Time;
+        double value = 0.;
+    };
+
+    std::map<std::string, Metric> metrics;
+
+    /**
+     * @brief addStitch
+     * Add the elapsed time and peak resident memory of a stitch, and of
+     * each of its operations, as stitch/<operation>/elapsed_ms and
+     * stitch/<operation>/peak_rss_mb.
+     * @param resources The resources of the operations, as reported.
+     * @param elapsed Elapsed time of the whole stitch.
+     */
+    void addStitch(const OperationResourcesMap &resources, const ElapsedTime &elapsed);
+
+    /**
+     * @brief addBenchmarks
+     * Add the real time of each benchmark of a Google Benchmark JSON
+     * output, in milliseconds, as benchmark/<name>.  Of repetitions of a
+     * benchmark, the fastest is kept, the least disturbed by noise.
+     * @throws std::invalid_argument If the file can't be read or has no
+     * benchmarks.
+     */
+    void addBenchmarks(const std::string &path);
+
+    /**
+     * @brief addQuality
+     * Add the PSNR and SSIM of a panorama against a reference panorama,
+     * as quality/psnr_db and quality/ssim.
+     */
+    void addQuality(const cv::Mat &reference, const cv::Mat &panorama);
+
+    /**
+     * @brief median
+     * The median of each metric over several runs, of those runs which
+     * have it, as stitch times vary from run to run.
+     */
+    static RegressionResults median(const std::vector<RegressionResults> &runs);
+
+    /**
+     * @brief load
+     * Load results stored by save.
+     * @throws std::invalid_argument If the file can't be read or parsed.
+     */
+    static RegressionResults load(const std::string &path);
+
+    /**
+     * @brief save
+     * Store the results as JSON, one metric per line to keep the diffs of
+     * a baseline readable.
+     * @throws std::invalid_argument If the file can't be written.
+     */
+    void save(const std::string &path) const;
+};
+
+/**
+ * @brief RegressionComparison
+ * The changes of each metric of a run from its baseline.
+ */
+struct RegressionComparison
+{
+    enum class Status { Unchanged, Improved, Regressed, Added, Missing };
+
+    struct Row
+    {
+        std::string name;
+        RegressionResults::Kind kind = RegressionResults::Kind::Time;
+        double baseline = 0.;
+        double current = 0.;
+        Status status = Status::Unchanged;
+
+        /**
+         * @brief change
+         * The change from the baseline, as a fraction of the baseline, 0
+         * if either is missing.
+         */
+        double change() const;
+    };
+
+    //! A row per metric of either results, by name.
+    std::vector<Row> rows;
+
+    /**
+     * @brief compare
+     * Compare the results of a run to a baseline.  Metrics only in one of
+     * them are added or missing, neither of which is a regression.
+     */
+    static RegressionComparison compare(const RegressionResults &baseline,
+                                        const RegressionResults &current,
+                                        const RegressionTolerances &tolerances);
+
+    /**
+     * @brief regressed
+     * Whether any metric regressed.
+     */
+    bool regressed() const;
+
+    /**
+     * @brief str
+     * The comparison as a table of every metric, its baseline, current
+     * value, change and status, followed by a summary.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief psnr
+ * Peak signal to noise ratio of an image against a reference, in dB,
+ * 100 for identical images.  The image is resized to the reference
+ * if their sizes differ, as the crop of a panorama may.
+ */
+double psnr(const cv::Mat &reference, const cv::Mat &image);
+
+/**
+ * @brief ssim
+ * Mean structural similarity of the grayscale of an image and a
+ * reference, with a gaussian window, between -1 and 1, 1 for identical
+ * images.  The image is resized to the reference as psnr does.
+ */
+double ssim(const cv::Mat &reference, const cv::Mat &image);
+
+} // namespace monitor
+} // namespace stitcher
+} // namespace airmap
@@ -0,0 +1,151 @@
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#include "airmap/opencv_stitcher.h"
+#include "metrics.h"
+#include "util/images.h"
+
+#include <opencv2/imgcodecs.hpp>
+using namespace airmap::stitcher;
+using namespace airmap::logging;
+
+/**
+ * Stitches the panorama_aus_1 fixtures end to end, and compares the time
+ * and peak memory of each operation, the quality of the panorama against
+ * a reference panorama and, if given, the results of the benchmarks, to a
+ * baseline.  Exits with failure if any of them regressed.
+ */
+int main(int argc, char *argv[])
+{
+    boost::program_options::options_description desc(
+            std::string(argv[0]) + " [OPTIONS]\n"
+                "compares the performance of a stitch of the fixtures to a baseline");
+    desc.add_options()
+            ("help", "show help")
+            ("baseline", boost::program_options::value<std::string>(),
+                "The baseline results, as JSON.")
+            ("update", "Instead of comparing to the baseline, write the results as the baseline, and the panorama as the reference if there is none yet.")
+            ("reference", boost::program_options::value<std::string>(),
+                "The reference panorama the quality of the panorama is measured against, reference.jpg next to the baseline by default.")
+            ("benchmarks", boost::program_options::value<std::string>(),
+                "Also compare the benchmarks of this Google Benchmark JSON output.")
+            ("output", boost::program_options::value<std::string>(),
+                "Write the results of the run to this path, as JSON.")
+            ("report", boost::program_options::value<std::string>(),
+                "Also write the comparison to this path.")
+            ("panorama", boost::program_options::value<std::string>()->default_value("regression.jpg"),
+                "Path of the stitched panorama.")
+            ("runs", boost::program_options::value<size_t>()->default_value(3),
+                "The number of stitches, of which the median of each metric is compared.")
+            ("ram_budget",
+                boost::program_options::value<size_t>()->default_value(Panorama::Parameters::defaultMemoryBudgetMB()),
+                "RAM buget (in MB) the stitcher can assume it can use")
+            ("threads", boost::program_options::value<size_t>()->default_value(std::max(1u, std::thread::hardware_concurrency())),
+                "The number of threads of the stitch.")
+            ("time_tolerance", boost::program_options::value<double>()->default_value(0.1),
+                "The fraction by which a time may grow before it regressed.")
+            ("memory_tolerance", boost::program_options::value<double>()->default_value(0.1),
+                "The fraction by which a peak memory may grow before it regressed.")
+            ("quality_tolerance", boost::program_options::value<double>()->default_value(0.01),
+                "The fraction by which the PSNR or SSIM of the panorama may drop before it regressed.")
+            ;
+    try {
+        boost::program_options::variables_map vm;
+        boost::program_options::store(
+            boost::program_options::command_line_parser(argc, argv)
+            .options(desc)
+            .run(),
+            vm
+        );
+        boost::program_options::notify(vm);
+
+        if (vm.count("help") || !vm.count("baseline")) {
+            std::cout << desc << "\n";
+            return EXIT_FAILURE;
+        }
+
+        const std::string baselinePath = vm["baseline"].as<std::string>();
+        const std::string referencePath = vm.count("reference")
+                ? vm["reference"].as<std::string>()
+                : (boost::filesystem::path(baselinePath).parent_path() / "reference.jpg").string();
+        const std::string panoramaPath = vm["panorama"].as<std::string>();
+        const bool update = vm.count("update") > 0;
+        // Fail before stitching, which takes minutes, rather than after.
+        if (!update && !boost::filesystem::exists(baselinePath)) {
+            std::cerr << "No baseline at " << baselinePath
+                      << ", write one with the stitcherRegressionBaseline target."
+                      << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        auto logger = std::make_shared<stdoe_logger>();
+        Panorama::Parameters parameters{
+            vm["ram_budget"].as<size_t>(),
+            false,
+            true,
+            true
+        };
+        cv::setNumThreads(static_cast<int>(vm["threads"].as<size_t>()));
+        const Panorama panorama{ util::images::Images::original() };
+
+        std::vector<monitor::RegressionResults> runs;
+        for (size_t run = 0; run < vm["runs"].as<size_t>(); ++run) {
+            monitor::Timer timer;
+            timer.start();
+            auto stitcher = std::make_shared<LowLevelOpenCVStitcher>(
+                Configuration(StitchType::ThreeSixty), panorama, parameters,
+                panoramaPath, logger);
+            Stitcher::Report report = RetryingStitcher{ stitcher, parameters, logger }.stitch();
+            timer.stop();
+
+            monitor::RegressionResults results;
+            results.addStitch(report.operationResources, timer.elapsed());
+            if (boost::filesystem::exists(referencePath)) {
+                results.addQuality(cv::imread(referencePath), cv::imread(panoramaPath));
+            } else if (update) {
+                // The quality of the runs after this one is measured
+                // against it.
+                boost::filesystem::copy_file(panoramaPath, referencePath);
+                std::stringstream message;
+                message << "Written reference panorama to " << referencePath << ".";
+                logger->log(Logger::Severity::info, message, "regression");
+            }
+            runs.push_back(results);
+        }
+
+        monitor::RegressionResults current = monitor::RegressionResults::median(runs);
+        if (vm.count("benchmarks")) {
+            current.addBenchmarks(vm["benchmarks"].as<std::string>());
+        }
+        if (vm.count("output")) {
+            current.save(vm["output"].as<std::string>());
+        }
+        if (update) {
+            current.save(baselinePath);
+            std::stringstream message;
+            message << "Written baseline to " << baselinePath << ".";
+            logger->log(Logger::Severity::info, message, "regression");
+            return EXIT_SUCCESS;
+        }
+
+        monitor::RegressionTolerances tolerances;
+        tolerances.time = vm["time_tolerance"].as<double>();
+        tolerances.memory = vm["memory_tolerance"].as<double>();
+        tolerances.quality = vm["quality_tolerance"].as<double>();
+        const monitor::RegressionComparison comparison = monitor::RegressionComparison::compare(
+                monitor::RegressionResults::load(baselinePath), current, tolerances);
+        std::cout << comparison.str() << std::endl;
+        if (vm.count("report")) {
+            std::ofstream report(vm["report"].as<std::string>());
+            report << comparison.str() << std::endl;
+        }
+        return comparison.regressed() ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,217 @@
+#include "gtest/gtest.h"
+
+#include "metrics.h"
+
+#include <boost/filesystem.hpp>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <fstream>
+
+using airmap::stitcher::monitor::ElapsedTime;
+using airmap::stitcher::monitor::Operation;
+using airmap::stitcher::monitor::OperationResourcesMap;
+using airmap::stitcher::monitor::RegressionComparison;
+using airmap::stitcher::monitor::RegressionResults;
+using airmap::stitcher::monitor::RegressionTolerances;
+using airmap::stitcher::monitor::psnr;
+using airmap::stitcher::monitor::ssim;
+
+class RegressionTest : public ::testing::Test {
+protected:
+    RegressionTest()
+        : path((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("regression-%%%%-%%%%.json"))
+                       .string())
+    {
+    }
+
+    ~RegressionTest() { boost::filesystem::remove(path); }
+
+    RegressionResults baseline()
+    {
+        RegressionResults results;
+        results.metrics["stitch/elapsed_ms"] = { RegressionResults::Kind::Time, 1000. };
+        results.metrics["stitch/Start/elapsed_ms"] = { RegressionResults::Kind::Time, 5. };
+        results.metrics["stitch/peak_rss_mb"] = { RegressionResults::Kind::Memory, 500. };
+        results.metrics["quality/psnr_db"] = { RegressionResults::Kind::Quality, 30. };
+        results.metrics["quality/ssim"] = { RegressionResults::Kind::Quality, 0.9 };
+        results.metrics["benchmark/BM_Removed"] = { RegressionResults::Kind::Time, 20. };
+        return results;
+    }
+
+    /**
+     * @brief image
+     * A smooth gradient with a few shapes, as a panorama has.
+     */
+    cv::Mat image()
+    {
+        cv::Mat image(120, 240, CV_8UC3);
+        for (int y = 0; y < image.rows; ++y) {
+            for (int x = 0; x < image.cols; ++x) {
+                image.at<cv::Vec3b>(y, x) = cv::Vec3b(static_cast<uchar>(x),
+                                                      static_cast<uchar>(2 * y), 128);
+            }
+        }
+        cv::circle(image, cv::Point(60, 60), 30, cv::Scalar(255, 255, 255), -1);
+        cv::rectangle(image, cv::Rect(150, 30, 60, 40), cv::Scalar(0, 0, 0), -1);
+        return image;
+    }
+
+    const std::string path;
+};
+
+TEST_F(RegressionTest, compare)
+{
+    RegressionResults current = baseline();
+    current.metrics.erase("benchmark/BM_Removed");
+    current.metrics["stitch/elapsed_ms"].value = 1200.;
+    // Under the 10% tolerance.
+    current.metrics["stitch/peak_rss_mb"].value = 520.;
+    // 80% slower, but under the 10 ms floor.
+    current.metrics["stitch/Start/elapsed_ms"].value = 9.;
+    current.metrics["quality/psnr_db"].value = 29.5;
+    current.metrics["quality/ssim"].value = 0.95;
+    current.metrics["benchmark/BM_Added"] = { RegressionResults::Kind::Time, 10. };
+
+    RegressionComparison comparison =
+            RegressionComparison::compare(baseline(), current, RegressionTolerances());
+    ASSERT_EQ(comparison.rows.size(), 7);
+    std::map<std::string, RegressionComparison::Row> rows;
+    for (const auto &row : comparison.rows) {
+        rows[row.name] = row;
+    }
+    EXPECT_EQ(rows["stitch/elapsed_ms"].status, RegressionComparison::Status::Regressed);
+    EXPECT_DOUBLE_EQ(rows["stitch/elapsed_ms"].change(), 0.2);
+    EXPECT_EQ(rows["stitch/peak_rss_mb"].status, RegressionComparison::Status::Unchanged);
+    EXPECT_EQ(rows["stitch/Start/elapsed_ms"].status,
+              RegressionComparison::Status::Unchanged);
+    EXPECT_EQ(rows["quality/psnr_db"].status, RegressionComparison::Status::Regressed);
+    EXPECT_EQ(rows["quality/ssim"].status, RegressionComparison::Status::Improved);
+    EXPECT_EQ(rows["benchmark/BM_Added"].status, RegressionComparison::Status::Added);
+    EXPECT_EQ(rows["benchmark/BM_Removed"].status, RegressionComparison::Status::Missing);
+    EXPECT_TRUE(comparison.regressed());
+
+    const std::string report = comparison.str();
+    EXPECT_NE(report.find("REGRESSED"), std::string::npos);
+    EXPECT_NE(report.find("+20.0%"), std::string::npos);
+    EXPECT_NE(report.find("2 of 7 metrics regressed, 1 improved, 1 added, 1 missing."),
+              std::string::npos);
+
+    // Looser tolerances let the same run pass.
+    RegressionTolerances tolerances;
+    tolerances.time = 0.25;
+    tolerances.quality = 0.02;
+    EXPECT_FALSE(RegressionComparison::compare(baseline(), current, tolerances).regressed());
+}
+
+TEST_F(RegressionTest, saveAndLoad)
+{
+    RegressionResults results = baseline();
+    results.metrics["benchmark/BM_FindSeams/scale:25/threads:1"] = {
+        RegressionResults::Kind::Time, 123.456789
+    };
+    results.save(path);
+
+    RegressionResults loaded = RegressionResults::load(path);
+    ASSERT_EQ(loaded.metrics.size(), results.metrics.size());
+    for (const auto &metric : results.metrics) {
+        EXPECT_EQ(loaded.metrics.at(metric.first).kind, metric.second.kind);
+        EXPECT_DOUBLE_EQ(loaded.metrics.at(metric.first).value, metric.second.value);
+    }
+
+    std::ofstream(path) << "{\"metrics\": {\"a\": {\"kind\": \"speed\", \"value\": 1}}}";
+    EXPECT_THROW(RegressionResults::load(path), std::invalid_argument);
+    EXPECT_THROW(RegressionResults::load(path + ".missing"), std::invalid_argument);
+}
+
+TEST_F(RegressionTest, median)
+{
+    std::vector<RegressionResults> runs(3, baseline());
+    runs[0].metrics["stitch/elapsed_ms"].value = 900.;
+    runs[1].metrics["stitch/elapsed_ms"].value = 2000.;
+    runs[2].metrics.erase("quality/psnr_db");
+    runs[1].metrics["quality/psnr_db"].value = 32.;
+
+    RegressionResults median = RegressionResults::median(runs);
+    EXPECT_DOUBLE_EQ(median.metrics["stitch/elapsed_ms"].value, 1000.);
+    // Of the two runs with a quality.
+    EXPECT_DOUBLE_EQ(median.metrics["quality/psnr_db"].value, 31.);
+    EXPECT_EQ(median.metrics["quality/psnr_db"].kind, RegressionResults::Kind::Quality);
+}
+
+TEST_F(RegressionTest, addStitch)
+{
+    OperationResourcesMap resources;
+    resources[Operation::FindSeams().value()].wall = ElapsedTime::fromMilliseconds(700);
+    resources[Operation::FindSeams().value()].peakRssMB = 900;
+    resources[Operation::Compose().value()].wall = ElapsedTime::fromMilliseconds(300);
+    resources[Operation::Compose().value()].peakRssMB = 1200;
+
+    RegressionResults results;
+    results.addStitch(resources, ElapsedTime::fromSeconds(2));
+    EXPECT_EQ(results.metrics.size(), 6);
+    EXPECT_DOUBLE_EQ(results.metrics["stitch/elapsed_ms"].value, 2000.);
+    EXPECT_DOUBLE_EQ(results.metrics["stitch/peak_rss_mb"].value, 1200.);
+    EXPECT_DOUBLE_EQ(results.metrics["stitch/FindSeams/elapsed_ms"].value, 700.);
+    EXPECT_EQ(results.metrics["stitch/FindSeams/peak_rss_mb"].kind,
+              RegressionResults::Kind::Memory);
+}
+
+TEST_F(RegressionTest, addBenchmarks)
+{
+    std::ofstream(path) << R"({
+  "context": {"num_cpus": 8, "cpu_scaling_enabled": false},
+  "benchmarks": [
+    {"name": "BM_FindSeams/scale:25", "run_type": "iteration", "real_time": 2.5e+07,
+     "cpu_time": 2.4e+07, "time_unit": "ns"},
+    {"name": "BM_FindSeams/scale:25", "run_type": "iteration", "real_time": 2.0e+07,
+     "cpu_time": 2.0e+07, "time_unit": "ns"},
+    {"name": "BM_FindSeams/scale:25_mean", "run_type": "aggregate", "real_time": 2.25e+07,
+     "cpu_time": 2.2e+07, "time_unit": "ns"},
+    {"name": "BM_Compose/scale:25", "run_type": "iteration", "real_time": 150.5,
+     "cpu_time": 140, "time_unit": "ms"}
+  ]
+})";
+
+    RegressionResults results;
+    results.addBenchmarks(path);
+    ASSERT_EQ(results.metrics.size(), 2);
+    // The fastest of the repetitions.
+    EXPECT_DOUBLE_EQ(results.metrics["benchmark/BM_FindSeams/scale:25"].value, 20.);
+    EXPECT_DOUBLE_EQ(results.metrics["benchmark/BM_Compose/scale:25"].value, 150.5);
+
+    std::ofstream(path) << "{\"context\": {}}";
+    EXPECT_THROW(results.addBenchmarks(path), std::invalid_argument);
+}
+
+TEST_F(RegressionTest, quality)
+{
+    cv::Mat reference = image();
+    EXPECT_DOUBLE_EQ(psnr(reference, reference), 100.);
+    EXPECT_NEAR(ssim(reference, reference), 1., 1e-6);
+
+    cv::Mat noisy = reference.clone();
+    cv::Mat noise(reference.size(), CV_8UC3);
+    cv::randu(noise, cv::Scalar::all(0), cv::Scalar::all(20));
+    noisy += noise;
+    cv::Mat blurred;
+    cv::GaussianBlur(reference, blurred, cv::Size(9, 9), 3.);
+    EXPECT_LT(psnr(reference, noisy), 40.);
+    EXPECT_LT(ssim(reference, noisy), 0.99);
+    EXPECT_LT(ssim(reference, blurred), 0.99);
+    EXPECT_LT(ssim(reference, blurred), ssim(reference, reference));
+
+    // A panorama cropped to another size is compared at the size of the
+    // reference.
+    cv::Mat larger;
+    cv::resize(reference, larger, cv::Size(), 2., 2., cv::INTER_CUBIC);
+    EXPECT_GT(psnr(reference, larger), 25.);
+    EXPECT_GT(ssim(reference, larger), 0.9);
+
+    RegressionResults results;
+    results.addQuality(reference, noisy);
+    EXPECT_DOUBLE_EQ(results.metrics["quality/psnr_db"].value, psnr(reference, noisy));
+    EXPECT_THROW(psnr(cv::Mat(), reference), std::invalid_argument);
+}